@@ -11,8 +11,22 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if !defined(AVIFINFO_DISABLE_SIMD)
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AVIFINFO_SSE2
+#elif (defined(__aarch64__) && defined(__ARM_NEON) && \
+       !defined(__AARCH64EB__)) ||                        \
+    defined(_M_ARM64)
+#include <arm_neon.h>
+#define AVIFINFO_NEON
+#endif
+#endif  // !AVIFINFO_DISABLE_SIMD
+
 //------------------------------------------------------------------------------
 
 // Status returned when reading the content of a box (or file).
@@ -39,22 +53,65 @@ static AvifInfoStatus AvifInfoInternalConvertStatus(AvifInfoInternalStatus s) {
 // AvifInfoInternalFeatures uses uint8_t to store values.
 #define AVIFINFO_MAX_VALUE UINT8_MAX
 // Maximum number of stored associations. Past that, they are skipped.
+// These are the default limits, sizing the tables on the stack of each call.
+// They can be overridden at compile time to save stack memory.
+#if !defined(AVIFINFO_MAX_TILES)
 #define AVIFINFO_MAX_TILES 16
+#endif
+#if !defined(AVIFINFO_MAX_PROPS)
 #define AVIFINFO_MAX_PROPS 32
+#endif
+#if !defined(AVIFINFO_MAX_FEATURES)
 #define AVIFINFO_MAX_FEATURES 8
+#endif
+#if !defined(AVIFINFO_MAX_LOCATIONS)
+#define AVIFINFO_MAX_LOCATIONS 32
+#endif
+// Upper bound of the limits in AvifInfoOptions.
+#define AVIFINFO_MAX_LIMIT (1u << 24)
+#if AVIFINFO_MAX_TILES < 1 || AVIFINFO_MAX_TILES > AVIFINFO_MAX_LIMIT ||     \
+    AVIFINFO_MAX_PROPS < 1 || AVIFINFO_MAX_PROPS > AVIFINFO_MAX_LIMIT ||     \
+    AVIFINFO_MAX_FEATURES < 1 || AVIFINFO_MAX_FEATURES > AVIFINFO_MAX_LIMIT || \
+    AVIFINFO_MAX_LOCATIONS < 1 || AVIFINFO_MAX_LOCATIONS > AVIFINFO_MAX_LIMIT
+#error "The default limits must be between 1 and AVIFINFO_MAX_LIMIT."
+#endif
 #define AVIFINFO_UNDEFINED 0
+// Number of nested box loops whose state can be saved: file, "meta", "iprp"
+// (or "iref" or "iinf") and "ipco".
+#define AVIFINFO_MAX_NESTING_LEVEL 4
 
 // Reads an unsigned integer from 'input' with most significant bits first.
 // 'input' must be at least 'num_bytes'-long.
+// Fixed-width cases are explicit so that the compiler can turn them into a
+// single load and byte swap when 'num_bytes' is known.
 static uint32_t AvifInfoInternalReadBigEndian(const uint8_t* input,
                                               uint32_t num_bytes) {
-  uint32_t value = 0;
-  for (uint32_t i = 0; i < num_bytes; ++i) {
-    value = (value << 8) | input[i];
+  switch (num_bytes) {
+    case 1:
+      return input[0];
+    case 2:
+      return ((uint32_t)input[0] << 8) | input[1];
+    case 3:
+      return ((uint32_t)input[0] << 16) | ((uint32_t)input[1] << 8) | input[2];
+    case 4:
+      return ((uint32_t)input[0] << 24) | ((uint32_t)input[1] << 16) |
+             ((uint32_t)input[2] << 8) | input[3];
+    default: {
+      uint32_t value = 0;
+      for (uint32_t i = 0; i < num_bytes; ++i) {
+        value = (value << 8) | input[i];
+      }
+      return value;
+    }
   }
-  return value;
 }
 
+// Four-character code of a box type, as read with
+// AvifInfoInternalReadBigEndian(type, 4).
+#define AVIFINFO_FOURCC(a, b, c, d)                                       \
+  (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | \
+   (uint32_t)(d))
+
 //------------------------------------------------------------------------------
 // Convenience macros.
 
@@ -100,32 +157,315 @@ static void AvifInfoInternalLogError(const char* file, int line,
 #define AVIF_DEBUG_LOG(...)
 #endif
 
+// Toggle to fill AvifInfoParseStats. Nothing is counted otherwise.
+#if defined(AVIFINFO_ENABLE_STATS)
+#define AVIFINFO_STATS(stream, statement)                 \
+  do {                                                    \
+    AvifInfoParseStats* const stats = (stream)->stats;    \
+    if (stats != NULL) {                                  \
+      statement;                                          \
+    }                                                     \
+  } while (0)
+#else
+#define AVIFINFO_STATS(stream, statement)
+#endif
+
 //------------------------------------------------------------------------------
 // Streamed input struct and helper functions.
 
+typedef AvifInfoSegment AvifInfoInternalBuffer;
+
+// Defined below. Only used by resumable parsing.
+typedef struct AvifInfoInternalCheckpoint AvifInfoInternalCheckpoint;
+
 typedef struct {
   void* stream;             // User-defined data.
   read_stream_t read;       // Used to fetch more bytes from the 'stream'.
+                            // 'read_at' is used instead if null.
   skip_stream_t skip;       // Used to advance the position in the 'stream'.
                             // Fallback to 'read' if 'skip' is null.
+  read_at_stream_t read_at;  // Used to fetch bytes at 'num_read_bytes'.
+                             // 'window' is used instead if null.
+  window_stream_t window;    // Used to refill the 'buffer'.
+                             // The 'next_buffers' are used instead if null.
   uint64_t num_read_bytes;  // Number of bytes read or skipped.
+
+  // Bytes available for reading if 'read' and 'read_at' are null. Once the
+  // 'buffer' is exhausted, it is refilled by 'window' or the 'next_buffers'
+  // are consumed in order.
+  AvifInfoInternalBuffer buffer;
+  const AvifInfoInternalBuffer* next_buffers;
+  size_t num_next_buffers;
+  // Storage for the bytes of a read spanning over several buffers.
+  uint8_t gathered_bytes[AVIFINFO_MAX_NUM_READ_BYTES];
+
+  // Not null if the parsing can be resumed after a kTruncated status.
+  AvifInfoInternalCheckpoint* checkpoint;
+
+  // Position right after the box being parsed, or 0 while parsing its header.
+  uint64_t box_end;
+  // Position right after the "meta" box, or 0 if not found yet.
+  uint64_t meta_end;
+  // Size of the stream that would have been enough for the last failed read.
+  uint64_t num_needed_bytes;
+
+  AvifInfoParseStats* stats;  // Can be null. See AVIFINFO_STATS().
+
+  // Null unless a limit is set. See AvifInfoInternalSpend().
+  const AvifInfoBudget* budget;
+  uint64_t num_spent_read_bytes, num_spent_skipped_bytes;
+  uint32_t num_spent_callbacks;
 } AvifInfoInternalStream;
 
+// Returns kAborted if the 'stream->deadline_reached()'.
+static AvifInfoInternalStatus AvifInfoInternalCheckDeadline(
+    AvifInfoInternalStream* stream) {
+  const AvifInfoBudget* const budget = stream->budget;
+  if (budget->deadline_reached != NULL &&
+      budget->deadline_reached(budget->deadline)) {
+    if (budget->exceeded != NULL) *budget->exceeded = kAvifInfoBudgetDeadline;
+    AVIFINFO_RETURN(kAborted);
+  }
+  return kFound;
+}
+
+// Accounts for the reading of 'num_read_bytes', the skipping of
+// 'num_skipped_bytes' and 'num_callbacks' calls to the user-defined functions
+// before they happen. Returns kAborted if the 'stream->budget' is exceeded.
+static AvifInfoInternalStatus AvifInfoInternalSpend(
+    AvifInfoInternalStream* stream, uint32_t num_read_bytes,
+    uint32_t num_skipped_bytes, uint32_t num_callbacks) {
+  const AvifInfoBudget* const budget = stream->budget;
+  stream->num_spent_read_bytes += num_read_bytes;
+  stream->num_spent_skipped_bytes += num_skipped_bytes;
+  stream->num_spent_callbacks += num_callbacks;
+  AvifInfoBudgetReason reason = kAvifInfoBudgetNone;
+  if (budget->max_num_read_bytes != 0 &&
+      stream->num_spent_read_bytes > budget->max_num_read_bytes) {
+    reason = kAvifInfoBudgetReadBytes;
+  } else if (budget->max_num_skipped_bytes != 0 &&
+             stream->num_spent_skipped_bytes > budget->max_num_skipped_bytes) {
+    reason = kAvifInfoBudgetSkippedBytes;
+  } else if (budget->max_num_callbacks != 0 &&
+             stream->num_spent_callbacks > budget->max_num_callbacks) {
+    reason = kAvifInfoBudgetCallbacks;
+  } else if (num_callbacks != 0) {
+    return AvifInfoInternalCheckDeadline(stream);
+  }
+  if (reason != kAvifInfoBudgetNone) {
+    if (budget->exceeded != NULL) *budget->exceeded = reason;
+    AVIFINFO_RETURN(kAborted);
+  }
+  return kFound;
+}
+
+// Same as AvifInfoInternalSpend() but only if there is a budget.
+#define AVIFINFO_SPEND(stream, num_read_bytes, num_skipped_bytes,            \
+                       num_callbacks)                                        \
+  do {                                                                       \
+    if ((stream)->budget != NULL) {                                          \
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalSpend(                            \
+          (stream), (num_read_bytes), (num_skipped_bytes), (num_callbacks))); \
+    }                                                                        \
+  } while (0)
+
+// Copies 'num_bytes' spanning over several buffers of the 'stream' into
+// 'stream->gathered_bytes'.
+static AvifInfoInternalStatus AvifInfoInternalGather(
+    AvifInfoInternalStream* stream, uint32_t num_bytes) {
+  size_t num_available_bytes = stream->buffer.data_size;
+  for (size_t i = 0;
+       i < stream->num_next_buffers && num_available_bytes < num_bytes; ++i) {
+    num_available_bytes += stream->next_buffers[i].data_size;
+  }
+  if (num_available_bytes < num_bytes) return kTruncated;
+
+  uint32_t num_gathered_bytes = 0;
+  while (num_gathered_bytes < num_bytes) {
+    if (stream->buffer.data_size == 0) {
+      stream->buffer = *stream->next_buffers;
+      ++stream->next_buffers;
+      --stream->num_next_buffers;
+      continue;
+    }
+    uint32_t num_copied_bytes = num_bytes - num_gathered_bytes;
+    if (num_copied_bytes > stream->buffer.data_size) {
+      num_copied_bytes = (uint32_t)stream->buffer.data_size;
+    }
+    memcpy(stream->gathered_bytes + num_gathered_bytes, stream->buffer.data,
+           num_copied_bytes);
+    stream->buffer.data += num_copied_bytes;
+    stream->buffer.data_size -= num_copied_bytes;
+    num_gathered_bytes += num_copied_bytes;
+  }
+  return kFound;
+}
+
+// Reads 'num_bytes' spanning over several windows of the 'stream'. They are
+// available at '*data', either in a new window or copied into
+// 'stream->gathered_bytes'. The remaining bytes of the last window are kept in
+// 'stream->buffer'.
+static AvifInfoInternalStatus AvifInfoInternalReadWindows(
+    AvifInfoInternalStream* stream, uint32_t num_bytes, const uint8_t** data) {
+  uint32_t num_gathered_bytes = 0;
+  while (num_gathered_bytes < num_bytes) {
+    if (stream->buffer.data_size == 0) {
+      AVIFINFO_STATS(stream, ++stats->num_read_calls);
+      stream->buffer.data =
+          stream->window(stream->stream, &stream->buffer.data_size);
+      if (stream->buffer.data == NULL) stream->buffer.data_size = 0;
+      if (stream->buffer.data_size == 0) return kTruncated;
+      if (num_gathered_bytes == 0 && stream->buffer.data_size >= num_bytes) {
+        // No need to copy.
+        *data = stream->buffer.data;
+        stream->buffer.data += num_bytes;
+        stream->buffer.data_size -= num_bytes;
+        return kFound;
+      }
+    }
+    uint32_t num_copied_bytes = num_bytes - num_gathered_bytes;
+    if (num_copied_bytes > stream->buffer.data_size) {
+      num_copied_bytes = (uint32_t)stream->buffer.data_size;
+    }
+    memcpy(stream->gathered_bytes + num_gathered_bytes, stream->buffer.data,
+           num_copied_bytes);
+    stream->buffer.data += num_copied_bytes;
+    stream->buffer.data_size -= num_copied_bytes;
+    num_gathered_bytes += num_copied_bytes;
+  }
+  *data = stream->gathered_bytes;
+  return kFound;
+}
+
 // Reads 'num_bytes' from the 'stream'. They are available at '*data'.
 // 'num_bytes' must be greater than zero.
 static AvifInfoInternalStatus AvifInfoInternalRead(
     AvifInfoInternalStream* stream, uint32_t num_bytes, const uint8_t** data) {
-  *data = stream->read(stream->stream, num_bytes);
-  AVIFINFO_CHECK(*data != NULL, kTruncated);
+  AVIFINFO_SPEND(stream, num_bytes, 0, 0);
+  // Fast path: the 'buffer' is empty unless 'read' and 'read_at' are null.
+  if (num_bytes <= stream->buffer.data_size) {
+    *data = stream->buffer.data;
+    stream->buffer.data += num_bytes;
+    stream->buffer.data_size -= num_bytes;
+    stream->num_read_bytes += num_bytes;
+    AVIFINFO_STATS(stream, stats->num_read_bytes += num_bytes);
+    return kFound;
+  }
+  if (stream->read != NULL) {
+    AVIFINFO_SPEND(stream, 0, 0, 1);
+    AVIFINFO_STATS(stream, ++stats->num_read_calls);
+    *data = stream->read(stream->stream, num_bytes);
+  } else if (stream->read_at != NULL) {
+    AVIFINFO_STATS(stream, ++stats->num_read_calls);
+    *data = stream->read_at(stream->stream, stream->num_read_bytes, num_bytes);
+  } else if (stream->window != NULL) {
+    if (AvifInfoInternalReadWindows(stream, num_bytes, data) != kFound) {
+      *data = NULL;
+    }
+  } else {
+    // Avoid copying the bytes if they are all in the next non-empty buffer.
+    while (stream->buffer.data_size == 0 && stream->num_next_buffers > 0) {
+      stream->buffer = *stream->next_buffers;
+      ++stream->next_buffers;
+      --stream->num_next_buffers;
+    }
+    if (num_bytes <= stream->buffer.data_size) {
+      *data = stream->buffer.data;
+      stream->buffer.data += num_bytes;
+      stream->buffer.data_size -= num_bytes;
+    } else {
+      *data = (AvifInfoInternalGather(stream, num_bytes) == kFound)
+                  ? stream->gathered_bytes
+                  : NULL;
+    }
+  }
+  if (*data == NULL) {
+    // The whole box will be needed anyway, unless it is its header that is
+    // being read.
+    stream->num_needed_bytes = stream->num_read_bytes + num_bytes;
+    if (stream->box_end > stream->num_needed_bytes) {
+      stream->num_needed_bytes = stream->box_end;
+    }
+    AVIFINFO_RETURN(kTruncated);
+  }
   stream->num_read_bytes += num_bytes;
+  AVIFINFO_STATS(stream, stats->num_read_bytes += num_bytes);
   return kFound;
 }
 
 // Skips 'num_bytes' from the 'stream'. 'num_bytes' can be zero.
 static AvifInfoInternalStatus AvifInfoInternalSkip(
     AvifInfoInternalStream* stream, uint32_t num_bytes) {
+  AVIFINFO_SPEND(stream, 0, num_bytes, 0);
+  if (num_bytes <= stream->buffer.data_size) {  // Fast path, see above.
+    stream->buffer.data += num_bytes;
+    stream->buffer.data_size -= num_bytes;
+    stream->num_read_bytes += num_bytes;
+    AVIFINFO_STATS(stream, stats->num_skipped_bytes += num_bytes);
+    return kFound;
+  }
   // Avoid a call to the user-defined function for nothing.
   if (num_bytes > 0) {
+    if (stream->read_at != NULL) {
+      // Nothing to fetch. The next read is just located further.
+      stream->num_read_bytes += num_bytes;
+      AVIFINFO_STATS(stream, stats->num_skipped_bytes += num_bytes);
+      return kFound;
+    }
+    if (stream->window != NULL) {
+      // The bytes left in the current window are consumed first.
+      uint32_t num_remaining_bytes =
+          num_bytes - (uint32_t)stream->buffer.data_size;
+      stream->buffer.data_size = 0;
+      if (stream->skip != NULL) {
+        AVIFINFO_STATS(stream, ++stats->num_skip_calls);
+        stream->skip(stream->stream, num_remaining_bytes);
+      } else {
+        // Skipping past the end of the 'stream' is fine. Only the following
+        // reads fail.
+        while (num_remaining_bytes > 0) {
+          size_t window_size = 0;
+          AVIFINFO_STATS(stream, ++stats->num_read_calls);
+          const uint8_t* window_data =
+              stream->window(stream->stream, &window_size);
+          if (window_data == NULL || window_size == 0) break;
+          if (window_size > num_remaining_bytes) {
+            // Keep the bytes after the skipped ones.
+            stream->buffer.data = window_data + num_remaining_bytes;
+            stream->buffer.data_size = window_size - num_remaining_bytes;
+            break;
+          }
+          num_remaining_bytes -= (uint32_t)window_size;
+        }
+      }
+      stream->num_read_bytes += num_bytes;
+      AVIFINFO_STATS(stream, stats->num_skipped_bytes += num_bytes);
+      return kFound;
+    }
+    if (stream->read == NULL) {
+      // Skipping past the available bytes is fine, like with a 'skip'
+      // function. Only the following reads fail.
+      uint32_t num_skipped_bytes = 0;
+      while (num_skipped_bytes < num_bytes) {
+        if (stream->buffer.data_size == 0) {
+          if (stream->num_next_buffers == 0) break;
+          stream->buffer = *stream->next_buffers;
+          ++stream->next_buffers;
+          --stream->num_next_buffers;
+          continue;
+        }
+        uint32_t num_advanced_bytes = num_bytes - num_skipped_bytes;
+        if (num_advanced_bytes > stream->buffer.data_size) {
+          num_advanced_bytes = (uint32_t)stream->buffer.data_size;
+        }
+        stream->buffer.data += num_advanced_bytes;
+        stream->buffer.data_size -= num_advanced_bytes;
+        num_skipped_bytes += num_advanced_bytes;
+      }
+      stream->num_read_bytes += num_bytes;
+      AVIFINFO_STATS(stream, stats->num_skipped_bytes += num_bytes);
+      return kFound;
+    }
     if (stream->skip == NULL) {
       const uint8_t* unused;
       while (num_bytes > AVIFINFO_MAX_NUM_READ_BYTES) {
@@ -135,163 +475,892 @@ static AvifInfoInternalStatus AvifInfoInternalSkip(
       }
       return AvifInfoInternalRead(stream, num_bytes, &unused);
     }
+    AVIFINFO_SPEND(stream, 0, 0, 1);
+    AVIFINFO_STATS(stream, ++stats->num_skip_calls);
     stream->skip(stream->stream, num_bytes);
     stream->num_read_bytes += num_bytes;
+    AVIFINFO_STATS(stream, stats->num_skipped_bytes += num_bytes);
   }
   return kFound;
 }
 
+#if !defined(AVIFINFO_IDENTIFY_ONLY)
 //------------------------------------------------------------------------------
 // Features are parsed into temporary property associations.
 
 typedef struct {
-  uint8_t tile_item_id;
-  uint8_t parent_item_id;
-  uint8_t dimg_idx;      // Index of this association in the dimg box (0-based).
+  uint32_t tile_item_id;
+  uint32_t parent_item_id;
+  uint32_t dimg_idx;     // Index of this association in the dimg box (0-based).
+  uint32_t next;         // See AvifInfoInternalIdEntry.
 } AvifInfoInternalTile;  // Tile item id <-> parent item id associations.
 
 typedef struct {
-  uint8_t property_index;
-  uint8_t item_id;
+  uint32_t property_index;
+  uint32_t item_id;
+  uint32_t next;         // See AvifInfoInternalIdEntry.
 } AvifInfoInternalProp;  // Property index <-> item id associations.
 
 typedef struct {
-  uint8_t property_index;
+  uint32_t property_index;
   uint32_t width, height;
 } AvifInfoInternalDimProp;  // Property <-> features associations.
 
 typedef struct {
-  uint8_t property_index;
+  uint32_t property_index;
   uint8_t bit_depth, num_channels;
 } AvifInfoInternalChanProp;  // Property <-> features associations.
 
+typedef struct {
+  uint32_t item_id;
+  AvifInfoExtent extent;
+} AvifInfoInternalLocation;  // Item id <-> payload location associations.
+
+// Index of the associations above for a given item id or property index, so
+// that they can be found without going through all of them. Each field is 0
+// or 1 plus the position of an association in its array. 'next' links the
+// associations of the same item in the order they were parsed.
+typedef struct {
+  uint32_t first_prop, last_prop;  // 'props' of this item id.
+  uint32_t first_tile, last_tile;  // 'tiles' whose parent is this item id.
+  uint32_t first_prop_item;        // First of the 'props' of this index.
+  uint32_t dim_prop, chan_prop;    // First 'dim_props' or 'chan_props'.
+  uint32_t location;               // First of the 'locations' of this item.
+} AvifInfoInternalIdEntry;
+
+// Storage of the associations within the default limits.
+typedef struct {
+  AvifInfoInternalTile tiles[AVIFINFO_MAX_TILES];
+  AvifInfoInternalProp props[AVIFINFO_MAX_PROPS];
+  AvifInfoInternalDimProp dim_props[AVIFINFO_MAX_FEATURES];
+  AvifInfoInternalChanProp chan_props[AVIFINFO_MAX_FEATURES];
+  AvifInfoInternalLocation locations[AVIFINFO_MAX_LOCATIONS];
+} AvifInfoInternalTables;
+
 typedef struct {
   uint8_t has_primary_item;  // True if "pitm" was parsed.
   uint8_t has_alpha;    // True if an alpha "auxC" was parsed.
-  // Index of the gain map auxC property.
-  uint8_t gainmap_property_index;
-  uint8_t primary_item_id;
+  // Index of the gain map and alpha auxC properties.
+#if !defined(AVIFINFO_NO_GAINMAP)
+  uint32_t gainmap_property_index;
+#endif
+  uint32_t alpha_property_index;
+  uint32_t primary_item_id;
   AvifInfoFeatures primary_item_features;  // Deduced from the data below.
+  // True once 'primary_item_features' are known, at the same point whether the
+  // parsing then goes on for the 'extents', 'thumbnail' or 'items' or not.
+  // They are final from then on.
+  uint8_t has_primary_item_features;
   uint8_t data_was_skipped;  // True if some loops/indices were skipped.
-  uint8_t tone_mapped_item_id;  // Id of the "tmap" box, > 0 if present.
+  uint32_t tone_mapped_item_id;  // Id of the "tmap" box, > 0 if present.
   uint8_t iinf_parsed;  // True if the "iinf" (item info) box was parsed.
-  uint8_t iref_parsed;  // True if the "iref" (item reference) box was parsed.
-
-  uint8_t num_tiles;
-  AvifInfoInternalTile tiles[AVIFINFO_MAX_TILES];
-  uint8_t num_props;
-  AvifInfoInternalProp props[AVIFINFO_MAX_PROPS];
-  uint8_t num_dim_props;
-  AvifInfoInternalDimProp dim_props[AVIFINFO_MAX_FEATURES];
-  uint8_t num_chan_props;
-  AvifInfoInternalChanProp chan_props[AVIFINFO_MAX_FEATURES];
+  uint32_t requested_fields;  // Bitwise combination of AvifInfoField values.
+  // Bitwise combination of AvifInfoLimit values that caused 'data_was_skipped'.
+  uint32_t skipped_data_limits;
+  // Null unless the item locations or the thumbnail are requested. These are
+  // then only known once the "iloc", "iprp" and "iref" boxes are entirely
+  // parsed, or once the whole "meta" box is.
+  AvifInfoItemExtents* extents;
+  AvifInfoThumbnail* thumbnail;
+  // Null unless all items are requested. Only known once the "iinf", "iprp"
+  // and "iref" boxes are entirely parsed, or once the whole "meta" box is.
+  AvifInfoItems* items;
+  uint8_t iloc_parsed, iprp_parsed, iref_parsed_entirely, meta_parsed;
+  // First "thmb" reference, to the primary item if it was known by then.
+  uint32_t thumbnail_item_id, thumbnail_of_item_id;
+  // True if the "moov" box is parsed into 'track'. See ParseFile().
+  uint8_t track_requested;
+  uint8_t has_track;  // True if 'track' was found.
+  uint8_t has_meta_features;  // True if the "meta" box gave the features.
+  AvifInfoTrack track;
+
+  // Item ids and property indices above 'max_value' are skipped.
+  uint32_t max_value, max_tiles, max_props, max_features, max_locations;
+  // Either AvifInfoInternalTables or caller-provided memory. The arrays are
+  // only appended to so that a checkpoint stays valid when rewinding.
+  uint32_t num_tiles;
+  AvifInfoInternalTile* tiles;
+  uint32_t num_props;
+  AvifInfoInternalProp* props;
+  uint32_t num_dim_props;
+  AvifInfoInternalDimProp* dim_props;
+  uint32_t num_chan_props;
+  AvifInfoInternalChanProp* chan_props;
+  uint32_t num_locations;
+  AvifInfoInternalLocation* locations;
+  // Null, or 'max_value'+1 entries. Only with caller-provided memory, which is
+  // incompatible with checkpoints because the index is not rewound.
+  AvifInfoInternalIdEntry* ids;
 } AvifInfoInternalFeatures;
 
+// Marks 'features' as incomplete because of the AvifInfoLimit 'limit'.
+#define AVIFINFO_SKIP_DATA(features, limit) \
+  ((features)->data_was_skipped = 1, (features)->skipped_data_limits |= (limit))
+
+// Returns the default value of a limit if 'limit' is 0.
+static uint32_t AvifInfoInternalLimitOrDefault(uint32_t limit,
+                                               uint32_t default_limit) {
+  return (limit != 0) ? limit : default_limit;
+}
+
+// Sets the limits of 'f' from the 'options', or the default ones if null.
+static void AvifInfoInternalSetLimits(AvifInfoInternalFeatures* f,
+                                      const AvifInfoOptions* options) {
+  const AvifInfoOptions default_options = {0};
+  if (options == NULL) options = &default_options;
+  f->max_value =
+      AvifInfoInternalLimitOrDefault(options->max_item_id, AVIFINFO_MAX_VALUE);
+  f->max_tiles =
+      AvifInfoInternalLimitOrDefault(options->max_tiles, AVIFINFO_MAX_TILES);
+  f->max_props =
+      AvifInfoInternalLimitOrDefault(options->max_props, AVIFINFO_MAX_PROPS);
+  f->max_features = AvifInfoInternalLimitOrDefault(options->max_features,
+                                                   AVIFINFO_MAX_FEATURES);
+  f->max_locations = AvifInfoInternalLimitOrDefault(options->max_locations,
+                                                    AVIFINFO_MAX_LOCATIONS);
+}
+
+// Returns the number of bytes needed to store the associations and their
+// index within the limits of 'f', or 0 if the limits are too high.
+static size_t AvifInfoInternalGetScratchSize(
+    const AvifInfoInternalFeatures* f) {
+  if (f->max_value > AVIFINFO_MAX_LIMIT || f->max_tiles > AVIFINFO_MAX_LIMIT ||
+      f->max_props > AVIFINFO_MAX_LIMIT ||
+      f->max_features > AVIFINFO_MAX_LIMIT ||
+      f->max_locations > AVIFINFO_MAX_LIMIT) {
+    return 0;
+  }
+  const uint64_t size =
+      ((uint64_t)f->max_value + 1) * sizeof(AvifInfoInternalIdEntry) +
+      (uint64_t)f->max_tiles * sizeof(AvifInfoInternalTile) +
+      (uint64_t)f->max_props * sizeof(AvifInfoInternalProp) +
+      (uint64_t)f->max_features * sizeof(AvifInfoInternalDimProp) +
+      (uint64_t)f->max_features * sizeof(AvifInfoInternalChanProp) +
+      (uint64_t)f->max_locations * sizeof(AvifInfoInternalLocation) +
+      sizeof(uint64_t) - 1;  // Alignment.
+  return (size <= SIZE_MAX) ? (size_t)size : 0;
+}
+
+// Sets up the 'f' before parsing anything. The associations are stored in
+// 'tables' unless 'options' provide scratch memory. 'options->extents' and
+// 'options->thumbnail' are expected to be reset already.
+static AvifInfoInternalStatus AvifInfoInternalInitFeatures(
+    AvifInfoInternalFeatures* f, const AvifInfoOptions* options,
+    AvifInfoInternalTables* tables) {
+  memset(f, AVIFINFO_UNDEFINED, sizeof(*f));
+  f->requested_fields = (options != NULL && options->requested_fields != 0)
+                            ? (options->requested_fields & kAvifInfoFieldAll)
+                            : kAvifInfoFieldAll;
+  if (options != NULL) {
+    f->extents = options->extents;
+    f->thumbnail = options->thumbnail;
+    f->items = options->items;
+    f->track_requested = (options->track != NULL);
+  }
+  if (options == NULL || options->scratch == NULL) {
+    // The limits in 'options' are ignored.
+    AvifInfoInternalSetLimits(f, /*options=*/NULL);
+    f->tiles = tables->tiles;
+    f->props = tables->props;
+    f->dim_props = tables->dim_props;
+    f->chan_props = tables->chan_props;
+    f->locations = tables->locations;
+    return kFound;
+  }
+
+  AvifInfoInternalSetLimits(f, options);
+  const size_t scratch_size = AvifInfoInternalGetScratchSize(f);
+  AVIFINFO_CHECK(scratch_size != 0 && options->scratch_size >= scratch_size,
+                 kAborted);
+  // The locations contain uint64_t members so they come first, 8-byte aligned.
+  // The other arrays only contain uint32_t and uint8_t members.
+  uint8_t* data = (uint8_t*)options->scratch;
+  data += (sizeof(uint64_t) - (uintptr_t)data % sizeof(uint64_t)) %
+          sizeof(uint64_t);
+  f->locations = (AvifInfoInternalLocation*)data;
+  data += f->max_locations * sizeof(*f->locations);
+  f->ids = (AvifInfoInternalIdEntry*)data;
+  data += ((size_t)f->max_value + 1) * sizeof(*f->ids);
+  f->tiles = (AvifInfoInternalTile*)data;
+  data += f->max_tiles * sizeof(*f->tiles);
+  f->props = (AvifInfoInternalProp*)data;
+  data += f->max_props * sizeof(*f->props);
+  f->dim_props = (AvifInfoInternalDimProp*)data;
+  data += f->max_features * sizeof(*f->dim_props);
+  f->chan_props = (AvifInfoInternalChanProp*)data;
+  memset(f->ids, 0, ((size_t)f->max_value + 1) * sizeof(*f->ids));
+  return kFound;
+}
+
+// Returns true if the whole "iloc", "iprp" and "iref" boxes must be parsed.
+static int AvifInfoInternalNeedsLocations(const AvifInfoInternalFeatures* f) {
+  return f->extents != NULL || f->thumbnail != NULL;
+}
+
+// Returns true if the whole "meta" box may have to be parsed.
+static int AvifInfoInternalNeedsWholeMeta(const AvifInfoInternalFeatures* f) {
+  return AvifInfoInternalNeedsLocations(f) || f->items != NULL;
+}
+
+// Returns true if the width or height of the primary item is requested but
+// not known yet.
+static int AvifInfoInternalMissesDimensions(const AvifInfoInternalFeatures* f) {
+  return (f->requested_fields & kAvifInfoFieldDimensions) &&
+         (f->primary_item_features.width == AVIFINFO_UNDEFINED ||
+          f->primary_item_features.height == AVIFINFO_UNDEFINED);
+}
+
+// Returns true if the bit depth or number of channels of the primary item is
+// requested but not known yet.
+static int AvifInfoInternalMissesChannels(const AvifInfoInternalFeatures* f) {
+  return (f->requested_fields &
+          (kAvifInfoFieldBitDepth | kAvifInfoFieldNumChannels)) &&
+         (f->primary_item_features.bit_depth == AVIFINFO_UNDEFINED ||
+          f->primary_item_features.num_channels == AVIFINFO_UNDEFINED);
+}
+
+// Association setters. The data is skipped if a limit is reached.
+
+static void AvifInfoInternalAddTile(AvifInfoInternalFeatures* f,
+                                    uint32_t parent_item_id,
+                                    uint32_t tile_item_id, uint32_t dimg_idx) {
+  if (f->num_tiles >= f->max_tiles) {
+    AVIFINFO_SKIP_DATA(f, kAvifInfoLimitTiles);
+    return;
+  }
+  if (parent_item_id > f->max_value || tile_item_id > f->max_value) {
+    AVIFINFO_SKIP_DATA(f, kAvifInfoLimitValue);
+    return;
+  }
+  AvifInfoInternalTile* const tile = &f->tiles[f->num_tiles++];
+  tile->tile_item_id = tile_item_id;
+  tile->parent_item_id = parent_item_id;
+  tile->dimg_idx = dimg_idx;
+  tile->next = 0;
+  if (f->ids != NULL) {
+    AvifInfoInternalIdEntry* const parent = &f->ids[parent_item_id];
+    if (parent->last_tile != 0) {
+      f->tiles[parent->last_tile - 1].next = f->num_tiles;
+    } else {
+      parent->first_tile = f->num_tiles;
+    }
+    parent->last_tile = f->num_tiles;
+  }
+}
+
+static void AvifInfoInternalAddProp(AvifInfoInternalFeatures* f,
+                                    uint32_t item_id, uint32_t property_index) {
+  if (property_index > f->max_value || item_id > f->max_value) {
+    AVIFINFO_SKIP_DATA(f, kAvifInfoLimitValue);
+    return;
+  }
+  AvifInfoInternalProp* const prop = &f->props[f->num_props++];
+  prop->property_index = property_index;
+  prop->item_id = item_id;
+  prop->next = 0;
+  if (f->ids != NULL) {
+    AvifInfoInternalIdEntry* const item = &f->ids[item_id];
+    if (item->last_prop != 0) {
+      f->props[item->last_prop - 1].next = f->num_props;
+    } else {
+      item->first_prop = f->num_props;
+    }
+    item->last_prop = f->num_props;
+    if (f->ids[property_index].first_prop_item == 0) {
+      f->ids[property_index].first_prop_item = f->num_props;
+    }
+  }
+}
+
+static void AvifInfoInternalAddDimProp(AvifInfoInternalFeatures* f,
+                                       uint32_t property_index, uint32_t width,
+                                       uint32_t height) {
+  if (f->num_dim_props >= f->max_features || property_index > f->max_value) {
+    AVIFINFO_SKIP_DATA(f, (f->num_dim_props < f->max_features)
+                              ? kAvifInfoLimitValue
+                              : kAvifInfoLimitFeatures);
+    return;
+  }
+  AvifInfoInternalDimProp* const dim_prop = &f->dim_props[f->num_dim_props++];
+  dim_prop->property_index = property_index;
+  dim_prop->width = width;
+  dim_prop->height = height;
+  if (f->ids != NULL && f->ids[property_index].dim_prop == 0) {
+    f->ids[property_index].dim_prop = f->num_dim_props;
+  }
+}
+
+static void AvifInfoInternalAddChanProp(AvifInfoInternalFeatures* f,
+                                        uint32_t property_index,
+                                        uint32_t bit_depth,
+                                        uint32_t num_channels) {
+  if (f->num_chan_props >= f->max_features || property_index > f->max_value ||
+      bit_depth > AVIFINFO_MAX_VALUE || num_channels > AVIFINFO_MAX_VALUE) {
+    AVIFINFO_SKIP_DATA(f, (f->num_chan_props < f->max_features)
+                              ? kAvifInfoLimitValue
+                              : kAvifInfoLimitFeatures);
+    return;
+  }
+  AvifInfoInternalChanProp* const chan_prop =
+      &f->chan_props[f->num_chan_props++];
+  chan_prop->property_index = property_index;
+  chan_prop->bit_depth = (uint8_t)bit_depth;
+  chan_prop->num_channels = (uint8_t)num_channels;
+  if (f->ids != NULL && f->ids[property_index].chan_prop == 0) {
+    f->ids[property_index].chan_prop = f->num_chan_props;
+  }
+}
+
+static void AvifInfoInternalAddLocation(AvifInfoInternalFeatures* f,
+                                        uint32_t item_id, uint64_t offset,
+                                        uint64_t size) {
+  if (f->num_locations >= f->max_locations) {
+    AVIFINFO_SKIP_DATA(f, kAvifInfoLimitLocations);
+    return;
+  }
+  // The ids of all items of interest are at most 'max_value', so the others
+  // can be ignored without being reported.
+  if (item_id > f->max_value) return;
+  AvifInfoInternalLocation* const location = &f->locations[f->num_locations++];
+  location->item_id = item_id;
+  location->extent.offset = offset;
+  location->extent.size = size;
+  if (f->ids != NULL && f->ids[item_id].location == 0) {
+    f->ids[item_id].location = f->num_locations;
+  }
+}
+
+// Association getters. The iterators return the position of the next matching
+// association, or the number of associations if there is none.
+
+static uint32_t AvifInfoInternalFirstPropOfItem(
+    const AvifInfoInternalFeatures* f, uint32_t item_id) {
+  if (f->ids != NULL) {
+    return (item_id <= f->max_value && f->ids[item_id].first_prop != 0)
+               ? f->ids[item_id].first_prop - 1
+               : f->num_props;
+  }
+  uint32_t i = 0;
+  while (i < f->num_props && f->props[i].item_id != item_id) ++i;
+  return i;
+}
+
+static uint32_t AvifInfoInternalNextPropOfItem(
+    const AvifInfoInternalFeatures* f, uint32_t i) {
+  if (f->ids != NULL) {
+    return (f->props[i].next != 0) ? f->props[i].next - 1 : f->num_props;
+  }
+  const uint32_t item_id = f->props[i].item_id;
+  ++i;
+  while (i < f->num_props && f->props[i].item_id != item_id) ++i;
+  return i;
+}
+
+static uint32_t AvifInfoInternalFirstTileOfParent(
+    const AvifInfoInternalFeatures* f, uint32_t parent_item_id) {
+  if (f->ids != NULL) {
+    return (parent_item_id <= f->max_value &&
+            f->ids[parent_item_id].first_tile != 0)
+               ? f->ids[parent_item_id].first_tile - 1
+               : f->num_tiles;
+  }
+  uint32_t i = 0;
+  while (i < f->num_tiles && f->tiles[i].parent_item_id != parent_item_id) ++i;
+  return i;
+}
+
+static uint32_t AvifInfoInternalNextTileOfParent(
+    const AvifInfoInternalFeatures* f, uint32_t i) {
+  if (f->ids != NULL) {
+    return (f->tiles[i].next != 0) ? f->tiles[i].next - 1 : f->num_tiles;
+  }
+  const uint32_t parent_item_id = f->tiles[i].parent_item_id;
+  ++i;
+  while (i < f->num_tiles && f->tiles[i].parent_item_id != parent_item_id) ++i;
+  return i;
+}
+
+// Returns the first association of the property at 'property_index', or null.
+static const AvifInfoInternalProp* AvifInfoInternalFindPropItem(
+    const AvifInfoInternalFeatures* f, uint32_t property_index) {
+  if (f->ids != NULL) {
+    return (property_index <= f->max_value &&
+            f->ids[property_index].first_prop_item != 0)
+               ? &f->props[f->ids[property_index].first_prop_item - 1]
+               : NULL;
+  }
+  for (uint32_t i = 0; i < f->num_props; ++i) {
+    if (f->props[i].property_index == property_index) return &f->props[i];
+  }
+  return NULL;
+}
+
+static const AvifInfoInternalDimProp* AvifInfoInternalFindDimProp(
+    const AvifInfoInternalFeatures* f, uint32_t property_index) {
+  if (f->ids != NULL) {
+    return (f->ids[property_index].dim_prop != 0)
+               ? &f->dim_props[f->ids[property_index].dim_prop - 1]
+               : NULL;
+  }
+  for (uint32_t i = 0; i < f->num_dim_props; ++i) {
+    if (f->dim_props[i].property_index == property_index) {
+      return &f->dim_props[i];
+    }
+  }
+  return NULL;
+}
+
+static const AvifInfoInternalChanProp* AvifInfoInternalFindChanProp(
+    const AvifInfoInternalFeatures* f, uint32_t property_index) {
+  if (f->ids != NULL) {
+    return (f->ids[property_index].chan_prop != 0)
+               ? &f->chan_props[f->ids[property_index].chan_prop - 1]
+               : NULL;
+  }
+  for (uint32_t i = 0; i < f->num_chan_props; ++i) {
+    if (f->chan_props[i].property_index == property_index) {
+      return &f->chan_props[i];
+    }
+  }
+  return NULL;
+}
+
+// Returns the payload location of the item 'item_id', or null.
+static const AvifInfoExtent* AvifInfoInternalFindLocation(
+    const AvifInfoInternalFeatures* f, uint32_t item_id) {
+  if (f->ids != NULL) {
+    return (item_id <= f->max_value && f->ids[item_id].location != 0)
+               ? &f->locations[f->ids[item_id].location - 1].extent
+               : NULL;
+  }
+  for (uint32_t i = 0; i < f->num_locations; ++i) {
+    if (f->locations[i].item_id == item_id) return &f->locations[i].extent;
+  }
+  return NULL;
+}
+
+// Outputs the payload locations of the primary item and of the items it
+// depends on to 'f->extents', and the thumbnail to 'f->thumbnail'.
+static AvifInfoInternalStatus AvifInfoInternalGetItemLocations(
+    AvifInfoInternalFeatures* f) {
+  // Some locations or tiles might be missing otherwise. Leave the outputs
+  // unknown ('parsed' is 0) rather than partially filled, without changing the
+  // features nor the status.
+  if ((f->skipped_data_limits & (kAvifInfoLimitTiles | kAvifInfoLimitValue |
+                                 kAvifInfoLimitLocations)) != 0) {
+    return kFound;
+  }
+  const AvifInfoExtent* extent;
+  AvifInfoThumbnail* const thumbnail = f->thumbnail;
+  if (thumbnail != NULL && f->thumbnail_item_id != 0 &&
+      f->thumbnail_of_item_id == f->primary_item_id) {
+    thumbnail->item_id = f->thumbnail_item_id;
+    for (uint32_t prop_item =
+             AvifInfoInternalFirstPropOfItem(f, f->thumbnail_item_id);
+         prop_item < f->num_props;
+         prop_item = AvifInfoInternalNextPropOfItem(f, prop_item)) {
+      const AvifInfoInternalDimProp* const dim_prop =
+          AvifInfoInternalFindDimProp(f, f->props[prop_item].property_index);
+      if (dim_prop != NULL) {
+        thumbnail->width = dim_prop->width;
+        thumbnail->height = dim_prop->height;
+        break;
+      }
+    }
+    extent = AvifInfoInternalFindLocation(f, f->thumbnail_item_id);
+    if (extent != NULL) thumbnail->extent = *extent;
+  }
+  if (thumbnail != NULL) thumbnail->parsed = 1;
+
+  AvifInfoItemExtents* const extents = f->extents;
+  if (extents == NULL) return kFound;
+  extents->parsed = 1;
+  extent = AvifInfoInternalFindLocation(f, f->primary_item_id);
+  if (extent != NULL) extents->primary_item = *extent;
+  if (f->alpha_property_index > 0) {
+    const AvifInfoInternalProp* const prop =
+        AvifInfoInternalFindPropItem(f, f->alpha_property_index);
+    extent = (prop != NULL) ? AvifInfoInternalFindLocation(f, prop->item_id)
+                            : NULL;
+    if (extent != NULL) extents->alpha_item = *extent;
+  }
+#if !defined(AVIFINFO_NO_GAINMAP)
+  if (f->primary_item_features.has_gainmap) {
+    extent = AvifInfoInternalFindLocation(
+        f, f->primary_item_features.gainmap_item_id);
+    if (extent != NULL) extents->gainmap_item = *extent;
+  }
+#endif
+  extents->num_tiles = 0;
+  for (uint32_t tile = AvifInfoInternalFirstTileOfParent(f, f->primary_item_id);
+       tile < f->num_tiles; tile = AvifInfoInternalNextTileOfParent(f, tile)) {
+    if (extents->tiles != NULL && extents->num_tiles < extents->max_num_tiles) {
+      extent = AvifInfoInternalFindLocation(f, f->tiles[tile].tile_item_id);
+      memset(&extents->tiles[extents->num_tiles], 0, sizeof(*extent));
+      if (extent != NULL) extents->tiles[extents->num_tiles] = *extent;
+    }
+    ++extents->num_tiles;
+  }
+  return kFound;
+}
+
 // Generates the features of a given 'target_item_id' from internal features.
 static AvifInfoInternalStatus AvifInfoInternalGetItemFeatures(
     AvifInfoInternalFeatures* f, uint32_t target_item_id, uint32_t tile_depth) {
-  for (uint32_t prop_item = 0; prop_item < f->num_props; ++prop_item) {
-    if (f->props[prop_item].item_id != target_item_id) continue;
+  for (uint32_t prop_item = AvifInfoInternalFirstPropOfItem(f, target_item_id);
+       prop_item < f->num_props;
+       prop_item = AvifInfoInternalNextPropOfItem(f, prop_item)) {
+    // Property indices are at most 'max_value' once stored.
     const uint32_t property_index = f->props[prop_item].property_index;
 
     // Retrieve the width and height of the primary item if not already done.
     if (target_item_id == f->primary_item_id &&
-        (f->primary_item_features.width == AVIFINFO_UNDEFINED ||
-         f->primary_item_features.height == AVIFINFO_UNDEFINED)) {
-      for (uint32_t i = 0; i < f->num_dim_props; ++i) {
-        if (f->dim_props[i].property_index != property_index) continue;
-        f->primary_item_features.width = f->dim_props[i].width;
-        f->primary_item_features.height = f->dim_props[i].height;
-        if (f->primary_item_features.bit_depth != AVIFINFO_UNDEFINED &&
-            f->primary_item_features.num_channels != AVIFINFO_UNDEFINED) {
-          return kFound;
-        }
-        break;
+        AvifInfoInternalMissesDimensions(f)) {
+      const AvifInfoInternalDimProp* const dim_prop =
+          AvifInfoInternalFindDimProp(f, property_index);
+      if (dim_prop != NULL) {
+        f->primary_item_features.width = dim_prop->width;
+        f->primary_item_features.height = dim_prop->height;
+        if (!AvifInfoInternalMissesChannels(f)) return kFound;
       }
     }
     // Retrieve the bit depth and number of channels of the target item if not
     // already done.
-    if (f->primary_item_features.bit_depth == AVIFINFO_UNDEFINED ||
-        f->primary_item_features.num_channels == AVIFINFO_UNDEFINED) {
-      for (uint32_t i = 0; i < f->num_chan_props; ++i) {
-        if (f->chan_props[i].property_index != property_index) continue;
-        f->primary_item_features.bit_depth = f->chan_props[i].bit_depth;
-        f->primary_item_features.num_channels = f->chan_props[i].num_channels;
-        if (f->primary_item_features.width != AVIFINFO_UNDEFINED &&
-            f->primary_item_features.height != AVIFINFO_UNDEFINED) {
-          return kFound;
-        }
-        break;
+    if (AvifInfoInternalMissesChannels(f)) {
+      const AvifInfoInternalChanProp* const chan_prop =
+          AvifInfoInternalFindChanProp(f, property_index);
+      if (chan_prop != NULL) {
+        f->primary_item_features.bit_depth = chan_prop->bit_depth;
+        f->primary_item_features.num_channels = chan_prop->num_channels;
+        if (!AvifInfoInternalMissesDimensions(f)) return kFound;
       }
     }
   }
 
   // Check for the bit_depth and num_channels in a tile if not yet found.
-  for (uint32_t tile = 0; tile < f->num_tiles && tile_depth < 3; ++tile) {
-    if (f->tiles[tile].parent_item_id != target_item_id) continue;
+  for (uint32_t tile = AvifInfoInternalFirstTileOfParent(f, target_item_id);
+       tile < f->num_tiles && tile_depth < 3;
+       tile = AvifInfoInternalNextTileOfParent(f, tile)) {
     AVIFINFO_CHECK_NOT_FOUND(AvifInfoInternalGetItemFeatures(
         f, f->tiles[tile].tile_item_id, tile_depth + 1));
   }
   AVIFINFO_RETURN(kNotFound);
 }
 
+// Sets the width, height, bit depth and number of channels of 'item' from the
+// properties of 'item_id', or of its tiles for the latter two.
+static void AvifInfoInternalGetItem(const AvifInfoInternalFeatures* f,
+                                    uint32_t item_id, uint32_t tile_depth,
+                                    AvifInfoItem* item) {
+  for (uint32_t prop_item = AvifInfoInternalFirstPropOfItem(f, item_id);
+       prop_item < f->num_props;
+       prop_item = AvifInfoInternalNextPropOfItem(f, prop_item)) {
+    const uint32_t property_index = f->props[prop_item].property_index;
+    const AvifInfoInternalDimProp* const dim_prop =
+        AvifInfoInternalFindDimProp(f, property_index);
+    if (tile_depth == 0 && dim_prop != NULL && item->width == 0) {
+      item->width = dim_prop->width;
+      item->height = dim_prop->height;
+    }
+    const AvifInfoInternalChanProp* const chan_prop =
+        AvifInfoInternalFindChanProp(f, property_index);
+    if (chan_prop != NULL && item->bit_depth == 0) {
+      item->bit_depth = chan_prop->bit_depth;
+      item->num_channels = chan_prop->num_channels;
+    }
+  }
+  const uint32_t tile = AvifInfoInternalFirstTileOfParent(f, item_id);
+  if (item->bit_depth == 0 && tile < f->num_tiles && tile_depth < 3) {
+    AvifInfoInternalGetItem(f, f->tiles[tile].tile_item_id, tile_depth + 1,
+                            item);
+  }
+}
+
+// Outputs the features and roles of all items to 'f->items'.
+static AvifInfoInternalStatus AvifInfoInternalGetItems(
+    AvifInfoInternalFeatures* f) {
+  // Some items or associations might be missing otherwise. Leave the outputs
+  // unknown ('parsed' is 0), as in AvifInfoInternalGetItemLocations().
+  if ((f->skipped_data_limits &
+       (kAvifInfoLimitTiles | kAvifInfoLimitProps | kAvifInfoLimitFeatures |
+        kAvifInfoLimitValue)) != 0) {
+    return kFound;
+  }
+  AvifInfoItems* const items = f->items;
+  items->parsed = 1;
+  items->num_items = 0;
+  for (uint32_t i = 0; i < f->num_props; ++i) {
+    const uint32_t item_id = f->props[i].item_id;
+    // Only consider the first association of each item.
+    if (AvifInfoInternalFirstPropOfItem(f, item_id) != i) continue;
+    if (items->items != NULL && items->num_items < items->max_num_items) {
+      AvifInfoItem* const item = &items->items[items->num_items];
+      memset(item, 0, sizeof(*item));
+      item->item_id = item_id;
+      AvifInfoInternalGetItem(f, item_id, /*tile_depth=*/0, item);
+      if (item_id == f->primary_item_id) item->roles |= kAvifInfoItemPrimary;
+#if !defined(AVIFINFO_NO_GAINMAP)
+      if (f->primary_item_features.has_gainmap &&
+          item_id == f->primary_item_features.gainmap_item_id) {
+        item->roles |= kAvifInfoItemGainmap;
+      }
+#endif
+      if (f->tone_mapped_item_id != 0 && item_id == f->tone_mapped_item_id) {
+        item->roles |= kAvifInfoItemTmap;
+      }
+    }
+    ++items->num_items;
+  }
+
+  uint32_t num_output_items = 0;
+  if (items->items != NULL) {
+    num_output_items = (items->num_items < items->max_num_items)
+                           ? items->num_items
+                           : items->max_num_items;
+  }
+  for (uint32_t i = 0; f->alpha_property_index > 0 && i < f->num_props; ++i) {
+    if (f->props[i].property_index != f->alpha_property_index) continue;
+    for (uint32_t j = 0; j < num_output_items; ++j) {
+      if (items->items[j].item_id == f->props[i].item_id) {
+        items->items[j].roles |= kAvifInfoItemAlpha;
+      }
+    }
+  }
+  for (uint32_t i = 0; i < f->num_tiles; ++i) {
+    // The inputs of a "tmap" item are the base image and the gain map.
+    if (f->tone_mapped_item_id != 0 &&
+        f->tiles[i].parent_item_id == f->tone_mapped_item_id) {
+      continue;
+    }
+    for (uint32_t j = 0; j < num_output_items; ++j) {
+      if (items->items[j].item_id == f->tiles[i].tile_item_id) {
+        items->items[j].roles |= kAvifInfoItemTile;
+      }
+    }
+  }
+  return kFound;
+}
+
 // Generates the 'f->primary_item_features' from the AvifInfoInternalFeatures.
 // Returns kNotFound if there is not enough information.
-static AvifInfoInternalStatus AvifInfoInternalGetPrimaryItemFeatures(
+static AvifInfoInternalStatus AvifInfoInternalFindPrimaryItemFeatures(
     AvifInfoInternalFeatures* f) {
   // Nothing to do without the primary item ID.
   AVIFINFO_CHECK(f->has_primary_item, kNotFound);
   // Early exit.
-  AVIFINFO_CHECK(f->num_dim_props > 0 && f->num_chan_props, kNotFound);
+  AVIFINFO_CHECK(!AvifInfoInternalMissesDimensions(f) || f->num_dim_props > 0,
+                 kNotFound);
+  AVIFINFO_CHECK(!AvifInfoInternalMissesChannels(f) || f->num_chan_props > 0,
+                 kNotFound);
 
-  // Look for a gain map.
+#if !defined(AVIFINFO_NO_GAINMAP)
+  // Look for a gain map, unless it is not requested.
   // HEIF scheme: gain map is a hidden input of a derived item.
-  if (f->tone_mapped_item_id) {
-    for (uint32_t tile = 0; tile < f->num_tiles; ++tile) {
-      if (f->tiles[tile].parent_item_id == f->tone_mapped_item_id &&
-          f->tiles[tile].dimg_idx == 1) {
+  const int gainmap_is_requested =
+      (f->requested_fields & kAvifInfoFieldGainmap) != 0;
+  if (gainmap_is_requested && f->tone_mapped_item_id) {
+    for (uint32_t tile =
+             AvifInfoInternalFirstTileOfParent(f, f->tone_mapped_item_id);
+         tile < f->num_tiles;
+         tile = AvifInfoInternalNextTileOfParent(f, tile)) {
+      if (f->tiles[tile].dimg_idx == 1) {
+        // AvifInfoFeatures can only store small ids.
+        AVIFINFO_CHECK(f->tiles[tile].tile_item_id <= UINT8_MAX, kAborted);
         f->primary_item_features.has_gainmap = 1;
-        f->primary_item_features.gainmap_item_id = f->tiles[tile].tile_item_id;
+        f->primary_item_features.gainmap_item_id =
+            (uint8_t)f->tiles[tile].tile_item_id;
         break;
       }
     }
   }
   // Adobe scheme: gain map is an auxiliary item.
-  if (!f->primary_item_features.has_gainmap && f->gainmap_property_index > 0) {
-    for (uint32_t prop_item = 0; prop_item < f->num_props; ++prop_item) {
-      if (f->props[prop_item].property_index == f->gainmap_property_index) {
-        f->primary_item_features.has_gainmap = 1;
-        f->primary_item_features.gainmap_item_id = f->props[prop_item].item_id;
-        break;
-      }
+  if (gainmap_is_requested && !f->primary_item_features.has_gainmap &&
+      f->gainmap_property_index > 0) {
+    const AvifInfoInternalProp* const prop =
+        AvifInfoInternalFindPropItem(f, f->gainmap_property_index);
+    if (prop != NULL) {
+      AVIFINFO_CHECK(prop->item_id <= UINT8_MAX, kAborted);
+      f->primary_item_features.has_gainmap = 1;
+      f->primary_item_features.gainmap_item_id = (uint8_t)prop->item_id;
     }
   }
   // If the gain map has not been found but we haven't read all the relevant
-  // metadata, we might still find one later and cannot stop now.
-  if (!f->primary_item_features.has_gainmap &&
-      (!f->iinf_parsed || (f->tone_mapped_item_id && !f->iref_parsed))) {
+  // metadata, we might still find one later and cannot stop now. The inputs
+  // of the tone mapped item may be listed by any "dimg" box in "iref".
+  if (gainmap_is_requested && !f->primary_item_features.has_gainmap &&
+      (!f->iinf_parsed ||
+       (f->tone_mapped_item_id && !f->iref_parsed_entirely &&
+        AvifInfoInternalFirstTileOfParent(f, f->tone_mapped_item_id) >=
+            f->num_tiles))) {
     return kNotFound;
   }
+#endif  // !AVIFINFO_NO_GAINMAP
 
-  AVIFINFO_CHECK_FOUND(
-      AvifInfoInternalGetItemFeatures(f, f->primary_item_id, /*tile_depth=*/0));
+  if (AvifInfoInternalMissesDimensions(f) ||
+      AvifInfoInternalMissesChannels(f)) {
+    AVIFINFO_CHECK_FOUND(AvifInfoInternalGetItemFeatures(
+        f, f->primary_item_id, /*tile_depth=*/0));
+  }
 
   // "auxC" is parsed before the "ipma" properties so it is known now, if any.
   if (f->has_alpha) ++f->primary_item_features.num_channels;
+
+  // Only output the requested fields.
+  if (!(f->requested_fields & kAvifInfoFieldBitDepth)) {
+    f->primary_item_features.bit_depth = 0;
+  }
+  if (!(f->requested_fields & kAvifInfoFieldNumChannels)) {
+    f->primary_item_features.num_channels = 0;
+  }
+  if (!(f->requested_fields & kAvifInfoFieldPrimaryItemIdLocation)) {
+    f->primary_item_features.primary_item_id_location = 0;
+    f->primary_item_features.primary_item_id_bytes = 0;
+  }
+  return kFound;
+}
+
+// Generates the 'f->primary_item_features' if not done yet, then the item
+// locations and the list of items if requested. Returns kNotFound if there is
+// not enough information.
+static AvifInfoInternalStatus AvifInfoInternalGetPrimaryItemFeatures(
+    AvifInfoInternalFeatures* f) {
+  if (!f->has_primary_item_features) {
+    AVIFINFO_CHECK_FOUND(AvifInfoInternalFindPrimaryItemFeatures(f));
+    f->has_primary_item_features = 1;
+  }
+
+  // The item locations and the list of items may need more boxes.
+  if (AvifInfoInternalNeedsLocations(f) && !f->meta_parsed &&
+      (!f->iloc_parsed || !f->iprp_parsed || !f->iref_parsed_entirely)) {
+    return kNotFound;
+  }
+  if (f->items != NULL && !f->meta_parsed &&
+      (!f->iinf_parsed || !f->iprp_parsed || !f->iref_parsed_entirely)) {
+    return kNotFound;
+  }
+  if (AvifInfoInternalNeedsLocations(f)) {
+    AVIFINFO_CHECK_FOUND(AvifInfoInternalGetItemLocations(f));
+  }
+  if (f->items != NULL) AVIFINFO_CHECK_FOUND(AvifInfoInternalGetItems(f));
   return kFound;
 }
+#endif  // !AVIFINFO_IDENTIFY_ONLY
 
 //------------------------------------------------------------------------------
 // Box header parsing and various size checks.
 
 typedef struct {
   uint32_t size;          // In bytes.
-  uint8_t type[4];        // Four characters.
+  uint32_t type;          // Four characters. See AVIFINFO_FOURCC().
   uint32_t version;       // 0 or actual version if this is a full box.
   uint32_t flags;         // 0 or actual value if this is a full box.
   uint32_t content_size;  // 'size' minus the header size.
 } AvifInfoInternalBox;
 
+#if !defined(AVIFINFO_IDENTIFY_ONLY)
+//------------------------------------------------------------------------------
+// Resumable parsing.
+// The state of each box loop is saved before parsing each of its child boxes.
+// If bytes are missing, the parsing can restart from the last saved state
+// instead of from the beginning of the file once more bytes are available.
+
+typedef struct {
+  uint32_t num_remaining_bytes;  // Size of the unparsed children of the loop.
+  uint32_t index;                // Box or entry index of the loop.
+  uint32_t count;                // Number of entries of the loop, if any.
+  AvifInfoInternalBox box;       // Last box parsed at this nesting level.
+} AvifInfoInternalFrame;
+
+struct AvifInfoInternalCheckpoint {
+  // Nesting level of the box loop to resume, or -1 for the "ftyp" box.
+  int nesting_level;
+  // True while going through the outer levels towards 'nesting_level'.
+  int is_resuming;
+  uint64_t num_read_bytes;  // Position of the stream at the checkpoint.
+  uint32_t num_parsed_boxes;
+  AvifInfoInternalFeatures features;
+  AvifInfoInternalFrame frames[AVIFINFO_MAX_NESTING_LEVEL];
+};
+
+// Saves the state of the box loop at 'nesting_level', before parsing its next
+// child box.
+static void AvifInfoInternalSave(AvifInfoInternalStream* stream,
+                                 int nesting_level,
+                                 uint32_t num_remaining_bytes, uint32_t index,
+                                 uint32_t count, uint32_t num_parsed_boxes,
+                                 const AvifInfoInternalFeatures* features) {
+  AvifInfoInternalCheckpoint* const checkpoint = stream->checkpoint;
+  if (checkpoint == NULL) return;
+  checkpoint->nesting_level = nesting_level;
+  checkpoint->num_read_bytes = stream->num_read_bytes;
+  checkpoint->num_parsed_boxes = num_parsed_boxes;
+  memcpy(&checkpoint->features, features, sizeof(*features));
+  AvifInfoInternalFrame* const frame = &checkpoint->frames[nesting_level];
+  frame->num_remaining_bytes = num_remaining_bytes;
+  frame->index = index;
+  frame->count = count;
+}
+
+// Restores the state of the box loop at 'nesting_level' if the parsing is
+// being resumed. Returns 0 if there is nothing to restore, 1 if the loop
+// should continue with its next child box, or 2 if the loop should continue
+// within the child 'box' that was being parsed. 'box' is null for the loops
+// whose child boxes contain no saved loop, where 2 is never returned.
+static int AvifInfoInternalResume(AvifInfoInternalStream* stream,
+                                  int nesting_level,
+                                  uint32_t* num_remaining_bytes,
+                                  uint32_t* index, uint32_t* count,
+                                  AvifInfoInternalBox* box) {
+  AvifInfoInternalCheckpoint* const checkpoint = stream->checkpoint;
+  if (checkpoint == NULL || !checkpoint->is_resuming) return 0;
+  const AvifInfoInternalFrame* const frame = &checkpoint->frames[nesting_level];
+  *num_remaining_bytes = frame->num_remaining_bytes;
+  if (index != NULL) *index = frame->index;
+  if (count != NULL) *count = frame->count;
+  if (nesting_level < checkpoint->nesting_level && box != NULL) {
+    memcpy(box, &frame->box, sizeof(*box));
+    return 2;
+  }
+  checkpoint->is_resuming = 0;
+  return 1;
+}
+#endif  // !AVIFINFO_IDENTIFY_ONLY
+
+// Full boxes that can be parsed, and their parsable versions. Any other box
+// is parsed as a box without the "version" and "flags" fields.
+typedef struct {
+  uint32_t type;
+  uint8_t min_version, max_version;
+} AvifInfoInternalFullBoxType;
+
+static const AvifInfoInternalFullBoxType kAvifInfoInternalFullBoxTypes[] = {
+    // See AV1 Image File Format (AVIF) 8.1
+    // at https://aomediacodec.github.io/av1-avif/#avif-boxes (available when
+    // https://github.com/AOMediaCodec/av1-avif/pull/170 is merged).
+    {AVIFINFO_FOURCC('m', 'e', 't', 'a'), 0, 0},
+    {AVIFINFO_FOURCC('p', 'i', 't', 'm'), 0, 1},
+    {AVIFINFO_FOURCC('i', 'p', 'm', 'a'), 0, 1},
+    {AVIFINFO_FOURCC('i', 's', 'p', 'e'), 0, 0},
+    {AVIFINFO_FOURCC('p', 'i', 'x', 'i'), 0, 0},
+    {AVIFINFO_FOURCC('i', 'r', 'e', 'f'), 0, 1},
+    {AVIFINFO_FOURCC('a', 'u', 'x', 'C'), 0, 0},
+    {AVIFINFO_FOURCC('i', 'i', 'n', 'f'), 0, 1},
+    {AVIFINFO_FOURCC('i', 'n', 'f', 'e'), 2, 3},
+};
+
+// Returns the entry of kAvifInfoInternalFullBoxTypes matching 'type', or null.
+static const AvifInfoInternalFullBoxType* AvifInfoInternalFindFullBoxType(
+    uint32_t type) {
+  const size_t num_types = sizeof(kAvifInfoInternalFullBoxTypes) /
+                           sizeof(kAvifInfoInternalFullBoxTypes[0]);
+  for (size_t i = 0; i < num_types; ++i) {
+    if (kAvifInfoInternalFullBoxTypes[i].type == type) {
+      return &kAvifInfoInternalFullBoxTypes[i];
+    }
+  }
+  return NULL;
+}
+
 // Reads the header of a 'box' starting at the beginning of a 'stream'.
 // 'num_remaining_bytes' is the remaining size of the container of the 'box'
 // (either the file size itself or the content size of the parent of the 'box').
@@ -299,13 +1368,18 @@ static AvifInfoInternalStatus AvifInfoInternalParseBox(
     int nesting_level, AvifInfoInternalStream* stream,
     uint32_t num_remaining_bytes, uint32_t* num_parsed_boxes,
     AvifInfoInternalBox* box) {
+  if (stream->budget != NULL) {
+    AVIFINFO_CHECK_FOUND(AvifInfoInternalCheckDeadline(stream));
+  }
+  const uint64_t box_start = stream->num_read_bytes;
+  stream->box_end = 0;  // Unknown until the size is read.
   const uint8_t* data;
   // See ISO/IEC 14496-12:2012(E) 4.2
   uint32_t box_header_size = 8;  // box 32b size + 32b type (at least)
   AVIFINFO_CHECK(box_header_size <= num_remaining_bytes, kInvalid);
   AVIFINFO_CHECK_FOUND(AvifInfoInternalRead(stream, 8, &data));
   box->size = AvifInfoInternalReadBigEndian(data, sizeof(uint32_t));
-  memcpy(box->type, data + 4, 4);
+  box->type = AvifInfoInternalReadBigEndian(data + 4, sizeof(uint32_t));
   // 'box->size==1' means 64-bit size should be read after the box type.
   // 'box->size==0' means this box extends to all remaining bytes.
   if (box->size == 1) {
@@ -326,17 +1400,14 @@ static AvifInfoInternalStatus AvifInfoInternalParseBox(
   }
   AVIFINFO_CHECK(box->size >= box_header_size, kInvalid);
   AVIFINFO_CHECK(box->size <= num_remaining_bytes, kInvalid);
+  stream->box_end = box_start + box->size;
 
   // 16 bytes of usertype should be read here if the box type is 'uuid'.
   // 'uuid' boxes are skipped so usertype is part of the skipped body.
 
-  const int has_fullbox_header =
-      !memcmp(box->type, "meta", 4) || !memcmp(box->type, "pitm", 4) ||
-      !memcmp(box->type, "ipma", 4) || !memcmp(box->type, "ispe", 4) ||
-      !memcmp(box->type, "pixi", 4) || !memcmp(box->type, "iref", 4) ||
-      !memcmp(box->type, "auxC", 4) || !memcmp(box->type, "iinf", 4) ||
-      !memcmp(box->type, "infe", 4);
-  if (has_fullbox_header) box_header_size += 4;
+  const AvifInfoInternalFullBoxType* const full_box_type =
+      AvifInfoInternalFindFullBoxType(box->type);
+  if (full_box_type != NULL) box_header_size += 4;
   AVIFINFO_CHECK(box->size >= box_header_size, kInvalid);
   box->content_size = box->size - box_header_size;
   // AvifInfoGetFeaturesStream() can be called on a full stream or on a stream
@@ -345,7 +1416,7 @@ static AvifInfoInternalStatus AvifInfoInternalParseBox(
   // both situations (because of the AVIFINFO_MAX_NUM_BOXES check that would
   // compare a different box count otherwise). This is fine because top-level
   // 'ftyp' boxes are just skipped anyway.
-  if (nesting_level != 0 || memcmp(box->type, "ftyp", 4)) {
+  if (nesting_level != 0 || box->type != AVIFINFO_FOURCC('f', 't', 'y', 'p')) {
     // Avoid timeouts. The maximum number of parsed boxes is arbitrary.
     ++*num_parsed_boxes;
     AVIFINFO_CHECK(*num_parsed_boxes < AVIFINFO_MAX_NUM_BOXES, kAborted);
@@ -353,36 +1424,62 @@ static AvifInfoInternalStatus AvifInfoInternalParseBox(
 
   box->version = 0;
   box->flags = 0;
-  if (has_fullbox_header) {
+  if (full_box_type != NULL) {
     AVIFINFO_CHECK_FOUND(AvifInfoInternalRead(stream, 4, &data));
     box->version = AvifInfoInternalReadBigEndian(data, 1);
     box->flags = AvifInfoInternalReadBigEndian(data + 1, 3);
-    // See AV1 Image File Format (AVIF) 8.1
-    // at https://aomediacodec.github.io/av1-avif/#avif-boxes (available when
-    // https://github.com/AOMediaCodec/av1-avif/pull/170 is merged).
-    const uint32_t is_parsable =
-        (!memcmp(box->type, "meta", 4) && box->version <= 0) ||
-        (!memcmp(box->type, "pitm", 4) && box->version <= 1) ||
-        (!memcmp(box->type, "ipma", 4) && box->version <= 1) ||
-        (!memcmp(box->type, "ispe", 4) && box->version <= 0) ||
-        (!memcmp(box->type, "pixi", 4) && box->version <= 0) ||
-        (!memcmp(box->type, "iref", 4) && box->version <= 1) ||
-        (!memcmp(box->type, "auxC", 4) && box->version <= 0) ||
-        (!memcmp(box->type, "iinf", 4) && box->version <= 1) ||
-        (!memcmp(box->type, "infe", 4) && box->version >= 2 &&
-         box->version <= 3);
     // Instead of considering this file as invalid, skip unparsable boxes.
-    if (!is_parsable) memcpy(box->type, "skip", 4);  // FreeSpaceBox
+    if (box->version < full_box_type->min_version ||
+        box->version > full_box_type->max_version) {
+      box->type = AVIFINFO_FOURCC('s', 'k', 'i', 'p');  // FreeSpaceBox
+    }
+  }
+  if (nesting_level == 0 && box->type == AVIFINFO_FOURCC('m', 'e', 't', 'a')) {
+    stream->meta_end = stream->box_end;
   }
+#if !defined(AVIFINFO_IDENTIFY_ONLY)
+  if (stream->checkpoint != NULL) {
+    memcpy(&stream->checkpoint->frames[nesting_level].box, box, sizeof(*box));
+  }
+#endif  // !AVIFINFO_IDENTIFY_ONLY
+  AVIFINFO_STATS(stream, {
+    if ((uint32_t)nesting_level > stats->max_nesting_level) {
+      stats->max_nesting_level = (uint32_t)nesting_level;
+    }
+  });
   AVIF_DEBUG_LOG("%*c", nesting_level * 2, ' ');
-  AVIF_DEBUG_LOG("Box type %.4s size %d\n", box->type, box->size);
+  AVIF_DEBUG_LOG("Box type %c%c%c%c size %d\n", (char)(box->type >> 24),
+                 (char)(box->type >> 16), (char)(box->type >> 8),
+                 (char)box->type, box->size);
   return kFound;
 }
 
+#if !defined(AVIFINFO_IDENTIFY_ONLY)
 //------------------------------------------------------------------------------
 
-// Parses a 'stream' of an "ipco" box into 'features'.
-// "ispe" is used for width and height, "pixi" and "av1C" are used for bit depth
+// Parses a 'stream' of an "av1C" box of 'content_size' bytes.
+static AvifInfoInternalStatus AvifInfoInternalParseAv1C(
+    AvifInfoInternalStream* stream, uint32_t content_size, uint8_t* bit_depth,
+    uint8_t* num_channels) {
+  // See AV1 Codec ISO Media File Format Binding 2.3.1
+  // at https://aomediacodec.github.io/av1-isobmff/#av1c
+  // Only parse the necessary third byte. Assume that the others are valid.
+  const uint8_t* data;
+  AVIFINFO_CHECK(content_size >= 3, kInvalid);
+  AVIFINFO_CHECK_FOUND(AvifInfoInternalRead(stream, 3, &data));
+  const int high_bitdepth = (data[2] & 0x40) != 0;
+  const int twelve_bit = (data[2] & 0x20) != 0;
+  const int monochrome = (data[2] & 0x10) != 0;
+  if (twelve_bit) {
+    AVIFINFO_CHECK(high_bitdepth, kInvalid);
+  }
+  *bit_depth = high_bitdepth ? twelve_bit ? 12 : 10 : 8;
+  *num_channels = monochrome ? 1 : 3;
+  return AvifInfoInternalSkip(stream, content_size - 3);
+}
+
+// Parses a 'stream' of an "ipco" box into 'features'.
+// "ispe" is used for width and height, "pixi" and "av1C" are used for bit depth
 // and number of channels, and "auxC" is used for alpha.
 static AvifInfoInternalStatus ParseIpco(int nesting_level,
                                         AvifInfoInternalStream* stream,
@@ -390,12 +1487,16 @@ static AvifInfoInternalStatus ParseIpco(int nesting_level,
                                         uint32_t* num_parsed_boxes,
                                         AvifInfoInternalFeatures* features) {
   uint32_t box_index = 1;  // 1-based index. Used for iterating over properties.
+  AvifInfoInternalResume(stream, nesting_level, &num_remaining_bytes,
+                         &box_index, /*count=*/NULL, /*box=*/NULL);
   do {
+    AvifInfoInternalSave(stream, nesting_level, num_remaining_bytes, box_index,
+                         /*count=*/0, *num_parsed_boxes, features);
     AvifInfoInternalBox box;
     AVIFINFO_CHECK_FOUND(AvifInfoInternalParseBox(
         nesting_level, stream, num_remaining_bytes, num_parsed_boxes, &box));
 
-    if (!memcmp(box.type, "ispe", 4)) {
+    if (box.type == AVIFINFO_FOURCC('i', 's', 'p', 'e')) {
       // See ISO/IEC 23008-12:2017(E) 6.5.3.2
       const uint8_t* data;
       AVIFINFO_CHECK(box.content_size >= 8, kInvalid);
@@ -403,17 +1504,9 @@ static AvifInfoInternalStatus ParseIpco(int nesting_level,
       const uint32_t width = AvifInfoInternalReadBigEndian(data + 0, 4);
       const uint32_t height = AvifInfoInternalReadBigEndian(data + 4, 4);
       AVIFINFO_CHECK(width != 0 && height != 0, kInvalid);
-      if (features->num_dim_props < AVIFINFO_MAX_FEATURES &&
-          box_index <= AVIFINFO_MAX_VALUE) {
-        features->dim_props[features->num_dim_props].property_index = box_index;
-        features->dim_props[features->num_dim_props].width = width;
-        features->dim_props[features->num_dim_props].height = height;
-        ++features->num_dim_props;
-      } else {
-        features->data_was_skipped = 1;
-      }
+      AvifInfoInternalAddDimProp(features, box_index, width, height);
       AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(stream, box.content_size - 8));
-    } else if (!memcmp(box.type, "pixi", 4)) {
+    } else if (box.type == AVIFINFO_FOURCC('p', 'i', 'x', 'i')) {
       // See ISO/IEC 23008-12:2017(E) 6.5.6.2
       const uint8_t* data;
       AVIFINFO_CHECK(box.content_size >= 1, kInvalid);
@@ -431,52 +1524,23 @@ static AvifInfoInternalStatus ParseIpco(int nesting_level,
                        kInvalid);
         AVIFINFO_CHECK(i <= 32, kAborted);  // Be reasonable.
       }
-      if (features->num_chan_props < AVIFINFO_MAX_FEATURES &&
-          box_index <= AVIFINFO_MAX_VALUE && bit_depth <= AVIFINFO_MAX_VALUE &&
-          num_channels <= AVIFINFO_MAX_VALUE) {
-        features->chan_props[features->num_chan_props].property_index =
-            box_index;
-        features->chan_props[features->num_chan_props].bit_depth = bit_depth;
-        features->chan_props[features->num_chan_props].num_channels =
-            num_channels;
-        ++features->num_chan_props;
-      } else {
-        features->data_was_skipped = 1;
-      }
+      AvifInfoInternalAddChanProp(features, box_index, bit_depth,
+                                  num_channels);
       AVIFINFO_CHECK_FOUND(
           AvifInfoInternalSkip(stream, box.content_size - (1 + num_channels)));
-    } else if (!memcmp(box.type, "av1C", 4)) {
-      // See AV1 Codec ISO Media File Format Binding 2.3.1
-      // at https://aomediacodec.github.io/av1-isobmff/#av1c
-      // Only parse the necessary third byte. Assume that the others are valid.
-      const uint8_t* data;
-      AVIFINFO_CHECK(box.content_size >= 3, kInvalid);
-      AVIFINFO_CHECK_FOUND(AvifInfoInternalRead(stream, 3, &data));
-      const int high_bitdepth = (data[2] & 0x40) != 0;
-      const int twelve_bit = (data[2] & 0x20) != 0;
-      const int monochrome = (data[2] & 0x10) != 0;
-      if (twelve_bit) {
-        AVIFINFO_CHECK(high_bitdepth, kInvalid);
-      }
-      if (features->num_chan_props < AVIFINFO_MAX_FEATURES &&
-          box_index <= AVIFINFO_MAX_VALUE) {
-        features->chan_props[features->num_chan_props].property_index =
-            box_index;
-        features->chan_props[features->num_chan_props].bit_depth =
-            high_bitdepth ? twelve_bit ? 12 : 10 : 8;
-        features->chan_props[features->num_chan_props].num_channels =
-            monochrome ? 1 : 3;
-        ++features->num_chan_props;
-      } else {
-        features->data_was_skipped = 1;
-      }
-      AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(stream, box.content_size - 3));
-    } else if (!memcmp(box.type, "auxC", 4)) {
+    } else if (box.type == AVIFINFO_FOURCC('a', 'v', '1', 'C')) {
+      uint8_t bit_depth, num_channels;
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalParseAv1C(
+          stream, box.content_size, &bit_depth, &num_channels));
+      AvifInfoInternalAddChanProp(features, box_index, bit_depth, num_channels);
+    } else if (box.type == AVIFINFO_FOURCC('a', 'u', 'x', 'C')) {
       // See AV1 Image File Format (AVIF) 4
       // at https://aomediacodec.github.io/av1-avif/#auxiliary-images
       const char* kAlphaStr = "urn:mpeg:mpegB:cicp:systems:auxiliary:alpha";
       const uint32_t kAlphaStrLength = 44;  // Includes terminating character.
+#if !defined(AVIFINFO_NO_GAINMAP)
       const char* kGainmapStr = "urn:com:photo:aux:hdrgainmap";
+#endif
       const uint32_t kGainmapStrLength = 29;  // Includes terminating character.
       uint32_t num_read_bytes = 0;
       // Check for a gain map or for an alpha plane. Start with the gain map
@@ -487,16 +1551,19 @@ static AvifInfoInternalStatus ParseIpco(int nesting_level,
             AvifInfoInternalRead(stream, kGainmapStrLength, &data));
         num_read_bytes = kGainmapStrLength;
         const char* const aux_type = (const char*)data;
+#if !defined(AVIFINFO_NO_GAINMAP)
         if (strcmp(aux_type, kGainmapStr) == 0) {
           // Note: It is unlikely but it is possible that this gain map
           // does not belong to the primary item or a tile. Ignore this issue.
-          if (box_index <= AVIFINFO_MAX_VALUE) {
-            features->gainmap_property_index = (uint8_t)box_index;
+          if (box_index <= features->max_value) {
+            features->gainmap_property_index = box_index;
           } else {
-            features->data_was_skipped = 1;
+            AVIFINFO_SKIP_DATA(features, kAvifInfoLimitValue);
           }
-        } else if (box.content_size >= kAlphaStrLength &&
-                   memcmp(aux_type, kAlphaStr, kGainmapStrLength) == 0) {
+        } else
+#endif  // !AVIFINFO_NO_GAINMAP
+        if (box.content_size >= kAlphaStrLength &&
+            memcmp(aux_type, kAlphaStr, kGainmapStrLength) == 0) {
           // The beginning of the aux type matches the alpha aux type string.
           // Check the end as well.
           const uint8_t* data2;
@@ -508,6 +1575,9 @@ static AvifInfoInternalStatus ParseIpco(int nesting_level,
             // Note: It is unlikely but it is possible that this alpha plane
             // does not belong to the primary item or a tile. Ignore this issue.
             features->has_alpha = 1;
+            if (box_index <= features->max_value) {
+              features->alpha_property_index = box_index;
+            }
           }
         }
       }
@@ -529,16 +1599,29 @@ static AvifInfoInternalStatus ParseIprp(int nesting_level,
                                         uint32_t num_remaining_bytes,
                                         uint32_t* num_parsed_boxes,
                                         AvifInfoInternalFeatures* features) {
+  AvifInfoInternalBox box;
+  int resume_box = AvifInfoInternalResume(stream, nesting_level,
+                                          &num_remaining_bytes, /*index=*/NULL,
+                                          /*count=*/NULL, &box) == 2;
   do {
-    AvifInfoInternalBox box;
-    AVIFINFO_CHECK_FOUND(AvifInfoInternalParseBox(
-        nesting_level, stream, num_remaining_bytes, num_parsed_boxes, &box));
+    if (resume_box) {
+      resume_box = 0;
+    } else {
+      AvifInfoInternalSave(stream, nesting_level, num_remaining_bytes,
+                           /*index=*/0, /*count=*/0, *num_parsed_boxes,
+                           features);
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalParseBox(
+          nesting_level, stream, num_remaining_bytes, num_parsed_boxes, &box));
+    }
 
-    if (!memcmp(box.type, "ipco", 4)) {
+    // The properties of a duplicated "ipco" box would be mixed with the ones
+    // of the final features, so it is skipped.
+    if (box.type == AVIFINFO_FOURCC('i', 'p', 'c', 'o') &&
+        !features->has_primary_item_features) {
       AVIFINFO_CHECK_NOT_FOUND(ParseIpco(nesting_level + 1, stream,
                                          box.content_size, num_parsed_boxes,
                                          features));
-    } else if (!memcmp(box.type, "ipma", 4)) {
+    } else if (box.type == AVIFINFO_FOURCC('i', 'p', 'm', 'a')) {
       // See ISO/IEC 23008-12:2017(E) 9.3.2
       uint32_t num_read_bytes = 4;
       const uint8_t* data;
@@ -550,9 +1633,9 @@ static AvifInfoInternalStatus ParseIprp(int nesting_level,
       const uint32_t essential_bit_mask = (box.flags & 1) ? 0x8000 : 0x80;
 
       for (uint32_t entry = 0; entry < entry_count; ++entry) {
-        if (entry >= AVIFINFO_MAX_PROPS ||
-            features->num_props >= AVIFINFO_MAX_PROPS) {
-          features->data_was_skipped = 1;
+        if (entry >= features->max_props ||
+            features->num_props >= features->max_props) {
+          AVIFINFO_SKIP_DATA(features, kAvifInfoLimitProps);
           break;
         }
         num_read_bytes += id_num_bytes + 1;
@@ -566,9 +1649,9 @@ static AvifInfoInternalStatus ParseIprp(int nesting_level,
 
         uint32_t property;
         for (property = 0; property < association_count; ++property) {
-          if (property >= AVIFINFO_MAX_PROPS ||
-              features->num_props >= AVIFINFO_MAX_PROPS) {
-            features->data_was_skipped = 1;
+          if (property >= features->max_props ||
+              features->num_props >= features->max_props) {
+            AVIFINFO_SKIP_DATA(features, kAvifInfoLimitProps);
             break;
           }
           num_read_bytes += index_num_bytes;
@@ -579,15 +1662,7 @@ static AvifInfoInternalStatus ParseIprp(int nesting_level,
               AvifInfoInternalReadBigEndian(data, index_num_bytes);
           // const int essential = (value & essential_bit_mask);  // Unused.
           const uint32_t property_index = (value & ~essential_bit_mask);
-          if (property_index <= AVIFINFO_MAX_VALUE &&
-              item_id <= AVIFINFO_MAX_VALUE) {
-            features->props[features->num_props].property_index =
-                property_index;
-            features->props[features->num_props].item_id = item_id;
-            ++features->num_props;
-          } else {
-            features->data_was_skipped = 1;
-          }
+          AvifInfoInternalAddProp(features, item_id, property_index);
         }
         if (property < association_count) break;  // Do not read garbage.
       }
@@ -618,14 +1693,20 @@ static AvifInfoInternalStatus ParseIref(int nesting_level,
                                         uint32_t num_remaining_bytes,
                                         uint32_t* num_parsed_boxes,
                                         AvifInfoInternalFeatures* features) {
-  features->iref_parsed = 1;
-
+  AvifInfoInternalResume(stream, nesting_level, &num_remaining_bytes,
+                         /*index=*/NULL, /*count=*/NULL, /*box=*/NULL);
   do {
+    AvifInfoInternalSave(stream, nesting_level, num_remaining_bytes,
+                         /*index=*/0, /*count=*/0, *num_parsed_boxes,
+                         features);
     AvifInfoInternalBox box;
     AVIFINFO_CHECK_FOUND(AvifInfoInternalParseBox(
         nesting_level, stream, num_remaining_bytes, num_parsed_boxes, &box));
+    // All references are known once those of the last box are read.
+    const int is_last_box = (box.size == num_remaining_bytes);
+    if (is_last_box) features->iref_parsed_entirely = 1;
 
-    if (!memcmp(box.type, "dimg", 4)) {
+    if (box.type == AVIFINFO_FOURCC('d', 'i', 'm', 'g')) {
       // See ISO/IEC 14496-12:2015(E) 8.11.12.2
       const uint32_t num_bytes_per_id = (box.version == 0) ? 2 : 4;
       uint32_t num_read_bytes = num_bytes_per_id + 2;
@@ -639,8 +1720,8 @@ static AvifInfoInternalStatus ParseIref(int nesting_level,
           AvifInfoInternalReadBigEndian(data + num_bytes_per_id, 2);
 
       for (uint32_t i = 0; i < reference_count; ++i) {
-        if (i >= AVIFINFO_MAX_TILES) {
-          features->data_was_skipped = 1;
+        if (i >= features->max_tiles) {
+          AVIFINFO_SKIP_DATA(features, kAvifInfoLimitTiles);
           break;
         }
         num_read_bytes += num_bytes_per_id;
@@ -649,16 +1730,7 @@ static AvifInfoInternalStatus ParseIref(int nesting_level,
             AvifInfoInternalRead(stream, num_bytes_per_id, &data));
         const uint32_t to_item_id =
             AvifInfoInternalReadBigEndian(data, num_bytes_per_id);
-        if (from_item_id <= AVIFINFO_MAX_VALUE &&
-            to_item_id <= AVIFINFO_MAX_VALUE &&
-            features->num_tiles < AVIFINFO_MAX_TILES) {
-          features->tiles[features->num_tiles].tile_item_id = to_item_id;
-          features->tiles[features->num_tiles].parent_item_id = from_item_id;
-          features->tiles[features->num_tiles].dimg_idx = i;
-          ++features->num_tiles;
-        } else {
-          features->data_was_skipped = 1;
-        }
+        AvifInfoInternalAddTile(features, from_item_id, to_item_id, i);
       }
 
       // If all features are available now, do not look further.
@@ -668,7 +1740,48 @@ static AvifInfoInternalStatus ParseIref(int nesting_level,
       // Mostly if 'data_was_skipped'.
       AVIFINFO_CHECK_FOUND(
           AvifInfoInternalSkip(stream, box.content_size - num_read_bytes));
+    } else if (box.type == AVIFINFO_FOURCC('t', 'h', 'm', 'b') &&
+               features->thumbnail != NULL &&
+               features->thumbnail_item_id == 0) {
+      // See ISO/IEC 23008-12:2017(E) 6.4.6. The thumbnail refers to the items
+      // it is a thumbnail of.
+      const uint32_t num_bytes_per_id = (box.version == 0) ? 2 : 4;
+      uint32_t num_read_bytes = num_bytes_per_id + 2;
+      const uint8_t* data;
+      AVIFINFO_CHECK(box.content_size >= num_read_bytes, kInvalid);
+      AVIFINFO_CHECK_FOUND(
+          AvifInfoInternalRead(stream, num_bytes_per_id + 2, &data));
+      const uint32_t from_item_id =
+          AvifInfoInternalReadBigEndian(data, num_bytes_per_id);
+      const uint32_t reference_count =
+          AvifInfoInternalReadBigEndian(data + num_bytes_per_id, 2);
+
+      for (uint32_t i = 0; i < reference_count; ++i) {
+        num_read_bytes += num_bytes_per_id;
+        AVIFINFO_CHECK(box.content_size >= num_read_bytes, kInvalid);
+        AVIFINFO_CHECK_FOUND(
+            AvifInfoInternalRead(stream, num_bytes_per_id, &data));
+        const uint32_t to_item_id =
+            AvifInfoInternalReadBigEndian(data, num_bytes_per_id);
+        if (!features->has_primary_item ||
+            to_item_id == features->primary_item_id) {
+          features->thumbnail_item_id = from_item_id;
+          features->thumbnail_of_item_id = to_item_id;
+          break;
+        }
+      }
+      if (is_last_box) {
+        AVIFINFO_CHECK_NOT_FOUND(
+            AvifInfoInternalGetPrimaryItemFeatures(features));
+      }
+      AVIFINFO_CHECK_FOUND(
+          AvifInfoInternalSkip(stream, box.content_size - num_read_bytes));
     } else {
+      if (is_last_box) {
+        // The gain map may only be known to be missing now.
+        AVIFINFO_CHECK_NOT_FOUND(
+            AvifInfoInternalGetPrimaryItemFeatures(features));
+      }
       AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(stream, box.content_size));
     }
     num_remaining_bytes -= box.size;
@@ -687,21 +1800,32 @@ static AvifInfoInternalStatus ParseIinf(int nesting_level,
                                         AvifInfoInternalFeatures* features) {
   features->iinf_parsed = 1;
 
-  const uint32_t num_bytes_per_entry_count = box_version == 0 ? 2 : 4;
-  AVIFINFO_CHECK(num_bytes_per_entry_count <= num_remaining_bytes, kInvalid);
-  const uint8_t* data;
-  AVIFINFO_CHECK_FOUND(
-      AvifInfoInternalRead(stream, num_bytes_per_entry_count, &data));
-  num_remaining_bytes -= num_bytes_per_entry_count;
-  const uint32_t entry_count =
-      AvifInfoInternalReadBigEndian(data, num_bytes_per_entry_count);
+  uint32_t i = 0;
+  uint32_t entry_count;
+  if (!AvifInfoInternalResume(stream, nesting_level, &num_remaining_bytes, &i,
+                              &entry_count, /*box=*/NULL)) {
+    const uint32_t num_bytes_per_entry_count = box_version == 0 ? 2 : 4;
+    AVIFINFO_CHECK(num_bytes_per_entry_count <= num_remaining_bytes, kInvalid);
+    const uint8_t* data;
+    AVIFINFO_CHECK_FOUND(
+        AvifInfoInternalRead(stream, num_bytes_per_entry_count, &data));
+    num_remaining_bytes -= num_bytes_per_entry_count;
+    entry_count =
+        AvifInfoInternalReadBigEndian(data, num_bytes_per_entry_count);
+  }
 
-  for (int i = 0; i < entry_count; ++i) {
+  for (; i < entry_count; ++i) {
+    AvifInfoInternalSave(stream, nesting_level, num_remaining_bytes, i,
+                         entry_count, *num_parsed_boxes, features);
     AvifInfoInternalBox box;
     AVIFINFO_CHECK_FOUND(AvifInfoInternalParseBox(
         nesting_level, stream, num_remaining_bytes, num_parsed_boxes, &box));
+    // The "iprp" box may have been parsed already, in which case the features
+    // were only missing the item types. They are complete after the last one.
+    const int is_last_entry =
+        (i + 1 == entry_count || box.size == num_remaining_bytes);
 
-    if (!memcmp(box.type, "infe", 4)) {
+    if (box.type == AVIFINFO_FOURCC('i', 'n', 'f', 'e')) {
       // See ISO/IEC 14496-12:2015(E) 8.11.6.2
       const uint32_t num_bytes_per_id = (box.version == 2) ? 2 : 4;
       const uint8_t* data;
@@ -719,65 +1843,213 @@ static AvifInfoInternalStatus ParseIinf(int nesting_level,
       AVIFINFO_CHECK_FOUND(AvifInfoInternalRead(stream, 4, &item_type));
       if (!memcmp(item_type, "tmap", 4)) {
         // Tone Mapped Image: indicates the presence of a gain map.
-        if (item_id <= AVIFINFO_MAX_VALUE) {
-          features->tone_mapped_item_id = (uint8_t)item_id;
+        if (item_id <= features->max_value) {
+          features->tone_mapped_item_id = item_id;
         } else {
-          features->data_was_skipped = 1;
+          AVIFINFO_SKIP_DATA(features, kAvifInfoLimitValue);
         }
       }
 
+      if (is_last_entry) {
+        AVIFINFO_CHECK_NOT_FOUND(
+            AvifInfoInternalGetPrimaryItemFeatures(features));
+      }
       AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(
           stream, box.content_size - (num_bytes_per_id + 2 + 4)));
     } else {
+      if (is_last_entry) {
+        AVIFINFO_CHECK_NOT_FOUND(
+            AvifInfoInternalGetPrimaryItemFeatures(features));
+      }
       AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(stream, box.content_size));
     }
 
     num_remaining_bytes -= box.size;
     if (num_remaining_bytes == 0) break;  // Ignore entry_count bigger than box.
   }
+  if (entry_count == 0) {
+    AVIFINFO_CHECK_NOT_FOUND(AvifInfoInternalGetPrimaryItemFeatures(features));
+  }
+  // Ignore the boxes past entry_count.
+  AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(stream, num_remaining_bytes));
   AVIFINFO_RETURN(kNotFound);
 }
 
 //------------------------------------------------------------------------------
 
-// Parses a 'stream' of a "meta" box. It looks for the primary item ID in the
-// "pitm" box and recurses into other boxes to find its 'features'.
-static AvifInfoInternalStatus ParseMeta(int nesting_level,
-                                        AvifInfoInternalStream* stream,
+// Reads a big-endian 'value' stored on 'num_bytes' (0, 2, 4 or 8) out of the
+// 'num_remaining_bytes' of a box.
+static AvifInfoInternalStatus AvifInfoInternalReadValue(
+    AvifInfoInternalStream* stream, uint32_t num_bytes,
+    uint32_t* num_remaining_bytes, uint64_t* value) {
+  const uint8_t* data;
+  *value = 0;
+  if (num_bytes == 0) return kFound;
+  AVIFINFO_CHECK(num_bytes <= *num_remaining_bytes, kInvalid);
+  AVIFINFO_CHECK_FOUND(AvifInfoInternalRead(stream, num_bytes, &data));
+  *num_remaining_bytes -= num_bytes;
+  if (num_bytes == 8) {
+    *value = ((uint64_t)AvifInfoInternalReadBigEndian(data, 4) << 32) |
+             AvifInfoInternalReadBigEndian(data + 4, 4);
+  } else {
+    *value = AvifInfoInternalReadBigEndian(data, num_bytes);
+  }
+  return kFound;
+}
+
+// Returns true if 'num_bytes' is a valid size of an "iloc" field.
+static int AvifInfoInternalIsIlocFieldSize(uint32_t num_bytes) {
+  return num_bytes == 0 || num_bytes == 4 || num_bytes == 8;
+}
+
+// Parses a 'stream' of an "iloc" box into 'features'. Its version and flags
+// are read here rather than by AvifInfoInternalParseBox() so that the box is
+// skipped as a whole when the item locations are not requested.
+static AvifInfoInternalStatus ParseIloc(AvifInfoInternalStream* stream,
                                         uint32_t num_remaining_bytes,
-                                        uint32_t* num_parsed_boxes,
                                         AvifInfoInternalFeatures* features) {
+  // See ISO/IEC 14496-12:2015(E) 8.11.3.2
+  uint64_t value;
+  AVIFINFO_CHECK_FOUND(
+      AvifInfoInternalReadValue(stream, 4, &num_remaining_bytes, &value));
+  const uint32_t version = (uint32_t)(value >> 24);
+  if (version <= 2) {
+    AVIFINFO_CHECK_FOUND(
+        AvifInfoInternalReadValue(stream, 2, &num_remaining_bytes, &value));
+    const uint32_t offset_size = (value >> 12) & 0xf;
+    const uint32_t length_size = (value >> 8) & 0xf;
+    const uint32_t base_offset_size = (value >> 4) & 0xf;
+    const uint32_t index_size = (version >= 1) ? (value & 0xf) : 0;
+    AVIFINFO_CHECK(AvifInfoInternalIsIlocFieldSize(offset_size) &&
+                       AvifInfoInternalIsIlocFieldSize(length_size) &&
+                       AvifInfoInternalIsIlocFieldSize(base_offset_size) &&
+                       AvifInfoInternalIsIlocFieldSize(index_size),
+                   kInvalid);
+    const uint32_t id_num_bytes = (version < 2) ? 2 : 4;
+    AVIFINFO_CHECK_FOUND(AvifInfoInternalReadValue(stream, id_num_bytes,
+                                                   &num_remaining_bytes,
+                                                   &value));
+    const uint32_t item_count = (uint32_t)value;
+
+    for (uint32_t item = 0; item < item_count; ++item) {
+      if (features->num_locations >= features->max_locations) {
+        AVIFINFO_SKIP_DATA(features, kAvifInfoLimitLocations);
+        break;
+      }
+      uint64_t item_id, data_reference_index, base_offset, extent_count;
+      uint64_t construction_method = 0;
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalReadValue(
+          stream, id_num_bytes, &num_remaining_bytes, &item_id));
+      if (version >= 1) {
+        AVIFINFO_CHECK_FOUND(AvifInfoInternalReadValue(
+            stream, 2, &num_remaining_bytes, &construction_method));
+        construction_method &= 0xf;
+      }
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalReadValue(
+          stream, 2, &num_remaining_bytes, &data_reference_index));
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalReadValue(
+          stream, base_offset_size, &num_remaining_bytes, &base_offset));
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalReadValue(
+          stream, 2, &num_remaining_bytes, &extent_count));
+
+      // Only payloads stored as a single range of bytes of this file can be
+      // output. A length of 0 means the rest of the file.
+      int is_range = construction_method == 0 && data_reference_index == 0 &&
+                     extent_count > 0 && length_size > 0;
+      uint64_t begin = 0, end = 0;
+      // Do not loop over empty extents.
+      if (index_size + offset_size + length_size == 0) extent_count = 0;
+      for (uint64_t extent = 0; extent < extent_count; ++extent) {
+        uint64_t offset, length;
+        AVIFINFO_CHECK_FOUND(AvifInfoInternalReadValue(
+            stream, index_size, &num_remaining_bytes, &value));
+        AVIFINFO_CHECK_FOUND(AvifInfoInternalReadValue(
+            stream, offset_size, &num_remaining_bytes, &offset));
+        AVIFINFO_CHECK_FOUND(AvifInfoInternalReadValue(
+            stream, length_size, &num_remaining_bytes, &length));
+        if (length == 0 || offset > UINT64_MAX - base_offset ||
+            length > UINT64_MAX - (base_offset + offset) ||
+            (extent > 0 && base_offset + offset != end)) {
+          is_range = 0;
+        } else if (extent == 0) {
+          begin = base_offset + offset;
+          end = begin + length;
+        } else {
+          end += length;
+        }
+      }
+      AvifInfoInternalAddLocation(features, (uint32_t)item_id,
+                                  is_range ? begin : 0,
+                                  is_range ? end - begin : 0);
+    }
+  }
+  // Mostly if 'data_was_skipped' or if the version is unknown.
+  AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(stream, num_remaining_bytes));
+  features->iloc_parsed = 1;
+  AVIFINFO_RETURN(kNotFound);
+}
+
+// Parses a 'stream' of a "meta" box. It looks for the primary item ID in the
+// "pitm" box and recurses into other boxes to find its 'features'.
+static AvifInfoInternalStatus ParseMetaChildren(
+    int nesting_level, AvifInfoInternalStream* stream,
+    uint32_t num_remaining_bytes, uint32_t* num_parsed_boxes,
+    AvifInfoInternalFeatures* features) {
+  AvifInfoInternalBox box;
+  int resume_box = AvifInfoInternalResume(stream, nesting_level,
+                                          &num_remaining_bytes, /*index=*/NULL,
+                                          /*count=*/NULL, &box) == 2;
   do {
-    AvifInfoInternalBox box;
-    AVIFINFO_CHECK_FOUND(AvifInfoInternalParseBox(
-        nesting_level, stream, num_remaining_bytes, num_parsed_boxes, &box));
-    if (!memcmp(box.type, "pitm", 4)) {
+    if (resume_box) {
+      resume_box = 0;
+    } else {
+      AvifInfoInternalSave(stream, nesting_level, num_remaining_bytes,
+                           /*index=*/0, /*count=*/0, *num_parsed_boxes,
+                           features);
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalParseBox(
+          nesting_level, stream, num_remaining_bytes, num_parsed_boxes, &box));
+    }
+    if (box.type == AVIFINFO_FOURCC('p', 'i', 't', 'm')) {
       // See ISO/IEC 14496-12:2015(E) 8.11.4.2
       const uint32_t num_bytes_per_id = (box.version == 0) ? 2 : 4;
       const uint64_t primary_item_id_location = stream->num_read_bytes;
       const uint8_t* data;
-      AVIFINFO_CHECK(num_bytes_per_id <= num_remaining_bytes, kInvalid);
+      AVIFINFO_CHECK(num_bytes_per_id <= box.content_size, kInvalid);
       AVIFINFO_CHECK_FOUND(
           AvifInfoInternalRead(stream, num_bytes_per_id, &data));
       const uint32_t primary_item_id =
           AvifInfoInternalReadBigEndian(data, num_bytes_per_id);
-      AVIFINFO_CHECK(primary_item_id <= AVIFINFO_MAX_VALUE, kAborted);
-      features->has_primary_item = 1;
-      features->primary_item_id = primary_item_id;
-      features->primary_item_features.primary_item_id_location =
-          primary_item_id_location;
-      features->primary_item_features.primary_item_id_bytes = num_bytes_per_id;
+      // A duplicated "pitm" box does not change the final features.
+      if (!features->has_primary_item_features) {
+        AVIFINFO_CHECK(primary_item_id <= features->max_value, kAborted);
+        features->has_primary_item = 1;
+        features->primary_item_id = primary_item_id;
+        features->primary_item_features.primary_item_id_location =
+            primary_item_id_location;
+        features->primary_item_features.primary_item_id_bytes =
+            num_bytes_per_id;
+      }
+
+      // If all requested features are available now, do not look further.
+      AVIFINFO_CHECK_NOT_FOUND(
+          AvifInfoInternalGetPrimaryItemFeatures(features));
+
       AVIFINFO_CHECK_FOUND(
           AvifInfoInternalSkip(stream, box.content_size - num_bytes_per_id));
-    } else if (!memcmp(box.type, "iprp", 4)) {
+    } else if (box.type == AVIFINFO_FOURCC('i', 'p', 'r', 'p')) {
       AVIFINFO_CHECK_NOT_FOUND(ParseIprp(nesting_level + 1, stream,
                                          box.content_size, num_parsed_boxes,
                                          features));
-    } else if (!memcmp(box.type, "iref", 4)) {
+      features->iprp_parsed = 1;
+    } else if (box.type == AVIFINFO_FOURCC('i', 'r', 'e', 'f')) {
       AVIFINFO_CHECK_NOT_FOUND(ParseIref(nesting_level + 1, stream,
                                          box.content_size, num_parsed_boxes,
                                          features));
-    } else if (!memcmp(box.type, "iinf", 4)) {
+      features->iref_parsed_entirely = 1;
+    } else if (box.type == AVIFINFO_FOURCC('i', 'l', 'o', 'c') &&
+               AvifInfoInternalNeedsLocations(features)) {
+      AVIFINFO_CHECK_NOT_FOUND(ParseIloc(stream, box.content_size, features));
+    } else if (box.type == AVIFINFO_FOURCC('i', 'i', 'n', 'f')) {
       AVIFINFO_CHECK_NOT_FOUND(ParseIinf(nesting_level + 1, stream,
                                          box.content_size, box.version,
                                          num_parsed_boxes, features));
@@ -785,11 +2057,269 @@ static AvifInfoInternalStatus ParseMeta(int nesting_level,
       AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(stream, box.content_size));
     }
     num_remaining_bytes -= box.size;
+    // The primary item features are only generated where they would be when
+    // the whole "meta" box is not needed, so that they do not depend on it.
+    if (AvifInfoInternalNeedsWholeMeta(features) &&
+        features->has_primary_item_features) {
+      // The item locations may be complete once any child box is parsed.
+      features->meta_parsed = (num_remaining_bytes == 0);
+      AVIFINFO_CHECK_NOT_FOUND(
+          AvifInfoInternalGetPrimaryItemFeatures(features));
+    }
   } while (num_remaining_bytes != 0);
   // According to ISO/IEC 14496-12:2012(E) 8.11.1.1 there is at most one "meta".
   AVIFINFO_RETURN(features->data_was_skipped ? kAborted : kInvalid);
 }
 
+// Same as ParseMetaChildren(), but the primary item features are returned
+// even if the remainder of the "meta" box, only parsed for the 'extents',
+// 'thumbnail' or 'items', turns out to be invalid. These are then not output
+// and AvifInfoItemExtents::parsed and AvifInfoThumbnail::parsed stay at 0.
+static AvifInfoInternalStatus ParseMeta(int nesting_level,
+                                        AvifInfoInternalStream* stream,
+                                        uint32_t num_remaining_bytes,
+                                        uint32_t* num_parsed_boxes,
+                                        AvifInfoInternalFeatures* features) {
+  const AvifInfoInternalStatus status =
+      ParseMetaChildren(nesting_level, stream, num_remaining_bytes,
+                        num_parsed_boxes, features);
+  return (status == kInvalid && features->has_primary_item_features) ? kFound
+                                                                     : status;
+}
+
+//------------------------------------------------------------------------------
+// Image sequences. Only the sample tables are parsed, not the samples.
+
+typedef struct {
+  uint32_t handler_type;  // Of the "hdlr" box.
+  uint8_t has_av1c;        // True if the first sample entry is "av01".
+  uint8_t has_stsz;        // True if 'features.num_frames' comes from "stsz".
+  AvifInfoTrack features;
+} AvifInfoInternalTrack;
+
+// Reads the version and flags of a full 'box' of a "trak" box. These boxes are
+// not listed in kAvifInfoInternalFullBoxTypes so that they are skipped as
+// regular boxes elsewhere. The 'box' becomes a "skip" box if its version is
+// greater than 'max_version'.
+static AvifInfoInternalStatus AvifInfoInternalParseTrackFullBox(
+    AvifInfoInternalStream* stream, uint8_t max_version,
+    AvifInfoInternalBox* box) {
+  const uint8_t* data;
+  AVIFINFO_CHECK(box->content_size >= 4, kInvalid);
+  AVIFINFO_CHECK_FOUND(AvifInfoInternalRead(stream, 4, &data));
+  box->content_size -= 4;
+  box->version = AvifInfoInternalReadBigEndian(data, 1);
+  box->flags = AvifInfoInternalReadBigEndian(data + 1, 3);
+  if (box->version > max_version) {
+    box->type = AVIFINFO_FOURCC('s', 'k', 'i', 'p');  // FreeSpaceBox
+  }
+  return kFound;
+}
+
+// Parses the first sample entry of a 'stream' of an "stsd" box into 'track'.
+static AvifInfoInternalStatus ParseStsd(int nesting_level,
+                                        AvifInfoInternalStream* stream,
+                                        uint32_t num_remaining_bytes,
+                                        uint32_t* num_parsed_boxes,
+                                        AvifInfoInternalTrack* track) {
+  // See ISO/IEC 14496-12:2015(E) 8.5.2.2
+  const uint8_t* data;
+  AVIFINFO_CHECK(num_remaining_bytes >= 4, kInvalid);
+  AVIFINFO_CHECK_FOUND(AvifInfoInternalRead(stream, 4, &data));
+  num_remaining_bytes -= 4;
+  const uint32_t entry_count = AvifInfoInternalReadBigEndian(data, 4);
+  if (entry_count == 0) {
+    return AvifInfoInternalSkip(stream, num_remaining_bytes);
+  }
+  AvifInfoInternalBox entry;
+  AVIFINFO_CHECK_FOUND(AvifInfoInternalParseBox(
+      nesting_level, stream, num_remaining_bytes, num_parsed_boxes, &entry));
+  num_remaining_bytes -= entry.size;
+  // See ISO/IEC 14496-12:2015(E) 12.1.3.2 and AV1 Codec ISO Media File Format
+  // Binding 2.2.3. The VisualSampleEntry fields are 78 bytes long.
+  if (entry.type != AVIFINFO_FOURCC('a', 'v', '0', '1') ||
+      entry.content_size < 78) {
+    AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(stream, entry.content_size));
+    return AvifInfoInternalSkip(stream, num_remaining_bytes);
+  }
+  AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(stream, 78));
+  uint32_t num_remaining_entry_bytes = entry.content_size - 78;
+  while (num_remaining_entry_bytes != 0) {
+    AvifInfoInternalBox box;
+    AVIFINFO_CHECK_FOUND(AvifInfoInternalParseBox(
+        nesting_level + 1, stream, num_remaining_entry_bytes, num_parsed_boxes,
+        &box));
+    if (box.type == AVIFINFO_FOURCC('a', 'v', '1', 'C') && !track->has_av1c) {
+      uint8_t bit_depth, num_channels;
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalParseAv1C(
+          stream, box.content_size, &bit_depth, &num_channels));
+      track->has_av1c = 1;
+      track->features.bit_depth = bit_depth;
+      track->features.num_channels = num_channels;
+    } else {
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(stream, box.content_size));
+    }
+    num_remaining_entry_bytes -= box.size;
+  }
+  // The other sample entries are ignored.
+  return AvifInfoInternalSkip(stream, num_remaining_bytes);
+}
+
+// Parses a 'stream' of a "trak" box or of one of its "mdia", "minf" or "stbl"
+// descendants into 'track'.
+static AvifInfoInternalStatus ParseTrak(int nesting_level,
+                                        AvifInfoInternalStream* stream,
+                                        uint32_t num_remaining_bytes,
+                                        uint32_t* num_parsed_boxes,
+                                        AvifInfoInternalTrack* track) {
+  while (num_remaining_bytes != 0) {
+    AvifInfoInternalBox box;
+    AVIFINFO_CHECK_FOUND(AvifInfoInternalParseBox(
+        nesting_level, stream, num_remaining_bytes, num_parsed_boxes, &box));
+    if (box.type == AVIFINFO_FOURCC('t', 'k', 'h', 'd') ||
+        box.type == AVIFINFO_FOURCC('m', 'd', 'h', 'd')) {
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalParseTrackFullBox(
+          stream, /*max_version=*/1, &box));
+    } else if (box.type == AVIFINFO_FOURCC('s', 't', 's', 'd') ||
+               box.type == AVIFINFO_FOURCC('s', 't', 't', 's') ||
+               box.type == AVIFINFO_FOURCC('s', 't', 's', 'z')) {
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalParseTrackFullBox(
+          stream, /*max_version=*/0, &box));
+    }
+    const uint8_t* data;
+    // "mdia", "minf" and "stbl" are expected at nesting levels 2, 3 and 4.
+    // Do not recurse any deeper.
+    if (nesting_level <= 4 &&
+        (box.type == AVIFINFO_FOURCC('m', 'd', 'i', 'a') ||
+         box.type == AVIFINFO_FOURCC('m', 'i', 'n', 'f') ||
+         box.type == AVIFINFO_FOURCC('s', 't', 'b', 'l'))) {
+      AVIFINFO_CHECK_FOUND(ParseTrak(nesting_level + 1, stream,
+                                     box.content_size, num_parsed_boxes,
+                                     track));
+    } else if (box.type == AVIFINFO_FOURCC('t', 'k', 'h', 'd')) {
+      // See ISO/IEC 14496-12:2015(E) 8.3.2.2
+      const uint32_t track_id_offset = (box.version == 1) ? 16 : 8;
+      const uint32_t width_offset = (box.version == 1) ? 76 : 72;
+      AVIFINFO_CHECK(box.content_size >= width_offset + 8, kInvalid);
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(stream, track_id_offset));
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalRead(stream, 4, &data));
+      track->features.track_id = AvifInfoInternalReadBigEndian(data, 4);
+      AVIFINFO_CHECK_FOUND(
+          AvifInfoInternalSkip(stream, width_offset - (track_id_offset + 4)));
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalRead(stream, 8, &data));
+      // Fixed-point 16.16 values.
+      track->features.width = AvifInfoInternalReadBigEndian(data, 2);
+      track->features.height = AvifInfoInternalReadBigEndian(data + 4, 2);
+      AVIFINFO_CHECK_FOUND(
+          AvifInfoInternalSkip(stream, box.content_size - (width_offset + 8)));
+    } else if (box.type == AVIFINFO_FOURCC('m', 'd', 'h', 'd')) {
+      // See ISO/IEC 14496-12:2015(E) 8.4.2.2
+      const uint32_t timescale_offset = (box.version == 1) ? 16 : 8;
+      AVIFINFO_CHECK(box.content_size >= timescale_offset + 4, kInvalid);
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(stream, timescale_offset));
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalRead(stream, 4, &data));
+      track->features.timescale = AvifInfoInternalReadBigEndian(data, 4);
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(
+          stream, box.content_size - (timescale_offset + 4)));
+    } else if (box.type == AVIFINFO_FOURCC('h', 'd', 'l', 'r')) {
+      // See ISO/IEC 14496-12:2015(E) 8.4.3.2
+      // Not listed in kAvifInfoInternalFullBoxTypes so that the "hdlr" box of
+      // the "meta" box is skipped as before. Read the version and flags here.
+      AVIFINFO_CHECK(box.content_size >= 12, kInvalid);
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalRead(stream, 12, &data));
+      track->handler_type = AvifInfoInternalReadBigEndian(data + 8, 4);
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(stream, box.content_size - 12));
+    } else if (box.type == AVIFINFO_FOURCC('s', 't', 's', 'd')) {
+      AVIFINFO_CHECK_FOUND(ParseStsd(nesting_level + 1, stream,
+                                     box.content_size, num_parsed_boxes,
+                                     track));
+    } else if (box.type == AVIFINFO_FOURCC('s', 't', 't', 's')) {
+      // See ISO/IEC 14496-12:2015(E) 8.6.1.2.2
+      AVIFINFO_CHECK(box.content_size >= 4, kInvalid);
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalRead(stream, 4, &data));
+      const uint32_t entry_count = AvifInfoInternalReadBigEndian(data, 4);
+      AVIFINFO_CHECK((box.content_size - 4) / 8 >= entry_count, kInvalid);
+      uint64_t num_frames = 0;
+      for (uint32_t i = 0; i < entry_count; ++i) {
+        AVIFINFO_CHECK_FOUND(AvifInfoInternalRead(stream, 8, &data));
+        const uint32_t sample_count = AvifInfoInternalReadBigEndian(data, 4);
+        const uint32_t sample_delta =
+            AvifInfoInternalReadBigEndian(data + 4, 4);
+        num_frames += sample_count;
+        track->features.duration += (uint64_t)sample_count * sample_delta;
+      }
+      AVIFINFO_CHECK(num_frames <= UINT32_MAX, kAborted);
+      if (!track->has_stsz) track->features.num_frames = (uint32_t)num_frames;
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(
+          stream, box.content_size - (4 + entry_count * 8)));
+    } else if (box.type == AVIFINFO_FOURCC('s', 't', 's', 'z')) {
+      // See ISO/IEC 14496-12:2015(E) 8.7.3.2.2
+      AVIFINFO_CHECK(box.content_size >= 8, kInvalid);
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalRead(stream, 8, &data));
+      track->has_stsz = 1;
+      track->features.num_frames = AvifInfoInternalReadBigEndian(data + 4, 4);
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(stream, box.content_size - 8));
+    } else {
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(stream, box.content_size));
+    }
+    num_remaining_bytes -= box.size;
+  }
+  return kFound;
+}
+
+// Parses a 'stream' of a "moov" box. The first "trak" box describing an AV1
+// video track is output into 'features->track'.
+static AvifInfoInternalStatus ParseMoov(int nesting_level,
+                                        AvifInfoInternalStream* stream,
+                                        uint32_t num_remaining_bytes,
+                                        uint32_t* num_parsed_boxes,
+                                        AvifInfoInternalFeatures* features) {
+  while (num_remaining_bytes != 0) {
+    AvifInfoInternalBox box;
+    AVIFINFO_CHECK_FOUND(AvifInfoInternalParseBox(
+        nesting_level, stream, num_remaining_bytes, num_parsed_boxes, &box));
+    num_remaining_bytes -= box.size;
+    if (box.type == AVIFINFO_FOURCC('t', 'r', 'a', 'k')) {
+      AvifInfoInternalTrack track;
+      memset(&track, 0, sizeof(track));
+      AVIFINFO_CHECK_FOUND(ParseTrak(nesting_level + 1, stream,
+                                     box.content_size, num_parsed_boxes,
+                                     &track));
+      // See AV1 Image File Format (AVIF) 7.3.1
+      // at https://aomediacodec.github.io/av1-avif/#image-sequence-brand
+      if ((track.handler_type == AVIFINFO_FOURCC('p', 'i', 'c', 't') ||
+           track.handler_type == AVIFINFO_FOURCC('v', 'i', 'd', 'e')) &&
+          track.has_av1c && track.features.width != 0 &&
+          track.features.height != 0) {
+        features->has_track = 1;
+        features->track = track.features;
+        // Do not look further.
+        return AvifInfoInternalSkip(stream, num_remaining_bytes);
+      }
+    } else {
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(stream, box.content_size));
+    }
+  }
+  return kFound;
+}
+
+// Generates the 'f->primary_item_features' from the 'f->track'.
+static void AvifInfoInternalGetTrackFeatures(AvifInfoInternalFeatures* f) {
+  AvifInfoFeatures* const features = &f->primary_item_features;
+  memset(features, 0, sizeof(*features));
+  if (f->requested_fields & kAvifInfoFieldDimensions) {
+    features->width = f->track.width;
+    features->height = f->track.height;
+  }
+  if (f->requested_fields & kAvifInfoFieldBitDepth) {
+    features->bit_depth = f->track.bit_depth;
+  }
+  if (f->requested_fields & kAvifInfoFieldNumChannels) {
+    features->num_channels = f->track.num_channels;
+  }
+}
+#endif  // !AVIFINFO_IDENTIFY_ONLY
+
 //------------------------------------------------------------------------------
 
 // Parses a file 'stream'. The file type is checked through the "ftyp" box.
@@ -799,7 +2329,7 @@ static AvifInfoInternalStatus ParseFtyp(AvifInfoInternalStream* stream) {
   const int nesting_level = 0;
   AVIFINFO_CHECK_FOUND(AvifInfoInternalParseBox(
       nesting_level, stream, AVIFINFO_MAX_SIZE, &num_parsed_boxes, &box));
-  AVIFINFO_CHECK(!memcmp(box.type, "ftyp", 4), kInvalid);
+  AVIFINFO_CHECK(box.type == AVIFINFO_FOURCC('f', 't', 'y', 'p'), kInvalid);
   // Iterate over brands. See ISO/IEC 14496-12:2012(E) 4.3.1
   AVIFINFO_CHECK(box.content_size >= 8, kInvalid);  // major_brand,minor_version
   for (uint32_t i = 0; i + 4 <= box.content_size; i += 4) {
@@ -816,77 +2346,238 @@ static AvifInfoInternalStatus ParseFtyp(AvifInfoInternalStream* stream) {
   AVIFINFO_RETURN(kInvalid);  // No AVIF brand no good.
 }
 
-// Parses a file 'stream'. 'features' are extracted from the "meta" box.
+#if !defined(AVIFINFO_IDENTIFY_ONLY)
+// Parses a file 'stream'. 'features' are extracted from the "meta" box, or from
+// the "moov" box if requested and if there is no "meta" box before it.
 static AvifInfoInternalStatus ParseFile(AvifInfoInternalStream* stream,
                                         uint32_t* num_parsed_boxes,
                                         AvifInfoInternalFeatures* features) {
+  uint32_t num_remaining_bytes = AVIFINFO_MAX_SIZE;  // Unused.
+  AvifInfoInternalBox box;
+  int resume_box = AvifInfoInternalResume(stream, /*nesting_level=*/0,
+                                          &num_remaining_bytes, /*index=*/NULL,
+                                          /*count=*/NULL, &box) == 2;
   while (1) {
-    AvifInfoInternalBox box;
-    AVIFINFO_CHECK_FOUND(AvifInfoInternalParseBox(
-        /*nesting_level=*/0, stream, AVIFINFO_MAX_SIZE, num_parsed_boxes,
-        &box));
-    if (!memcmp(box.type, "meta", 4)) {
+    if (resume_box) {
+      resume_box = 0;
+    } else {
+      AvifInfoInternalSave(stream, /*nesting_level=*/0, num_remaining_bytes,
+                           /*index=*/0, /*count=*/0, *num_parsed_boxes,
+                           features);
+      const AvifInfoInternalStatus status = AvifInfoInternalParseBox(
+          /*nesting_level=*/0, stream, AVIFINFO_MAX_SIZE, num_parsed_boxes,
+          &box);
+      // The 'stream' cannot tell how many bytes are left, so a missing or
+      // partial top-level box header is the end of the file. There is no
+      // "moov" box after the "meta" box.
+      if (status == kTruncated && features->has_meta_features &&
+          stream->box_end == 0) {
+        return kFound;
+      }
+      AVIFINFO_CHECK_FOUND(status);
+    }
+    if (box.type == AVIFINFO_FOURCC('m', 'e', 't', 'a') &&
+        !features->track_requested) {
       return ParseMeta(/*nesting_level=*/1, stream, box.content_size,
                        num_parsed_boxes, features);
+    } else if (box.type == AVIFINFO_FOURCC('m', 'e', 't', 'a') &&
+               !features->has_meta_features) {
+      // AvifInfoParser does not request the track so this is not resumable.
+      const AvifInfoInternalStatus status = ParseMeta(
+          /*nesting_level=*/1, stream, box.content_size, num_parsed_boxes,
+          features);
+      if (status == kFound) {
+        features->has_meta_features = 1;
+      } else if (status != kInvalid || features->has_primary_item ||
+                 stream->num_read_bytes != stream->meta_end) {
+        AVIFINFO_RETURN(status);
+      }  // Otherwise there is no still image, only maybe an image sequence.
+      // ParseMeta() returns as soon as the features are known. Look for the
+      // track after the "meta" box.
+      AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(
+          stream, (uint32_t)(stream->meta_end - stream->num_read_bytes)));
+    } else if (box.type == AVIFINFO_FOURCC('m', 'o', 'o', 'v') &&
+               features->track_requested) {
+      AVIFINFO_CHECK_FOUND(ParseMoov(/*nesting_level=*/1, stream,
+                                     box.content_size, num_parsed_boxes,
+                                     features));
+      if (features->has_meta_features) return kFound;
+      // Image sequence without any "meta" box before its "moov" box.
+      if (features->has_track) {
+        AvifInfoInternalGetTrackFeatures(features);
+        return kFound;
+      }
+    } else if (box.type == AVIFINFO_FOURCC('m', 'd', 'a', 't') &&
+               features->has_meta_features) {
+      // The "moov" box is expected before the samples, if any.
+      return kFound;
     } else {
       AVIFINFO_CHECK_FOUND(AvifInfoInternalSkip(stream, box.content_size));
     }
   }
 }
 
-//------------------------------------------------------------------------------
-// Helpers for converting the fixed-size input public API to the streamed one.
+// Parses a file 'stream' from its beginning. The file type is checked through
+// the "ftyp" box, then 'features' are extracted from the "meta" box.
+static AvifInfoInternalStatus ParseFtypAndFile(
+    AvifInfoInternalStream* stream, uint32_t* num_parsed_boxes,
+    AvifInfoInternalFeatures* features) {
+  AVIFINFO_CHECK_FOUND(ParseFtyp(stream));
+  return ParseFile(stream, num_parsed_boxes, features);
+}
 
-typedef struct {
-  const uint8_t* data;
-  size_t data_size;
-} AvifInfoInternalForward;
+// Sets the public outputs to 0 before parsing anything.
+static void AvifInfoInternalResetOutputs(const AvifInfoOptions* options,
+                                         AvifInfoFeatures* features) {
+  if (features != NULL) memset(features, 0, sizeof(*features));
+  if (options != NULL && options->stats != NULL) {
+    memset(options->stats, 0, sizeof(*options->stats));
+  }
+  if (options != NULL && options->extents != NULL) {
+    AvifInfoItemExtents* const extents = options->extents;
+    memset(&extents->primary_item, 0, sizeof(extents->primary_item));
+    memset(&extents->alpha_item, 0, sizeof(extents->alpha_item));
+    memset(&extents->gainmap_item, 0, sizeof(extents->gainmap_item));
+    extents->num_tiles = 0;
+    extents->parsed = 0;
+  }
+  if (options != NULL && options->thumbnail != NULL) {
+    memset(options->thumbnail, 0, sizeof(*options->thumbnail));
+  }
+  if (options != NULL && options->items != NULL) {
+    options->items->num_items = 0;
+    options->items->parsed = 0;
+  }
+  if (options != NULL && options->track != NULL) {
+    memset(options->track, 0, sizeof(*options->track));
+  }
+  if (options != NULL && options->budget.exceeded != NULL) {
+    *options->budget.exceeded = kAvifInfoBudgetNone;
+  }
+}
+
+// Same as ParseFtypAndFile() (or ParseFile() if 'parse_ftyp' is 0) but outputs
+// the public 'features' if kAvifInfoOk is returned. They are left untouched
+// otherwise. The 'options->stats' are filled in any case.
+static AvifInfoStatus AvifInfoInternalGetFeatures(
+    AvifInfoInternalStream* stream, int parse_ftyp,
+    const AvifInfoOptions* options, AvifInfoFeatures* features) {
+  uint32_t num_parsed_boxes = 0;
+  AvifInfoInternalTables tables;
+  AvifInfoInternalFeatures internal_features;
+  const AvifInfoInternalStatus init_status =
+      AvifInfoInternalInitFeatures(&internal_features, options, &tables);
+  if (init_status != kFound) return AvifInfoInternalConvertStatus(init_status);
+#if defined(AVIFINFO_ENABLE_STATS)
+  if (options != NULL) stream->stats = options->stats;
+#endif
+  if (options != NULL) {
+    const AvifInfoBudget* const budget = &options->budget;
+    if (budget->max_num_read_bytes != 0 || budget->max_num_skipped_bytes != 0 ||
+        budget->max_num_callbacks != 0 || budget->deadline_reached != NULL) {
+      stream->budget = budget;
+    }
+  }
 
-static const uint8_t* AvifInfoInternalForwardRead(void* stream,
-                                                  size_t num_bytes) {
-  AvifInfoInternalForward* forward = (AvifInfoInternalForward*)stream;
-  if (num_bytes > forward->data_size) return NULL;
-  const uint8_t* data = forward->data;
-  forward->data += num_bytes;
-  forward->data_size -= num_bytes;
-  return data;
+  const AvifInfoInternalStatus status =
+      parse_ftyp
+          ? ParseFtypAndFile(stream, &num_parsed_boxes, &internal_features)
+          : ParseFile(stream, &num_parsed_boxes, &internal_features);
+  if (status == kFound && features != NULL) {
+    memcpy(features, &internal_features.primary_item_features,
+           sizeof(*features));
+  }
+  if (status == kFound && internal_features.has_track) {
+    memcpy(options->track, &internal_features.track, sizeof(*options->track));
+  }
+  AVIFINFO_STATS(stream, {
+    stats->num_parsed_boxes = num_parsed_boxes;
+    stats->features_offset = (status == kFound) ? stream->num_read_bytes : 0;
+    stats->skipped_data_limits = internal_features.skipped_data_limits;
+  });
+  return AvifInfoInternalConvertStatus(status);
 }
 
-static void AvifInfoInternalForwardSkip(void* stream, size_t num_bytes) {
-  AvifInfoInternalForward* forward = (AvifInfoInternalForward*)stream;
-  if (num_bytes > forward->data_size) num_bytes = forward->data_size;
-  forward->data += num_bytes;
-  forward->data_size -= num_bytes;
+size_t AvifInfoGetScratchSize(const AvifInfoOptions* options) {
+  AvifInfoInternalFeatures features;
+  AvifInfoInternalSetLimits(&features, options);
+  return AvifInfoInternalGetScratchSize(&features);
 }
+#endif  // !AVIFINFO_IDENTIFY_ONLY
 
 //------------------------------------------------------------------------------
 // Fixed-size input public API
 
+// The fixed-size input is read straight from memory, without calling any
+// read_stream_t or skip_stream_t function. The behavior is the same.
+
 AvifInfoStatus AvifInfoIdentify(const uint8_t* data, size_t data_size) {
-  AvifInfoInternalForward stream;
-  stream.data = data;
-  stream.data_size = data_size;
-  // Forward null 'data' as a null 'stream' to handle it the same way.
-  return AvifInfoIdentifyStream(
-      (void*)&stream, (data == NULL) ? NULL : AvifInfoInternalForwardRead,
-      AvifInfoInternalForwardSkip);
+  // Same as AvifInfoIdentifyStream() with a null 'read'.
+  if (data == NULL) return kAvifInfoNotEnoughData;
+
+  AvifInfoInternalStream internal_stream;
+  memset(&internal_stream, 0, sizeof(internal_stream));
+  internal_stream.buffer.data = data;
+  internal_stream.buffer.data_size = data_size;
+  return AvifInfoInternalConvertStatus(ParseFtyp(&internal_stream));
 }
 
+#if !defined(AVIFINFO_IDENTIFY_ONLY)
 AvifInfoStatus AvifInfoGetFeatures(const uint8_t* data, size_t data_size,
                                    AvifInfoFeatures* features) {
-  const AvifInfoStatus status = AvifInfoIdentify(data, data_size);
-  if (status != kAvifInfoOk) {
-    if (features != NULL) memset(features, 0, sizeof(*features));
-    return status;
-  }
-  AvifInfoInternalForward stream;
-  stream.data = data;
-  stream.data_size = data_size;
-  return AvifInfoGetFeaturesStream(
-      (void*)&stream, (data == NULL) ? NULL : AvifInfoInternalForwardRead,
-      AvifInfoInternalForwardSkip, features);
+  return AvifInfoGetFeaturesWithOptions(data, data_size, /*options=*/NULL,
+                                        features);
 }
 
+AvifInfoStatus AvifInfoGetFeaturesWithOptions(const uint8_t* data,
+                                              size_t data_size,
+                                              const AvifInfoOptions* options,
+                                              AvifInfoFeatures* features) {
+  AvifInfoInternalResetOutputs(options, features);
+  // Same as AvifInfoIdentifyStream() with a null 'read'.
+  if (data == NULL) return kAvifInfoNotEnoughData;
+
+  AvifInfoInternalStream internal_stream;
+  memset(&internal_stream, 0, sizeof(internal_stream));
+  internal_stream.buffer.data = data;
+  internal_stream.buffer.data_size = data_size;
+  // Equivalent to AvifInfoIdentify() followed by AvifInfoGetFeaturesStream()
+  // on a new stream, but the "ftyp" box is only parsed once.
+  return AvifInfoInternalGetFeatures(&internal_stream, /*parse_ftyp=*/1,
+                                     options, features);
+}
+#endif  // !AVIFINFO_IDENTIFY_ONLY
+
+//------------------------------------------------------------------------------
+// Segmented input API
+
+AvifInfoStatus AvifInfoIdentifyIov(const AvifInfoSegment* segments,
+                                   size_t num_segments) {
+  if (segments == NULL) return kAvifInfoNotEnoughData;
+
+  AvifInfoInternalStream internal_stream;
+  memset(&internal_stream, 0, sizeof(internal_stream));
+  internal_stream.next_buffers = segments;
+  internal_stream.num_next_buffers = num_segments;
+  return AvifInfoInternalConvertStatus(ParseFtyp(&internal_stream));
+}
+
+#if !defined(AVIFINFO_IDENTIFY_ONLY)
+AvifInfoStatus AvifInfoGetFeaturesIov(const AvifInfoSegment* segments,
+                                      size_t num_segments,
+                                      AvifInfoFeatures* features) {
+  if (features != NULL) memset(features, 0, sizeof(*features));
+  if (segments == NULL) return kAvifInfoNotEnoughData;
+
+  AvifInfoInternalStream internal_stream;
+  memset(&internal_stream, 0, sizeof(internal_stream));
+  internal_stream.next_buffers = segments;
+  internal_stream.num_next_buffers = num_segments;
+  return AvifInfoInternalGetFeatures(&internal_stream, /*parse_ftyp=*/1,
+                                     /*options=*/NULL, features);
+}
+#endif  // !AVIFINFO_IDENTIFY_ONLY
+
 //------------------------------------------------------------------------------
 // Streamed input API
 
@@ -895,34 +2586,553 @@ AvifInfoStatus AvifInfoIdentifyStream(void* stream, read_stream_t read,
   if (read == NULL) return kAvifInfoNotEnoughData;
 
   AvifInfoInternalStream internal_stream;
+  memset(&internal_stream, 0, sizeof(internal_stream));
   internal_stream.stream = stream;
   internal_stream.read = read;
   internal_stream.skip = skip;  // Fallbacks to 'read' if null.
-  internal_stream.num_read_bytes = 0;
   return AvifInfoInternalConvertStatus(ParseFtyp(&internal_stream));
 }
 
+#if !defined(AVIFINFO_IDENTIFY_ONLY)
 AvifInfoStatus AvifInfoGetFeaturesStream(void* stream, read_stream_t read,
                                          skip_stream_t skip,
                                          AvifInfoFeatures* features) {
-  if (features != NULL) memset(features, 0, sizeof(*features));
+  return AvifInfoGetFeaturesStreamWithOptions(stream, read, skip,
+                                              /*options=*/NULL, features);
+}
+
+AvifInfoStatus AvifInfoGetFeaturesStreamWithOptions(
+    void* stream, read_stream_t read, skip_stream_t skip,
+    const AvifInfoOptions* options, AvifInfoFeatures* features) {
+  AvifInfoInternalResetOutputs(options, features);
   if (read == NULL) return kAvifInfoNotEnoughData;
 
   AvifInfoInternalStream internal_stream;
+  memset(&internal_stream, 0, sizeof(internal_stream));
   internal_stream.stream = stream;
   internal_stream.read = read;
   internal_stream.skip = skip;  // Fallbacks to 'read' if null.
-  internal_stream.num_read_bytes = 0;
-  uint32_t num_parsed_boxes = 0;
-  AvifInfoInternalFeatures internal_features;
-  memset(&internal_features, AVIFINFO_UNDEFINED, sizeof(internal_features));
-
   // Go through all relevant boxes sequentially.
-  const AvifInfoInternalStatus status =
-      ParseFile(&internal_stream, &num_parsed_boxes, &internal_features);
-  if (status == kFound && features != NULL) {
-    memcpy(features, &internal_features.primary_item_features,
-           sizeof(*features));
+  return AvifInfoInternalGetFeatures(&internal_stream, /*parse_ftyp=*/0,
+                                     options, features);
+}
+#endif  // !AVIFINFO_IDENTIFY_ONLY
+
+//------------------------------------------------------------------------------
+// Batch input API
+
+#if !defined(AVIFINFO_IDENTIFY_ONLY)
+#if defined(__GNUC__) || defined(__clang__)
+#define AVIFINFO_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define AVIFINFO_PREFETCH(address)
+#endif
+
+// Number of inputs fetched ahead of the one being parsed. The "ftyp" and
+// "meta" box headers are usually in the first two cache lines.
+#define AVIFINFO_BATCH_PREFETCH_DISTANCE 4
+
+typedef struct {
+  const uint8_t* const* data;
+  const size_t* sizes;
+  size_t count;
+  AvifInfoFeatures* features;
+  AvifInfoStatus* statuses;
+  const AvifInfoOptions* options;  // Can be null.
+  // Sliced into 'task_scratch_size' bytes per task. Null if there are no
+  // 'options' or no scratch memory.
+  uint8_t* scratch;
+  size_t task_scratch_size;  // 0 if the scratch memory is too small.
+} AvifInfoInternalBatch;
+
+// Returns the number of tasks needed for 'count' inputs.
+static size_t AvifInfoInternalGetNumBatchTasks(size_t count) {
+  return count / AVIFINFO_BATCH_TASK_SIZE +
+         ((count % AVIFINFO_BATCH_TASK_SIZE) != 0 ? 1 : 0);
+}
+
+static void AvifInfoInternalPrefetch(const uint8_t* data, size_t data_size) {
+  if (data == NULL || data_size == 0) return;
+  AVIFINFO_PREFETCH(data);
+  if (data_size > 64) AVIFINFO_PREFETCH(data + 64);
+}
+
+static void AvifInfoInternalRunBatchTask(void* batch, size_t task_index) {
+  const AvifInfoInternalBatch* b = (const AvifInfoInternalBatch*)batch;
+  const size_t begin = task_index * AVIFINFO_BATCH_TASK_SIZE;
+  if (begin >= b->count) return;
+  const size_t end = (b->count - begin > AVIFINFO_BATCH_TASK_SIZE)
+                         ? begin + AVIFINFO_BATCH_TASK_SIZE
+                         : b->count;
+  for (size_t i = begin;
+       i < end && i < begin + AVIFINFO_BATCH_PREFETCH_DISTANCE; ++i) {
+    AvifInfoInternalPrefetch(b->data[i], b->sizes[i]);
   }
-  return AvifInfoInternalConvertStatus(status);
+
+  // Each task has its own slice of the scratch memory.
+  AvifInfoOptions options;
+  const AvifInfoOptions* task_options = b->options;
+  if (b->scratch != NULL) {
+    options = *b->options;
+    options.scratch = b->scratch + task_index * b->task_scratch_size;
+    options.scratch_size = b->task_scratch_size;
+    task_options = &options;
+  }
+
+  for (size_t i = begin; i < end; ++i) {
+    // Hide the memory latency of the next inputs behind the parsing of this
+    // one.
+    if (i + AVIFINFO_BATCH_PREFETCH_DISTANCE < end) {
+      AvifInfoInternalPrefetch(b->data[i + AVIFINFO_BATCH_PREFETCH_DISTANCE],
+                               b->sizes[i + AVIFINFO_BATCH_PREFETCH_DISTANCE]);
+    }
+    AvifInfoFeatures* const features =
+        (b->features != NULL) ? &b->features[i] : NULL;
+    b->statuses[i] = AvifInfoGetFeaturesWithOptions(b->data[i], b->sizes[i],
+                                                    task_options, features);
+  }
+}
+
+size_t AvifInfoGetBatchScratchSize(const AvifInfoOptions* options,
+                                   size_t count) {
+  const size_t task_scratch_size = AvifInfoGetScratchSize(options);
+  const size_t num_tasks = AvifInfoInternalGetNumBatchTasks(count);
+  if (num_tasks > 0 && task_scratch_size > SIZE_MAX / num_tasks) return 0;
+  return task_scratch_size * num_tasks;
+}
+
+size_t AvifInfoGetFeaturesBatch(const uint8_t* const* data,
+                                const size_t* sizes, size_t count,
+                                AvifInfoFeatures* features,
+                                AvifInfoStatus* statuses,
+                                const AvifInfoBatchOptions* batch_options) {
+  if (data == NULL || sizes == NULL || statuses == NULL) return 0;
+
+  AvifInfoOptions options;
+  AvifInfoInternalBatch batch;
+  batch.data = data;
+  batch.sizes = sizes;
+  batch.count = count;
+  batch.features = features;
+  batch.statuses = statuses;
+  batch.options = NULL;
+  batch.scratch = NULL;
+  batch.task_scratch_size = 0;
+  if (batch_options != NULL &&
+      (batch_options->options != NULL || batch_options->scratch != NULL)) {
+    // Only keep the settings. The outputs cannot be shared between inputs.
+    if (batch_options->options != NULL) {
+      options = *batch_options->options;
+    } else {
+      memset(&options, 0, sizeof(options));
+    }
+    options.stats = NULL;
+    options.extents = NULL;
+    options.thumbnail = NULL;
+    options.items = NULL;
+    options.track = NULL;
+    options.budget.exceeded = NULL;
+    options.scratch = NULL;
+    options.scratch_size = 0;
+    batch.options = &options;
+    if (batch_options->scratch != NULL) {
+      batch.scratch = (uint8_t*)batch_options->scratch;
+      // A 'task_scratch_size' of 0 makes every input kAvifInfoTooComplex.
+      const size_t batch_scratch_size =
+          AvifInfoGetBatchScratchSize(&options, count);
+      if (batch_scratch_size != 0 &&
+          batch_options->scratch_size >= batch_scratch_size) {
+        batch.task_scratch_size = AvifInfoGetScratchSize(&options);
+      }
+    }
+  }
+
+  const size_t num_tasks = AvifInfoInternalGetNumBatchTasks(count);
+  if (batch_options != NULL && batch_options->run != NULL && num_tasks > 1) {
+    batch_options->run(batch_options->runner, AvifInfoInternalRunBatchTask,
+                       &batch, num_tasks);
+  } else {
+    for (size_t task_index = 0; task_index < num_tasks; ++task_index) {
+      AvifInfoInternalRunBatchTask(&batch, task_index);
+    }
+  }
+
+  size_t num_ok = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (statuses[i] == kAvifInfoOk) ++num_ok;
+  }
+  return num_ok;
+}
+#endif  // !AVIFINFO_IDENTIFY_ONLY
+
+// Returns a bitmask where the i-th bit is set if the i-th 32-bit word of the
+// 64 'bytes' is the "avif" or "avis" brand.
+static uint32_t AvifInfoInternalFindAvifBrands(const uint8_t bytes[64]) {
+  uint32_t mask = 0;
+#if defined(AVIFINFO_SSE2)
+  // The brands only differ by their last character.
+  const __m128i avif = _mm_set1_epi32((int)0x66697661);  // "avif" as LE
+  const __m128i avis = _mm_set1_epi32((int)0x73697661);  // "avis" as LE
+  for (int i = 0; i < 4; ++i) {
+    const __m128i words = _mm_loadu_si128((const __m128i*)(bytes + i * 16));
+    const __m128i matches = _mm_or_si128(_mm_cmpeq_epi32(words, avif),
+                                         _mm_cmpeq_epi32(words, avis));
+    mask |= (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(matches)) << (i * 4);
+  }
+#elif defined(AVIFINFO_NEON)
+  const uint32x4_t avif = vdupq_n_u32(0x66697661);  // "avif" as LE
+  const uint32x4_t avis = vdupq_n_u32(0x73697661);  // "avis" as LE
+  static const uint32_t kBits[4] = {1, 2, 4, 8};
+  const uint32x4_t bits = vld1q_u32(kBits);
+  for (int i = 0; i < 4; ++i) {
+    const uint32x4_t words = vreinterpretq_u32_u8(vld1q_u8(bytes + i * 16));
+    const uint32x4_t matches =
+        vorrq_u32(vceqq_u32(words, avif), vceqq_u32(words, avis));
+    mask |= vaddvq_u32(vandq_u32(matches, bits)) << (i * 4);
+  }
+#else
+  for (int i = 0; i < 16; ++i) {
+    const uint8_t* const word = bytes + i * 4;
+    if (!memcmp(word, "avif", 4) || !memcmp(word, "avis", 4)) {
+      mask |= 1u << i;
+    }
+  }
+#endif
+  return mask;
+}
+
+// Sets '*status' to what AvifInfoIdentify() would return and returns 1, or
+// returns 0 if the input is not simple enough to decide from its first 64
+// bytes.
+static int AvifInfoInternalQuickIdentify(const uint8_t* data, size_t data_size,
+                                         AvifInfoStatus* status) {
+  if (data == NULL || data_size < 8) {
+    *status = kAvifInfoNotEnoughData;
+    return 1;
+  }
+  const uint32_t box_size = AvifInfoInternalReadBigEndian(data, 4);
+  if (memcmp(data + 4, "ftyp", 4)) {
+    // AvifInfoInternalParseBox() reads more bytes for 64-bit sizes and full
+    // boxes before the type is checked.
+    if (box_size == 1 || AvifInfoInternalFindFullBoxType(
+                             AvifInfoInternalReadBigEndian(data + 4, 4))) {
+      return 0;
+    }
+    *status = kAvifInfoInvalidFile;
+    return 1;
+  }
+  if (box_size == 0 || box_size == 1) return 0;  // Size not in the header.
+  if (box_size < 16) {  // No room for major_brand and minor_version.
+    *status = kAvifInfoInvalidFile;
+    return 1;
+  }
+
+  uint8_t padded_bytes[64];
+  const uint8_t* bytes = data;
+  if (data_size < sizeof(padded_bytes)) {
+    memset(padded_bytes, 0, sizeof(padded_bytes));
+    memcpy(padded_bytes, data, data_size);
+    bytes = padded_bytes;
+  }
+  // Only the whole words of the box that are available are read by
+  // ParseFtyp(). Word 0 is the size, 1 the type, 2 the major_brand, 3 the
+  // minor_version and the compatible_brands follow.
+  const uint32_t num_box_words = box_size / 4;
+  const uint32_t num_available_words =
+      (data_size < 64) ? (uint32_t)data_size / 4 : 16;
+  const uint32_t num_words = (num_box_words < num_available_words)
+                                 ? num_box_words
+                                 : num_available_words;
+  const uint32_t brands = AvifInfoInternalFindAvifBrands(bytes) &
+                          ((1u << num_words) - 1) &
+                          ~((1u << 0) | (1u << 1) | (1u << 3));
+  if (brands != 0) {
+    *status = kAvifInfoOk;
+    return 1;
+  }
+  if (num_box_words <= num_words) {  // All brands were compared.
+    *status = kAvifInfoInvalidFile;
+    return 1;
+  }
+  if (num_available_words < 16) {  // The next brand is missing.
+    *status = kAvifInfoNotEnoughData;
+    return 1;
+  }
+  return 0;  // Long brand list.
+}
+
+size_t AvifInfoIdentifyBatch(const uint8_t* const* data, const size_t* sizes,
+                             size_t count, AvifInfoStatus* statuses) {
+  if (data == NULL || sizes == NULL || statuses == NULL) return 0;
+  size_t num_ok = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (!AvifInfoInternalQuickIdentify(data[i], sizes[i], &statuses[i])) {
+      statuses[i] = AvifInfoIdentify(data[i], sizes[i]);
+    }
+    if (statuses[i] == kAvifInfoOk) ++num_ok;
+  }
+  return num_ok;
+}
+
+//------------------------------------------------------------------------------
+// Windowed input API
+
+AvifInfoStatus AvifInfoIdentifyStreamWindow(void* stream,
+                                            window_stream_t window,
+                                            skip_stream_t skip) {
+  if (window == NULL) return kAvifInfoNotEnoughData;
+
+  AvifInfoInternalStream internal_stream;
+  memset(&internal_stream, 0, sizeof(internal_stream));
+  internal_stream.stream = stream;
+  internal_stream.window = window;
+  internal_stream.skip = skip;  // Fallbacks to 'window' if null.
+  return AvifInfoInternalConvertStatus(ParseFtyp(&internal_stream));
+}
+
+#if !defined(AVIFINFO_IDENTIFY_ONLY)
+AvifInfoStatus AvifInfoGetFeaturesStreamWindow(void* stream,
+                                               window_stream_t window,
+                                               skip_stream_t skip,
+                                               AvifInfoFeatures* features) {
+  if (features != NULL) memset(features, 0, sizeof(*features));
+  if (window == NULL) return kAvifInfoNotEnoughData;
+
+  AvifInfoInternalStream internal_stream;
+  memset(&internal_stream, 0, sizeof(internal_stream));
+  internal_stream.stream = stream;
+  internal_stream.window = window;
+  internal_stream.skip = skip;  // Fallbacks to 'window' if null.
+  return AvifInfoInternalGetFeatures(&internal_stream, /*parse_ftyp=*/1,
+                                     /*options=*/NULL, features);
+}
+#endif  // !AVIFINFO_IDENTIFY_ONLY
+
+//------------------------------------------------------------------------------
+// Random access input API
+
+AvifInfoStatus AvifInfoIdentifyStreamAt(void* stream,
+                                        read_at_stream_t read_at) {
+  if (read_at == NULL) return kAvifInfoNotEnoughData;
+
+  AvifInfoInternalStream internal_stream;
+  memset(&internal_stream, 0, sizeof(internal_stream));
+  internal_stream.stream = stream;
+  internal_stream.read_at = read_at;
+  return AvifInfoInternalConvertStatus(ParseFtyp(&internal_stream));
+}
+
+#if !defined(AVIFINFO_IDENTIFY_ONLY)
+AvifInfoStatus AvifInfoGetFeaturesStreamAt(void* stream,
+                                           read_at_stream_t read_at,
+                                           AvifInfoFeatures* features) {
+  if (features != NULL) memset(features, 0, sizeof(*features));
+  if (read_at == NULL) return kAvifInfoNotEnoughData;
+
+  AvifInfoInternalStream internal_stream;
+  memset(&internal_stream, 0, sizeof(internal_stream));
+  internal_stream.stream = stream;
+  internal_stream.read_at = read_at;
+  return AvifInfoInternalGetFeatures(&internal_stream, /*parse_ftyp=*/1,
+                                     /*options=*/NULL, features);
+}
+#endif  // !AVIFINFO_IDENTIFY_ONLY
+
+#if !defined(AVIFINFO_IDENTIFY_ONLY)
+//------------------------------------------------------------------------------
+// Push-based input API
+
+struct AvifInfoParser {
+  AvifInfoInternalCheckpoint checkpoint;  // Where to resume the parsing.
+  AvifInfoInternalTables tables;  // Referenced by 'checkpoint.features'.
+  AvifInfoStatus status;  // Final once it is not kAvifInfoNotEnoughData.
+  AvifInfoFeatures features;  // Set once 'status' is kAvifInfoOk.
+  uint64_t num_fed_bytes;     // Sum of the sizes of all fed chunks.
+  AvifInfoDataSizeHint hint;  // Set if 'status' is kAvifInfoNotEnoughData.
+  // Fed bytes located after 'checkpoint.num_read_bytes', kept for next time.
+  uint8_t* kept_bytes;
+  size_t num_kept_bytes, kept_bytes_capacity;
+};
+
+AvifInfoParser* AvifInfoParserCreate(void) {
+  AvifInfoParser* const parser = (AvifInfoParser*)malloc(sizeof(*parser));
+  if (parser == NULL) return NULL;
+  memset(parser, 0, sizeof(*parser));
+  parser->checkpoint.nesting_level = -1;  // Start with the "ftyp" box.
+  AvifInfoInternalInitFeatures(&parser->checkpoint.features,
+                               /*options=*/NULL, &parser->tables);
+  parser->status = kAvifInfoNotEnoughData;
+  return parser;
+}
+
+void AvifInfoParserDestroy(AvifInfoParser* parser) {
+  if (parser == NULL) return;
+  free(parser->kept_bytes);
+  free(parser);
+}
+
+// Keeps the fed bytes that were not consumed since the last checkpoint, out of
+// the 'num_kept_bytes' previously kept bytes followed by the 'data'.
+static AvifInfoStatus AvifInfoInternalKeepBytes(AvifInfoParser* parser,
+                                                const uint8_t* data,
+                                                size_t data_size) {
+  // The kept bytes start at 'first_kept_byte' and end at 'num_fed_bytes'.
+  const uint64_t first_kept_byte =
+      parser->num_fed_bytes - parser->num_kept_bytes;
+  const uint64_t first_byte_to_keep = parser->checkpoint.num_read_bytes;
+  const uint64_t num_fed_bytes = parser->num_fed_bytes + data_size;
+  if (first_byte_to_keep >= num_fed_bytes) {
+    parser->num_kept_bytes = 0;
+    parser->num_fed_bytes = num_fed_bytes;
+    return kAvifInfoNotEnoughData;
+  }
+  const size_t num_bytes_to_keep = (size_t)(num_fed_bytes - first_byte_to_keep);
+  if (num_bytes_to_keep > parser->kept_bytes_capacity) {
+    size_t capacity = 2 * parser->kept_bytes_capacity;
+    if (capacity < num_bytes_to_keep) capacity = num_bytes_to_keep;
+    uint8_t* const kept_bytes = (uint8_t*)realloc(parser->kept_bytes, capacity);
+    if (kept_bytes == NULL) return kAvifInfoTooComplex;
+    parser->kept_bytes = kept_bytes;
+    parser->kept_bytes_capacity = capacity;
+  }
+  size_t num_already_kept_bytes = 0;
+  if (first_byte_to_keep < parser->num_fed_bytes) {
+    // Some previously kept bytes are still needed. Move them to the front.
+    num_already_kept_bytes =
+        (size_t)(parser->num_fed_bytes - first_byte_to_keep);
+    memmove(parser->kept_bytes,
+            parser->kept_bytes + (first_byte_to_keep - first_kept_byte),
+            num_already_kept_bytes);
+  }
+  // 'data' may be null if no byte of it is kept.
+  const size_t num_new_kept_bytes = num_bytes_to_keep - num_already_kept_bytes;
+  if (num_new_kept_bytes != 0) {
+    memcpy(parser->kept_bytes + num_already_kept_bytes,
+           data + (data_size - num_new_kept_bytes), num_new_kept_bytes);
+  }
+  parser->num_kept_bytes = num_bytes_to_keep;
+  parser->num_fed_bytes = num_fed_bytes;
+  return kAvifInfoNotEnoughData;
+}
+
+AvifInfoStatus AvifInfoParserFeed(AvifInfoParser* parser, const uint8_t* data,
+                                  size_t data_size) {
+  if (parser == NULL) return kAvifInfoNotEnoughData;
+  if (parser->status != kAvifInfoNotEnoughData) return parser->status;
+  if (data == NULL) data_size = 0;
+
+  AvifInfoInternalBuffer next_buffer = {data, data_size};
+  AvifInfoInternalStream stream;
+  memset(&stream, 0, sizeof(stream));
+  stream.num_read_bytes = parser->checkpoint.num_read_bytes;
+  if (stream.num_read_bytes >= parser->num_fed_bytes) {
+    // Drop the bytes that were skipped before being fed.
+    const uint64_t num_skipped_bytes =
+        stream.num_read_bytes - parser->num_fed_bytes;
+    if (num_skipped_bytes > 0 && num_skipped_bytes >= data_size) {
+      parser->num_fed_bytes += data_size;
+      return kAvifInfoNotEnoughData;
+    }
+    stream.buffer.data = data + num_skipped_bytes;
+    stream.buffer.data_size = data_size - (size_t)num_skipped_bytes;
+  } else {
+    stream.buffer.data = parser->kept_bytes;
+    stream.buffer.data_size = parser->num_kept_bytes;
+    stream.next_buffers = &next_buffer;
+    stream.num_next_buffers = 1;
+  }
+  stream.checkpoint = &parser->checkpoint;
+  stream.meta_end = parser->hint.meta_data_size;
+
+  AvifInfoInternalCheckpoint* const checkpoint = &parser->checkpoint;
+  AvifInfoInternalFeatures features;
+  memcpy(&features, &checkpoint->features, sizeof(features));
+  uint32_t num_parsed_boxes = checkpoint->num_parsed_boxes;
+  AvifInfoInternalStatus status;
+  if (checkpoint->nesting_level < 0) {
+    status = ParseFtypAndFile(&stream, &num_parsed_boxes, &features);
+  } else {
+    checkpoint->is_resuming = 1;
+    status = ParseFile(&stream, &num_parsed_boxes, &features);
+    checkpoint->is_resuming = 0;
+  }
+
+  if (status == kTruncated || status == kNotFound) {
+    if (status == kTruncated) {
+      parser->hint.min_data_size = stream.num_needed_bytes;
+    }
+    parser->hint.meta_data_size = stream.meta_end;
+    parser->status = AvifInfoInternalKeepBytes(parser, data, data_size);
+    if (parser->status == kAvifInfoNotEnoughData) return parser->status;
+    status = kAborted;  // Out of memory.
+  }
+  parser->status = AvifInfoInternalConvertStatus(status);
+  memset(&parser->hint, 0, sizeof(parser->hint));
+  if (status == kFound) {
+    memcpy(&parser->features, &features.primary_item_features,
+           sizeof(parser->features));
+  }
+  free(parser->kept_bytes);
+  parser->kept_bytes = NULL;
+  parser->num_kept_bytes = parser->kept_bytes_capacity = 0;
+  parser->num_fed_bytes += data_size;
+  return parser->status;
+}
+
+AvifInfoStatus AvifInfoParserGetFeatures(const AvifInfoParser* parser,
+                                         AvifInfoFeatures* features) {
+  if (features != NULL) memset(features, 0, sizeof(*features));
+  if (parser == NULL) return kAvifInfoNotEnoughData;
+  if (parser->status == kAvifInfoOk && features != NULL) {
+    memcpy(features, &parser->features, sizeof(*features));
+  }
+  return parser->status;
+}
+
+AvifInfoStatus AvifInfoParserGetDataSizeHint(const AvifInfoParser* parser,
+                                             AvifInfoDataSizeHint* hint) {
+  if (hint != NULL) memset(hint, 0, sizeof(*hint));
+  if (parser == NULL) return kAvifInfoNotEnoughData;
+  if (hint != NULL) memcpy(hint, &parser->hint, sizeof(*hint));
+  return parser->status;
+}
+
+AvifInfoStatus AvifInfoParserFeedAt(AvifInfoParser* parser, uint64_t offset,
+                                    const uint8_t* data, size_t data_size) {
+  if (parser == NULL) return kAvifInfoNotEnoughData;
+  if (parser->status != kAvifInfoNotEnoughData) return parser->status;
+  if (data == NULL) data_size = 0;
+  if (offset < parser->num_fed_bytes) {
+    // Ignore the bytes that were already fed.
+    if (parser->num_fed_bytes - offset >= data_size) return parser->status;
+    data += parser->num_fed_bytes - offset;
+    data_size -= (size_t)(parser->num_fed_bytes - offset);
+  } else if (offset > parser->num_fed_bytes) {
+    // The missing bytes must be skipped by the parser, so there is no byte
+    // kept from previous feeds.
+    if (offset > parser->checkpoint.num_read_bytes) return parser->status;
+    parser->num_fed_bytes = offset;
+  }
+  return AvifInfoParserFeed(parser, data, data_size);
+}
+
+AvifInfoStatus AvifInfoParserGetNextRange(const AvifInfoParser* parser,
+                                          uint64_t* offset, uint64_t* size) {
+  if (offset != NULL) *offset = 0;
+  if (size != NULL) *size = 0;
+  if (parser == NULL) return kAvifInfoNotEnoughData;
+  if (parser->status != kAvifInfoNotEnoughData) return parser->status;
+
+  // The bytes between what was fed and where the parsing resumes are skipped.
+  uint64_t next_offset = parser->num_fed_bytes;
+  if (parser->checkpoint.num_read_bytes > next_offset) {
+    next_offset = parser->checkpoint.num_read_bytes;
+  }
+  uint64_t end = parser->hint.min_data_size;
+  if (parser->hint.meta_data_size > end) end = parser->hint.meta_data_size;
+  if (end <= next_offset) end = next_offset + 8;  // In case nothing was fed.
+  if (offset != NULL) *offset = next_offset;
+  if (size != NULL) *size = end - next_offset;
+  return parser->status;
 }
+#endif  // !AVIFINFO_IDENTIFY_ONLY
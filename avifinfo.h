@@ -39,7 +39,9 @@ typedef struct {
   uint32_t bit_depth;       // Likely 8, 10 or 12 bits per channel per pixel.
   uint32_t num_channels;    // Likely 1, 2, 3 or 4 channels:
                             //   (1 monochrome or 3 colors) + (0 or 1 alpha)
-  uint8_t has_gainmap;      // True if a gain map was found.
+  // True if a gain map was found. Never set if the library was compiled with
+  // AVIFINFO_NO_GAINMAP defined.
+  uint8_t has_gainmap;
   // Id of the gain map item. Assumes there is at most one. If there are several
   // gain map items (e.g. because the main image is tiled and each tile has an
   // independent gain map), then this is one of the ids, arbitrarily chosen.
@@ -71,9 +73,33 @@ AvifInfoStatus AvifInfoIdentify(const uint8_t* data, size_t data_size);
 // AvifInfoGetFeatures() parses the file further than AvifInfoIdentify() so it
 // is possible that AvifInfoGetFeatures() returns errors while
 // AvifInfoIdentify() returns kAvifInfoOk on the same given input bytes.
+// If the library was compiled with AVIFINFO_IDENTIFY_ONLY defined, only the
+// AvifInfoIdentify*() functions are available, not this one nor any other.
 AvifInfoStatus AvifInfoGetFeatures(const uint8_t* data, size_t data_size,
                                    AvifInfoFeatures* features);
 
+//------------------------------------------------------------------------------
+// Segmented input API
+// Use this API if the input bytes are available as a chain of non-contiguous
+// segments, such as network buffers. Bytes are only copied for fields
+// spanning over several segments.
+
+// Contiguous input bytes. Same layout as struct iovec on most platforms.
+typedef struct {
+  const uint8_t* data;  // Can only be null if 'data_size' is 0.
+  size_t data_size;
+} AvifInfoSegment;
+
+// Same as AvifInfoIdentify() and AvifInfoGetFeatures() but the input is the
+// concatenation of the 'num_segments' 'segments'. Any location-dependent
+// feature such as 'primary_item_id_location' is relative to the beginning of
+// the first segment.
+AvifInfoStatus AvifInfoIdentifyIov(const AvifInfoSegment* segments,
+                                   size_t num_segments);
+AvifInfoStatus AvifInfoGetFeaturesIov(const AvifInfoSegment* segments,
+                                      size_t num_segments,
+                                      AvifInfoFeatures* features);
+
 //------------------------------------------------------------------------------
 // Streamed input API
 // Use this API if the input bytes must be fetched and/or if the AVIF payload
@@ -109,6 +135,419 @@ AvifInfoStatus AvifInfoGetFeaturesStream(void* stream, read_stream_t read,
                                          skip_stream_t skip,
                                          AvifInfoFeatures* features);
 
+//------------------------------------------------------------------------------
+// Options
+// Use these to tune the behavior of the AvifInfo*WithOptions() functions.
+
+// Fields of AvifInfoFeatures that can be requested.
+typedef enum {
+  kAvifInfoFieldDimensions = 1 << 0,   // 'width' and 'height'.
+  kAvifInfoFieldBitDepth = 1 << 1,     // 'bit_depth'.
+  kAvifInfoFieldNumChannels = 1 << 2,  // 'num_channels'.
+  kAvifInfoFieldGainmap = 1 << 3,      // 'has_gainmap' and 'gainmap_item_id'.
+  kAvifInfoFieldPrimaryItemIdLocation = 1 << 4,  // 'primary_item_id_location'
+                                                 // and 'primary_item_id_bytes'.
+  kAvifInfoFieldAll = (1 << 5) - 1,
+} AvifInfoField;
+
+// Internal limits that can cause some input data to be ignored.
+typedef enum {
+  kAvifInfoLimitTiles = 1 << 0,     // Too many "dimg" references.
+  kAvifInfoLimitProps = 1 << 1,     // Too many "ipma" associations.
+  kAvifInfoLimitFeatures = 1 << 2,  // Too many "ispe", "pixi" or "av1C".
+  kAvifInfoLimitValue = 1 << 3,     // Item id or property index too big.
+  kAvifInfoLimitLocations = 1 << 4,  // Too many "iloc" items.
+} AvifInfoLimit;
+
+// Statistics about a parsing. Only filled if the library was compiled with
+// AVIFINFO_ENABLE_STATS defined. Set to 0 otherwise.
+typedef struct {
+  // Calls to read_stream_t, window_stream_t or read_at_stream_t, and to
+  // skip_stream_t.
+  uint32_t num_read_calls, num_skip_calls;
+  // Bytes that were read (the skipped bytes are read instead if there is no
+  // skip_stream_t), or skipped.
+  uint64_t num_read_bytes, num_skipped_bytes;
+  // Number of parsed boxes, "ftyp" excluded. The parsing is aborted if it
+  // reaches 4096 boxes.
+  uint32_t num_parsed_boxes;
+  // Deepest box level reached. Top-level boxes such as "meta" are at level 0.
+  uint32_t max_nesting_level;
+  // Number of bytes read or skipped at the time the features were known, or
+  // 0 if they were not found.
+  uint64_t features_offset;
+  // Bitwise combination of AvifInfoLimit values that caused some data to be
+  // ignored. Such data may lead to kAvifInfoTooComplex.
+  uint32_t skipped_data_limits;
+} AvifInfoParseStats;
+
+// Location of the payload of an item in the file, as stored in the "iloc" box.
+typedef struct {
+  uint64_t offset;  // In bytes, from the beginning of the file.
+  uint64_t size;    // In bytes. 0 if unknown.
+} AvifInfoExtent;
+
+// Payload locations of the items needed to decode the primary item. Each
+// extent is left at 0 if the item does not exist or if its payload is not a
+// single range of bytes of the file (for example if it is stored in the "idat"
+// box, in another file, or in several non-contiguous extents).
+typedef struct {
+  AvifInfoExtent primary_item;
+  AvifInfoExtent alpha_item;    // The first alpha auxiliary item, if any.
+  AvifInfoExtent gainmap_item;  // Only set if kAvifInfoFieldGainmap is set.
+  // Set by the caller to an array of 'max_num_tiles' elements, or null.
+  AvifInfoExtent* tiles;
+  uint32_t max_num_tiles;
+  // Number of tiles of the primary item, in "dimg" order. Only the first
+  // 'max_num_tiles' are output into 'tiles'.
+  uint32_t num_tiles;
+  // 1 if the boxes needed for the extents were parsed, so that an extent left
+  // at 0 means that the payload is not a single range of bytes. 0 if
+  // kAvifInfoOk was returned with the extents unknown, because these boxes
+  // are invalid or because some of their data was skipped (see
+  // AvifInfoParseStats::skipped_data_limits). See AvifInfoOptions::extents.
+  uint8_t parsed;
+} AvifInfoItemExtents;
+
+// Thumbnail of the primary item, referenced by a "thmb" item reference.
+typedef struct {
+  uint32_t item_id;        // 0 if there is no thumbnail.
+  uint32_t width, height;  // Of its "ispe" property. 0 if unknown.
+  AvifInfoExtent extent;   // See AvifInfoItemExtents.
+  // 1 if the boxes needed for the thumbnail were parsed, so that an 'item_id'
+  // of 0 means that there is no thumbnail. See AvifInfoItemExtents::parsed.
+  uint8_t parsed;
+} AvifInfoThumbnail;
+
+// Roles of an image item. An item can have several roles, or none.
+// kAvifInfoItemGainmap is never set if the library was compiled with
+// AVIFINFO_NO_GAINMAP defined.
+typedef enum {
+  kAvifInfoItemPrimary = 1 << 0,  // Referenced by the "pitm" box.
+  kAvifInfoItemAlpha = 1 << 1,    // Alpha auxiliary image of another item.
+  kAvifInfoItemGainmap = 1 << 2,  // Only set if kAvifInfoFieldGainmap is set.
+  kAvifInfoItemTile = 1 << 3,     // Input of a derived image ("dimg").
+  kAvifInfoItemTmap = 1 << 4,     // Tone mapped derived image.
+} AvifInfoItemRole;
+
+// Features of an image item, as given by its own properties. For example the
+// 'num_channels' of the primary item do not include its alpha item here.
+typedef struct {
+  uint32_t item_id;
+  uint32_t roles;          // Bitwise combination of AvifInfoItemRole values.
+  uint32_t width, height;  // Of its "ispe" property. 0 if unknown.
+  // Of its "pixi" or "av1C" property, or of its first tile. 0 if unknown.
+  uint32_t bit_depth, num_channels;
+} AvifInfoItem;
+
+// Image items that are associated with properties in the "ipma" box, in that
+// order (usually by increasing item id).
+typedef struct {
+  // Set by the caller to an array of 'max_num_items' elements, or null.
+  AvifInfoItem* items;
+  uint32_t max_num_items;
+  // Number of items. Only the first 'max_num_items' are output into 'items'.
+  uint32_t num_items;
+  // 1 if the boxes needed for the items were parsed. 0 if kAvifInfoOk was
+  // returned with the items unknown, for the same reasons as
+  // AvifInfoItemExtents::parsed.
+  uint8_t parsed;
+} AvifInfoItems;
+
+// First AV1 video track of an image sequence ("avis" brand), as described in
+// the "moov" box. The samples in the "mdat" box are not accessed.
+typedef struct {
+  uint32_t track_id;       // 0 if there is no such track.
+  uint32_t width, height;  // Of its "tkhd" box, rounded down. In pixels.
+  uint32_t bit_depth;      // Of its "av1C" box. Likely 8, 10 or 12.
+  uint32_t num_channels;   // Of its "av1C" box. 1 or 3. Alpha is not included.
+  uint32_t num_frames;     // Number of samples in its "stsz" or "stts" box.
+  uint32_t timescale;      // Of its "mdhd" box. In units per second.
+  uint64_t duration;       // Sum of the "stts" sample durations, in timescale.
+} AvifInfoTrack;
+
+// Budget of a parsing that caused it to be stopped.
+typedef enum {
+  kAvifInfoBudgetNone = 0,
+  kAvifInfoBudgetReadBytes,     // 'max_num_read_bytes' was exceeded.
+  kAvifInfoBudgetSkippedBytes,  // 'max_num_skipped_bytes' was exceeded.
+  kAvifInfoBudgetCallbacks,     // 'max_num_callbacks' was exceeded.
+  kAvifInfoBudgetDeadline,      // 'deadline_reached' returned non-zero.
+} AvifInfoBudgetReason;
+
+// Upper bounds on the work done by a parsing, to bound its latency on hostile
+// or slow inputs. kAvifInfoTooComplex is returned as soon as one is exceeded.
+// 0 or null means no limit.
+typedef struct {
+  // Bytes read, including those read instead of skipped if there is no
+  // skip_stream_t, and those read straight from memory.
+  uint64_t max_num_read_bytes;
+  // Bytes skipped, whether a skip_stream_t is called or not.
+  uint64_t max_num_skipped_bytes;
+  // Calls to read_stream_t or skip_stream_t.
+  uint32_t max_num_callbacks;
+  // Called before each box and each read_stream_t or skip_stream_t call with
+  // the 'deadline' as argument. The parsing stops as soon as it returns
+  // non-zero, for example once a monotonic clock passed a deadline.
+  int (*deadline_reached)(void* deadline);
+  void* deadline;
+  // If not null, set to the exceeded budget, or to kAvifInfoBudgetNone.
+  AvifInfoBudgetReason* exceeded;
+} AvifInfoBudget;
+
+// A zero-initialized AvifInfoOptions means the default behavior.
+typedef struct {
+  // Bitwise combination of AvifInfoField values. The parsing stops as soon as
+  // these fields are known, so fewer input bytes may be needed. The fields
+  // that are not requested are set to 0. 0 means kAvifInfoFieldAll.
+  uint32_t requested_fields;
+  // If not null, filled with the statistics of the parsing.
+  AvifInfoParseStats* stats;
+  // If not null, the "iloc" box is also parsed and the payload locations are
+  // output into 'extents' if kAvifInfoOk is returned. More bytes may be needed
+  // because the whole "iloc", "iprp" and "iref" boxes must be parsed. The
+  // returned features and status are the same as with a null 'extents': if
+  // the boxes parsed only for 'extents' are invalid or if some of their data
+  // was skipped, kAvifInfoOk is returned with 'extents->parsed' set to 0 and
+  // every extent left at 0.
+  AvifInfoItemExtents* extents;
+  // If not null, filled with the first thumbnail of the primary item if
+  // kAvifInfoOk is returned. Same constraints as 'extents', including the
+  // meaning of 'thumbnail->parsed'.
+  AvifInfoThumbnail* thumbnail;
+  // If not null, filled with the features of all image items if kAvifInfoOk
+  // is returned. More bytes may be needed because the whole "iinf", "iprp" and
+  // "iref" boxes must be parsed. The returned features and kAvifInfoOk or
+  // kAvifInfoInvalidFile status are the same as with a null 'items', so no
+  // item is listed ('items->parsed' is 0) if the boxes parsed only for 'items'
+  // are invalid or if some of their data was skipped.
+  AvifInfoItems* items;
+  // If not null, the top-level "moov" box is also parsed and its first AV1
+  // video track is output into 'track' if kAvifInfoOk is returned. The parsing
+  // then goes on after the "meta" box until the "moov" or "mdat" box, or until
+  // the end of the data ('track->track_id' is then 0). If there is no "meta"
+  // box before the "moov" box, the features are those of 'track'.
+  AvifInfoTrack* track;
+  // See AvifInfoBudget.
+  AvifInfoBudget budget;
+
+  // By default, at most 16 tiles, 32 item-property associations, 8 "ispe",
+  // "pixi" or "av1C" properties and 32 "iloc" items are stored, and item ids
+  // and property indices above 255 are ignored. Such skipped data may lead to
+  // kAvifInfoTooComplex. The first four defaults can be changed by compiling
+  // the library with AVIFINFO_MAX_TILES, AVIFINFO_MAX_PROPS,
+  // AVIFINFO_MAX_FEATURES and AVIFINFO_MAX_LOCATIONS defined, for example to
+  // use less stack memory. These limits can be raised by providing at least
+  // AvifInfoGetScratchSize() bytes of 'scratch' memory, used instead of the
+  // stack. The associations are then indexed by item id and property index, so
+  // that the parsing does not get slower as more tiles and properties are
+  // stored.
+  // kAvifInfoTooComplex is returned if 'scratch_size' is too small.
+  // The limits are ignored if 'scratch' is null. 0 means the default limit.
+  void* scratch;
+  size_t scratch_size;
+  uint32_t max_item_id;  // Also the maximum property index.
+  uint32_t max_tiles, max_props, max_features, max_locations;
+} AvifInfoOptions;
+
+// Returns the minimum 'scratch_size' for the limits in 'options', or 0 if they
+// are too high. 'options' can be null.
+size_t AvifInfoGetScratchSize(const AvifInfoOptions* options);
+
+// Same as AvifInfoGetFeatures() and AvifInfoGetFeaturesStream() but with
+// 'options'. 'options' can be null for the default behavior.
+AvifInfoStatus AvifInfoGetFeaturesWithOptions(const uint8_t* data,
+                                              size_t data_size,
+                                              const AvifInfoOptions* options,
+                                              AvifInfoFeatures* features);
+AvifInfoStatus AvifInfoGetFeaturesStreamWithOptions(
+    void* stream, read_stream_t read, skip_stream_t skip,
+    const AvifInfoOptions* options, AvifInfoFeatures* features);
+
+//------------------------------------------------------------------------------
+// Batch input API
+// Use this API to parse many small inputs at once, such as the first bytes of
+// thousands of files. The next inputs are prefetched while each one is parsed,
+// and they can be spread over several threads.
+
+// Maximum number of inputs parsed by each AvifInfoBatchTask.
+#define AVIFINFO_BATCH_TASK_SIZE 64
+
+// Parses the inputs of the task at 'task_index' in the 'batch'.
+typedef void (*AvifInfoBatchTask)(void* batch, size_t task_index);
+// Calls 'task(batch, i)' once for each 'i' in [0, num_tasks), in any order and
+// possibly concurrently, and returns once all these calls returned. For
+// example the tasks can be posted to a thread pool identified by 'runner'.
+typedef void (*AvifInfoBatchRunner)(void* runner, AvifInfoBatchTask task,
+                                    void* batch, size_t num_tasks);
+
+// A zero-initialized AvifInfoBatchOptions means the default behavior.
+typedef struct {
+  // Applied to each input. Can be null. Its outputs (such as 'stats',
+  // 'extents' or 'budget.exceeded') would be shared by all inputs so they are
+  // ignored. Its 'scratch' memory is not accessed either, see below. The
+  // 'budget' applies to each input separately.
+  const AvifInfoOptions* options;
+  // If not null, the tasks are given to 'run' with 'runner' as first argument.
+  // Otherwise they are run in order on the calling thread.
+  AvifInfoBatchRunner run;
+  void* runner;
+  // Memory used instead of 'options->scratch', which cannot be shared between
+  // concurrent tasks. Each task uses its own slice of AvifInfoGetScratchSize()
+  // bytes, so at least AvifInfoGetBatchScratchSize() bytes are needed.
+  // kAvifInfoTooComplex is output for every input if 'scratch_size' is too
+  // small. The limits in 'options' are ignored if 'scratch' is null.
+  void* scratch;
+  size_t scratch_size;
+} AvifInfoBatchOptions;
+
+// Returns the minimum 'scratch_size' of AvifInfoBatchOptions for 'count' inputs
+// with the limits in 'options', or 0 if they are too high. 'options' can be
+// null.
+size_t AvifInfoGetBatchScratchSize(const AvifInfoOptions* options,
+                                   size_t count);
+
+// Same as calling AvifInfoGetFeaturesWithOptions() on each of the 'count'
+// inputs of 'sizes[i]' bytes at 'data[i]'. The status of each input is output
+// into 'statuses[i]' and its features into 'features[i]' if 'features' is not
+// null. 'batch_options' can be null for the default behavior.
+// Returns the number of inputs for which kAvifInfoOk was output, or 0 if
+// 'data', 'sizes' or 'statuses' is null.
+size_t AvifInfoGetFeaturesBatch(const uint8_t* const* data,
+                                const size_t* sizes, size_t count,
+                                AvifInfoFeatures* features,
+                                AvifInfoStatus* statuses,
+                                const AvifInfoBatchOptions* batch_options);
+
+// Same as calling AvifInfoIdentify() on each of the 'count' inputs of
+// 'sizes[i]' bytes at 'data[i]', and outputting the status into 'statuses[i]'.
+// Meant to classify many short prefixes (such as the first 64 bytes of each
+// file) quickly: the brands are compared with SIMD instructions when
+// available, and the usual parsing only happens for uncommon inputs.
+// Returns the number of inputs for which kAvifInfoOk was output, or 0 if
+// 'data', 'sizes' or 'statuses' is null.
+size_t AvifInfoIdentifyBatch(const uint8_t* const* data, const size_t* sizes,
+                             size_t count, AvifInfoStatus* statuses);
+
+//------------------------------------------------------------------------------
+// Windowed input API
+// Use this API if each call to the 'stream' is costly. Many fields are parsed
+// from each window instead of calling read_stream_t for each one of them.
+
+// Returns a pointer to the next available bytes of the 'stream' and sets
+// '*num_bytes' to their count. The position in the 'stream' must be advanced by
+// '*num_bytes'. Returns null or sets '*num_bytes' to 0 at the end of the
+// 'stream'. The returned data must remain valid until the next call to the
+// window_stream_t or the skip_stream_t.
+typedef const uint8_t* (*window_stream_t)(void* stream, size_t* num_bytes);
+
+// Same as AvifInfoIdentify() and AvifInfoGetFeatures() but the bytes are
+// fetched with 'window' from the 'stream'. 'window' cannot be null. If 'skip'
+// is null, 'window' is called instead.
+// The bytes after the "ftyp" box may be consumed by
+// AvifInfoIdentifyStreamWindow(), so AvifInfoGetFeaturesStreamWindow() parses
+// the "ftyp" box itself and expects a 'stream' positioned at the beginning of
+// the file.
+AvifInfoStatus AvifInfoIdentifyStreamWindow(void* stream,
+                                            window_stream_t window,
+                                            skip_stream_t skip);
+AvifInfoStatus AvifInfoGetFeaturesStreamWindow(void* stream,
+                                               window_stream_t window,
+                                               skip_stream_t skip,
+                                               AvifInfoFeatures* features);
+
+//------------------------------------------------------------------------------
+// Random access input API
+// Use this API if the input bytes can be fetched at any position, such as with
+// pread() or HTTP range requests. Skipped boxes (such as "mdat") are never
+// fetched.
+
+// Returns a pointer to the 'num_bytes' located at 'offset' bytes from the
+// beginning of the 'stream', or null if it cannot be fulfilled.
+// The returned data must remain valid until the next read.
+typedef const uint8_t* (*read_at_stream_t)(void* stream, uint64_t offset,
+                                           size_t num_bytes);
+
+// Same as AvifInfoIdentify() and AvifInfoGetFeatures() but the bytes are
+// fetched with 'read_at' from the 'stream'. At most
+// AVIFINFO_MAX_NUM_READ_BYTES are requested per call.
+AvifInfoStatus AvifInfoIdentifyStreamAt(void* stream, read_at_stream_t read_at);
+AvifInfoStatus AvifInfoGetFeaturesStreamAt(void* stream,
+                                           read_at_stream_t read_at,
+                                           AvifInfoFeatures* features);
+
+//------------------------------------------------------------------------------
+// Push-based input API
+// Use this API if the input bytes arrive in chunks, for example from the
+// network. Each chunk is parsed once: the parsing resumes where it stopped
+// instead of starting again from the beginning of the file.
+
+// Opaque parser object keeping the parsing state between chunks.
+typedef struct AvifInfoParser AvifInfoParser;
+
+// Returns a new parser, or null in case of memory allocation failure.
+// It must be released with AvifInfoParserDestroy().
+AvifInfoParser* AvifInfoParserCreate(void);
+void AvifInfoParserDestroy(AvifInfoParser* parser);
+
+// Parses the next 'data_size' bytes of the AVIF file at 'data'. The first
+// chunk must start at the beginning of the file and chunks must be given in
+// order. 'data' is not accessed after the call returns: the few bytes needed
+// across chunks are copied into the 'parser'.
+// Returns what AvifInfoGetFeatures() would return if it was called on all the
+// bytes given to AvifInfoParserFeed() so far. Once a status different from
+// kAvifInfoNotEnoughData is returned, it is returned for any following call,
+// and no more byte is parsed.
+AvifInfoStatus AvifInfoParserFeed(AvifInfoParser* parser, const uint8_t* data,
+                                  size_t data_size);
+
+// Returns the last status returned by AvifInfoParserFeed() and sets the
+// 'features' if it is kAvifInfoOk. 'features' are set to 0 otherwise.
+AvifInfoStatus AvifInfoParserGetFeatures(const AvifInfoParser* parser,
+                                         AvifInfoFeatures* features);
+
+// Sizes of the beginning of the AVIF file that are enough to parse further.
+// Can be used to size the next fetch instead of guessing.
+typedef struct {
+  // Enough bytes to parse past the box the parser is blocked on (or past its
+  // header if its size is not known yet). Greater than the number of bytes
+  // fed so far, once AvifInfoParserFeed() was called at least once.
+  uint64_t min_data_size;
+  // Enough bytes to contain the whole "meta" box, after which the status will
+  // not be kAvifInfoNotEnoughData anymore. 0 if the "meta" box was not found
+  // yet.
+  uint64_t meta_data_size;
+} AvifInfoDataSizeHint;
+
+// Returns the last status returned by AvifInfoParserFeed() and sets the
+// 'hint' if it is kAvifInfoNotEnoughData. 'hint' is set to 0 otherwise.
+AvifInfoStatus AvifInfoParserGetDataSizeHint(const AvifInfoParser* parser,
+                                             AvifInfoDataSizeHint* hint);
+
+// Same as AvifInfoParserFeed() but the 'data' starts at 'offset' bytes from
+// the beginning of the file, instead of right after the previously fed bytes.
+// The bytes that were already fed are ignored. Bytes can be left out only if
+// 'offset' is at most what AvifInfoParserGetNextRange() returns; otherwise the
+// 'data' is ignored.
+AvifInfoStatus AvifInfoParserFeedAt(AvifInfoParser* parser, uint64_t offset,
+                                    const uint8_t* data, size_t data_size);
+
+// Returns the last status returned by AvifInfoParserFeed() or
+// AvifInfoParserFeedAt(). If it is kAvifInfoNotEnoughData, sets the 'offset'
+// and the 'size' of the range of bytes to feed next with
+// AvifInfoParserFeedAt(). The range covers the "meta" box if its location is
+// known, or the box the parser is blocked on. For a file with a big "mdat" box
+// located before the "meta" box, only the top-level box headers and the "meta"
+// box are requested. 'offset' and 'size' are set to 0 otherwise.
+// Usage:
+//   while (AvifInfoParserGetNextRange(parser, &offset, &size) ==
+//          kAvifInfoNotEnoughData) {
+//     // Fetch 'size' or more bytes at 'offset' into 'data'.
+//     AvifInfoParserFeedAt(parser, offset, data, data_size);
+//   }
+AvifInfoStatus AvifInfoParserGetNextRange(const AvifInfoParser* parser,
+                                          uint64_t* offset, uint64_t* size);
+
 //------------------------------------------------------------------------------
 
 #ifdef __cplusplus
@@ -0,0 +1,221 @@
+// Copyright (c) 2021, Alliance for Open Media. All rights reserved
+//
+// This source code is subject to the terms of the BSD 2 Clause License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 2 Clause License
+// was not distributed with this source code in the LICENSE file, you can
+// obtain it at www.aomedia.org/license/software. If the Alliance for Open
+// Media Patent License 1.0 was not distributed with this source code in the
+// PATENTS file, you can obtain it at www.aomedia.org/license/patent.
+
+#ifndef AVIFINFO_HPP_
+#define AVIFINFO_HPP_
+
+// Header-only C++17 wrapper of avifinfo.h. The C API entry point matching the
+// type of the input source is selected at compile time:
+//  - Contiguous sources, with data() and size() members (std::vector,
+//    std::string_view, std::array, avifinfo::Span over a memory-mapped file
+//    etc.), are parsed straight from memory as with AvifInfoGetFeatures().
+//  - Segmented sources, with a segments() member returning a contiguous
+//    container of AvifInfoSegment (such as the one or two spans of a ring
+//    buffer), are parsed as with AvifInfoGetFeaturesIov().
+//  - Other sources, with a Read() member behaving like read_stream_t and an
+//    optional Skip() member behaving like skip_stream_t, are parsed as with
+//    AvifInfoGetFeaturesStream().
+// The first two kinds never call back into the source during the box walk.
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "avifinfo.h"
+
+namespace avifinfo {
+
+// Non-owning view of contiguous bytes, such as a memory-mapped file.
+class Span {
+ public:
+  constexpr Span() = default;
+  constexpr Span(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  constexpr const uint8_t* data() const { return data_; }
+  constexpr size_t size() const { return size_; }
+
+ private:
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+namespace internal {
+
+template <typename Source, typename = void>
+struct IsContiguous : std::false_type {};
+template <typename Source>
+struct IsContiguous<Source,
+                    std::void_t<decltype(std::declval<const Source&>().data()),
+                                decltype(std::declval<const Source&>().size())>>
+    : std::bool_constant<sizeof(*std::declval<const Source&>().data()) == 1> {
+};
+
+template <typename Source, typename = void>
+struct IsSegmented : std::false_type {};
+template <typename Source>
+struct IsSegmented<
+    Source, std::void_t<decltype(std::declval<Source&>().segments().data()),
+                        decltype(std::declval<Source&>().segments().size())>>
+    : std::is_same<std::remove_cv_t<std::remove_reference_t<decltype(
+                       *std::declval<Source&>().segments().data())>>,
+                   AvifInfoSegment> {};
+
+template <typename Source, typename = void>
+struct IsStreamed : std::false_type {};
+template <typename Source>
+struct IsStreamed<Source, std::void_t<decltype(std::declval<Source&>().Read(
+                              size_t{0}))>>
+    : std::is_convertible<decltype(std::declval<Source&>().Read(size_t{0})),
+                          const uint8_t*> {};
+
+template <typename Source, typename = void>
+struct HasSkip : std::false_type {};
+template <typename Source>
+struct HasSkip<Source, std::void_t<decltype(std::declval<Source&>().Skip(
+                           size_t{0}))>> : std::true_type {};
+
+// read_stream_t and skip_stream_t generated for each streamed Source type.
+template <typename Source>
+const uint8_t* Read(void* stream, size_t num_bytes) {
+  return static_cast<Source*>(stream)->Read(num_bytes);
+}
+template <typename Source>
+void Skip(void* stream, size_t num_bytes) {
+  static_cast<Source*>(stream)->Skip(num_bytes);
+}
+template <typename Source>
+constexpr skip_stream_t GetSkip() {
+  if constexpr (HasSkip<Source>::value) {
+    return Skip<Source>;
+  } else {
+    return nullptr;  // Fallbacks to Read().
+  }
+}
+
+// Counts the bytes read or skipped from a streamed Source.
+template <typename Source>
+struct CountedSource {
+  Source& source;
+  uint64_t num_bytes;
+
+  const uint8_t* Read(size_t num_read_bytes) {
+    const uint8_t* data = source.Read(num_read_bytes);
+    if (data != nullptr) num_bytes += num_read_bytes;
+    return data;
+  }
+  template <typename S = Source>
+  auto Skip(size_t num_skipped_bytes)
+      -> decltype(std::declval<S&>().Skip(size_t{0}), void()) {
+    source.Skip(num_skipped_bytes);
+    num_bytes += num_skipped_bytes;
+  }
+};
+
+}  // namespace internal
+
+// Parses the AVIF features of a 'Source' (see above). The 'source' must
+// outlive the Parser. A streamed 'source' is consumed: it must be positioned
+// at the beginning of the file and only one of Identify() or GetFeatures()
+// can be called. The AvifInfoParseStats of a streamed 'source' do not account
+// for the "ftyp" box, except for 'features_offset'.
+template <typename Source>
+class Parser {
+ public:
+  static constexpr bool kIsContiguous = internal::IsContiguous<Source>::value;
+  static constexpr bool kIsSegmented =
+      !kIsContiguous && internal::IsSegmented<Source>::value;
+  static constexpr bool kIsStreamed =
+      !kIsContiguous && !kIsSegmented && internal::IsStreamed<Source>::value;
+  static_assert(kIsContiguous || kIsSegmented || kIsStreamed,
+                "Source must have data() and size(), segments() or Read()");
+
+  explicit Parser(Source& source) : source_(source) {}
+
+  // Same as AvifInfoIdentify().
+  AvifInfoStatus Identify() {
+    if constexpr (kIsContiguous) {
+      return AvifInfoIdentify(Data(), source_.size());
+    } else if constexpr (kIsSegmented) {
+      const auto& segments = source_.segments();
+      return AvifInfoIdentifyIov(segments.data(), segments.size());
+    } else {
+      return AvifInfoIdentifyStream(&source_, internal::Read<Source>,
+                                    internal::GetSkip<Source>());
+    }
+  }
+
+  // Same as AvifInfoGetFeatures(). The "ftyp" box is parsed too.
+  AvifInfoStatus GetFeatures(AvifInfoFeatures* features) {
+    if constexpr (kIsContiguous) {
+      return AvifInfoGetFeatures(Data(), source_.size(), features);
+    } else if constexpr (kIsSegmented) {
+      const auto& segments = source_.segments();
+      return AvifInfoGetFeaturesIov(segments.data(), segments.size(),
+                                    features);
+    } else {
+      return GetFeatures(features, /*options=*/nullptr);
+    }
+  }
+
+  // Same as AvifInfoGetFeaturesWithOptions(). Not available for segmented
+  // sources.
+  AvifInfoStatus GetFeatures(AvifInfoFeatures* features,
+                             const AvifInfoOptions& options) {
+    return GetFeatures(features, &options);
+  }
+
+ private:
+  const uint8_t* Data() const {
+    return reinterpret_cast<const uint8_t*>(source_.data());
+  }
+
+  AvifInfoStatus GetFeatures(AvifInfoFeatures* features,
+                             const AvifInfoOptions* options) {
+    static_assert(!kIsSegmented, "No AvifInfoOptions for segmented sources");
+    if constexpr (kIsContiguous) {
+      return AvifInfoGetFeaturesWithOptions(Data(), source_.size(), options,
+                                            features);
+    } else {
+      // The 'features' are relative to the end of the "ftyp" box.
+      internal::CountedSource<Source> counted_source = {source_, 0};
+      using CountedSource = internal::CountedSource<Source>;
+      const AvifInfoStatus status = AvifInfoIdentifyStream(
+          &counted_source, internal::Read<CountedSource>,
+          internal::GetSkip<CountedSource>());
+      if (status != kAvifInfoOk) {
+        // Same outputs as AvifInfoGetFeaturesStreamWithOptions() on failure.
+        AvifInfoGetFeaturesStreamWithOptions(/*stream=*/nullptr,
+                                             /*read=*/nullptr,
+                                             /*skip=*/nullptr, options,
+                                             features);
+        return status;
+      }
+      const AvifInfoStatus features_status =
+          AvifInfoGetFeaturesStreamWithOptions(
+              &source_, internal::Read<Source>, internal::GetSkip<Source>(),
+              options, features);
+      if (features_status == kAvifInfoOk && features != nullptr &&
+          features->primary_item_id_bytes != 0) {
+        features->primary_item_id_location += counted_source.num_bytes;
+      }
+      if (options != nullptr && options->stats != nullptr &&
+          options->stats->features_offset != 0) {
+        options->stats->features_offset += counted_source.num_bytes;
+      }
+      return features_status;
+    }
+  }
+
+  Source& source_;
+};
+
+}  // namespace avifinfo
+
+#endif  // AVIFINFO_HPP_
@@ -25,6 +25,7 @@ const MAX_TILES     = 16;
 const MAX_PROPS     = 32;
 const MAX_FEATURES  = 8;
 const UNDEFINED     = 0;          // Value was not yet parsed.
+const BLOCK_SIZE    = 4096;       // Usually enough for the boxes before "mdat". See Parser.
 
 /**
  * Reads an unsigned integer with most significant bits first.
@@ -56,6 +57,9 @@ function read_big_endian( $input, $num_bytes ) {
  * @return binary string|false            The raw bytes or false on failure.
  */
 function read( $handle, $num_bytes ) {
+  if ( $handle instanceof Buffered_Stream ) {
+    return $handle->read( $num_bytes );
+  }
   $data = fread( $handle, $num_bytes );
   return ( $data !== false && strlen( $data ) >= $num_bytes ) ? $data : false;
 }
@@ -69,9 +73,87 @@ function read( $handle, $num_bytes ) {
  */
 // Skips 'num_bytes' from the 'stream'. 'num_bytes' can be zero.
 function skip( $handle, $num_bytes ) {
+  if ( $handle instanceof Buffered_Stream ) {
+    return $handle->skip( $num_bytes );
+  }
   return ( fseek( $handle, $num_bytes, SEEK_CUR ) == 0 );
 }
 
+/**
+ * Seekable resource read by blocks.
+ *
+ * The parser reads most boxes a few bytes at a time. Instead of as many fread()
+ * calls, a block is read once and the bytes are taken from that string. Skipped
+ * bytes are not read: fseek() is only called if the parser needs bytes past the
+ * end of the block.
+ */
+class Buffered_Stream {
+  private $handle; // Input stream. Its position is right after the $buffer.
+  private $block_size; // Minimum number of bytes read with each fread().
+  private $buffer = ''; // Bytes read from the $handle.
+  private $buffer_position; // Position of the first byte of the $buffer in the $handle.
+  private $position; // Position of the next byte returned by read() in the $handle.
+
+  /**
+   * @param stream $handle     Bytes will be read from this resource from its current position.
+   * @param int    $block_size Number of bytes read at once. Must be greater than 0.
+   */
+  function __construct( $handle, $block_size ) {
+    $this->handle          = $handle;
+    $this->block_size      = $block_size;
+    $this->buffer_position = ftell( $handle );
+    $this->position        = $this->buffer_position;
+  }
+
+  /**
+   * Same as read() on the underlying resource.
+   *
+   * @param int                  $num_bytes Number of bytes read. Must be greater than 0.
+   * @return binary string|false            The raw bytes or false on failure.
+   */
+  public function read( $num_bytes ) {
+    if ( $this->buffer_position === false ) {
+      return false; // ftell() failed.
+    }
+    $offset = $this->position - $this->buffer_position;
+    if ( $offset + $num_bytes > strlen( $this->buffer ) ) {
+      if ( $offset <= strlen( $this->buffer ) ) {
+        // Keep the remaining bytes of the $buffer and read the following ones.
+        $this->buffer = substr( $this->buffer, $offset );
+      } else {
+        // Skipped past the end of the $buffer.
+        if ( fseek( $this->handle, $this->position, SEEK_SET ) != 0 ) {
+          return false;
+        }
+        $this->buffer = '';
+      }
+      $this->buffer_position = $this->position;
+      $offset                = 0;
+      $data = fread( $this->handle, max( $num_bytes - strlen( $this->buffer ), $this->block_size ) );
+      if ( $data === false ) {
+        return false;
+      }
+      $this->buffer .= $data;
+      if ( $num_bytes > strlen( $this->buffer ) ) {
+        return false;
+      }
+    }
+    $this->position += $num_bytes;
+    return substr( $this->buffer, $offset, $num_bytes );
+  }
+
+  /**
+   * Same as skip() on the underlying resource, without calling fseek().
+   *
+   * @param int  $num_bytes Number of skipped bytes. Can be 0.
+   * @return bool           True.
+   */
+  public function skip( $num_bytes ) {
+    $this->position += $num_bytes;
+    return true;
+  }
+}
+
 //------------------------------------------------------------------------------
 // Features are parsed into temporary property associations.
 
@@ -319,8 +401,14 @@ class Parser {
   private $data_was_skipped = false;
   public $features;
 
-  function __construct( $handle ) {
-    $this->handle   = $handle;
+  /**
+   * @param stream $handle     Bytes will be read from this resource from its current position.
+   * @param int    $block_size If greater than 0, such as BLOCK_SIZE, the $handle is read by blocks
+   *                           of at least that many bytes. See Buffered_Stream. Otherwise it is
+   *                           read box by box.
+   */
+  function __construct( $handle, $block_size = 0 ) {
+    $this->handle   = ( $block_size > 0 ) ? new Buffered_Stream( $handle, $block_size ) : $handle;
     $this->features = new Features();
   }
 
@@ -7,6 +7,8 @@
 // Media Patent License 1.0 was not distributed with this source code in the
 // PATENTS file, you can obtain it at www.aomedia.org/license/patent.
 
+use std::io::{ErrorKind, Read, Seek, SeekFrom};
+
 //-----------------------------------------------------------------------------
 
 #[derive(PartialEq, Debug)]
@@ -88,6 +90,12 @@ const AVIFINFO_MAX_TILES: usize = 16;
 const AVIFINFO_MAX_PROPS: usize = 32;
 const AVIFINFO_MAX_FEATURES: usize = 8;
 const AVIFINFO_UNDEFINED: u8 = 0;
+// Maximum number of bytes of the 'meta' box buffered by get_features_from_reader().
+const AVIFINFO_MAX_META_SIZE: usize = 1 << 24;
+// Number of bytes of the 'meta' box first read by get_features_from_reader().
+const AVIFINFO_META_CHUNK_SIZE: usize = 4096;
+// Minimum number of inputs parsed by each thread of get_features_batch().
+const AVIFINFO_BATCH_TASK_SIZE: usize = 64;
 
 //------------------------------------------------------------------------------
 // Streamed input struct and helper functions.
@@ -101,7 +109,7 @@ struct Stream<'a> {
     offset: usize,
 }
 
-impl Stream<'_> {
+impl<'a> Stream<'a> {
     fn read(&mut self, num_bytes: usize) -> InternalResult<&[u8]> {
         if num_bytes == 0 {
             return Ok(&[]);
@@ -170,7 +178,7 @@ impl Stream<'_> {
 
     // Returns a portion of the stream. The size of the portion is either given
     // or all remaining bytes are returned.
-    fn substream(&mut self, num_bytes: Option<usize>) -> InternalResult<Stream> {
+    fn substream(&mut self, num_bytes: Option<usize>) -> InternalResult<Stream<'a>> {
         let offset = self.offset;
         let num_transferred_bytes = num_bytes.unwrap_or(match &self.data {
             Some(data) => data.len().saturating_sub(offset),
@@ -179,7 +187,7 @@ impl Stream<'_> {
         self.skip(num_transferred_bytes)?;
         self.offset = offset.checked_add(num_transferred_bytes).ok_or(InternalError::Aborted)?;
         Ok(Stream {
-            data: if let Some(data) = &self.data {
+            data: if let Some(data) = self.data {
                 let available_size = data.len().saturating_sub(offset);
                 let size = std::cmp::min(available_size, num_transferred_bytes);
                 if size != 0 { Some(&data[offset..offset + size]) } else { None }
@@ -232,7 +240,7 @@ struct InternalFeatures {
     data_was_skipped: bool,          // True if some loops/indices were skipped.
     tone_mapped_item_id: u8,         // Id of the "tmap" box, > 0 if present.
     iinf_parsed: bool,               // True if the "iinf" (item info) box was parsed.
-    iref_parsed: bool,               // True if the "iref" (item reference) box was parsed.
+    iref_parsed: bool,               // True if all "iref" (item reference) boxes were parsed.
 
     num_tiles: usize,
     tiles: [InternalTile; AVIFINFO_MAX_TILES],
@@ -344,10 +352,15 @@ impl InternalFeatures {
             }
         }
         // If the gain map has not been found but we haven't read all the relevant
-        // metadata, we might still find one later and cannot stop now.
+        // metadata, we might still find one later and cannot stop now. The inputs
+        // of the tone mapped item may be listed by any 'dimg' box in 'iref'.
         if !self.primary_item_features.has_gainmap
             && (!self.iinf_parsed
-                || (self.tone_mapped_item_id != AVIFINFO_UNDEFINED && !self.iref_parsed))
+                || (self.tone_mapped_item_id != AVIFINFO_UNDEFINED
+                    && !self.iref_parsed
+                    && !self.tiles[..self.num_tiles]
+                        .iter()
+                        .any(|tile| tile.parent_item_id == self.tone_mapped_item_id)))
         {
             return Err(InternalError::NotFound);
         }
@@ -387,7 +400,12 @@ fn parse_box(
     // box_size==0 means this box extends to all remaining bytes.
     if box_size == Some(1) {
         box_header_size += 8;
-        box_size = Some(stream.read_u64()?.try_into().or(Err(InternalError::Aborted))?);
+        let box_size_64 = stream.read_u64()?;
+        // Stop the parsing if any box has a size greater than 4GB.
+        if box_size_64 > u32::MAX as u64 {
+            return Err(InternalError::Aborted);
+        }
+        box_size = Some(box_size_64.try_into().or(Err(InternalError::Aborted))?);
     } else if box_size == Some(0) {
         if nesting_level != 0 {
             // ISO/IEC 14496-12 4.2.2:
@@ -448,7 +466,7 @@ fn parse_box(
             || (&box_type == b"iref" && version <= 1)
             || (&box_type == b"auxC" && version == 0)
             || (&box_type == b"iinf" && version <= 1)
-            || (&box_type == b"infe" && version <= 2);
+            || (&box_type == b"infe" && (2..=3).contains(&version));
         // Instead of considering this file as invalid, skip unparsable boxes.
         if !is_parsable {
             box_type = *b"skip"; // FreeSpaceBox. To be ignored by readers.
@@ -471,7 +489,7 @@ impl InternalFeatures {
         num_parsed_boxes: &mut u32,
     ) -> InternalResult<()> {
         let mut box_index = 1u8; // 1-based index. Used for iterating over properties.
-        while stream.has_more_bytes() {
+        loop {
             let box_features = parse_box(nesting_level, stream, num_parsed_boxes)?;
             let mut box_stream = stream.substream(box_features.content_size)?;
 
@@ -566,6 +584,9 @@ impl InternalFeatures {
                 return Err(InternalError::NotFound);
             }
             box_index += 1;
+            if !stream.has_more_bytes() {
+                break;
+            }
         }
         Err(InternalError::NotFound)
     }
@@ -579,7 +600,7 @@ impl InternalFeatures {
         stream: &mut Stream,
         num_parsed_boxes: &mut u32,
     ) -> InternalResult<()> {
-        while stream.has_more_bytes() {
+        loop {
             let box_features = parse_box(nesting_level, stream, num_parsed_boxes)?;
             let mut box_stream = stream.substream(box_features.content_size)?;
 
@@ -642,6 +663,9 @@ impl InternalFeatures {
                 }
                 _ => {}
             }
+            if !stream.has_more_bytes() {
+                break;
+            }
         }
         Err(InternalError::NotFound)
     }
@@ -656,11 +680,13 @@ impl InternalFeatures {
         stream: &mut Stream,
         num_parsed_boxes: &mut u32,
     ) -> InternalResult<()> {
-        self.iref_parsed = true;
-
-        while stream.has_more_bytes() {
+        loop {
             let box_features = parse_box(nesting_level, stream, num_parsed_boxes)?;
             let mut box_stream = stream.substream(box_features.content_size)?;
+            // All references are known once those of the last box are read.
+            if !stream.has_more_bytes() {
+                self.iref_parsed = true;
+            }
 
             if let b"dimg" = &box_features.box_type {
                 // See ISO/IEC 14496-12:2015(E) 8.11.12.2
@@ -693,8 +719,12 @@ impl InternalFeatures {
                     Err(error) => return Err(error),
                 }
             }
+            if !stream.has_more_bytes() {
+                break;
+            }
         }
-        Err(InternalError::NotFound)
+        // The gain map may only be known to be missing now.
+        self.get_primary_item_features()
     }
 
     // Parses a stream of an 'iinf' box.
@@ -735,7 +765,9 @@ impl InternalFeatures {
                 break; // Ignore entry_count bigger than box.
             }
         }
-        Err(InternalError::NotFound)
+        // The 'iprp' box may have been parsed already, in which case the
+        // features were only missing the item types.
+        self.get_primary_item_features()
     }
 
     // Parses a stream of a 'meta' box. It looks for the primary item ID in the
@@ -747,7 +779,7 @@ impl InternalFeatures {
         stream: &mut Stream,
         num_parsed_boxes: &mut u32,
     ) -> InternalResult<()> {
-        while stream.has_more_bytes() {
+        loop {
             let box_features = parse_box(nesting_level, stream, num_parsed_boxes)?;
             let box_header_size = stream.num_read_bytes();
             let mut box_stream = stream.substream(box_features.content_size)?;
@@ -795,6 +827,9 @@ impl InternalFeatures {
                 }
                 _ => {}
             }
+            if !stream.has_more_bytes() {
+                break;
+            }
         }
         // According to ISO/IEC 14496-12:2012(E) 8.11.1.1 there is at most one 'meta'.
         Err(if self.data_was_skipped { InternalError::Aborted } else { InternalError::Invalid })
@@ -811,9 +846,9 @@ fn parse_ftyp(stream: &mut Stream) -> InternalResult<()> {
     if &box_features.box_type != b"ftyp" {
         return Err(InternalError::Invalid);
     }
-    // Consider a FileTypeBox running till the end of the file as invalid,
-    // because it should be first and a MetaBox should follow.
-    let content_size = box_features.content_size.ok_or(InternalError::Invalid)?;
+    // A FileTypeBox running till the end of the file cannot be followed by a
+    // MetaBox. Like the C implementation, read its brands until the data ends.
+    let content_size = box_features.content_size.unwrap_or(u32::MAX as usize - 8);
     // Iterate over brands. See ISO/IEC 14496-12:2012(E) 4.3.1
     if content_size < 8 {
         // major_brand,minor_version
@@ -853,8 +888,9 @@ impl InternalFeatures {
                     &mut num_parsed_boxes,
                 );
             } else if box_features.content_size.is_none() {
-                // This non-MetaBox runs till the end of the file. 'meta' is missing.
-                return Err(InternalError::Invalid);
+                // This non-MetaBox runs till the end of the file, which could
+                // be longer than the given bytes, so 'meta' may still follow.
+                return Err(InternalError::Truncated);
             }
         }
     }
@@ -871,6 +907,9 @@ pub fn identify(data: &[u8]) -> AvifInfoResult<()> {
 }
 
 pub fn get_features(data: &[u8]) -> AvifInfoResult<Features> {
+    // There is no need to call identify() before get_features(): the file type
+    // is checked first, then the file is parsed from its beginning.
+    parse_ftyp(&mut Stream { data: Some(data), size: None, offset: 0 })?;
     let mut features = InternalFeatures { ..Default::default() };
     match features.parse_file(&mut Stream { data: Some(data), size: None, offset: 0 }) {
         Ok(()) => Ok(features.primary_item_features),
@@ -878,7 +917,142 @@ pub fn get_features(data: &[u8]) -> AvifInfoResult<Features> {
     }
 }
 
+// Same as get_features() on each of the 'inputs', in the same order. The inputs
+// are split into chunks of at least AVIFINFO_BATCH_TASK_SIZE inputs, parsed on
+// as many threads as std::thread::available_parallelism().
+pub fn get_features_batch<T: AsRef<[u8]> + Sync>(inputs: &[T]) -> Vec<AvifInfoResult<Features>> {
+    let num_threads = std::thread::available_parallelism().map_or(1, |n| n.get());
+    let chunk_size = std::cmp::max(AVIFINFO_BATCH_TASK_SIZE, inputs.len().div_ceil(num_threads));
+    if inputs.len() <= chunk_size {
+        return inputs.iter().map(|input| get_features(input.as_ref())).collect();
+    }
+    std::thread::scope(|scope| {
+        let threads: Vec<_> = inputs
+            .chunks(chunk_size)
+            .map(|chunk| {
+                scope.spawn(move || {
+                    chunk.iter().map(|input| get_features(input.as_ref())).collect::<Vec<_>>()
+                })
+            })
+            .collect();
+        // get_features() does not panic, so neither does join().
+        threads.into_iter().flat_map(|thread| thread.join().unwrap()).collect()
+    })
+}
+
 //------------------------------------------------------------------------------
 // Streamed input API
 
-// There is no streamed input API yet.
+// Reads as many bytes as possible into 'buffer' and returns their count.
+// An I/O error is considered as missing bytes.
+fn read_up_to<R: Read>(reader: &mut R, buffer: &mut [u8]) -> InternalResult<usize> {
+    let mut num_read_bytes = 0;
+    while num_read_bytes < buffer.len() {
+        match reader.read(&mut buffer[num_read_bytes..]) {
+            Ok(0) => break,
+            Ok(n) => num_read_bytes += n,
+            Err(error) if error.kind() == ErrorKind::Interrupted => {}
+            Err(_) => return Err(InternalError::Truncated),
+        }
+    }
+    Ok(num_read_bytes)
+}
+
+// Same as InternalFeatures::parse_file() but only the header of each top-level
+// box and the content of the 'meta' box are read. Other boxes such as 'mdat'
+// are skipped with seek().
+impl InternalFeatures {
+    fn parse_file_from_reader<R: Read + Seek>(&mut self, reader: &mut R) -> InternalResult<()> {
+        // Same as identify(), which reads at most 34 brands of the 'ftyp' box.
+        let mut ftyp = [0u8; 16 + 34 * 4];
+        let ftyp_size = read_up_to(reader, &mut ftyp)?;
+        parse_ftyp(&mut Stream { data: Some(&ftyp[..ftyp_size]), size: None, offset: 0 })?;
+        reader.seek(SeekFrom::Current(-(ftyp_size as i64))).or(Err(InternalError::Truncated))?;
+
+        let mut num_parsed_boxes = 0u32;
+        let mut offset = 0usize; // Relative to the initial position of the 'reader'.
+        loop {
+            // Largest header: 32-bit size, type, 64-bit size, version and flags.
+            let mut header = [0u8; 20];
+            let header_size = read_up_to(reader, &mut header)?;
+            let mut stream = Stream { data: Some(&header[..header_size]), size: None, offset: 0 };
+            let box_features =
+                parse_box(/* nesting_level= */ 0, &mut stream, &mut num_parsed_boxes)?;
+            // The bytes read past the box header belong to its content.
+            let content_bytes = &header[stream.num_read_bytes()..header_size];
+            offset = offset.checked_add(stream.num_read_bytes()).ok_or(InternalError::Aborted)?;
+
+            if &box_features.box_type == b"meta" {
+                if let Some(content_size) = box_features.content_size {
+                    offset.checked_add(content_size).ok_or(InternalError::Aborted)?;
+                }
+                // This MetaBox runs till the end of the file if its size is unknown.
+                let content_size = box_features.content_size.unwrap_or(usize::MAX);
+                let num_bytes = std::cmp::min(content_bytes.len(), content_size);
+                let mut content = content_bytes[..num_bytes].to_vec();
+                // The features are usually at the beginning of the 'meta' box. Read it in
+                // chunks of doubling size and parse it again after each chunk, as long as
+                // bytes are missing. At most twice the needed bytes are read.
+                let mut chunk_size = AVIFINFO_META_CHUNK_SIZE;
+                loop {
+                    let wanted_size = std::cmp::min(
+                        std::cmp::min(chunk_size, content_size),
+                        AVIFINFO_MAX_META_SIZE,
+                    );
+                    let mut is_complete = content_size <= wanted_size;
+                    if wanted_size > content.len() {
+                        reader
+                            .take((wanted_size - content.len()) as u64)
+                            .read_to_end(&mut content)
+                            .or(Err(InternalError::Truncated))?;
+                        // The end of the file was reached.
+                        is_complete |= content.len() < wanted_size;
+                    }
+                    *self = InternalFeatures { ..Default::default() };
+                    let mut num_parsed_meta_boxes = num_parsed_boxes;
+                    match self.parse_meta(
+                        /* nesting_level= */ 1,
+                        offset,
+                        &mut Stream {
+                            data: if content.is_empty() { None } else { Some(&content) },
+                            size: box_features.content_size,
+                            offset: 0,
+                        },
+                        &mut num_parsed_meta_boxes,
+                    ) {
+                        Err(InternalError::Truncated) if !is_complete => {
+                            if wanted_size == AVIFINFO_MAX_META_SIZE {
+                                return Err(InternalError::Aborted); // Be reasonable.
+                            }
+                            chunk_size *= 2;
+                        }
+                        result => return result,
+                    }
+                }
+            }
+            // This non-MetaBox runs till the end of the file. See parse_file().
+            let content_size = box_features.content_size.ok_or(InternalError::Truncated)?;
+            offset = offset.checked_add(content_size).ok_or(InternalError::Aborted)?;
+            // Past the end of any file if it does not fit.
+            let num_skipped_bytes: i64 = (content_size as i128 - content_bytes.len() as i128)
+                .try_into()
+                .or(Err(InternalError::Truncated))?;
+            reader.seek(SeekFrom::Current(num_skipped_bytes)).or(Err(InternalError::Truncated))?;
+        }
+    }
+}
+
+// Same as get_features() on the bytes of the 'reader' from its current
+// position. Only the top-level box headers and the beginning of the 'meta' box
+// are read, so 'mdat' boxes before 'meta' are not loaded. I/O errors are
+// reported as AvifInfoError::NotEnoughData. AvifInfoError::TooComplex is
+// returned if more than AVIFINFO_MAX_META_SIZE bytes of the 'meta' box are
+// needed. Slices are better given to get_features(), which parses them in
+// place without copying.
+pub fn get_features_from_reader<R: Read + Seek>(reader: &mut R) -> AvifInfoResult<Features> {
+    let mut features = InternalFeatures { ..Default::default() };
+    match features.parse_file_from_reader(reader) {
+        Ok(()) => Ok(features.primary_item_features),
+        Err(error) => Err(error.into()),
+    }
+}
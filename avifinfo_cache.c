@@ -0,0 +1,272 @@
+// Copyright (c) 2021, Alliance for Open Media. All rights reserved
+//
+// This source code is subject to the terms of the BSD 2 Clause License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 2 Clause License
+// was not distributed with this source code in the LICENSE file, you can
+// obtain it at www.aomedia.org/license/software. If the Alliance for Open
+// Media Patent License 1.0 was not distributed with this source code in the
+// PATENTS file, you can obtain it at www.aomedia.org/license/patent.
+
+#include "avifinfo_cache.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "avifinfo.h"
+
+//------------------------------------------------------------------------------
+
+// At most that many top-level boxes are expected before the "meta" box.
+// Inputs with more boxes are not cached.
+#define AVIFINFO_CACHE_MAX_NUM_BOXES 16
+#define AVIFINFO_CACHE_MIN_NUM_ENTRIES 16
+#define AVIFINFO_CACHE_MAX_NUM_ENTRIES (1u << 24)
+// The counters are sharded to limit the contention between threads.
+#define AVIFINFO_CACHE_NUM_SHARDS 16
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define AVIFINFO_CACHE_THREAD_LOCAL __declspec(thread)
+#else
+#define AVIFINFO_CACHE_THREAD_LOCAL _Thread_local
+#endif
+
+// Number of 64-bit words needed to store AvifInfoFeatures.
+#define AVIFINFO_CACHE_NUM_WORDS ((sizeof(AvifInfoFeatures) + 7) / 8)
+
+// AvifInfoFeatures and its status, guarded by a sequence lock: readers never
+// block and retry nothing, a concurrent write only causes a miss. All fields
+// are atomic so that such a race is not undefined behavior.
+typedef struct {
+  atomic_uint_least32_t sequence;  // Odd while the entry is being written.
+  atomic_uint_least64_t key;       // 0 if empty.
+  atomic_uint_least64_t status;
+  atomic_uint_least64_t words[AVIFINFO_CACHE_NUM_WORDS];
+} AvifInfoCacheEntry;
+_Static_assert(sizeof(AvifInfoCacheEntry) <= 64, "One cache line per entry");
+
+typedef struct {
+  atomic_uint_least64_t num_hits, num_misses, num_bypasses;
+  uint8_t padding[64 - 3 * sizeof(atomic_uint_least64_t)];  // Cache line.
+} AvifInfoCacheShard;
+
+struct AvifInfoCache {
+  void* memory;                 // As allocated.
+  AvifInfoCacheEntry* entries;  // Aligned to 64 bytes.
+  size_t num_entries;           // Power of two.
+  uint64_t seed;
+  AvifInfoCacheShard shards[AVIFINFO_CACHE_NUM_SHARDS];
+};
+
+//------------------------------------------------------------------------------
+
+// Index of the counters of each thread, plus one. Assigned in a round-robin
+// fashion on first use, so that the threads spread evenly over the shards
+// whatever inputs they look up, even if it is always the same one.
+static atomic_uint_least32_t next_shard_index;
+static AVIFINFO_CACHE_THREAD_LOCAL uint32_t thread_shard_index;
+
+static AvifInfoCacheShard* AvifInfoCacheGetThreadShard(AvifInfoCache* cache) {
+  if (thread_shard_index == 0) {
+    thread_shard_index =
+        (uint32_t)(atomic_fetch_add_explicit(&next_shard_index, 1,
+                                             memory_order_relaxed) %
+                   AVIFINFO_CACHE_NUM_SHARDS) +
+        1;
+  }
+  return &cache->shards[thread_shard_index - 1];
+}
+
+static uint32_t AvifInfoCacheReadBigEndian32(const uint8_t* data) {
+  return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+         ((uint32_t)data[2] << 8) | (uint32_t)data[3];
+}
+
+// Mixes the 'data_size' bytes at 'data' into 'hash', 8 bytes at a time.
+static uint64_t AvifInfoCacheHash(uint64_t hash, const uint8_t* data,
+                                  size_t data_size) {
+  const uint64_t kMultiplier = 0x9e3779b97f4a7c15ull;
+  hash ^= data_size * kMultiplier;
+  for (; data_size >= 8; data += 8, data_size -= 8) {
+    uint64_t word;
+    memcpy(&word, data, 8);
+    hash = (hash ^ word) * kMultiplier;
+    hash ^= hash >> 29;
+  }
+  if (data_size > 0) {
+    uint64_t word = 0;
+    memcpy(&word, data, data_size);
+    hash = (hash ^ word) * kMultiplier;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+// Returns a hash of the bytes that AvifInfoGetFeatures() depends on, or 0 if
+// they are not all available in 'data' or if the layout of the file is
+// unusual. See avifinfo_cache.h.
+static uint64_t AvifInfoCacheGetKey(uint64_t seed, const uint8_t* data,
+                                    size_t data_size) {
+  if (data == NULL) return 0;
+  uint64_t hash = seed;
+  size_t offset = 0;
+  for (int i = 0; i < AVIFINFO_CACHE_MAX_NUM_BOXES; ++i) {
+    if (data_size - offset < 8) return 0;
+    const uint32_t box_size = AvifInfoCacheReadBigEndian32(data + offset);
+    // 0 and 1 mean the size is not in the regular header.
+    if (box_size < 8 || box_size > data_size - offset) return 0;
+    const uint8_t* const type = data + offset + 4;
+    if (i == 0 && memcmp(type, "ftyp", 4)) return 0;
+    // AvifInfoGetFeatures() skips the "meta" boxes whose version is not 0.
+    const int is_meta =
+        !memcmp(type, "meta", 4) && box_size >= 12 && data[offset + 8] == 0;
+    // Only the size and type of the other boxes matter: they are skipped.
+    hash = AvifInfoCacheHash(hash, data + offset,
+                             (i == 0 || is_meta) ? box_size : 8);
+    if (is_meta) return (hash != 0) ? hash : 1;
+    offset += box_size;
+  }
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+
+AvifInfoCache* AvifInfoCacheCreate(size_t num_entries) {
+  size_t rounded_num_entries = AVIFINFO_CACHE_MIN_NUM_ENTRIES;
+  while (rounded_num_entries < num_entries &&
+         rounded_num_entries < AVIFINFO_CACHE_MAX_NUM_ENTRIES) {
+    rounded_num_entries *= 2;
+  }
+  AvifInfoCache* const cache = (AvifInfoCache*)malloc(sizeof(*cache));
+  if (cache == NULL) return NULL;
+  cache->memory =
+      malloc(rounded_num_entries * sizeof(AvifInfoCacheEntry) + 63);
+  if (cache->memory == NULL) {
+    free(cache);
+    return NULL;
+  }
+  cache->entries =
+      (AvifInfoCacheEntry*)(((uintptr_t)cache->memory + 63) & ~(uintptr_t)63);
+  cache->num_entries = rounded_num_entries;
+  // Not a secret, but differs between processes if the address space layout
+  // is randomized.
+  cache->seed = AvifInfoCacheHash(0x243f6a8885a308d3ull,
+                                  (const uint8_t*)&cache, sizeof(cache));
+  for (size_t i = 0; i < rounded_num_entries; ++i) {
+    AvifInfoCacheEntry* const entry = &cache->entries[i];
+    atomic_init(&entry->sequence, 0);
+    atomic_init(&entry->key, 0);
+    atomic_init(&entry->status, 0);
+    for (size_t w = 0; w < AVIFINFO_CACHE_NUM_WORDS; ++w) {
+      atomic_init(&entry->words[w], 0);
+    }
+  }
+  for (int i = 0; i < AVIFINFO_CACHE_NUM_SHARDS; ++i) {
+    atomic_init(&cache->shards[i].num_hits, 0);
+    atomic_init(&cache->shards[i].num_misses, 0);
+    atomic_init(&cache->shards[i].num_bypasses, 0);
+  }
+  return cache;
+}
+
+void AvifInfoCacheDestroy(AvifInfoCache* cache) {
+  if (cache == NULL) return;
+  free(cache->memory);
+  free(cache);
+}
+
+// Copies the 'entry' into 'status' and 'features' and returns 1 if it is
+// stored under 'key'. Returns 0 otherwise or if it is being written.
+static int AvifInfoCacheLoad(AvifInfoCacheEntry* entry, uint64_t key,
+                             AvifInfoStatus* status,
+                             AvifInfoFeatures* features) {
+  const uint_least32_t sequence =
+      atomic_load_explicit(&entry->sequence, memory_order_acquire);
+  if (sequence & 1) return 0;
+  if (atomic_load_explicit(&entry->key, memory_order_relaxed) != key) return 0;
+  uint64_t words[AVIFINFO_CACHE_NUM_WORDS];
+  for (size_t w = 0; w < AVIFINFO_CACHE_NUM_WORDS; ++w) {
+    words[w] = atomic_load_explicit(&entry->words[w], memory_order_relaxed);
+  }
+  const uint64_t stored_status =
+      atomic_load_explicit(&entry->status, memory_order_relaxed);
+  atomic_thread_fence(memory_order_acquire);
+  if (atomic_load_explicit(&entry->sequence, memory_order_relaxed) !=
+      sequence) {
+    return 0;
+  }
+  *status = (AvifInfoStatus)stored_status;
+  if (features != NULL) memcpy(features, words, sizeof(*features));
+  return 1;
+}
+
+// Stores the 'status' and 'features' into the 'entry' under 'key', unless
+// another thread is writing it.
+static void AvifInfoCacheStore(AvifInfoCacheEntry* entry, uint64_t key,
+                               AvifInfoStatus status,
+                               const AvifInfoFeatures* features) {
+  uint_least32_t sequence =
+      atomic_load_explicit(&entry->sequence, memory_order_relaxed);
+  if ((sequence & 1) ||
+      !atomic_compare_exchange_strong_explicit(
+          &entry->sequence, &sequence, sequence + 1, memory_order_acquire,
+          memory_order_relaxed)) {
+    return;  // Let the other writer win.
+  }
+  atomic_thread_fence(memory_order_release);
+  uint64_t words[AVIFINFO_CACHE_NUM_WORDS] = {0};
+  memcpy(words, features, sizeof(*features));
+  atomic_store_explicit(&entry->key, key, memory_order_relaxed);
+  atomic_store_explicit(&entry->status, (uint64_t)status,
+                        memory_order_relaxed);
+  for (size_t w = 0; w < AVIFINFO_CACHE_NUM_WORDS; ++w) {
+    atomic_store_explicit(&entry->words[w], words[w], memory_order_relaxed);
+  }
+  atomic_store_explicit(&entry->sequence, sequence + 2, memory_order_release);
+}
+
+AvifInfoStatus AvifInfoCacheGetFeatures(AvifInfoCache* cache,
+                                        const uint8_t* data, size_t data_size,
+                                        AvifInfoFeatures* features) {
+  if (cache == NULL) return AvifInfoGetFeatures(data, data_size, features);
+  const uint64_t key = AvifInfoCacheGetKey(cache->seed, data, data_size);
+  AvifInfoCacheShard* const shard = AvifInfoCacheGetThreadShard(cache);
+  if (key == 0) {
+    atomic_fetch_add_explicit(&shard->num_bypasses, 1, memory_order_relaxed);
+    return AvifInfoGetFeatures(data, data_size, features);
+  }
+
+  AvifInfoCacheEntry* const entry =
+      &cache->entries[key & (cache->num_entries - 1)];
+  AvifInfoStatus status;
+  if (AvifInfoCacheLoad(entry, key, &status, features)) {
+    atomic_fetch_add_explicit(&shard->num_hits, 1, memory_order_relaxed);
+    return status;
+  }
+  atomic_fetch_add_explicit(&shard->num_misses, 1, memory_order_relaxed);
+  AvifInfoFeatures parsed_features;
+  status = AvifInfoGetFeatures(data, data_size, &parsed_features);
+  if (status != kAvifInfoNotEnoughData) {
+    AvifInfoCacheStore(entry, key, status, &parsed_features);
+  }
+  if (features != NULL) *features = parsed_features;
+  return status;
+}
+
+void AvifInfoCacheGetStats(const AvifInfoCache* cache,
+                           AvifInfoCacheStats* stats) {
+  if (stats == NULL) return;
+  memset(stats, 0, sizeof(*stats));
+  if (cache == NULL) return;
+  for (int i = 0; i < AVIFINFO_CACHE_NUM_SHARDS; ++i) {
+    // The counters are only read, the cast drops the const for C11 atomics.
+    AvifInfoCacheShard* const shard = (AvifInfoCacheShard*)&cache->shards[i];
+    stats->num_hits +=
+        atomic_load_explicit(&shard->num_hits, memory_order_relaxed);
+    stats->num_misses +=
+        atomic_load_explicit(&shard->num_misses, memory_order_relaxed);
+    stats->num_bypasses +=
+        atomic_load_explicit(&shard->num_bypasses, memory_order_relaxed);
+  }
+}
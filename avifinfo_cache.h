@@ -0,0 +1,67 @@
+// Copyright (c) 2021, Alliance for Open Media. All rights reserved
+//
+// This source code is subject to the terms of the BSD 2 Clause License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 2 Clause License
+// was not distributed with this source code in the LICENSE file, you can
+// obtain it at www.aomedia.org/license/software. If the Alliance for Open
+// Media Patent License 1.0 was not distributed with this source code in the
+// PATENTS file, you can obtain it at www.aomedia.org/license/patent.
+
+#ifndef AVIFINFO_CACHE_H_
+#define AVIFINFO_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "avifinfo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------------
+// Features cache
+// Use this optional module if the same AVIF files are parsed over and over.
+// The results of AvifInfoGetFeatures() are stored in a fixed-size table
+// indexed by a 64-bit hash of the bytes they depend on: the "ftyp" box, the
+// headers of the other top-level boxes before the first "meta" box of version
+// 0, and that "meta" box. Inputs that do not contain all these bytes are
+// parsed without caching.
+// The hash is not cryptographic: inputs crafted to collide with a cached file
+// could get its features.
+
+// Opaque table. All functions can be called concurrently on the same cache
+// from several threads, except AvifInfoCacheDestroy(). None of them blocks.
+typedef struct AvifInfoCache AvifInfoCache;
+
+// Returns a new cache of 'num_entries' rounded up to a power of two, between
+// 16 and 2^24, or null in case of memory allocation failure. Each entry takes
+// 64 bytes. It must be released with AvifInfoCacheDestroy().
+AvifInfoCache* AvifInfoCacheCreate(size_t num_entries);
+void AvifInfoCacheDestroy(AvifInfoCache* cache);
+
+// Same as AvifInfoGetFeatures(), but the status and the 'features' are taken
+// from the 'cache' if the same bytes were already parsed. Otherwise they are
+// stored into the 'cache' if the status is not kAvifInfoNotEnoughData,
+// possibly replacing another entry.
+AvifInfoStatus AvifInfoCacheGetFeatures(AvifInfoCache* cache,
+                                        const uint8_t* data, size_t data_size,
+                                        AvifInfoFeatures* features);
+
+typedef struct {
+  uint64_t num_hits;      // Calls answered from the cache.
+  uint64_t num_misses;    // Calls that parsed and possibly stored the input.
+  uint64_t num_bypasses;  // Calls that parsed an input that cannot be cached.
+} AvifInfoCacheStats;
+
+// Sets the 'stats' to the counts of AvifInfoCacheGetFeatures() calls so far.
+void AvifInfoCacheGetStats(const AvifInfoCache* cache,
+                           AvifInfoCacheStats* stats);
+
+//------------------------------------------------------------------------------
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // AVIFINFO_CACHE_H_
@@ -0,0 +1,414 @@
+// Copyright (c) 2021, Alliance for Open Media. All rights reserved
+//
+// This source code is subject to the terms of the BSD 2 Clause License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 2 Clause License
+// was not distributed with this source code in the LICENSE file, you can
+// obtain it at www.aomedia.org/license/software. If the Alliance for Open
+// Media Patent License 1.0 was not distributed with this source code in the
+// PATENTS file, you can obtain it at www.aomedia.org/license/patent.
+
+// Measures the time per call, the number of callbacks per call and the number
+// of bytes touched per call of each public entry point, over the test files
+// and some synthetic headers. Must be run from the tests/ directory.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "avifinfo.h"
+#include "benchmark/benchmark.h"
+
+namespace {
+
+using Data = std::vector<uint8_t>;
+
+Data LoadFile(const char file_name[]) {
+  std::ifstream file(file_name, std::ios::binary | std::ios::ate);
+  if (!file) return Data();
+  const auto file_size = file.tellg();
+  Data bytes(file_size * sizeof(char));
+  file.seekg(0);  // Rewind.
+  return file.read(reinterpret_cast<char*>(bytes.data()), file_size) ? bytes
+                                                                     : Data();
+}
+
+//------------------------------------------------------------------------------
+// Synthetic headers.
+
+void AppendBigEndian(uint32_t value, uint32_t num_bytes, Data& output) {
+  for (int i = num_bytes - 1; i >= 0; --i) {
+    output.push_back((value >> (i * 8)) & 0xff);
+  }
+}
+
+// Returns a box of 'type' containing the 'content'. 'version' is only written
+// if it is not negative.
+Data Box(const char type[4], const Data& content, int version = -1) {
+  Data box;
+  AppendBigEndian(8 + (version >= 0 ? 4 : 0) + content.size(), 4, box);
+  box.insert(box.end(), type, type + 4);
+  if (version >= 0) AppendBigEndian(version << 24, 4, box);  // No flags.
+  box.insert(box.end(), content.begin(), content.end());
+  return box;
+}
+
+Data Concat(const std::vector<Data>& parts) {
+  Data data;
+  for (const Data& part : parts) {
+    data.insert(data.end(), part.begin(), part.end());
+  }
+  return data;
+}
+
+// Returns a 1x1 AVIF header whose "ipco" box contains 'num_unknown_properties'
+// properties before the useful ones, and which has a "mdat" box of
+// 'mdat_size' bytes before the "meta" box.
+Data CreateAvif(uint32_t num_unknown_properties, uint32_t mdat_size) {
+  const Data ftyp = Box("ftyp", {'a', 'v', 'i', 'f', 0, 0, 0, 0, 'a', 'v', 'i',
+                                 'f', 'm', 'i', 'f', '1'});
+  const Data pitm = Box("pitm", {0, 1}, /*version=*/0);
+  const Data infe = Box("infe", {0, 1, 0, 0, 'a', 'v', '0', '1'}, 2);
+  const Data iinf = Box("iinf", Concat({{0, 1}, infe}), /*version=*/0);
+
+  std::vector<Data> properties;
+  for (uint32_t i = 0; i < num_unknown_properties; ++i) {
+    properties.push_back(Box("abcd", Data(4, 0)));
+  }
+  properties.push_back(Box("ispe", {0, 0, 0, 1, 0, 0, 0, 1}, /*version=*/0));
+  properties.push_back(Box("pixi", {3, 8, 8, 8}, /*version=*/0));
+  const Data ipco = Box("ipco", Concat(properties));
+  // One item with two associations, 1-based property indices on 7 bits.
+  const Data ipma = Box("ipma",
+                        {0, 0, 0, 1, 0, 1, 2,
+                         static_cast<uint8_t>(num_unknown_properties + 1),
+                         static_cast<uint8_t>(num_unknown_properties + 2)},
+                        /*version=*/0);
+  const Data iprp = Box("iprp", Concat({ipco, ipma}));
+  const Data meta = Box("meta", Concat({pitm, iinf, iprp}), /*version=*/0);
+
+  Data mdat;
+  if (mdat_size >= 8) mdat = Box("mdat", Data(mdat_size - 8, 0));
+  return Concat({ftyp, mdat, meta});
+}
+
+//------------------------------------------------------------------------------
+// Counting streams.
+
+struct Stream {
+  const Data* input;
+  size_t position = 0;
+  size_t window_size = 0;
+  // Only reset by the benchmarks themselves.
+  int64_t num_callbacks = 0;
+  int64_t num_touched_bytes = 0;
+
+  void Reset() { position = 0; }
+};
+
+const uint8_t* Read(void* stream, size_t num_bytes) {
+  Stream* s = reinterpret_cast<Stream*>(stream);
+  ++s->num_callbacks;
+  if (num_bytes > s->input->size() - s->position) return nullptr;
+  s->num_touched_bytes += num_bytes;
+  s->position += num_bytes;
+  return s->input->data() + s->position - num_bytes;
+}
+
+void Skip(void* stream, size_t num_bytes) {
+  Stream* s = reinterpret_cast<Stream*>(stream);
+  ++s->num_callbacks;
+  s->position += std::min(num_bytes, s->input->size() - s->position);
+}
+
+const uint8_t* Window(void* stream, size_t* num_bytes) {
+  Stream* s = reinterpret_cast<Stream*>(stream);
+  ++s->num_callbacks;
+  *num_bytes = std::min(s->window_size, s->input->size() - s->position);
+  s->num_touched_bytes += *num_bytes;
+  s->position += *num_bytes;
+  return s->input->data() + s->position - *num_bytes;
+}
+
+const uint8_t* ReadAt(void* stream, uint64_t offset, size_t num_bytes) {
+  Stream* s = reinterpret_cast<Stream*>(stream);
+  ++s->num_callbacks;
+  if (offset > s->input->size() || num_bytes > s->input->size() - offset) {
+    return nullptr;
+  }
+  s->num_touched_bytes += num_bytes;
+  return s->input->data() + offset;
+}
+
+//------------------------------------------------------------------------------
+// Benchmarks.
+
+// Reports the number of calls and bytes touched per second, and the number of
+// callbacks and bytes touched per call.
+void SetCounters(benchmark::State& state, int64_t num_callbacks,
+                 int64_t num_touched_bytes) {
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(num_touched_bytes);
+  state.counters["callbacks"] =
+      benchmark::Counter(static_cast<double>(num_callbacks),
+                         benchmark::Counter::kAvgIterations);
+  state.counters["touched_bytes"] =
+      benchmark::Counter(static_cast<double>(num_touched_bytes),
+                         benchmark::Counter::kAvgIterations);
+}
+void SetCounters(benchmark::State& state, const Stream& stream) {
+  SetCounters(state, stream.num_callbacks, stream.num_touched_bytes);
+}
+
+// Returns the number of bytes read (not skipped) by the parser when extracting
+// the features with 'options'. Used for the APIs without callbacks.
+int64_t GetNumTouchedBytes(const Data& input,
+                           const AvifInfoOptions* options = nullptr) {
+  Stream stream = {&input};
+  AvifInfoFeatures features;
+  AvifInfoGetFeaturesStreamWithOptions(&stream, Read, Skip, options,
+                                       &features);
+  return stream.num_touched_bytes;
+}
+
+void BM_Identify(benchmark::State& state, const Data& input) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(AvifInfoIdentify(input.data(), input.size()));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_IdentifyBatch(benchmark::State& state, const Data& input) {
+  // 64-byte prefixes of the input and of 3 times as many non-AVIF inputs.
+  const Data prefix(input.begin(),
+                    input.begin() + std::min<size_t>(64, input.size()));
+  Data other = prefix;
+  std::copy_n("\x89PNG\r\n\x1a\n", 8, other.begin());
+  std::vector<const uint8_t*> data;
+  std::vector<size_t> sizes;
+  for (int i = 0; i < 64; ++i) {
+    data.push_back((i % 4 == 0) ? prefix.data() : other.data());
+    sizes.push_back(prefix.size());
+  }
+  std::vector<AvifInfoStatus> statuses(data.size());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(AvifInfoIdentifyBatch(data.data(), sizes.data(),
+                                                   data.size(),
+                                                   statuses.data()));
+  }
+  state.SetItemsProcessed(state.iterations() * data.size());
+}
+
+void BM_GetFeatures(benchmark::State& state, const Data& input) {
+  AvifInfoFeatures features;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        AvifInfoGetFeatures(input.data(), input.size(), &features));
+  }
+  SetCounters(state, /*num_callbacks=*/0,
+              GetNumTouchedBytes(input) * state.iterations());
+}
+
+void BM_GetFeaturesDimensionsOnly(benchmark::State& state, const Data& input) {
+  const AvifInfoOptions options = {kAvifInfoFieldDimensions};
+  AvifInfoFeatures features;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(AvifInfoGetFeaturesWithOptions(
+        input.data(), input.size(), &options, &features));
+  }
+  SetCounters(state, /*num_callbacks=*/0,
+              GetNumTouchedBytes(input, &options) * state.iterations());
+}
+
+void BM_GetFeaturesIov(benchmark::State& state, const Data& input) {
+  // Split the input into 16-byte segments.
+  std::vector<AvifInfoSegment> segments;
+  for (size_t offset = 0; offset < input.size(); offset += 16) {
+    segments.push_back(
+        {input.data() + offset, std::min<size_t>(16, input.size() - offset)});
+  }
+  AvifInfoFeatures features;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        AvifInfoGetFeaturesIov(segments.data(), segments.size(), &features));
+  }
+  SetCounters(state, /*num_callbacks=*/0,
+              GetNumTouchedBytes(input) * state.iterations());
+}
+
+void BM_GetFeaturesBatch(benchmark::State& state, const Data& input) {
+  // As many copies as in a task, so that each one is a distinct memory area.
+  std::vector<Data> copies(AVIFINFO_BATCH_TASK_SIZE, input);
+  std::vector<const uint8_t*> data;
+  std::vector<size_t> sizes;
+  for (const Data& copy : copies) {
+    data.push_back(copy.data());
+    sizes.push_back(copy.size());
+  }
+  std::vector<AvifInfoFeatures> features(copies.size());
+  std::vector<AvifInfoStatus> statuses(copies.size());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(AvifInfoGetFeaturesBatch(
+        data.data(), sizes.data(), copies.size(), features.data(),
+        statuses.data(), /*batch_options=*/nullptr));
+  }
+  SetCounters(state, /*num_callbacks=*/0,
+              GetNumTouchedBytes(input) * state.iterations() * copies.size());
+  state.SetItemsProcessed(state.iterations() * copies.size());
+}
+
+void BM_IdentifyStream(benchmark::State& state, const Data& input) {
+  Stream stream = {&input};
+  for (auto _ : state) {
+    stream.Reset();
+    benchmark::DoNotOptimize(AvifInfoIdentifyStream(&stream, Read, Skip));
+  }
+  SetCounters(state, stream);
+}
+
+void BM_GetFeaturesStream(benchmark::State& state, const Data& input,
+                          skip_stream_t skip) {
+  Stream stream = {&input};
+  AvifInfoFeatures features;
+  for (auto _ : state) {
+    stream.Reset();
+    benchmark::DoNotOptimize(
+        AvifInfoIdentifyStream(&stream, Read, skip) == kAvifInfoOk &&
+        AvifInfoGetFeaturesStream(&stream, Read, skip, &features));
+  }
+  SetCounters(state, stream);
+}
+
+void BM_GetFeaturesStreamWindow(benchmark::State& state, const Data& input) {
+  Stream stream = {&input};
+  stream.window_size = 4096;
+  AvifInfoFeatures features;
+  for (auto _ : state) {
+    stream.Reset();
+    benchmark::DoNotOptimize(
+        AvifInfoGetFeaturesStreamWindow(&stream, Window, Skip, &features));
+  }
+  SetCounters(state, stream);
+}
+
+void BM_GetFeaturesStreamAt(benchmark::State& state, const Data& input) {
+  Stream stream = {&input};
+  AvifInfoFeatures features;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        AvifInfoGetFeaturesStreamAt(&stream, ReadAt, &features));
+  }
+  SetCounters(state, stream);
+}
+
+// Feeds the whole input at once, or in 'chunk_size'-byte chunks.
+void BM_Parser(benchmark::State& state, const Data& input, size_t chunk_size) {
+  AvifInfoFeatures features;
+  for (auto _ : state) {
+    AvifInfoParser* parser = AvifInfoParserCreate();
+    for (size_t offset = 0; offset < input.size(); offset += chunk_size) {
+      if (AvifInfoParserFeed(parser, input.data() + offset,
+                             std::min(chunk_size, input.size() - offset)) !=
+          kAvifInfoNotEnoughData) {
+        break;
+      }
+    }
+    benchmark::DoNotOptimize(AvifInfoParserGetFeatures(parser, &features));
+    AvifInfoParserDestroy(parser);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Follows the fetch plan of the parser.
+void BM_ParserNextRange(benchmark::State& state, const Data& input) {
+  Stream stream = {&input};
+  AvifInfoFeatures features;
+  for (auto _ : state) {
+    AvifInfoParser* parser = AvifInfoParserCreate();
+    uint64_t offset, size;
+    while (AvifInfoParserGetNextRange(parser, &offset, &size) ==
+               kAvifInfoNotEnoughData &&
+           offset < input.size()) {
+      size = std::min<uint64_t>(size, input.size() - offset);
+      ++stream.num_callbacks;
+      stream.num_touched_bytes += size;
+      AvifInfoParserFeedAt(parser, offset, input.data() + offset, size);
+    }
+    benchmark::DoNotOptimize(AvifInfoParserGetFeatures(parser, &features));
+    AvifInfoParserDestroy(parser);
+  }
+  SetCounters(state, stream);
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+  std::vector<std::pair<std::string, Data>> inputs;
+  for (const char* file_name :
+       {"avifinfo_test_1x1.avif", "avifinfo_test_2x2_alpha.avif",
+        "avifinfo_test_199x200_alpha_grid2x1.avif",
+        "avifinfo_test_20x20_gainmap.avif",
+        "avifinfo_test_12x34_gainmap_tmap.avif",
+        "avifinfo_test_12x34_gainmap_tmap_iref_after_iprp.avif"}) {
+    Data input = LoadFile(file_name);
+    if (input.empty()) {
+      fprintf(stderr, "Cannot load %s; run from the tests/ directory\n",
+              file_name);
+      return 1;
+    }
+    inputs.emplace_back(file_name, std::move(input));
+  }
+  inputs.emplace_back("synthetic_100_properties", CreateAvif(100, 0));
+  inputs.emplace_back("synthetic_mdat_before_meta", CreateAvif(0, 1 << 20));
+  for (const auto& input : inputs) {
+    if (AvifInfoGetFeatures(input.second.data(), input.second.size(),
+                            nullptr) != kAvifInfoOk) {
+      fprintf(stderr, "Cannot parse %s\n", input.first.c_str());
+      return 1;
+    }
+  }
+
+  for (const auto& input : inputs) {
+    const std::string& name = input.first;
+    const Data& data = input.second;
+    benchmark::RegisterBenchmark(("Identify/" + name).c_str(), BM_Identify,
+                                 data);
+    benchmark::RegisterBenchmark(("IdentifyBatch/" + name).c_str(),
+                                 BM_IdentifyBatch, data);
+    benchmark::RegisterBenchmark(("GetFeatures/" + name).c_str(),
+                                 BM_GetFeatures, data);
+    benchmark::RegisterBenchmark(("GetFeaturesDimensionsOnly/" + name).c_str(),
+                                 BM_GetFeaturesDimensionsOnly, data);
+    benchmark::RegisterBenchmark(("GetFeaturesIov/" + name).c_str(),
+                                 BM_GetFeaturesIov, data);
+    benchmark::RegisterBenchmark(("GetFeaturesBatch/" + name).c_str(),
+                                 BM_GetFeaturesBatch, data);
+    benchmark::RegisterBenchmark(("IdentifyStream/" + name).c_str(),
+                                 BM_IdentifyStream, data);
+    benchmark::RegisterBenchmark(("GetFeaturesStream/" + name).c_str(),
+                                 BM_GetFeaturesStream, data, Skip);
+    benchmark::RegisterBenchmark(("GetFeaturesStreamNoSkip/" + name).c_str(),
+                                 BM_GetFeaturesStream, data, nullptr);
+    benchmark::RegisterBenchmark(("GetFeaturesStreamWindow/" + name).c_str(),
+                                 BM_GetFeaturesStreamWindow, data);
+    benchmark::RegisterBenchmark(("GetFeaturesStreamAt/" + name).c_str(),
+                                 BM_GetFeaturesStreamAt, data);
+    benchmark::RegisterBenchmark(("Parser/" + name).c_str(), BM_Parser, data,
+                                 data.size());
+    benchmark::RegisterBenchmark(("Parser64BytesChunks/" + name).c_str(),
+                                 BM_Parser, data, 64);
+    benchmark::RegisterBenchmark(("ParserNextRange/" + name).c_str(),
+                                 BM_ParserNextRange, data);
+  }
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -135,6 +135,33 @@ static int IdentifyAndGetFeaturesStreams(const char* file_path) {
   return 0;
 }
 
+//------------------------------------------------------------------------------
+// Push-based API
+
+// Returns true if the file is an AVIF file and if a few features were
+// successfully parsed. The file is read in chunks and parsed as it arrives.
+static int IdentifyAndGetFeaturesParser(const char* file_path) {
+  FILE* file = fopen(file_path, "rb");
+  if (!file) return 0;
+  AvifInfoParser* parser = AvifInfoParserCreate();
+  AvifInfoStatus status = kAvifInfoNotEnoughData;
+  uint8_t data[100];  // Any chunk size works.
+  size_t data_size;
+  while (parser && status == kAvifInfoNotEnoughData &&
+         (data_size = fread(data, 1, sizeof(data), file)) > 0) {
+    status = AvifInfoParserFeed(parser, data, data_size);
+  }
+  fclose(file);
+  AvifInfoFeatures features;
+  if (AvifInfoParserGetFeatures(parser, &features) == kAvifInfoOk) {
+    // Use features.width, features.height etc.
+    AvifInfoParserDestroy(parser);
+    return 1;
+  }
+  AvifInfoParserDestroy(parser);
+  return 0;
+}
+
 //------------------------------------------------------------------------------
 
 int main(int argc, char** argv) {
@@ -146,7 +173,8 @@ int main(int argc, char** argv) {
   for (int i = 1; i < argc; ++i) {
     if (Identify(argv[i]) && IdentifyAndGetFeatures(argv[i]) &&
         IdentifyStream(argv[i]) && IdentifyAndGetFeaturesStream(argv[i]) &&
-        IdentifyAndGetFeaturesStreams(argv[i])) {
+        IdentifyAndGetFeaturesStreams(argv[i]) &&
+        IdentifyAndGetFeaturesParser(argv[i])) {
       printf("%s is valid\n", argv[i]);
     } else {
       fprintf(stderr, "ERROR: %s is NOT a valid AVIF file\n", argv[1]);
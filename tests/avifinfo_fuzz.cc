@@ -8,11 +8,16 @@
 // PATENTS file, you can obtain it at www.aomedia.org/license/patent.
 
 #include <algorithm>
+#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <vector>
 
 #include "avifinfo.h"
+#include "avifinfo.hpp"
+#include "avifinfo_cache.h"
 
 //------------------------------------------------------------------------------
 // Stream definition.
@@ -44,6 +49,60 @@ static void StreamSkip(void* stream, size_t num_bytes) {
   stream_data->data_size -= num_bytes;
 }
 
+// Returns up to 'window_size' bytes per call.
+struct WindowStreamData {
+  StreamData stream_data;
+  size_t window_size;
+};
+
+static const uint8_t* StreamWindow(void* stream, size_t* num_bytes) {
+  if (stream == nullptr || num_bytes == nullptr) std::abort();
+
+  WindowStreamData* window = reinterpret_cast<WindowStreamData*>(stream);
+  StreamData* stream_data = &window->stream_data;
+  *num_bytes = std::min(window->window_size, stream_data->data_size);
+  const uint8_t* data = stream_data->data;
+  stream_data->data += *num_bytes;
+  stream_data->data_size -= *num_bytes;
+  return data;
+}
+
+static void StreamWindowSkip(void* stream, size_t num_bytes) {
+  if (stream == nullptr) std::abort();
+  StreamSkip(&reinterpret_cast<WindowStreamData*>(stream)->stream_data,
+             num_bytes);
+}
+
+static const uint8_t* StreamReadAt(void* stream, uint64_t offset,
+                                   size_t num_bytes) {
+  if (stream == nullptr) std::abort();
+  if (num_bytes < 1 || num_bytes > AVIFINFO_MAX_NUM_READ_BYTES) std::abort();
+
+  const StreamData* stream_data = reinterpret_cast<StreamData*>(stream);
+  if (offset > stream_data->data_size ||
+      num_bytes > stream_data->data_size - offset) {
+    return nullptr;
+  }
+  return stream_data->data + offset;
+}
+
+// Streamed source of the C++ wrapper, with or without Skip().
+struct CppStream {
+  StreamData stream_data;
+  const uint8_t* Read(size_t num_bytes) {
+    return StreamRead(&stream_data, num_bytes);
+  }
+};
+struct CppStreamWithSkip : CppStream {
+  void Skip(size_t num_bytes) { StreamSkip(&stream_data, num_bytes); }
+};
+
+// Segmented source of the C++ wrapper, like a wrapped around ring buffer.
+struct CppRingBuffer {
+  std::array<AvifInfoSegment, 2> halves;
+  const std::array<AvifInfoSegment, 2>& segments() const { return halves; }
+};
+
 //------------------------------------------------------------------------------
 
 static bool Equals(const AvifInfoFeatures& lhs, const AvifInfoFeatures& rhs) {
@@ -56,11 +115,61 @@ static bool Equals(const AvifInfoFeatures& lhs, const AvifInfoFeatures& rhs) {
          lhs.primary_item_id_bytes == rhs.primary_item_id_bytes;
 }
 
+// A box among the bytes given to SplitBoxes().
+struct BoxSpan {
+  const uint8_t* type;  // Four characters.
+  const uint8_t* content;
+  size_t content_size;  // Truncated to the given bytes.
+};
+
+// Returns the boxes within the 'size' bytes of 'data', up to the first box
+// with an invalid header.
+static std::vector<BoxSpan> SplitBoxes(const uint8_t* data, size_t size) {
+  std::vector<BoxSpan> boxes;
+  for (size_t offset = 0; size - offset >= 8;) {
+    const uint8_t* const box = data + offset;
+    size_t header_size = 8;
+    uint64_t box_size = (uint64_t{box[0]} << 24) | (uint64_t{box[1]} << 16) |
+                        (uint64_t{box[2]} << 8) | box[3];
+    if (box_size == 1) {
+      if (size - offset < 16) break;
+      header_size = 16;
+      box_size = 0;
+      for (int i = 8; i < 16; ++i) box_size = (box_size << 8) | box[i];
+    } else if (box_size == 0) {
+      box_size = size - offset;  // Last box.
+    }
+    if (box_size < header_size) break;
+    const size_t available_size =
+        static_cast<size_t>(std::min<uint64_t>(box_size, size - offset));
+    boxes.push_back({box + 4, box + header_size,
+                     available_size - std::min(available_size, header_size)});
+    if (box_size > size - offset) break;
+    offset += available_size;
+  }
+  return boxes;
+}
+
+// Returns true if a top-level "moov" box starts before any top-level "meta"
+// box within the 'size' bytes of 'data'.
+static bool MoovIsBeforeMeta(const uint8_t* data, size_t size) {
+  for (const BoxSpan& box : SplitBoxes(data, size)) {
+    if (!std::memcmp(box.type, "moov", 4)) return true;
+    if (!std::memcmp(box.type, "meta", 4)) return false;
+  }
+  return false;
+}
+
 // Test a random bitstream of random size, whether it is valid or not.
 extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t data_size) {
   AvifInfoStatus previous_status_identity = kAvifInfoNotEnoughData;
   AvifInfoStatus previous_status_features = kAvifInfoNotEnoughData;
   AvifInfoFeatures previous_features = {0};
+  // Fed with the new bytes of each iteration, which should be the same as
+  // parsing the whole prefix at once.
+  AvifInfoParser* parser = AvifInfoParserCreate();
+  if (parser == nullptr) std::abort();
+  size_t num_fed_bytes = 0;
 
   // Check the consistency of the returned status and features:
   // for a given size and a status that is not kAvifInfoNotEnoughData, any
@@ -77,6 +186,15 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t data_size) {
     const AvifInfoStatus status_features =
         AvifInfoGetFeatures(data, size, &features);
 
+    // Batch identification, with or without its fast path.
+    const uint8_t* const batch_data[1] = {data};
+    AvifInfoStatus status_identity_batch;
+    if (AvifInfoIdentifyBatch(batch_data, &size, 1, &status_identity_batch) !=
+            (status_identity == kAvifInfoOk ? 1u : 0u) ||
+        status_identity_batch != status_identity) {
+      std::abort();
+    }
+
     // Once a status different than kAvifInfoNotEnoughData is returned, it
     // should not change even with more input bytes.
     if ((previous_status_identity != kAvifInfoNotEnoughData &&
@@ -125,7 +243,9 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t data_size) {
         AvifInfoIdentifyStream(&stream_identity, StreamRead, StreamSkip);
     const AvifInfoStatus status_features_stream = AvifInfoGetFeaturesStream(
         &stream_features, StreamRead, StreamSkip, &features_stream);
-    // Both API should have exactly the same behavior, errors included.
+    // Both API should have exactly the same behavior, errors included, even
+    // though the raw pointer API reads straight from memory without calling
+    // StreamRead() or StreamSkip().
     if (status_identity_stream != status_identity) {
       std::abort();
     }
@@ -138,6 +258,13 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t data_size) {
          !Equals(features_stream, features))) {
       std::abort();
     }
+    // AvifInfoGetFeatures() parses the "ftyp" box once but should return
+    // exactly what AvifInfoIdentify() followed by AvifInfoGetFeaturesStream()
+    // returns, errors included.
+    if (status_identity_stream != kAvifInfoOk &&
+        status_features != status_identity_stream) {
+      std::abort();
+    }
 
     // Another way of calling the stream API: reuse the stream object that was
     // used for AvifInfoIdentifyStream().
@@ -193,9 +320,316 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t data_size) {
       }
     }
 
+    // Requesting fewer fields may need fewer bytes but leads to the same
+    // values. Requesting all fields is the default.
+    AvifInfoOptions options = {kAvifInfoFieldAll};
+    AvifInfoFeatures features_options;
+    if (AvifInfoGetFeaturesWithOptions(data, size, &options,
+                                       &features_options) != status_features ||
+        !Equals(features_options, features)) {
+      std::abort();
+    }
+    options.requested_fields = kAvifInfoFieldDimensions;
+    const AvifInfoStatus status_dimensions = AvifInfoGetFeaturesWithOptions(
+        data, size, &options, &features_options);
+    if (status_features == kAvifInfoOk &&
+        (status_dimensions != kAvifInfoOk ||
+         features_options.width != features.width ||
+         features_options.height != features.height)) {
+      std::abort();
+    }
+    if (status_dimensions == kAvifInfoOk &&
+        (features_options.bit_depth != 0 ||
+         features_options.num_channels != 0 ||
+         features_options.has_gainmap != 0 ||
+         features_options.primary_item_id_location != 0)) {
+      std::abort();
+    }
+
+    // A budget either changes nothing or stops the parsing.
+    AvifInfoBudgetReason budget_reason;
+    AvifInfoOptions budget_options = {};
+    budget_options.budget.max_num_read_bytes = size / 2 + 1;
+    budget_options.budget.exceeded = &budget_reason;
+    const AvifInfoStatus status_budget = AvifInfoGetFeaturesWithOptions(
+        data, size, &budget_options, &features_options);
+    if (!(status_budget == kAvifInfoTooComplex &&
+          budget_reason == kAvifInfoBudgetReadBytes) &&
+        (status_budget != status_features ||
+         budget_reason != kAvifInfoBudgetNone ||
+         !Equals(features_options, features))) {
+      std::abort();
+    }
+
+    // Batch API. Each input is parsed independently.
+    {
+      const uint8_t* const batch_data[2] = {data, data};
+      const size_t batch_sizes[2] = {size, size / 2};
+      AvifInfoFeatures batch_features[2];
+      AvifInfoStatus batch_statuses[2];
+      const AvifInfoStatus status_half =
+          AvifInfoGetFeatures(data, size / 2, &features_options);
+      if (AvifInfoGetFeaturesBatch(batch_data, batch_sizes, 2, batch_features,
+                                   batch_statuses, /*batch_options=*/nullptr) !=
+              (status_features == kAvifInfoOk ? 1u : 0u) +
+                  (status_half == kAvifInfoOk ? 1u : 0u) ||
+          batch_statuses[0] != status_features ||
+          !Equals(batch_features[0], features) ||
+          batch_statuses[1] != status_half ||
+          !Equals(batch_features[1], features_options)) {
+        std::abort();
+      }
+    }
+
+    // The cache returns the same results, whether it is hit or not.
+    static AvifInfoCache* const cache = AvifInfoCacheCreate(64);
+    for (int i = 0; i < 2; ++i) {
+      if (AvifInfoCacheGetFeatures(cache, data, size, &features_options) !=
+              status_features ||
+          !Equals(features_options, features)) {
+        std::abort();
+      }
+    }
+
+    // The indexed associations behave like the default ones within the same
+    // limits.
+    static uint8_t scratch[1 << 16];
+    AvifInfoOptions scratch_options = {};
+    scratch_options.scratch = scratch;
+    scratch_options.scratch_size = sizeof(scratch);
+    if (AvifInfoGetScratchSize(&scratch_options) > sizeof(scratch) ||
+        AvifInfoGetFeaturesWithOptions(data, size, &scratch_options,
+                                       &features_options) != status_features ||
+        !Equals(features_options, features)) {
+      std::abort();
+    }
+
+    // The item locations are within the bounds of a 64-bit file.
+    AvifInfoExtent tiles[4] = {};
+    AvifInfoItemExtents extents = {};
+    extents.tiles = tiles;
+    extents.max_num_tiles = 4;
+    AvifInfoThumbnail thumbnail;
+    AvifInfoOptions extents_options = {};
+    extents_options.extents = &extents;
+    extents_options.thumbnail = &thumbnail;
+    if (AvifInfoGetFeaturesWithOptions(data, size, &extents_options,
+                                       &features_options) == kAvifInfoOk) {
+      for (const AvifInfoExtent& extent :
+           {extents.primary_item, extents.alpha_item, extents.gainmap_item,
+            tiles[0], tiles[1], tiles[2], tiles[3], thumbnail.extent}) {
+        if (extent.size > UINT64_MAX - extent.offset) std::abort();
+      }
+    }
+
+    // Listing the items does not change the features of the primary item. It
+    // may need more bytes or limits that are not needed otherwise, since the
+    // whole "meta" box may be parsed. The listed primary item matches them.
+    AvifInfoItem item_array[4];
+    AvifInfoItems items = {item_array, 4};
+    AvifInfoOptions items_options = {};
+    items_options.items = &items;
+    const AvifInfoStatus status_items = AvifInfoGetFeaturesWithOptions(
+        data, size, &items_options, &features_options);
+    if (status_items == kAvifInfoOk &&
+        (status_features != kAvifInfoOk ||
+         !Equals(features_options, features))) {
+      std::abort();
+    }
+    if (status_features == kAvifInfoOk && status_items != kAvifInfoOk &&
+        status_items != kAvifInfoNotEnoughData &&
+        status_items != kAvifInfoTooComplex) {
+      std::abort();
+    }
+    if (status_items == kAvifInfoOk && !items.parsed && items.num_items != 0) {
+      std::abort();
+    }
+    if (status_items == kAvifInfoOk) {
+      for (uint32_t i = 0; i < items.num_items && i < 4; ++i) {
+        if ((item_array[i].roles & kAvifInfoItemPrimary) &&
+            item_array[i].width != 0 &&
+            (item_array[i].width != features_options.width ||
+             item_array[i].height != features_options.height)) {
+          std::abort();
+        }
+      }
+    }
+
+    // Looking for a track does not change the features of the still image.
+    // If the "moov" box comes first, the features are those of the track,
+    // which are the only ones without any primary item id.
+    AvifInfoTrack track;
+    AvifInfoOptions track_options = {};
+    track_options.track = &track;
+    if (AvifInfoGetFeaturesWithOptions(data, size, &track_options,
+                                       &features_options) == kAvifInfoOk) {
+      const bool features_are_from_track =
+          MoovIsBeforeMeta(data, size) &&
+          features_options.primary_item_id_bytes == 0;
+      if (status_features == kAvifInfoOk && !features_are_from_track &&
+          !Equals(features_options, features)) {
+        std::abort();
+      }
+    } else if (track.track_id != 0) {
+      std::abort();
+    }
+
+    // Collecting statistics does not change the outcome.
+    AvifInfoParseStats stats;
+    options = {kAvifInfoFieldAll, &stats};
+    if (AvifInfoGetFeaturesWithOptions(data, size, &options,
+                                       &features_options) != status_features ||
+        !Equals(features_options, features) || stats.num_read_calls != 0 ||
+        stats.num_skip_calls != 0 ||
+        (stats.features_offset != 0 &&
+         stats.features_offset !=
+             stats.num_read_bytes + stats.num_skipped_bytes)) {
+      std::abort();
+    }
+
+    // Segmented API. Split the input in a few segments of various sizes,
+    // including empty ones. It should behave exactly like the raw pointer API.
+    AvifInfoSegment segments[8];
+    size_t num_segments = 0;
+    for (size_t offset = 0; offset < size || num_segments == 0;) {
+      size_t segment_size = (num_segments == 7) ? size - offset
+                            : (num_segments % 3 == 1)
+                                ? 0
+                                : std::min<size_t>(1 + num_segments * 5,
+                                                   size - offset);
+      segments[num_segments++] = {data + offset, segment_size};
+      offset += segment_size;
+      if (num_segments == 8) break;
+    }
+    AvifInfoFeatures features_iov;
+    if (AvifInfoIdentifyIov(segments, num_segments) != status_identity ||
+        AvifInfoGetFeaturesIov(segments, num_segments, &features_iov) !=
+            status_features ||
+        !Equals(features_iov, features)) {
+      std::abort();
+    }
+
+    // C++ wrapper. Each kind of source should behave exactly like the raw
+    // pointer API.
+    {
+      const avifinfo::Span span(data, size);
+      CppRingBuffer ring_buffer = {{{{data, size / 2},
+                                     {data + size / 2, size - size / 2}}}};
+      CppStreamWithSkip stream_with_skip = {{{data, size}}};
+      AvifInfoFeatures features_cpp;
+      if (avifinfo::Parser(span).Identify() != status_identity ||
+          avifinfo::Parser(span).GetFeatures(&features_cpp) !=
+              status_features ||
+          !Equals(features_cpp, features) ||
+          avifinfo::Parser(ring_buffer).Identify() != status_identity ||
+          avifinfo::Parser(ring_buffer).GetFeatures(&features_cpp) !=
+              status_features ||
+          !Equals(features_cpp, features) ||
+          avifinfo::Parser(stream_with_skip).GetFeatures(&features_cpp) !=
+              status_features ||
+          !Equals(features_cpp, features)) {
+        std::abort();
+      }
+      // Without Skip(), see the no skip stream API check above.
+      CppStream stream = {{data, size}};
+      const AvifInfoStatus status_cpp =
+          avifinfo::Parser(stream).GetFeatures(&features_cpp);
+      if (status_cpp != status_features &&
+          status_cpp != kAvifInfoNotEnoughData) {
+        std::abort();
+      }
+      if (status_cpp == status_features && !Equals(features_cpp, features)) {
+        std::abort();
+      }
+    }
+
+    // Windowed API, with and without a skip function. Skipping never fails
+    // so it should behave exactly like the raw pointer API.
+    for (size_t window_size : {size_t{1}, size_t{3}, size_t{64}, size}) {
+      for (skip_stream_t skip : {StreamWindowSkip, (skip_stream_t) nullptr}) {
+        AvifInfoFeatures features_window;
+        WindowStreamData stream_window = {{data, size}, window_size};
+        if (AvifInfoIdentifyStreamWindow(&stream_window, StreamWindow, skip) !=
+            status_identity) {
+          std::abort();
+        }
+        stream_window = {{data, size}, window_size};
+        if (AvifInfoGetFeaturesStreamWindow(&stream_window, StreamWindow, skip,
+                                            &features_window) !=
+                status_features ||
+            !Equals(features_window, features)) {
+          std::abort();
+        }
+      }
+    }
+
+    // Random access API. Skipping never fails so it should behave exactly
+    // like the raw pointer API.
+    AvifInfoFeatures features_at;
+    StreamData stream_at = {data, size};
+    if (AvifInfoIdentifyStreamAt(&stream_at, StreamReadAt) != status_identity ||
+        AvifInfoGetFeaturesStreamAt(&stream_at, StreamReadAt, &features_at) !=
+            status_features ||
+        !Equals(features_at, features)) {
+      std::abort();
+    }
+
+    // Push-based API following the fetch plan, restricted to the first 'size'
+    // bytes.
+    AvifInfoParser* parser_at = AvifInfoParserCreate();
+    if (parser_at == nullptr) std::abort();
+    uint64_t range_offset, range_size;
+    AvifInfoStatus status_at;
+    while ((status_at = AvifInfoParserGetNextRange(parser_at, &range_offset,
+                                                   &range_size)) ==
+               kAvifInfoNotEnoughData &&
+           range_offset < size) {
+      if (range_size == 0) std::abort();
+      range_size = std::min<uint64_t>(range_size, size - range_offset);
+      AvifInfoParserFeedAt(parser_at, range_offset, data + range_offset,
+                           range_size);
+    }
+    if (AvifInfoParserGetFeatures(parser_at, &features_at) != status_at ||
+        status_at != status_features || !Equals(features_at, features)) {
+      std::abort();
+    }
+    AvifInfoParserDestroy(parser_at);
+
+    // Push-based API.
+    AvifInfoFeatures features_parser;
+    const AvifInfoStatus status_feed =
+        AvifInfoParserFeed(parser, data + num_fed_bytes, size - num_fed_bytes);
+    num_fed_bytes = size;
+    if (AvifInfoParserGetFeatures(parser, &features_parser) != status_feed) {
+      std::abort();
+    }
+    if (status_feed != status_features ||
+        !Equals(features_parser, features)) {
+      std::abort();
+    }
+    AvifInfoDataSizeHint hint;
+    if (AvifInfoParserGetDataSizeHint(parser, &hint) != status_feed) {
+      std::abort();
+    }
+    if (status_feed == kAvifInfoNotEnoughData) {
+      if (hint.min_data_size <= size ||
+          (hint.meta_data_size != 0 && hint.meta_data_size < size)) {
+        std::abort();
+      }
+      // The whole "meta" box is enough to get a final status.
+      if (hint.meta_data_size != 0 && hint.meta_data_size <= data_size &&
+          AvifInfoGetFeatures(data, hint.meta_data_size, nullptr) ==
+              kAvifInfoNotEnoughData) {
+        std::abort();
+      }
+    } else if (hint.min_data_size != 0 || hint.meta_data_size != 0) {
+      std::abort();
+    }
+
     previous_status_identity = status_identity;
     previous_status_features = status_features;
     previous_features = features;
   }
+  AvifInfoParserDestroy(parser);
   return 0;
 }
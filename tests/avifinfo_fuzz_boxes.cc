@@ -0,0 +1,324 @@
+// Copyright (c) 2024, Alliance for Open Media. All rights reserved
+//
+// This source code is subject to the terms of the BSD 2 Clause License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 2 Clause License
+// was not distributed with this source code in the LICENSE file, you can
+// obtain it at www.aomedia.org/license/software. If the Alliance for Open
+// Media Patent License 1.0 was not distributed with this source code in the
+// PATENTS file, you can obtain it at www.aomedia.org/license/patent.
+
+// Fuzz target with a custom mutator aware of the ISOBMFF box structure.
+// Byte-level mutations mostly produce box headers that are rejected right
+// away. Here boxes are inserted, removed, duplicated, swapped and resized, and
+// the sizes of the enclosing boxes are fixed up, so that most executions reach
+// the "ipco", "ipma", "iref" etc. parsing. Each input is parsed once by
+// AvifInfoGetFeatures() and once, chunk by chunk, by AvifInfoParser, instead
+// of for every prefix size as in avifinfo_fuzz.cc.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "avifinfo.h"
+
+namespace {
+
+//------------------------------------------------------------------------------
+// Box tree
+
+// Location of a box in the input.
+struct Box {
+  size_t offset;          // Of the box header.
+  size_t header_size;     // Including the 64-bit size, if any.
+  size_t size;            // Of the whole box.
+  size_t content_offset;  // Of the first child, if it is a container.
+  int parent;             // Index of the enclosing box, or -1 if top-level.
+  bool is_container;
+};
+
+constexpr size_t kMaxNumBoxes = 256;
+constexpr int kMaxNestingLevel = 8;
+
+// Box types parsed by libavifinfo, used for inserted boxes.
+constexpr char kBoxTypes[][5] = {
+    "ftyp", "meta", "hdlr", "pitm", "iloc", "iinf", "infe", "iref", "dimg",
+    "thmb", "auxl", "prem", "iprp", "ipco", "ispe", "pixi", "av1C", "auxC",
+    "colr", "ipma", "grpl", "altr", "mdat", "free", "moov", "trak", "tmap"};
+
+uint64_t ReadBigEndian(const uint8_t* data, size_t num_bytes) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < num_bytes; ++i) value = (value << 8) | data[i];
+  return value;
+}
+
+void WriteBigEndian(uint64_t value, size_t num_bytes, uint8_t* data) {
+  for (size_t i = num_bytes; i-- > 0; value >>= 8) data[i] = value & 0xff;
+}
+
+// Returns the offset of the first child of the box of 'type' whose header of
+// 'header_size' bytes starts at 'offset', or 0 if it is not a container.
+size_t GetContentOffset(const std::vector<uint8_t>& data, size_t offset,
+                        size_t header_size, size_t size, const uint8_t* type) {
+  const size_t end = offset + size;
+  size_t content_offset = offset + header_size;
+  if (!std::memcmp(type, "meta", 4) || !std::memcmp(type, "iref", 4)) {
+    content_offset += 4;  // Full box header.
+  } else if (!std::memcmp(type, "iinf", 4)) {
+    // Full box header and 16-bit or 32-bit entry count.
+    if (content_offset + 4 > end) return 0;
+    content_offset += (data[content_offset] == 0) ? 4 + 2 : 4 + 4;
+  } else if (std::memcmp(type, "iprp", 4) && std::memcmp(type, "ipco", 4) &&
+             std::memcmp(type, "grpl", 4) && std::memcmp(type, "moov", 4) &&
+             std::memcmp(type, "trak", 4)) {
+    return 0;
+  }
+  return (content_offset <= end) ? content_offset : 0;
+}
+
+// Appends the boxes found between 'begin' and 'end' in 'data' to 'boxes',
+// recursively. Stops at the first box that does not fit.
+void ParseBoxes(const std::vector<uint8_t>& data, size_t begin, size_t end,
+                int parent, int nesting_level, std::vector<Box>& boxes) {
+  while (end - begin >= 8 && boxes.size() < kMaxNumBoxes) {
+    Box box = {begin, 8, 0, 0, parent, false};
+    const uint8_t* const type = &data[begin + 4];
+    box.size = ReadBigEndian(&data[begin], 4);
+    if (box.size == 1) {
+      if (end - begin < 16) return;
+      box.header_size = 16;
+      const uint64_t size = ReadBigEndian(&data[begin + 8], 8);
+      if (size > end - begin) return;
+      box.size = size;
+    } else if (box.size == 0) {
+      box.size = end - begin;  // Extends to the end of the parent.
+    }
+    if (box.size < box.header_size || box.size > end - begin) return;
+    box.content_offset =
+        GetContentOffset(data, begin, box.header_size, box.size, type);
+    box.is_container =
+        box.content_offset != 0 && nesting_level < kMaxNestingLevel;
+    boxes.push_back(box);
+    if (box.is_container) {
+      ParseBoxes(data, box.content_offset, begin + box.size,
+                 static_cast<int>(boxes.size() - 1), nesting_level + 1, boxes);
+    }
+    begin += box.size;
+  }
+}
+
+// Adds 'delta' to the size of the 'boxes' from 'index' up to the top level.
+// 'delta' bytes must have been inserted (or removed if negative) within the
+// box at 'index'. Returns false if a size field is too small.
+bool FixUpSizes(std::vector<uint8_t>& data, const std::vector<Box>& boxes,
+                int index, int64_t delta) {
+  for (; index >= 0; index = boxes[index].parent) {
+    const Box& box = boxes[index];
+    const uint64_t size = ReadBigEndian(&data[box.offset], 4);
+    if (size == 0) continue;  // Still extends to the end of the parent.
+    const uint64_t new_size =
+        static_cast<uint64_t>(static_cast<int64_t>(box.size) + delta);
+    if (size == 1) {
+      WriteBigEndian(new_size, 8, &data[box.offset + 8]);
+    } else if (new_size <= UINT32_MAX && new_size != 0 && new_size != 1) {
+      WriteBigEndian(new_size, 4, &data[box.offset]);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Mutations
+
+using Random = std::minstd_rand;
+
+size_t GetRandom(Random& random, size_t max_value_plus_one) {
+  return static_cast<size_t>(random()) % max_value_plus_one;
+}
+
+// Returns the index of a random container or -1 for the top level.
+int GetRandomParent(const std::vector<Box>& boxes, Random& random) {
+  std::vector<int> containers = {-1};
+  for (size_t i = 0; i < boxes.size(); ++i) {
+    if (boxes[i].is_container) containers.push_back(static_cast<int>(i));
+  }
+  return containers[GetRandom(random, containers.size())];
+}
+
+// Returns a random offset between two children of 'parent', or at either end.
+size_t GetRandomChildBoundary(const std::vector<Box>& boxes, int parent,
+                              Random& random) {
+  std::vector<size_t> offsets = {parent < 0 ? 0 : boxes[parent].content_offset};
+  for (const Box& box : boxes) {
+    if (box.parent == parent) offsets.push_back(box.offset + box.size);
+  }
+  return offsets[GetRandom(random, offsets.size())];
+}
+
+// Returns a new box of a random type known by libavifinfo, with a few random
+// bytes of content.
+std::vector<uint8_t> CreateRandomBox(Random& random) {
+  const char* const type = kBoxTypes[GetRandom(random, std::size(kBoxTypes))];
+  std::vector<uint8_t> box(8 + GetRandom(random, 33));
+  WriteBigEndian(box.size(), 4, box.data());
+  std::memcpy(&box[4], type, 4);
+  for (size_t i = 8; i < box.size(); ++i) box[i] = random() & 0xff;
+  // Version 0 makes any full box parsable.
+  if (box.size() >= 12 && (random() & 1)) std::fill(&box[8], &box[12], 0);
+  return box;
+}
+
+// Applies one structural change to 'data'. Returns false if none applies.
+bool MutateBoxes(std::vector<uint8_t>& data, Random& random) {
+  std::vector<Box> boxes;
+  ParseBoxes(data, 0, data.size(), /*parent=*/-1, /*nesting_level=*/0, boxes);
+  const int index = boxes.empty()
+                        ? -1
+                        : static_cast<int>(GetRandom(random, boxes.size()));
+  switch (GetRandom(random, 5)) {
+    case 0: {  // Insert a new box.
+      const int parent = GetRandomParent(boxes, random);
+      const size_t offset = GetRandomChildBoundary(boxes, parent, random);
+      const std::vector<uint8_t> box = CreateRandomBox(random);
+      data.insert(data.begin() + offset, box.begin(), box.end());
+      return FixUpSizes(data, boxes, parent, box.size());
+    }
+    case 1: {  // Remove a box.
+      if (index < 0) return false;
+      const Box& box = boxes[index];
+      data.erase(data.begin() + box.offset,
+                 data.begin() + box.offset + box.size);
+      return FixUpSizes(data, boxes, box.parent,
+                        -static_cast<int64_t>(box.size));
+    }
+    case 2: {  // Duplicate a box, right after itself.
+      if (index < 0) return false;
+      const Box& box = boxes[index];
+      const std::vector<uint8_t> copy(data.begin() + box.offset,
+                                      data.begin() + box.offset + box.size);
+      data.insert(data.begin() + box.offset + box.size, copy.begin(),
+                  copy.end());
+      return FixUpSizes(data, boxes, box.parent, copy.size());
+    }
+    case 3: {  // Swap a box with the next sibling.
+      if (index < 0) return false;
+      const Box& box = boxes[index];
+      const auto next = std::find_if(
+          boxes.begin() + index + 1, boxes.end(), [&](const Box& other) {
+            return other.parent == box.parent;
+          });
+      if (next == boxes.end() || next->offset != box.offset + box.size) {
+        return false;
+      }
+      std::rotate(data.begin() + box.offset, data.begin() + next->offset,
+                  data.begin() + next->offset + next->size);
+      return true;
+    }
+    default: {  // Grow or shrink the end of the content of a leaf box.
+      if (index < 0 || boxes[index].is_container) return false;
+      const Box& box = boxes[index];
+      const size_t end = box.offset + box.size;
+      if ((random() & 1) && box.size > box.header_size) {
+        const size_t num_bytes =
+            1 + GetRandom(random, std::min<size_t>(box.size - box.header_size,
+                                                   16));
+        data.erase(data.begin() + end - num_bytes, data.begin() + end);
+        return FixUpSizes(data, boxes, index,
+                          -static_cast<int64_t>(num_bytes));
+      }
+      const size_t num_bytes = 1 + GetRandom(random, 16);
+      data.insert(data.begin() + end, num_bytes,
+                  static_cast<uint8_t>(random()));
+      return FixUpSizes(data, boxes, index, num_bytes);
+    }
+  }
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+
+// Provided by libFuzzer.
+extern "C" size_t LLVMFuzzerMutate(uint8_t* data, size_t size,
+                                   size_t max_size);
+
+extern "C" size_t LLVMFuzzerCustomMutator(uint8_t* data, size_t size,
+                                          size_t max_size, unsigned int seed) {
+  Random random(seed);
+  // Keep some byte-level mutations for the content of the boxes.
+  if (GetRandom(random, 4) != 0) {
+    std::vector<uint8_t> mutated(data, data + size);
+    for (size_t i = 1 + GetRandom(random, 3); i > 0; --i) {
+      if (!MutateBoxes(mutated, random)) break;
+    }
+    if (mutated.size() <= max_size &&
+        (mutated.size() != size ||
+         !std::equal(mutated.begin(), mutated.end(), data))) {
+      std::copy(mutated.begin(), mutated.end(), data);
+      return mutated.size();
+    }
+  }
+  return LLVMFuzzerMutate(data, size, max_size);
+}
+
+// Checks that AvifInfoParser fed with chunks of the input agrees with
+// AvifInfoGetFeatures() on the whole input. The status of AvifInfoParser is
+// final once it is not kAvifInfoNotEnoughData, so that is also what
+// AvifInfoGetFeatures() returns on any longer input.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t data_size) {
+  AvifInfoFeatures features;
+  const AvifInfoStatus status = AvifInfoGetFeatures(data, data_size, &features);
+  if (status == kAvifInfoOk) {
+    if (AvifInfoIdentify(data, data_size) != kAvifInfoOk ||
+        features.width == 0u || features.height == 0u ||
+        features.bit_depth == 0u || features.num_channels == 0u ||
+        (!features.has_gainmap && features.gainmap_item_id) ||
+        features.primary_item_id_location + features.primary_item_id_bytes >
+            data_size) {
+      std::abort();
+    }
+  }
+
+  AvifInfoParser* const parser = AvifInfoParserCreate();
+  if (parser == nullptr) return 0;
+  AvifInfoStatus chunked_status = kAvifInfoNotEnoughData;
+  for (size_t offset = 0; offset < data_size &&
+                          chunked_status == kAvifInfoNotEnoughData;) {
+    // Chunk sizes derived from the input, to reach any split point.
+    const size_t chunk_size =
+        std::min<size_t>(1 + data[offset] % 64, data_size - offset);
+    chunked_status = AvifInfoParserFeed(parser, data + offset, chunk_size);
+    offset += chunk_size;
+    AvifInfoDataSizeHint hint;
+    if (AvifInfoParserGetDataSizeHint(parser, &hint) != chunked_status ||
+        (chunked_status == kAvifInfoNotEnoughData &&
+         (hint.min_data_size <= offset ||
+          (hint.meta_data_size != 0 && hint.meta_data_size <= offset)))) {
+      std::abort();
+    }
+  }
+  AvifInfoFeatures chunked_features;
+  if (AvifInfoParserGetFeatures(parser, &chunked_features) != chunked_status ||
+      chunked_status != status ||
+      (status == kAvifInfoOk &&
+       (chunked_features.width != features.width ||
+        chunked_features.height != features.height ||
+        chunked_features.bit_depth != features.bit_depth ||
+        chunked_features.num_channels != features.num_channels ||
+        chunked_features.has_gainmap != features.has_gainmap ||
+        chunked_features.gainmap_item_id != features.gainmap_item_id ||
+        chunked_features.primary_item_id_location !=
+            features.primary_item_id_location ||
+        chunked_features.primary_item_id_bytes !=
+            features.primary_item_id_bytes))) {
+    std::abort();
+  }
+  AvifInfoParserDestroy(parser);
+  return 0;
+}
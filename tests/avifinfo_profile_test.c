@@ -0,0 +1,132 @@
+// Copyright (c) 2024, Alliance for Open Media. All rights reserved
+//
+// This source code is subject to the terms of the BSD 2 Clause License and
+// the Alliance for Open Media Patent License 1.0. If the BSD 2 Clause License
+// was not distributed with this source code in the LICENSE file, you can
+// obtain it at www.aomedia.org/license/software. If the Alliance for Open
+// Media Patent License 1.0 was not distributed with this source code in the
+// PATENTS file, you can obtain it at www.aomedia.org/license/patent.
+
+// Checks the AVIFINFO_IDENTIFY_ONLY and AVIFINFO_NO_GAINMAP builds of
+// avifinfo.c, which the GoogleTest tests do not cover. Must be run from the
+// tests folder. Returns 0 on success.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "avifinfo.h"
+
+typedef struct {
+  const char* file_path;
+  uint32_t width, height, bit_depth, num_channels;
+  uint32_t roles;  // Bitwise combination of the roles of all items.
+} TestFile;
+
+// The features that a full build outputs when kAvifInfoFieldGainmap is not
+// requested.
+static const TestFile kTestFiles[] = {
+    {"avifinfo_test_1x1.avif", 1, 1, 8, 3, kAvifInfoItemPrimary},
+    {"avifinfo_test_2x2_alpha.avif", 2, 2, 8, 4,
+     kAvifInfoItemPrimary | kAvifInfoItemAlpha},
+    {"avifinfo_test_20x20_gainmap.avif", 20, 20, 8, 3, kAvifInfoItemPrimary},
+    // The inputs of the "tmap" item are not tiles.
+    {"avifinfo_test_12x34_gainmap_tmap.avif", 12, 34, 10, 4,
+     kAvifInfoItemPrimary | kAvifInfoItemAlpha | kAvifInfoItemTmap},
+    {"avifinfo_test_12x34_gainmap_tmap_iref_after_iprp.avif", 12, 34, 10, 4,
+     kAvifInfoItemPrimary | kAvifInfoItemAlpha | kAvifInfoItemTmap},
+    {"avifinfo_test_199x200_alpha_grid2x1.avif", 199, 200, 8, 4,
+     kAvifInfoItemPrimary | kAvifInfoItemAlpha | kAvifInfoItemTile},
+    {"avifinfo_test_1x1_10b_nopixi_metasize64b_mdatsize0.avif", 1, 1, 10, 3,
+     kAvifInfoItemPrimary},
+};
+
+static int num_failures = 0;
+
+static void Check(int condition, const char* file_path, const char* what) {
+  if (!condition) {
+    fprintf(stderr, "Failure: %s: %s\n", file_path, what);
+    ++num_failures;
+  }
+}
+
+// Returns the size of the file, or 0 on failure.
+static size_t LoadFile(const char* file_path, uint8_t* data, size_t max_size) {
+  FILE* file = fopen(file_path, "rb");
+  if (!file) return 0;
+  const size_t data_size = fread(data, 1, max_size, file);
+  fclose(file);
+  return data_size;
+}
+
+#if !defined(AVIFINFO_IDENTIFY_ONLY)
+static void CheckFeatures(const TestFile* test_file, const uint8_t* data,
+                          size_t data_size) {
+  const char* const path = test_file->file_path;
+  AvifInfoFeatures features;
+  Check(AvifInfoGetFeatures(data, data_size, &features) == kAvifInfoOk, path,
+        "AvifInfoGetFeatures()");
+  Check(features.width == test_file->width, path, "width");
+  Check(features.height == test_file->height, path, "height");
+  Check(features.bit_depth == test_file->bit_depth, path, "bit_depth");
+  Check(features.num_channels == test_file->num_channels, path,
+        "num_channels");
+  Check(!features.has_gainmap && features.gainmap_item_id == 0, path,
+        "has_gainmap");
+
+  AvifInfoItem items[8];
+  AvifInfoItems all_items = {items, 8, 0};
+  AvifInfoItemExtents extents;
+  memset(&extents, 0, sizeof(extents));
+  AvifInfoOptions options;
+  memset(&options, 0, sizeof(options));
+  options.items = &all_items;
+  options.extents = &extents;
+  Check(AvifInfoGetFeaturesWithOptions(data, data_size, &options, &features) ==
+            kAvifInfoOk,
+        path, "AvifInfoGetFeaturesWithOptions()");
+  Check(extents.gainmap_item.offset == 0 && extents.gainmap_item.size == 0,
+        path, "gainmap_item");
+  uint32_t roles = 0;
+  for (uint32_t i = 0; i < all_items.num_items && i < 8; ++i) {
+    roles |= items[i].roles;
+  }
+  Check(roles == test_file->roles, path, "roles");
+}
+
+// The "iinf" box is validated as in a full build, which returns
+// kAvifInfoInvalidFile too (see IinfWithInvalidInfe in avifinfo_test.cc).
+static void CheckInvalidIinf(void) {
+  const char* const path = "avifinfo_test_1x1.avif";
+  static uint8_t data[4096];
+  const size_t data_size = LoadFile(path, data, sizeof(data));
+  size_t infe = 4;
+  while (infe + 4 <= data_size && memcmp(data + infe, "infe", 4) != 0) ++infe;
+  Check(infe + 4 <= data_size, path, "infe");
+  if (infe + 4 > data_size) return;
+  data[infe - 1] = 0xff;  // The "infe" box is bigger than its "iinf" parent.
+  AvifInfoFeatures features;
+  Check(AvifInfoGetFeatures(data, data_size, &features) ==
+            kAvifInfoInvalidFile,
+        path, "invalid iinf");
+}
+#endif  // !AVIFINFO_IDENTIFY_ONLY
+
+int main(void) {
+  static uint8_t data[4096];
+  for (size_t i = 0; i < sizeof(kTestFiles) / sizeof(kTestFiles[0]); ++i) {
+    const TestFile* const test_file = &kTestFiles[i];
+    const size_t data_size =
+        LoadFile(test_file->file_path, data, sizeof(data));
+    Check(data_size != 0, test_file->file_path, "LoadFile()");
+    Check(AvifInfoIdentify(data, data_size) == kAvifInfoOk,
+          test_file->file_path, "AvifInfoIdentify()");
+#if !defined(AVIFINFO_IDENTIFY_ONLY)
+    CheckFeatures(test_file, data, data_size);
+#endif
+  }
+#if !defined(AVIFINFO_IDENTIFY_ONLY)
+  CheckInvalidIinf();
+#endif
+  return num_failures == 0 ? 0 : 1;
+}
@@ -10,9 +10,16 @@
 #include "avifinfo.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
 #include <fstream>
+#include <thread>
 #include <vector>
 
+#include "avifinfo.hpp"
+#include "avifinfo_cache.h"
+
 #include "gtest/gtest.h"
 
 namespace {
@@ -46,6 +53,221 @@ bool SetPrimaryItemIdToGainmapId(Data& input) {
   return true;
 }
 
+// Inserts a "free" box of 'free_box_size' bytes right before the "meta" box.
+// Returns the offset of the "free" box.
+size_t InsertFreeBoxBeforeMeta(Data& input, uint32_t free_box_size) {
+  const uint8_t kMetaTag[] = {'m', 'e', 't', 'a'};
+  const auto meta_box =
+      std::search(input.begin(), input.end(), kMetaTag, kMetaTag + 4) - 4;
+  Data free_box(free_box_size, 0);
+  WriteBigEndian(free_box_size, 4, free_box.data());
+  free_box[4] = 'f', free_box[5] = 'r', free_box[6] = 'e', free_box[7] = 'e';
+  const size_t free_box_offset = meta_box - input.begin();
+  input.insert(meta_box, free_box.begin(), free_box.end());
+  return free_box_offset;
+}
+
+// Moves the first box of 'type' right after the first box of 'next_type'. Both
+// must be siblings with 32-bit sizes, in that order.
+void MoveBoxAfter(Data& input, const char type[4], const char next_type[4]) {
+  const auto find_box = [&input](const char tag[4]) {
+    return std::search(input.begin(), input.end(), tag, tag + 4) - 4;
+  };
+  const auto box_size = [](Data::const_iterator box) {
+    return (box[0] << 24) | (box[1] << 16) | (box[2] << 8) | box[3];
+  };
+  const auto box = find_box(type);
+  const Data moved_box(box, box + box_size(box));
+  input.erase(box, box + moved_box.size());
+  const auto next_box = find_box(next_type);
+  input.insert(next_box + box_size(next_box), moved_box.begin(),
+               moved_box.end());
+}
+
+void AppendBigEndian(uint32_t value, uint32_t num_bytes, Data& output) {
+  output.resize(output.size() + num_bytes);
+  WriteBigEndian(value, num_bytes, output.data() + output.size() - num_bytes);
+}
+
+// Returns a box of 'type' containing the 'content'. 'version' is only written
+// if it is not negative.
+Data Box(const char type[4], const Data& content, int version = -1) {
+  Data box;
+  AppendBigEndian(8 + (version >= 0 ? 4 : 0) + content.size(), 4, box);
+  box.insert(box.end(), type, type + 4);
+  if (version >= 0) AppendBigEndian(version << 24, 4, box);  // No flags.
+  box.insert(box.end(), content.begin(), content.end());
+  return box;
+}
+
+// Returns the header of a 10-bit grid image of 'num_tiles' 1x1 tiles. Item 1
+// is the grid. Its "ipma" entry comes after the ones of the tiles. If
+// 'with_thumbnail', the last item is an 8x16 thumbnail of the grid. If
+// 'with_iloc', the payload of item i is located at 1000*i and is i bytes long.
+Data CreateGrid(uint32_t num_tiles, bool with_iloc = false,
+                bool with_thumbnail = false) {
+  const uint32_t num_items = 1 + num_tiles + (with_thumbnail ? 1 : 0);
+  const Data ftyp = Box("ftyp", {'a', 'v', 'i', 'f', 0, 0, 0, 0});
+  const Data pitm = Box("pitm", {0, 1}, /*version=*/0);
+  const Data infe = Box("infe", {0, 1, 0, 0, 'g', 'r', 'i', 'd'}, 2);
+  Data iinf_content = {0, 1};
+  iinf_content.insert(iinf_content.end(), infe.begin(), infe.end());
+  const Data iinf = Box("iinf", iinf_content, /*version=*/0);
+
+  Data dimg_content = {0, 1};
+  AppendBigEndian(num_tiles, 2, dimg_content);
+  Data ipma_content;
+  AppendBigEndian(num_items, 4, ipma_content);
+  for (uint32_t tile = 0; tile < num_tiles; ++tile) {
+    AppendBigEndian(2 + tile, 2, dimg_content);
+    AppendBigEndian(2 + tile, 2, ipma_content);
+    ipma_content.insert(ipma_content.end(), {1, 2});  // pixi
+  }
+  Data iref_content = Box("dimg", dimg_content);
+  if (with_thumbnail) {
+    AppendBigEndian(num_items, 2, ipma_content);
+    ipma_content.insert(ipma_content.end(), {1, 3});  // Small ispe
+    Data thmb_content;
+    AppendBigEndian(num_items, 2, thmb_content);
+    thmb_content.insert(thmb_content.end(), {0, 1, 0, 1});  // To the grid
+    const Data thmb = Box("thmb", thmb_content);
+    iref_content.insert(iref_content.end(), thmb.begin(), thmb.end());
+  }
+  ipma_content.insert(ipma_content.end(), {0, 1, 1, 1});  // Grid: ispe
+  const Data iref = Box("iref", iref_content, /*version=*/0);
+  Data iloc_content = {0x44, 0};  // 4-byte offsets and lengths
+  AppendBigEndian(with_iloc ? num_items : 0, 2, iloc_content);
+  for (uint32_t item = 1; with_iloc && item <= num_items; ++item) {
+    AppendBigEndian(item, 2, iloc_content);
+    iloc_content.insert(iloc_content.end(), {0, 0, 0, 1});  // 1 extent
+    AppendBigEndian(1000 * item, 4, iloc_content);
+    AppendBigEndian(item, 4, iloc_content);
+  }
+  const Data iloc = Box("iloc", iloc_content, /*version=*/0);
+
+  Data ipco_content = Box("ispe", {0, 0, 0, 16, 0, 0, 0, 32}, /*version=*/0);
+  const Data pixi = Box("pixi", {3, 10, 10, 10}, /*version=*/0);
+  ipco_content.insert(ipco_content.end(), pixi.begin(), pixi.end());
+  const Data small_ispe = Box("ispe", {0, 0, 0, 8, 0, 0, 0, 16}, 0);
+  ipco_content.insert(ipco_content.end(), small_ispe.begin(),
+                      small_ispe.end());
+  Data iprp_content = Box("ipco", ipco_content);
+  const Data ipma = Box("ipma", ipma_content, /*version=*/0);
+  iprp_content.insert(iprp_content.end(), ipma.begin(), ipma.end());
+  const Data iprp = Box("iprp", iprp_content);
+
+  Data meta_content;
+  for (const Data* box : {&pitm, &iloc, &iinf, &iref, &iprp}) {
+    meta_content.insert(meta_content.end(), box->begin(), box->end());
+  }
+  Data avif = ftyp;
+  const Data meta = Box("meta", meta_content, /*version=*/0);
+  avif.insert(avif.end(), meta.begin(), meta.end());
+  return avif;
+}
+
+// Returns an image sequence whose first track is 20x10, 10-bit, 4 frames long
+// and lasts 5000 units of a 30000 timescale. The "moov" box comes after the
+// "meta" box of CreateGrid() if 'with_still'.
+Data CreateSequence(bool with_still) {
+  Data tkhd_content(80, 0);
+  WriteBigEndian(1, 4, tkhd_content.data() + 8);          // track_ID
+  WriteBigEndian(20 << 16, 4, tkhd_content.data() + 72);  // width
+  WriteBigEndian(10 << 16, 4, tkhd_content.data() + 76);  // height
+  const Data tkhd = Box("tkhd", tkhd_content, /*version=*/0);
+  Data mdhd_content(20, 0);
+  WriteBigEndian(30000, 4, mdhd_content.data() + 8);  // timescale
+  const Data mdhd = Box("mdhd", mdhd_content, /*version=*/0);
+  Data hdlr_content = {0, 0, 0, 0, 'p', 'i', 'c', 't'};
+  hdlr_content.resize(hdlr_content.size() + 13, 0);  // Reserved, empty name.
+  const Data hdlr = Box("hdlr", hdlr_content, /*version=*/0);
+
+  Data av01_content(78, 0);
+  const Data av1c = Box("av1C", {0x81, 0, 0x40, 0});  // 10-bit
+  av01_content.insert(av01_content.end(), av1c.begin(), av1c.end());
+  Data stsd_content = {0, 0, 0, 1};
+  const Data av01 = Box("av01", av01_content);
+  stsd_content.insert(stsd_content.end(), av01.begin(), av01.end());
+  const Data stsd = Box("stsd", stsd_content, /*version=*/0);
+  Data stts_content;
+  for (uint32_t value : {2u, 3u, 1000u, 1u, 2000u}) {
+    AppendBigEndian(value, 4, stts_content);
+  }
+  const Data stts = Box("stts", stts_content, /*version=*/0);
+  Data stsz_content;
+  for (uint32_t value : {0u, 4u, 10u, 10u, 10u, 10u}) {
+    AppendBigEndian(value, 4, stsz_content);
+  }
+  const Data stsz = Box("stsz", stsz_content, /*version=*/0);
+
+  Data stbl_content;
+  for (const Data* box : {&stsd, &stts, &stsz}) {
+    stbl_content.insert(stbl_content.end(), box->begin(), box->end());
+  }
+  const Data minf = Box("minf", Box("stbl", stbl_content));
+  Data mdia_content;
+  for (const Data* box : {&mdhd, &hdlr, &minf}) {
+    mdia_content.insert(mdia_content.end(), box->begin(), box->end());
+  }
+  const Data mdia = Box("mdia", mdia_content);
+  Data trak_content = tkhd;
+  trak_content.insert(trak_content.end(), mdia.begin(), mdia.end());
+  const Data moov = Box("moov", Box("trak", trak_content));
+
+  Data avis = with_still ? CreateGrid(/*num_tiles=*/1)
+                         : Box("ftyp", {'a', 'v', 'i', 's', 0, 0, 0, 0});
+  avis.insert(avis.end(), moov.begin(), moov.end());
+  const Data mdat = Box("mdat", Data(40, 0));
+  avis.insert(avis.end(), mdat.begin(), mdat.end());
+  return avis;
+}
+
+// Random access over a Data, counting the fetched bytes.
+struct CountingReader {
+  const Data* input;
+  size_t num_fetched_bytes = 0;
+};
+
+const uint8_t* ReadAt(void* stream, uint64_t offset, size_t num_bytes) {
+  CountingReader* reader = reinterpret_cast<CountingReader*>(stream);
+  if (offset > reader->input->size() ||
+      num_bytes > reader->input->size() - offset) {
+    return nullptr;
+  }
+  reader->num_fetched_bytes += num_bytes;
+  return reader->input->data() + offset;
+}
+
+// Sequential access over a Data, counting the calls.
+struct CountingStream {
+  const Data* input;
+  size_t window_size;
+  size_t position = 0;
+  int num_calls = 0;
+};
+
+const uint8_t* Read(void* stream, size_t num_bytes) {
+  CountingStream* s = reinterpret_cast<CountingStream*>(stream);
+  ++s->num_calls;
+  if (num_bytes > s->input->size() - s->position) return nullptr;
+  s->position += num_bytes;
+  return s->input->data() + s->position - num_bytes;
+}
+
+const uint8_t* Window(void* stream, size_t* num_bytes) {
+  CountingStream* s = reinterpret_cast<CountingStream*>(stream);
+  ++s->num_calls;
+  *num_bytes = std::min(s->window_size, s->input->size() - s->position);
+  s->position += *num_bytes;
+  return s->input->data() + s->position - *num_bytes;
+}
+
+void Skip(void* stream, size_t num_bytes) {
+  CountingStream* s = reinterpret_cast<CountingStream*>(stream);
+  ++s->num_calls;
+  s->position += std::min(num_bytes, s->input->size() - s->position);
+}
+
 void ExpectEqual(const AvifInfoFeatures& actual,
                  const AvifInfoFeatures& expected) {
   EXPECT_EQ(actual.width, expected.width);
@@ -167,6 +389,39 @@ TEST(AvifInfoGetTest, WithGainmapTmap) {
   }
 }
 
+TEST(AvifInfoGetTest, WithGainmapTmapInLaterDimg) {
+  Data input =
+      LoadFile("avifinfo_test_12x34_gainmap_tmap_iref_after_iprp.avif");
+  ASSERT_FALSE(input.empty());
+  // Insert a "dimg" box unrelated to the "tmap" item before the "dimg" box
+  // that lists the inputs of the "tmap" item, and grow the parent boxes.
+  const uint8_t kDimgTag[] = {'d', 'i', 'm', 'g'};
+  const size_t dimg_box_offset =
+      std::search(input.begin(), input.end(), kDimgTag, kDimgTag + 4) -
+      input.begin() - 4;
+  const Data other_dimg = Box("dimg", {0, 5, 0, 1, 0, 6});  // From 5 to 6.
+  input.insert(input.begin() + dimg_box_offset, other_dimg.begin(),
+               other_dimg.end());
+  for (const char* parent_type : {"meta", "iref"}) {
+    // Only the two least significant bytes of the 32-bit sizes are used.
+    const auto parent_tag =
+        std::search(input.begin(), input.end(), parent_type, parent_type + 4);
+    WriteBigEndian((parent_tag[-2] << 8) + parent_tag[-1] + other_dimg.size(),
+                   2, &parent_tag[-2]);
+  }
+
+  AvifInfoFeatures f;
+  ASSERT_EQ(AvifInfoGetFeatures(input.data(), input.size(), &f), kAvifInfoOk);
+  ExpectEqual(f, {.width = 12u,
+                  .height = 34u,
+                  .bit_depth = 10u,
+                  .num_channels = 4u,
+                  .has_gainmap = 1u,
+                  .gainmap_item_id = 4u,
+                  .primary_item_id_location = 96u,
+                  .primary_item_id_bytes = 2u});
+}
+
 TEST(AvifInfoGetTest, NoPixi10b) {
   // Same as above but "meta" box size is stored as 64 bits, "av1C" has
   // 'high_bitdepth' set to true, "pixi" was renamed to "pixy" and "mdat" size
@@ -187,6 +442,536 @@ TEST(AvifInfoGetTest, NoPixi10b) {
                   .primary_item_id_bytes = 2u});
 }
 
+// Returns the smallest prefix of the 'input' for which the 'options' lead to
+// kAvifInfoOk, or 0.
+size_t GetMinSizeForOk(const Data& input, const AvifInfoOptions& options) {
+  for (size_t size = 0; size <= input.size(); ++size) {
+    if (AvifInfoGetFeaturesWithOptions(input.data(), size, &options,
+                                       nullptr) == kAvifInfoOk) {
+      return size;
+    }
+  }
+  return 0;
+}
+
+TEST(AvifInfoGetTest, RequestedFields) {
+  const Data input =
+      LoadFile("avifinfo_test_12x34_gainmap_tmap_iref_after_iprp.avif");
+  ASSERT_FALSE(input.empty());
+  AvifInfoFeatures all;
+  ASSERT_EQ(AvifInfoGetFeatures(input.data(), input.size(), &all),
+            kAvifInfoOk);
+
+  AvifInfoOptions options = {kAvifInfoFieldDimensions};
+  AvifInfoFeatures f;
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &options, &f),
+            kAvifInfoOk);
+  ExpectEqual(f, {.width = all.width, .height = all.height});
+  // The "iref" box is not needed to know that there is no gain map.
+  const size_t min_size_for_all = GetMinSizeForOk(input, {});
+  ASSERT_GT(min_size_for_all, 0u);
+  EXPECT_LT(GetMinSizeForOk(input, options), min_size_for_all);
+
+  options.requested_fields =
+      kAvifInfoFieldBitDepth | kAvifInfoFieldNumChannels;
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &options, &f),
+            kAvifInfoOk);
+  ExpectEqual(f,
+              {.bit_depth = all.bit_depth, .num_channels = all.num_channels});
+
+  // The "pitm" box is enough.
+  options.requested_fields = kAvifInfoFieldPrimaryItemIdLocation;
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &options, &f),
+            kAvifInfoOk);
+  ExpectEqual(f, {.primary_item_id_location = all.primary_item_id_location,
+                  .primary_item_id_bytes = all.primary_item_id_bytes});
+  EXPECT_LE(GetMinSizeForOk(input, options),
+            all.primary_item_id_location + all.primary_item_id_bytes);
+
+  options.requested_fields = kAvifInfoFieldAll;
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &options, &f),
+            kAvifInfoOk);
+  ExpectEqual(f, all);
+  ASSERT_EQ(GetMinSizeForOk(input, options), min_size_for_all);
+}
+
+TEST(AvifInfoGetTest, ParseStats) {
+  const Data input = LoadFile("avifinfo_test_2x2_alpha.avif");
+  ASSERT_FALSE(input.empty());
+  AvifInfoParseStats stats;
+  memset(&stats, 0xFF, sizeof(stats));  // Must be reset by the library.
+  AvifInfoOptions options = {};
+  options.stats = &stats;
+
+  CountingStream stream = {&input, 0};
+  AvifInfoFeatures f;
+  ASSERT_EQ(AvifInfoGetFeaturesStreamWithOptions(&stream, Read, Skip, &options,
+                                                 &f),
+            kAvifInfoOk);
+#if defined(AVIFINFO_ENABLE_STATS)
+  EXPECT_EQ(stats.num_read_calls + stats.num_skip_calls,
+            static_cast<uint32_t>(stream.num_calls));
+  EXPECT_GT(stats.num_skip_calls, 0u);
+  EXPECT_EQ(stats.num_read_bytes + stats.num_skipped_bytes, stream.position);
+  EXPECT_EQ(stats.features_offset, stream.position);
+  EXPECT_GT(stats.num_parsed_boxes, 5u);
+  EXPECT_GE(stats.max_nesting_level, 3u);  // meta/iprp/ipco/ispe
+  EXPECT_EQ(stats.skipped_data_limits, 0u);
+
+  // No callback is involved for the fixed-size input.
+  const AvifInfoParseStats stream_stats = stats;
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &options, &f),
+            kAvifInfoOk);
+  EXPECT_EQ(stats.num_read_calls, 0u);
+  EXPECT_EQ(stats.num_skip_calls, 0u);
+  EXPECT_EQ(stats.num_read_bytes + stats.num_skipped_bytes,
+            stats.features_offset);
+  EXPECT_EQ(stats.num_parsed_boxes, stream_stats.num_parsed_boxes);
+  EXPECT_EQ(stats.max_nesting_level, stream_stats.max_nesting_level);
+  EXPECT_EQ(stats.features_offset, stream_stats.features_offset);
+#else
+  EXPECT_EQ(stats.num_read_calls, 0u);
+  EXPECT_EQ(stats.num_parsed_boxes, 0u);
+  EXPECT_EQ(stats.features_offset, 0u);
+#endif
+}
+
+// Returns non-zero once called '*deadline' times.
+int CountDown(void* deadline) {
+  return --*reinterpret_cast<int*>(deadline) <= 0;
+}
+
+TEST(AvifInfoGetTest, Budget) {
+  Data input = LoadFile("avifinfo_test_2x2_alpha.avif");
+  ASSERT_FALSE(input.empty());
+  InsertFreeBoxBeforeMeta(input, 1000);
+  AvifInfoFeatures f;
+  CountingStream stream = {&input, 0};
+  ASSERT_EQ(AvifInfoGetFeaturesStream(&stream, Read, Skip, &f), kAvifInfoOk);
+  const uint32_t num_calls = static_cast<uint32_t>(stream.num_calls);
+
+  AvifInfoBudgetReason reason;
+  AvifInfoOptions options = {};
+  options.budget.exceeded = &reason;
+  options.budget.max_num_callbacks = num_calls;
+  stream = {&input, 0};
+  ASSERT_EQ(AvifInfoGetFeaturesStreamWithOptions(&stream, Read, Skip, &options,
+                                                 &f),
+            kAvifInfoOk);
+  EXPECT_EQ(reason, kAvifInfoBudgetNone);
+  options.budget.max_num_callbacks = num_calls - 1;
+  stream = {&input, 0};
+  ASSERT_EQ(AvifInfoGetFeaturesStreamWithOptions(&stream, Read, Skip, &options,
+                                                 &f),
+            kAvifInfoTooComplex);
+  EXPECT_EQ(reason, kAvifInfoBudgetCallbacks);
+  EXPECT_EQ(stream.num_calls, static_cast<int>(num_calls - 1));
+
+  // The "free" box is the only big one.
+  options.budget.max_num_callbacks = 0;
+  options.budget.max_num_skipped_bytes = 900;
+  stream = {&input, 0};
+  ASSERT_EQ(AvifInfoGetFeaturesStreamWithOptions(&stream, Read, Skip, &options,
+                                                 &f),
+            kAvifInfoTooComplex);
+  EXPECT_EQ(reason, kAvifInfoBudgetSkippedBytes);
+  // The skipped bytes are read instead without skip function.
+  options.budget.max_num_skipped_bytes = 0;
+  options.budget.max_num_read_bytes = 900;
+  stream = {&input, 0};
+  ASSERT_EQ(AvifInfoGetFeaturesStreamWithOptions(&stream, Read,
+                                                 /*skip=*/nullptr, &options,
+                                                 &f),
+            kAvifInfoTooComplex);
+  EXPECT_EQ(reason, kAvifInfoBudgetReadBytes);
+  EXPECT_LE(stream.position, 900u);
+  stream = {&input, 0};
+  ASSERT_EQ(AvifInfoGetFeaturesStreamWithOptions(&stream, Read, Skip, &options,
+                                                 &f),
+            kAvifInfoOk);
+  // Bytes read straight from memory count too.
+  options.budget.max_num_read_bytes = 8;
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &options, &f),
+            kAvifInfoTooComplex);
+  EXPECT_EQ(reason, kAvifInfoBudgetReadBytes);
+  options.budget.max_num_read_bytes = 0;
+
+  int deadline = 3;
+  options.budget.deadline_reached = CountDown;
+  options.budget.deadline = &deadline;
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &options, &f),
+            kAvifInfoTooComplex);
+  EXPECT_EQ(reason, kAvifInfoBudgetDeadline);
+  deadline = 1000;
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &options, &f),
+            kAvifInfoOk);
+  EXPECT_EQ(reason, kAvifInfoBudgetNone);
+}
+
+TEST(AvifInfoGetTest, ScratchMemory) {
+  for (uint32_t num_tiles : {4, 300}) {
+    const Data input = CreateGrid(num_tiles);
+    AvifInfoFeatures f;
+    ASSERT_EQ(AvifInfoGetFeatures(input.data(), input.size(), &f),
+              num_tiles <= 16 ? kAvifInfoOk : kAvifInfoTooComplex);
+
+    AvifInfoOptions options = {};
+    options.max_item_id = num_tiles + 1;
+    options.max_tiles = num_tiles;
+    options.max_props = num_tiles + 1;
+    const size_t scratch_size = AvifInfoGetScratchSize(&options);
+    ASSERT_GT(scratch_size, 0u);
+    std::vector<uint8_t> scratch(scratch_size + 1);
+    options.scratch = scratch.data();
+    options.scratch_size = scratch_size - 1;
+    ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                             &options, &f),
+              kAvifInfoTooComplex);
+    options.scratch_size = scratch_size;
+    for (size_t offset : {0, 1}) {  // Misaligned memory is fine.
+      options.scratch = scratch.data() + offset;
+      ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                               &options, &f),
+                kAvifInfoOk);
+      ExpectEqual(f, {.width = 16u,
+                      .height = 32u,
+                      .bit_depth = 10u,
+                      .num_channels = 3u,
+                      .primary_item_id_location = 40u,
+                      .primary_item_id_bytes = 2u});
+    }
+  }
+
+  AvifInfoOptions options = {};
+  options.max_tiles = UINT32_MAX;
+  EXPECT_EQ(AvifInfoGetScratchSize(&options), 0u);
+  EXPECT_GT(AvifInfoGetScratchSize(nullptr), 0u);
+}
+
+TEST(AvifInfoGetTest, ItemExtents) {
+  const Data input = CreateGrid(/*num_tiles=*/4, /*with_iloc=*/true);
+  AvifInfoExtent tiles[4] = {};
+  tiles[3] = {12, 34};  // Not enough room for the last tile.
+  AvifInfoItemExtents extents = {};
+  extents.tiles = tiles;
+  extents.max_num_tiles = 3;
+  AvifInfoOptions options = {};
+  options.extents = &extents;
+  AvifInfoFeatures f;
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &options, &f),
+            kAvifInfoOk);
+  EXPECT_EQ(f.bit_depth, 10u);
+  EXPECT_EQ(extents.parsed, 1u);
+  EXPECT_EQ(extents.primary_item.offset, 1000u);
+  EXPECT_EQ(extents.primary_item.size, 1u);
+  EXPECT_EQ(extents.alpha_item.size, 0u);
+  EXPECT_EQ(extents.gainmap_item.size, 0u);
+  ASSERT_EQ(extents.num_tiles, 4u);
+  for (uint32_t tile = 0; tile < 3; ++tile) {
+    EXPECT_EQ(tiles[tile].offset, 1000u * (2 + tile));
+    EXPECT_EQ(tiles[tile].size, 2u + tile);
+  }
+  EXPECT_EQ(tiles[3].offset, 12u);
+
+  // The whole "meta" box is needed because there is no "iref" box.
+  const Data alpha = LoadFile("avifinfo_test_2x2_alpha.avif");
+  ASSERT_FALSE(alpha.empty());
+  extents = {};
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(alpha.data(), alpha.size(),
+                                           &options, &f),
+            kAvifInfoOk);
+  EXPECT_EQ(f.num_channels, 4u);
+  EXPECT_GT(extents.primary_item.size, 0u);
+  EXPECT_GT(extents.alpha_item.size, 0u);
+  EXPECT_NE(extents.primary_item.offset, extents.alpha_item.offset);
+  EXPECT_LE(extents.primary_item.offset + extents.primary_item.size,
+            alpha.size());
+  EXPECT_LE(extents.alpha_item.offset + extents.alpha_item.size, alpha.size());
+  EXPECT_EQ(extents.num_tiles, 0u);
+  EXPECT_GE(GetMinSizeForOk(alpha, options), GetMinSizeForOk(alpha, {}));
+
+  // An invalid "iloc" box after the features does not change them, but the
+  // extents are not parsed.
+  Data invalid_iloc = alpha;
+  MoveBoxAfter(invalid_iloc, "iloc", "iprp");
+  const size_t iloc = std::search(invalid_iloc.begin(), invalid_iloc.end(),
+                                  "iloc", "iloc" + 4) -
+                      invalid_iloc.begin();
+  invalid_iloc[iloc + 8] = 0x33;  // offset_size and length_size of 3 bytes.
+  ASSERT_EQ(AvifInfoGetFeatures(invalid_iloc.data(), invalid_iloc.size(), &f),
+            kAvifInfoOk);
+  EXPECT_EQ(f.num_channels, 4u);
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(
+                invalid_iloc.data(), invalid_iloc.size(), &options, &f),
+            kAvifInfoOk);
+  EXPECT_EQ(f.num_channels, 4u);
+  EXPECT_EQ(extents.parsed, 0u);
+  EXPECT_EQ(extents.primary_item.size, 0u);
+  EXPECT_EQ(extents.alpha_item.size, 0u);
+
+  // Skipped locations do not change the features nor the status either.
+  AvifInfoOptions limited_options = {};
+  limited_options.max_locations = 2;
+  std::vector<uint8_t> scratch(AvifInfoGetScratchSize(&limited_options));
+  limited_options.scratch = scratch.data();
+  limited_options.scratch_size = scratch.size();
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &limited_options, &f),
+            kAvifInfoOk);
+  AvifInfoThumbnail thumbnail;
+  limited_options.extents = &extents;
+  limited_options.thumbnail = &thumbnail;
+  AvifInfoFeatures limited_f;
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &limited_options, &limited_f),
+            kAvifInfoOk);
+  ExpectEqual(limited_f, f);
+  EXPECT_EQ(extents.parsed, 0u);
+  EXPECT_EQ(extents.primary_item.size, 0u);
+  EXPECT_EQ(extents.num_tiles, 0u);
+  EXPECT_EQ(thumbnail.parsed, 0u);
+}
+
+TEST(AvifInfoGetTest, Thumbnail) {
+  for (bool with_thumbnail : {false, true}) {
+    const Data input =
+        CreateGrid(/*num_tiles=*/2, /*with_iloc=*/true, with_thumbnail);
+    AvifInfoThumbnail thumbnail;
+    AvifInfoOptions options = {};
+    options.thumbnail = &thumbnail;
+    AvifInfoFeatures f;
+    ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                             &options, &f),
+              kAvifInfoOk);
+    EXPECT_EQ(f.width, 16u);
+    EXPECT_EQ(f.height, 32u);
+    EXPECT_EQ(thumbnail.parsed, 1u);
+    if (with_thumbnail) {
+      EXPECT_EQ(thumbnail.item_id, 4u);
+      EXPECT_EQ(thumbnail.width, 8u);
+      EXPECT_EQ(thumbnail.height, 16u);
+      EXPECT_EQ(thumbnail.extent.offset, 4000u);
+      EXPECT_EQ(thumbnail.extent.size, 4u);
+    } else {
+      EXPECT_EQ(thumbnail.item_id, 0u);
+      EXPECT_EQ(thumbnail.width, 0u);
+      EXPECT_EQ(thumbnail.extent.size, 0u);
+    }
+  }
+}
+
+TEST(AvifInfoGetTest, Items) {
+  const Data input = LoadFile("avifinfo_test_199x200_alpha_grid2x1.avif");
+  ASSERT_FALSE(input.empty());
+  AvifInfoItem array[4];
+  AvifInfoItems items = {array, /*max_num_items=*/4};
+  AvifInfoOptions options = {};
+  options.items = &items;
+  AvifInfoFeatures f;
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &options, &f),
+            kAvifInfoOk);
+  EXPECT_EQ(f.num_channels, 4u);
+  EXPECT_EQ(items.parsed, 1u);
+  // The two alpha tiles are counted but not output.
+  ASSERT_EQ(items.num_items, 6u);
+  EXPECT_EQ(array[0].item_id, 1u);
+  EXPECT_EQ(array[0].roles, static_cast<uint32_t>(kAvifInfoItemPrimary));
+  EXPECT_EQ(array[0].width, 199u);
+  EXPECT_EQ(array[0].height, 200u);
+  EXPECT_EQ(array[0].bit_depth, 8u);
+  EXPECT_EQ(array[0].num_channels, 3u);
+  for (int i : {1, 2}) {
+    EXPECT_EQ(array[i].roles, static_cast<uint32_t>(kAvifInfoItemTile));
+    EXPECT_EQ(array[i].width, 100u);
+    EXPECT_EQ(array[i].height, 200u);
+  }
+  EXPECT_EQ(array[3].roles, static_cast<uint32_t>(kAvifInfoItemAlpha));
+  EXPECT_EQ(array[3].num_channels, 1u);
+  EXPECT_GE(GetMinSizeForOk(input, options), GetMinSizeForOk(input, {}));
+
+  const Data tmap = LoadFile("avifinfo_test_12x34_gainmap_tmap.avif");
+  ASSERT_FALSE(tmap.empty());
+  ASSERT_EQ(
+      AvifInfoGetFeaturesWithOptions(tmap.data(), tmap.size(), &options, &f),
+      kAvifInfoOk);
+  ASSERT_EQ(items.num_items, 4u);
+  EXPECT_EQ(array[2].roles, static_cast<uint32_t>(kAvifInfoItemTmap));
+  EXPECT_EQ(array[3].item_id, f.gainmap_item_id);
+  EXPECT_EQ(array[3].roles, static_cast<uint32_t>(kAvifInfoItemGainmap));
+  EXPECT_EQ(array[3].width, 6u);
+  EXPECT_EQ(array[3].height, 17u);
+
+  // Skipped tiles do not change the features nor the status.
+  AvifInfoOptions limited_options = {};
+  limited_options.max_tiles = 2;
+  std::vector<uint8_t> scratch(AvifInfoGetScratchSize(&limited_options));
+  limited_options.scratch = scratch.data();
+  limited_options.scratch_size = scratch.size();
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &limited_options, &f),
+            kAvifInfoOk);
+  limited_options.items = &items;
+  AvifInfoFeatures limited_f;
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &limited_options, &limited_f),
+            kAvifInfoOk);
+  ExpectEqual(limited_f, f);
+  EXPECT_EQ(items.parsed, 0u);
+  EXPECT_EQ(items.num_items, 0u);
+}
+
+TEST(AvifInfoGetTest, ItemsDoNotChangeFeatures) {
+  AvifInfoItem array[4];
+  AvifInfoItems items = {array, /*max_num_items=*/4};
+  AvifInfoOptions options = {};
+  options.items = &items;
+  AvifInfoFeatures f, items_f;
+  // Returns the offset of the first box of 'type' of 'data', and its size that
+  // is expected to fit in 16 bits.
+  const auto find_box = [](const Data& data, const char type[4],
+                           uint32_t* size) {
+    const size_t offset =
+        std::search(data.begin(), data.end(), type, type + 4) - data.begin() -
+        4;
+    *size = (data[offset + 2] << 8) | data[offset + 3];
+    return offset;
+  };
+  uint32_t meta_size, ignored_size;
+
+  // The properties are not associated if "ipma" comes before "ipco", even if
+  // the whole "meta" box is parsed to list the items.
+  Data input = LoadFile("avifinfo_test_1x1.avif");
+  ASSERT_FALSE(input.empty());
+  MoveBoxAfter(input, "ipco", "ipma");
+  EXPECT_EQ(AvifInfoGetFeatures(input.data(), input.size(), &f),
+            kAvifInfoInvalidFile);
+  EXPECT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &options, &items_f),
+            kAvifInfoInvalidFile);
+
+  // A duplicated "pitm" box is ignored once the features are known, even if
+  // the items are only listed after the "iref" box that comes next.
+  input = LoadFile("avifinfo_test_2x2_alpha.avif");
+  ASSERT_FALSE(input.empty());
+  MoveBoxAfter(input, "iref", "iprp");
+  size_t meta_offset = find_box(input, "meta", &meta_size);
+  const Data pitm = Box("pitm", {0, 2}, /*version=*/0);  // The alpha item.
+  input.insert(input.begin() + find_box(input, "iref", &ignored_size),
+               pitm.begin(), pitm.end());
+  WriteBigEndian(meta_size + pitm.size(), 4, &input[meta_offset]);
+  ASSERT_EQ(AvifInfoGetFeatures(input.data(), input.size(), &f), kAvifInfoOk);
+  EXPECT_EQ(f.num_channels, 4u);
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &options, &items_f),
+            kAvifInfoOk);
+  ExpectEqual(items_f, f);
+  ASSERT_EQ(items.num_items, 2u);
+  EXPECT_EQ(array[0].item_id, 1u);
+  EXPECT_EQ(array[0].roles, static_cast<uint32_t>(kAvifInfoItemPrimary));
+  EXPECT_EQ(array[1].roles, static_cast<uint32_t>(kAvifInfoItemAlpha));
+
+  // The properties of a duplicated "iprp" box are not mixed with the ones the
+  // features come from. Property 1 is "ispe" only in the duplicated box.
+  const Data original = LoadFile("avifinfo_test_1x1.avif");
+  ASSERT_FALSE(original.empty());
+  uint32_t iprp_size;
+  const size_t original_iprp_offset = find_box(original, "iprp", &iprp_size);
+  Data iprp(original.begin() + original_iprp_offset,
+            original.begin() + original_iprp_offset + iprp_size);
+  ASSERT_EQ(find_box(iprp, "ispe", &ignored_size), 16u);
+  WriteBigEndian(2, 4, &iprp[28]);  // Width of 2 instead of 1.
+  input = original;
+  MoveBoxAfter(input, "ispe", "pixi");
+  meta_offset = find_box(input, "meta", &meta_size);
+  input.insert(input.begin() + find_box(input, "iprp", &ignored_size) +
+                   iprp_size,
+               iprp.begin(), iprp.end());
+  WriteBigEndian(meta_size + iprp_size, 4, &input[meta_offset]);
+  ASSERT_EQ(AvifInfoGetFeatures(input.data(), input.size(), &f), kAvifInfoOk);
+  EXPECT_EQ(f.width, 1u);
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &options, &items_f),
+            kAvifInfoOk);
+  ExpectEqual(items_f, f);
+  ASSERT_EQ(items.num_items, 1u);
+  EXPECT_EQ(array[0].width, 1u);
+}
+
+TEST(AvifInfoGetTest, Track) {
+  for (bool with_still : {false, true}) {
+    const Data input = CreateSequence(with_still);
+    AvifInfoFeatures f;
+    // The "moov" box is ignored by default.
+    EXPECT_EQ(AvifInfoGetFeatures(input.data(), input.size(), &f),
+              with_still ? kAvifInfoOk : kAvifInfoNotEnoughData);
+
+    AvifInfoTrack track;
+    AvifInfoOptions options = {};
+    options.track = &track;
+    ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                             &options, &f),
+              kAvifInfoOk);
+    EXPECT_EQ(f.width, with_still ? 16u : 20u);
+    EXPECT_EQ(f.height, with_still ? 32u : 10u);
+    EXPECT_EQ(f.bit_depth, 10u);
+    EXPECT_EQ(f.num_channels, 3u);
+    EXPECT_EQ(track.track_id, 1u);
+    EXPECT_EQ(track.width, 20u);
+    EXPECT_EQ(track.height, 10u);
+    EXPECT_EQ(track.bit_depth, 10u);
+    EXPECT_EQ(track.num_channels, 3u);
+    EXPECT_EQ(track.num_frames, 4u);
+    EXPECT_EQ(track.timescale, 30000u);
+    EXPECT_EQ(track.duration, 5000u);
+    // Neither the "mdat" box nor the trailing sample sizes are needed.
+    // The still image is enough if the data ends before the "moov" box.
+    const size_t min_size = input.size() - 48 - 16;
+    if (!with_still) EXPECT_EQ(GetMinSizeForOk(input, options), min_size);
+    EXPECT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), min_size - 1,
+                                             &options, &f),
+              kAvifInfoNotEnoughData);
+  }
+}
+
+TEST(AvifInfoGetTest, NoTrack) {
+  const Data input = CreateGrid(/*num_tiles=*/1);
+  AvifInfoFeatures f;
+  ASSERT_EQ(AvifInfoGetFeatures(input.data(), input.size(), &f), kAvifInfoOk);
+
+  // There is no "moov" box to wait for after the "meta" box.
+  AvifInfoTrack track;
+  AvifInfoOptions options = {};
+  options.track = &track;
+  AvifInfoFeatures track_f;
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &options, &track_f),
+            kAvifInfoOk);
+  ExpectEqual(track_f, f);
+  EXPECT_EQ(track.track_id, 0u);
+  EXPECT_EQ(GetMinSizeForOk(input, options), GetMinSizeForOk(input, {}));
+
+  // Same if the image sequence is cut before its "moov" box, but not after.
+  const Data sequence = CreateSequence(/*with_still=*/true);
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(sequence.data(), input.size(),
+                                           &options, &track_f),
+            kAvifInfoOk);
+  ExpectEqual(track_f, f);
+  EXPECT_EQ(track.track_id, 0u);
+  EXPECT_EQ(AvifInfoGetFeaturesWithOptions(sequence.data(), input.size() + 8,
+                                           &options, &track_f),
+            kAvifInfoNotEnoughData);
+}
+
 TEST(AvifInfoGetTest, EnoughBytes) {
   Data input = LoadFile("avifinfo_test_1x1.avif");
   ASSERT_FALSE(input.empty());
@@ -207,6 +992,127 @@ TEST(AvifInfoGetTest, EnoughBytes) {
                   .primary_item_id_bytes = 2u});
 }
 
+TEST(AvifInfoGetTest, LongBrandList) {
+  const Data input = LoadFile("avifinfo_test_1x1.avif");
+  ASSERT_FALSE(input.empty());
+  // Replace the "ftyp" box by one with many brands before "avif".
+  for (uint32_t num_brands : {2, 32, 33}) {
+    SCOPED_TRACE(num_brands);
+    const uint32_t ftyp_size = input[3];
+    const uint32_t new_ftyp_size = 16 + 4 * num_brands;
+    Data ftyp(new_ftyp_size, 'a');
+    WriteBigEndian(new_ftyp_size, 4, ftyp.data());
+    std::copy(input.begin() + 4, input.begin() + 8, ftyp.begin() + 4);
+    std::copy(input.begin() + 8, input.begin() + 16, ftyp.begin() + 8);
+    ftyp[8] = 'm';  // Major brand is not "avif".
+    std::copy(input.begin() + 8, input.begin() + 12, ftyp.end() - 4);
+    Data modified = ftyp;
+    modified.insert(modified.end(), input.begin() + ftyp_size, input.end());
+
+    const AvifInfoStatus expected_status =
+        num_brands <= 32 ? kAvifInfoOk : kAvifInfoTooComplex;
+    ASSERT_EQ(AvifInfoIdentify(modified.data(), modified.size()),
+              expected_status);
+    AvifInfoFeatures f;
+    ASSERT_EQ(AvifInfoGetFeatures(modified.data(), modified.size(), &f),
+              expected_status);
+    if (expected_status == kAvifInfoOk) {
+      ExpectEqual(f, {.width = 1u,
+                      .height = 1u,
+                      .bit_depth = 8u,
+                      .num_channels = 3u,
+                      .has_gainmap = 0u,
+                      .primary_item_id_location =
+                          96u + new_ftyp_size - ftyp_size,
+                      .primary_item_id_bytes = 2u});
+    }
+  }
+}
+
+TEST(AvifInfoGetTest, IinfAfterIprp) {
+  const Data input = LoadFile("avifinfo_test_1x1.avif");
+  ASSERT_FALSE(input.empty());
+  Data moved_input = input;
+  MoveBoxAfter(moved_input, "iinf", "iprp");
+  ASSERT_NE(moved_input, input);
+
+  AvifInfoFeatures f, moved_f;
+  ASSERT_EQ(AvifInfoGetFeatures(input.data(), input.size(), &f), kAvifInfoOk);
+  ASSERT_EQ(AvifInfoGetFeatures(moved_input.data(), moved_input.size(),
+                                &moved_f),
+            kAvifInfoOk);
+  ExpectEqual(moved_f, f);
+}
+
+TEST(AvifInfoGetTest, IinfEntryCountTooSmall) {
+  const Data input = LoadFile("avifinfo_test_2x2_alpha.avif");
+  ASSERT_FALSE(input.empty());
+  // Decrement the 16-bit entry_count of the "iinf" box of version 0.
+  const uint8_t kIinfTag[] = {'i', 'i', 'n', 'f'};
+  Data small_input = input;
+  const auto iinf_tag = std::search(small_input.begin(), small_input.end(),
+                                    kIinfTag, kIinfTag + 4);
+  ASSERT_EQ(iinf_tag[4], 0);  // Version.
+  ASSERT_EQ(iinf_tag[8], 0);
+  ASSERT_GT(iinf_tag[9], 1);
+  --iinf_tag[9];
+
+  // The children of "iinf" past entry_count are ignored.
+  AvifInfoFeatures f, small_f;
+  ASSERT_EQ(AvifInfoGetFeatures(input.data(), input.size(), &f), kAvifInfoOk);
+  ASSERT_EQ(AvifInfoGetFeatures(small_input.data(), small_input.size(),
+                                &small_f),
+            kAvifInfoOk);
+  ExpectEqual(small_f, f);
+}
+
+TEST(AvifInfoGetTest, IinfWithInvalidInfe) {
+  Data input = LoadFile("avifinfo_test_1x1.avif");
+  ASSERT_FALSE(input.empty());
+  const uint8_t kInfeTag[] = {'i', 'n', 'f', 'e'};
+  const auto infe_tag =
+      std::search(input.begin(), input.end(), kInfeTag, kInfeTag + 4);
+  ASSERT_NE(infe_tag, input.end());
+  infe_tag[-1] = 0xff;  // The "infe" box is bigger than its "iinf" parent.
+  // Same status with all AVIFINFO_PROFILE values, see avifinfo_profile_test.c.
+  AvifInfoFeatures f;
+  EXPECT_EQ(AvifInfoGetFeatures(input.data(), input.size(), &f),
+            kAvifInfoInvalidFile);
+}
+
+TEST(AvifInfoGetTest, TrackBoxesInMetaAreSkipped) {
+  const Data input = LoadFile("avifinfo_test_1x1.avif");
+  ASSERT_FALSE(input.empty());
+  AvifInfoFeatures f;
+  ASSERT_EQ(AvifInfoGetFeatures(input.data(), input.size(), &f), kAvifInfoOk);
+  const uint8_t kMetaTag[] = {'m', 'e', 't', 'a'};
+  const size_t meta_offset =
+      std::search(input.begin(), input.end(), kMetaTag, kMetaTag + 4) -
+      input.begin() - 4;
+  const uint32_t meta_size = input[meta_offset + 3];
+  ASSERT_EQ(meta_size, 242u);  // Fits in the last byte of the 32-bit size.
+
+  // The boxes of a "trak" box are only parsed as full boxes inside a "moov"
+  // box. Elsewhere an empty box of these types is valid and skipped.
+  for (const char* type : {"tkhd", "mdhd", "stsd", "stts", "stsz"}) {
+    SCOPED_TRACE(type);
+    const Data box = Box(type, {});
+    Data modified = input;
+    // Insert the box right after the header and version of the "meta" box.
+    modified.insert(modified.begin() + meta_offset + 12, box.begin(),
+                    box.end());
+    WriteBigEndian(meta_size + box.size(), 4, &modified[meta_offset]);
+
+    AvifInfoFeatures modified_f;
+    ASSERT_EQ(AvifInfoGetFeatures(modified.data(), modified.size(),
+                                  &modified_f),
+              kAvifInfoOk);
+    AvifInfoFeatures expected_f = f;
+    expected_f.primary_item_id_location += box.size();
+    ExpectEqual(modified_f, expected_f);
+  }
+}
+
 TEST(AvifInfoGetTest, Null) {
   const Data input = LoadFile("avifinfo_test_1x1.avif");
   ASSERT_FALSE(input.empty());
@@ -215,6 +1121,613 @@ TEST(AvifInfoGetTest, Null) {
             kAvifInfoOk);
 }
 
+//------------------------------------------------------------------------------
+// Push-based input API
+
+TEST(AvifInfoParserTest, SameAsFixedSizeApi) {
+  for (const char* file_name :
+       {"avifinfo_test_1x1.avif", "avifinfo_test_2x2_alpha.avif",
+        "avifinfo_test_20x20_gainmap.avif",
+        "avifinfo_test_12x34_gainmap_tmap.avif",
+        "avifinfo_test_12x34_gainmap_tmap_iref_after_iprp.avif",
+        "avifinfo_test_199x200_alpha_grid2x1.avif",
+        "avifinfo_test_1x1_10b_nopixi_metasize64b_mdatsize0.avif"}) {
+    SCOPED_TRACE(file_name);
+    const Data input = LoadFile(file_name);
+    ASSERT_FALSE(input.empty());
+    AvifInfoFeatures expected_f;
+    ASSERT_EQ(AvifInfoGetFeatures(input.data(), input.size(), &expected_f),
+              kAvifInfoOk);
+
+    for (size_t chunk_size : {1, 2, 3, 7, 64, 1000}) {
+      SCOPED_TRACE(chunk_size);
+      AvifInfoParser* parser = AvifInfoParserCreate();
+      ASSERT_NE(parser, nullptr);
+      AvifInfoStatus status = kAvifInfoNotEnoughData;
+      for (size_t offset = 0; offset < input.size(); offset += chunk_size) {
+        const size_t size = std::min(chunk_size, input.size() - offset);
+        AvifInfoFeatures f, prefix_f;
+        const AvifInfoStatus prefix_status =
+            AvifInfoGetFeatures(input.data(), offset + size, &prefix_f);
+        ASSERT_EQ(status = AvifInfoParserFeed(parser, &input[offset], size),
+                  prefix_status);
+        ASSERT_EQ(AvifInfoParserGetFeatures(parser, &f), prefix_status);
+        ExpectEqual(f, prefix_f);
+      }
+      ASSERT_EQ(status, kAvifInfoOk);
+      AvifInfoParserDestroy(parser);
+    }
+  }
+}
+
+TEST(AvifInfoParserTest, SkippedBytesAreNotNeeded) {
+  // Put a big "free" box before the "meta" box.
+  Data input = LoadFile("avifinfo_test_1x1.avif");
+  ASSERT_FALSE(input.empty());
+  const uint32_t kFreeBoxSize = 1 << 20;
+  const size_t free_box_offset = InsertFreeBoxBeforeMeta(input, kFreeBoxSize);
+
+  AvifInfoParser* parser = AvifInfoParserCreate();
+  ASSERT_NE(parser, nullptr);
+  ASSERT_EQ(AvifInfoParserFeed(parser, input.data(), free_box_offset + 8),
+            kAvifInfoNotEnoughData);
+  // The content of the "free" box is dropped without being parsed.
+  for (size_t offset = free_box_offset + 8; offset < input.size();
+       offset += 4096) {
+    const size_t size = std::min<size_t>(4096, input.size() - offset);
+    const AvifInfoStatus status =
+        AvifInfoParserFeed(parser, &input[offset], size);
+    if (offset + size <= free_box_offset + kFreeBoxSize) {
+      ASSERT_EQ(status, kAvifInfoNotEnoughData);
+    }
+  }
+  AvifInfoFeatures f;
+  ASSERT_EQ(AvifInfoParserGetFeatures(parser, &f), kAvifInfoOk);
+  ExpectEqual(f, {.width = 1u,
+                  .height = 1u,
+                  .bit_depth = 8u,
+                  .num_channels = 3u,
+                  .has_gainmap = 0u,
+                  .primary_item_id_location = 96u + kFreeBoxSize,
+                  .primary_item_id_bytes = 2u});
+  AvifInfoParserDestroy(parser);
+}
+
+TEST(AvifInfoParserTest, DataSizeHint) {
+  const Data input = LoadFile("avifinfo_test_1x1.avif");
+  ASSERT_FALSE(input.empty());
+  const uint8_t kMetaTag[] = {'m', 'e', 't', 'a'};
+  const size_t meta_box_offset =
+      std::search(input.begin(), input.end(), kMetaTag, kMetaTag + 4) -
+      input.begin() - 4;
+  const size_t meta_box_end = meta_box_offset + input[meta_box_offset + 3];
+
+  AvifInfoParser* parser = AvifInfoParserCreate();
+  ASSERT_NE(parser, nullptr);
+  AvifInfoDataSizeHint hint;
+  // The "ftyp" box header is not complete.
+  ASSERT_EQ(AvifInfoParserFeed(parser, input.data(), 4),
+            kAvifInfoNotEnoughData);
+  ASSERT_EQ(AvifInfoParserGetDataSizeHint(parser, &hint),
+            kAvifInfoNotEnoughData);
+  EXPECT_EQ(hint.min_data_size, 8u);
+  EXPECT_EQ(hint.meta_data_size, 0u);
+  // The "ftyp" box is identified and skipped.
+  ASSERT_EQ(AvifInfoParserFeed(parser, input.data() + 4, 8),
+            kAvifInfoNotEnoughData);
+  ASSERT_EQ(AvifInfoParserGetDataSizeHint(parser, &hint),
+            kAvifInfoNotEnoughData);
+  EXPECT_EQ(hint.min_data_size, input[3] + 8u);  // Skipped, next header.
+  EXPECT_EQ(hint.meta_data_size, 0u);
+  // The "meta" box header is complete.
+  ASSERT_EQ(AvifInfoParserFeed(parser, input.data() + 12,
+                               meta_box_offset + 12 + 10 - 12),
+            kAvifInfoNotEnoughData);
+  ASSERT_EQ(AvifInfoParserGetDataSizeHint(parser, &hint),
+            kAvifInfoNotEnoughData);
+  EXPECT_GT(hint.min_data_size, meta_box_offset + 12 + 10);
+  EXPECT_LE(hint.min_data_size, meta_box_end);
+  EXPECT_EQ(hint.meta_data_size, meta_box_end);
+  // One more chunk up to the end of the "meta" box is enough.
+  const size_t offset = meta_box_offset + 12 + 10;
+  ASSERT_EQ(
+      AvifInfoParserFeed(parser, input.data() + offset, meta_box_end - offset),
+      kAvifInfoOk);
+  ASSERT_EQ(AvifInfoParserGetDataSizeHint(parser, &hint), kAvifInfoOk);
+  EXPECT_EQ(hint.min_data_size, 0u);
+  EXPECT_EQ(hint.meta_data_size, 0u);
+  AvifInfoParserDestroy(parser);
+}
+
+TEST(AvifInfoParserTest, StatusIsFinal) {
+  Data input = LoadFile("avifinfo_test_1x1.avif");
+  ASSERT_FALSE(input.empty());
+  // Change "ispe" to "aspe".
+  const uint8_t kIspeTag[] = {'i', 's', 'p', 'e'};
+  std::search(input.begin(), input.end(), kIspeTag, kIspeTag + 4)[0] = 'a';
+
+  AvifInfoParser* parser = AvifInfoParserCreate();
+  ASSERT_NE(parser, nullptr);
+  ASSERT_EQ(AvifInfoParserFeed(parser, input.data(), input.size()),
+            kAvifInfoInvalidFile);
+  ASSERT_EQ(AvifInfoParserFeed(parser, input.data(), input.size()),
+            kAvifInfoInvalidFile);
+  AvifInfoFeatures f;
+  ASSERT_EQ(AvifInfoParserGetFeatures(parser, &f), kAvifInfoInvalidFile);
+  ExpectEqual(f, {0});
+  AvifInfoParserDestroy(parser);
+}
+
+TEST(AvifInfoWindowTest, FewerCalls) {
+  const Data input = LoadFile("avifinfo_test_2x2_alpha.avif");
+  ASSERT_FALSE(input.empty());
+  AvifInfoFeatures expected;
+  ASSERT_EQ(AvifInfoGetFeatures(input.data(), input.size(), &expected),
+            kAvifInfoOk);
+
+  CountingStream read_stream = {&input, 0};
+  AvifInfoFeatures f;
+  ASSERT_EQ(AvifInfoIdentifyStream(&read_stream, Read, Skip), kAvifInfoOk);
+  ASSERT_EQ(AvifInfoGetFeaturesStream(&read_stream, Read, Skip, &f),
+            kAvifInfoOk);
+  EXPECT_GT(read_stream.num_calls, 30);
+
+  for (size_t window_size : {1, 7, 64, 4096}) {
+    CountingStream window_stream = {&input, window_size};
+    ASSERT_EQ(AvifInfoGetFeaturesStreamWindow(&window_stream, Window, Skip, &f),
+              kAvifInfoOk);
+    ExpectEqual(f, expected);
+    if (window_size >= 64) {
+      EXPECT_LT(window_stream.num_calls, read_stream.num_calls / 4);
+    }
+    // Without a skip function.
+    window_stream = {&input, window_size};
+    ASSERT_EQ(AvifInfoGetFeaturesStreamWindow(&window_stream, Window,
+                                              /*skip=*/nullptr, &f),
+              kAvifInfoOk);
+    ExpectEqual(f, expected);
+
+    window_stream = {&input, window_size};
+    ASSERT_EQ(AvifInfoIdentifyStreamWindow(&window_stream, Window, Skip),
+              kAvifInfoOk);
+  }
+}
+
+TEST(AvifInfoIovTest, SameAsFixedSizeApi) {
+  for (const char* file_name :
+       {"avifinfo_test_1x1.avif", "avifinfo_test_2x2_alpha.avif",
+        "avifinfo_test_20x20_gainmap.avif",
+        "avifinfo_test_199x200_alpha_grid2x1.avif"}) {
+    SCOPED_TRACE(file_name);
+    const Data input = LoadFile(file_name);
+    ASSERT_FALSE(input.empty());
+    AvifInfoFeatures expected;
+    ASSERT_EQ(AvifInfoGetFeatures(input.data(), input.size(), &expected),
+              kAvifInfoOk);
+
+    for (size_t segment_size : {1, 3, 16, 1000}) {
+      // Interleave empty segments.
+      std::vector<AvifInfoSegment> segments;
+      for (size_t offset = 0; offset < input.size(); offset += segment_size) {
+        segments.push_back({nullptr, 0});
+        segments.push_back(
+            {&input[offset], std::min(segment_size, input.size() - offset)});
+      }
+      ASSERT_EQ(AvifInfoIdentifyIov(segments.data(), segments.size()),
+                kAvifInfoOk);
+      AvifInfoFeatures f;
+      ASSERT_EQ(AvifInfoGetFeaturesIov(segments.data(), segments.size(), &f),
+                kAvifInfoOk);
+      ExpectEqual(f, expected);
+      // Missing last segment.
+      ASSERT_EQ(AvifInfoGetFeaturesIov(segments.data(), 2, &f),
+                segment_size >= 1000 ? kAvifInfoOk : kAvifInfoNotEnoughData);
+    }
+  }
+}
+
+// AvifInfoBatchRunner spreading the tasks over '*runner' threads.
+void RunOnThreads(void* runner, AvifInfoBatchTask task, void* batch,
+                  size_t num_tasks) {
+  std::atomic<size_t> next_task_index(0);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < *static_cast<const size_t*>(runner); ++i) {
+    threads.emplace_back([&]() {
+      for (size_t task_index = next_task_index++; task_index < num_tasks;
+           task_index = next_task_index++) {
+        task(batch, task_index);
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+}
+
+TEST(AvifInfoBatchTest, SameAsFixedSizeApi) {
+  std::vector<Data> files;
+  for (const char* file_name :
+       {"avifinfo_test_1x1.avif", "avifinfo_test_2x2_alpha.avif",
+        "avifinfo_test_20x20_gainmap.avif",
+        "avifinfo_test_199x200_alpha_grid2x1.avif"}) {
+    files.push_back(LoadFile(file_name));
+    ASSERT_FALSE(files.back().empty());
+  }
+  files.push_back(CreateGrid(/*num_tiles=*/300));
+  // Whole files and prefixes of various sizes, valid or not.
+  std::vector<const uint8_t*> data;
+  std::vector<size_t> sizes;
+  for (size_t i = 0; i < 1000; ++i) {
+    const Data& file = files[i % files.size()];
+    data.push_back(file.data());
+    sizes.push_back((i % 3 == 0) ? file.size() : (i * 7) % file.size());
+  }
+
+  AvifInfoOptions options = {};
+  options.max_item_id = 301;
+  options.max_tiles = 300;
+  options.max_props = 301;
+  std::vector<uint8_t> scratch(AvifInfoGetScratchSize(&options));
+  // One slice of the scratch memory per task.
+  std::vector<uint8_t> batch_scratch(
+      AvifInfoGetBatchScratchSize(&options, data.size()));
+  ASSERT_EQ(batch_scratch.size(),
+            scratch.size() * ((data.size() + AVIFINFO_BATCH_TASK_SIZE - 1) /
+                              AVIFINFO_BATCH_TASK_SIZE));
+  for (bool with_limits : {false, true}) {
+    options.scratch = with_limits ? scratch.data() : nullptr;
+    options.scratch_size = scratch.size();
+    std::vector<AvifInfoStatus> expected_statuses(data.size());
+    std::vector<AvifInfoFeatures> expected_features(data.size());
+    size_t expected_num_ok = 0;
+    for (size_t i = 0; i < data.size(); ++i) {
+      expected_statuses[i] = AvifInfoGetFeaturesWithOptions(
+          data[i], sizes[i], &options, &expected_features[i]);
+      if (expected_statuses[i] == kAvifInfoOk) ++expected_num_ok;
+    }
+    ASSERT_GT(expected_num_ok, 0u);
+    ASSERT_LT(expected_num_ok, data.size());
+
+    for (size_t num_threads : {0, 1, 4}) {
+      SCOPED_TRACE(num_threads);
+      AvifInfoBatchOptions batch_options = {&options};
+      if (num_threads != 0) {
+        batch_options.run = RunOnThreads;
+        batch_options.runner = &num_threads;
+      }
+      if (with_limits) {
+        batch_options.scratch = batch_scratch.data();
+        batch_options.scratch_size = batch_scratch.size();
+      }
+      std::vector<AvifInfoStatus> statuses(data.size());
+      std::vector<AvifInfoFeatures> features(data.size());
+      ASSERT_EQ(AvifInfoGetFeaturesBatch(data.data(), sizes.data(),
+                                         data.size(), features.data(),
+                                         statuses.data(), &batch_options),
+                expected_num_ok);
+      for (size_t i = 0; i < data.size(); ++i) {
+        ASSERT_EQ(statuses[i], expected_statuses[i]);
+        ExpectEqual(features[i], expected_features[i]);
+      }
+      // The features are optional.
+      EXPECT_EQ(AvifInfoGetFeaturesBatch(data.data(), sizes.data(),
+                                         data.size(), /*features=*/nullptr,
+                                         statuses.data(), &batch_options),
+                expected_num_ok);
+    }
+  }
+
+  // Same as a 'scratch_size' too small for the limits of each input.
+  AvifInfoBatchOptions batch_options = {&options};
+  batch_options.scratch = batch_scratch.data();
+  batch_options.scratch_size = batch_scratch.size() - 1;
+  std::vector<AvifInfoStatus> statuses(data.size());
+  EXPECT_EQ(AvifInfoGetFeaturesBatch(data.data(), sizes.data(), data.size(),
+                                     /*features=*/nullptr, statuses.data(),
+                                     &batch_options),
+            0u);
+  for (AvifInfoStatus status : statuses) {
+    EXPECT_EQ(status, kAvifInfoTooComplex);
+  }
+  EXPECT_EQ(AvifInfoGetBatchScratchSize(&options, 0), 0u);
+
+  AvifInfoStatus status;
+  EXPECT_EQ(AvifInfoGetFeaturesBatch(nullptr, nullptr, 1, nullptr, &status,
+                                     nullptr),
+            0u);
+}
+
+TEST(AvifInfoBatchTest, IdentifySameAsIdentify) {
+  std::vector<Data> inputs;
+  for (const char* file_name :
+       {"avifinfo_test_1x1.avif", "avifinfo_test_2x2_alpha.avif",
+        "avifinfo_test_20x20_gainmap.avif"}) {
+    const Data input = LoadFile(file_name);
+    ASSERT_FALSE(input.empty());
+    // All prefixes, and many single-byte changes of the first bytes.
+    const uint8_t kValues[] = {0, 1, 15, 16, 17, 64, 'a', 'f', 's', 'v'};
+    for (size_t size = 0; size <= 80; ++size) {
+      inputs.emplace_back(input.begin(), input.begin() + size);
+    }
+    for (size_t offset = 0; offset < 80; ++offset) {
+      for (uint8_t value : kValues) {
+        Data modified = input;
+        modified[offset] = value;
+        inputs.emplace_back(modified.begin(), modified.begin() + 40);
+        inputs.push_back(std::move(modified));
+      }
+    }
+    // Long "ftyp" box.
+    Data long_ftyp = input;
+    WriteBigEndian(input[3] + 64, 4, long_ftyp.data());
+    long_ftyp.insert(long_ftyp.begin() + 16, 64, 'a');
+    inputs.push_back(long_ftyp);
+    long_ftyp[8] = 'm';  // Major brand is not "avif".
+    inputs.push_back(long_ftyp);
+  }
+
+  std::vector<const uint8_t*> data;
+  std::vector<size_t> sizes;
+  size_t expected_num_ok = 0;
+  for (const Data& input : inputs) {
+    data.push_back(input.data());
+    sizes.push_back(input.size());
+    if (AvifInfoIdentify(input.data(), input.size()) == kAvifInfoOk) {
+      ++expected_num_ok;
+    }
+  }
+  std::vector<AvifInfoStatus> statuses(inputs.size());
+  ASSERT_EQ(AvifInfoIdentifyBatch(data.data(), sizes.data(), data.size(),
+                                  statuses.data()),
+            expected_num_ok);
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    ASSERT_EQ(statuses[i], AvifInfoIdentify(data[i], sizes[i])) << i;
+  }
+  EXPECT_EQ(AvifInfoIdentifyBatch(nullptr, nullptr, 1, statuses.data()), 0u);
+}
+
+TEST(AvifInfoCacheTest, SameAsFixedSizeApi) {
+  std::vector<Data> files;
+  for (const char* file_name :
+       {"avifinfo_test_1x1.avif", "avifinfo_test_2x2_alpha.avif",
+        "avifinfo_test_20x20_gainmap.avif"}) {
+    files.push_back(LoadFile(file_name));
+    ASSERT_FALSE(files.back().empty());
+  }
+  // Same bytes except for a "free" box that moves the "meta" box.
+  files.push_back(files[0]);
+  InsertFreeBoxBeforeMeta(files.back(), 100);
+  files.push_back(files[0]);
+  files.back()[9] ^= 1;  // Major brand is not "avif" anymore.
+
+  AvifInfoCache* cache = AvifInfoCacheCreate(/*num_entries=*/1000);
+  ASSERT_NE(cache, nullptr);
+  for (int pass = 0; pass < 3; ++pass) {
+    for (const Data& file : files) {
+      AvifInfoFeatures expected, f;
+      const AvifInfoStatus status =
+          AvifInfoGetFeatures(file.data(), file.size(), &expected);
+      ASSERT_EQ(AvifInfoCacheGetFeatures(cache, file.data(), file.size(), &f),
+                status);
+      ExpectEqual(f, expected);
+      EXPECT_EQ(AvifInfoCacheGetFeatures(cache, file.data(), file.size(),
+                                         /*features=*/nullptr),
+                status);
+    }
+  }
+  AvifInfoCacheStats stats;
+  AvifInfoCacheGetStats(cache, &stats);
+  EXPECT_EQ(stats.num_misses, files.size());
+  EXPECT_EQ(stats.num_hits, files.size() * 5);
+  EXPECT_EQ(stats.num_bypasses, 0u);
+
+  // The "meta" box is truncated, the input is parsed but not cached.
+  const Data& file = files[0];
+  EXPECT_EQ(AvifInfoCacheGetFeatures(cache, file.data(), 40, nullptr),
+            kAvifInfoNotEnoughData);
+  EXPECT_EQ(AvifInfoCacheGetFeatures(cache, nullptr, 0, nullptr),
+            kAvifInfoNotEnoughData);
+  AvifInfoCacheGetStats(cache, &stats);
+  EXPECT_EQ(stats.num_bypasses, 2u);
+
+  // Concurrent calls on the same entries. Each thread counts them in its own
+  // shard, and all of them are summed.
+  AvifInfoCacheGetStats(cache, &stats);
+  const uint64_t num_calls =
+      stats.num_hits + stats.num_misses + stats.num_bypasses;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 1000; ++i) {
+        const Data& file = files[i % files.size()];
+        AvifInfoFeatures expected, f;
+        EXPECT_EQ(AvifInfoCacheGetFeatures(cache, file.data(), file.size(), &f),
+                  AvifInfoGetFeatures(file.data(), file.size(), &expected));
+        ExpectEqual(f, expected);
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  AvifInfoCacheGetStats(cache, &stats);
+  EXPECT_EQ(stats.num_hits + stats.num_misses + stats.num_bypasses,
+            num_calls + 4 * 1000);
+  AvifInfoCacheDestroy(cache);
+
+  // A null cache parses every time.
+  AvifInfoFeatures f;
+  EXPECT_EQ(AvifInfoCacheGetFeatures(nullptr, file.data(), file.size(), &f),
+            kAvifInfoOk);
+  AvifInfoCacheGetStats(nullptr, &stats);
+  EXPECT_EQ(stats.num_hits + stats.num_misses + stats.num_bypasses, 0u);
+  AvifInfoCacheDestroy(nullptr);
+}
+
+TEST(AvifInfoCacheTest, MetaBoxOfVersion1IsSkipped) {
+  Data input = LoadFile("avifinfo_test_1x1.avif");
+  ASSERT_FALSE(input.empty());
+  // Turn a "free" box into a "meta" box of version 1, which is skipped.
+  const size_t meta_offset = InsertFreeBoxBeforeMeta(input, 12);
+  input[meta_offset + 4] = 'm', input[meta_offset + 5] = 'e';
+  input[meta_offset + 6] = 't', input[meta_offset + 7] = 'a';
+  input[meta_offset + 8] = 1;
+
+  AvifInfoCache* cache = AvifInfoCacheCreate(/*num_entries=*/16);
+  ASSERT_NE(cache, nullptr);
+  AvifInfoFeatures f;
+  ASSERT_EQ(AvifInfoCacheGetFeatures(cache, input.data(), input.size(), &f),
+            kAvifInfoOk);
+  EXPECT_EQ(f.width, 1u);
+  // The skipped box is not the one the features depend on.
+  EXPECT_EQ(AvifInfoCacheGetFeatures(cache, input.data(), meta_offset + 12, &f),
+            kAvifInfoNotEnoughData);
+  AvifInfoCacheStats stats;
+  AvifInfoCacheGetStats(cache, &stats);
+  EXPECT_EQ(stats.num_hits, 0u);
+  EXPECT_EQ(stats.num_bypasses, 1u);
+  AvifInfoCacheDestroy(cache);
+}
+
+// Source for avifinfo::Parser made of at most two segments.
+struct RingBuffer {
+  std::array<AvifInfoSegment, 2> halves;
+  const std::array<AvifInfoSegment, 2>& segments() const { return halves; }
+};
+
+// Source for avifinfo::Parser counting the calls.
+struct Reader {
+  const uint8_t* data;
+  size_t data_size;
+  uint32_t num_calls = 0;
+
+  const uint8_t* Read(size_t num_bytes) {
+    ++num_calls;
+    if (num_bytes > data_size) return nullptr;
+    data += num_bytes;
+    data_size -= num_bytes;
+    return data - num_bytes;
+  }
+  void Skip(size_t num_bytes) {
+    ++num_calls;
+    num_bytes = std::min(num_bytes, data_size);
+    data += num_bytes;
+    data_size -= num_bytes;
+  }
+};
+
+TEST(AvifInfoCppTest, SameAsFixedSizeApi) {
+  for (const char* file_name :
+       {"avifinfo_test_1x1.avif", "avifinfo_test_20x20_gainmap.avif",
+        "avifinfo_test_199x200_alpha_grid2x1.avif"}) {
+    SCOPED_TRACE(file_name);
+    const Data input = LoadFile(file_name);
+    ASSERT_FALSE(input.empty());
+    AvifInfoFeatures expected;
+    ASSERT_EQ(AvifInfoGetFeatures(input.data(), input.size(), &expected),
+              kAvifInfoOk);
+
+    AvifInfoFeatures f;
+    EXPECT_EQ(avifinfo::Parser(input).Identify(), kAvifInfoOk);
+    ASSERT_EQ(avifinfo::Parser(input).GetFeatures(&f), kAvifInfoOk);
+    ExpectEqual(f, expected);
+
+    const avifinfo::Span span(input.data(), input.size() - 1);
+    EXPECT_EQ(avifinfo::Parser(span).GetFeatures(&f), kAvifInfoOk);
+    ExpectEqual(f, expected);
+
+    RingBuffer ring_buffer = {{{{&input[10], input.size() - 10},
+                                {input.data(), 10}}}};
+    EXPECT_EQ(avifinfo::Parser(ring_buffer).GetFeatures(&f),
+              kAvifInfoInvalidFile);
+    std::swap(ring_buffer.halves[0], ring_buffer.halves[1]);
+    ASSERT_EQ(avifinfo::Parser(ring_buffer).GetFeatures(&f), kAvifInfoOk);
+    ExpectEqual(f, expected);
+
+    Reader reader = {input.data(), input.size()};
+    AvifInfoParseStats stats;
+    AvifInfoOptions options = {kAvifInfoFieldAll, &stats};
+    ASSERT_EQ(avifinfo::Parser(reader).GetFeatures(&f, options), kAvifInfoOk);
+    ExpectEqual(f, expected);
+    EXPECT_GT(reader.num_calls, 0u);
+    const uint64_t features_offset = stats.features_offset;
+    ASSERT_EQ(avifinfo::Parser(input).GetFeatures(&f, options), kAvifInfoOk);
+    EXPECT_EQ(features_offset, stats.features_offset);
+  }
+}
+
+TEST(AvifInfoReadAtTest, SkippedBytesAreNotFetched) {
+  Data input = LoadFile("avifinfo_test_1x1.avif");
+  ASSERT_FALSE(input.empty());
+  const uint32_t kFreeBoxSize = 1 << 20;
+  InsertFreeBoxBeforeMeta(input, kFreeBoxSize);
+
+  CountingReader reader = {&input};
+  ASSERT_EQ(AvifInfoIdentifyStreamAt(&reader, ReadAt), kAvifInfoOk);
+  EXPECT_LT(reader.num_fetched_bytes, 64u);
+  reader.num_fetched_bytes = 0;
+  AvifInfoFeatures f;
+  ASSERT_EQ(AvifInfoGetFeaturesStreamAt(&reader, ReadAt, &f), kAvifInfoOk);
+  EXPECT_LT(reader.num_fetched_bytes, input.size() - kFreeBoxSize);
+  ExpectEqual(f, {.width = 1u,
+                  .height = 1u,
+                  .bit_depth = 8u,
+                  .num_channels = 3u,
+                  .has_gainmap = 0u,
+                  .primary_item_id_location = 96u + kFreeBoxSize,
+                  .primary_item_id_bytes = 2u});
+}
+
+TEST(AvifInfoParserTest, NextRange) {
+  Data input = LoadFile("avifinfo_test_1x1.avif");
+  ASSERT_FALSE(input.empty());
+  const uint32_t kFreeBoxSize = 1 << 20;
+  const size_t free_box_offset = InsertFreeBoxBeforeMeta(input, kFreeBoxSize);
+
+  AvifInfoParser* parser = AvifInfoParserCreate();
+  ASSERT_NE(parser, nullptr);
+  size_t num_fetched_bytes = 0;
+  int num_fetches = 0;
+  uint64_t offset, size;
+  while (AvifInfoParserGetNextRange(parser, &offset, &size) ==
+         kAvifInfoNotEnoughData) {
+    ASSERT_LT(offset, input.size());
+    // The "free" box content is never requested.
+    ASSERT_FALSE(offset > free_box_offset + 8 &&
+                 offset < free_box_offset + kFreeBoxSize);
+    ASSERT_GT(size, 0u);
+    size = std::min<uint64_t>(size, input.size() - offset);
+    AvifInfoParserFeedAt(parser, offset, &input[offset], size);
+    num_fetched_bytes += size;
+    ASSERT_LT(++num_fetches, 10);
+  }
+  EXPECT_LT(num_fetched_bytes, input.size() - kFreeBoxSize);
+  EXPECT_EQ(offset, 0u);
+  EXPECT_EQ(size, 0u);
+
+  AvifInfoFeatures f;
+  ASSERT_EQ(AvifInfoParserGetFeatures(parser, &f), kAvifInfoOk);
+  EXPECT_EQ(f.primary_item_id_location, 96u + kFreeBoxSize);
+  AvifInfoParserDestroy(parser);
+}
+
+TEST(AvifInfoParserTest, FeedAtOverlap) {
+  const Data input = LoadFile("avifinfo_test_1x1.avif");
+  ASSERT_FALSE(input.empty());
+  AvifInfoParser* parser = AvifInfoParserCreate();
+  ASSERT_NE(parser, nullptr);
+  // Bytes beyond what can be skipped are ignored.
+  ASSERT_EQ(AvifInfoParserFeedAt(parser, 4, &input[4], input.size() - 4),
+            kAvifInfoNotEnoughData);
+  ASSERT_EQ(AvifInfoParserFeedAt(parser, 0, input.data(), 10),
+            kAvifInfoNotEnoughData);
+  // Already fed bytes are ignored.
+  ASSERT_EQ(AvifInfoParserFeedAt(parser, 5, &input[5], input.size() - 5),
+            kAvifInfoOk);
+  AvifInfoFeatures f, expected;
+  ASSERT_EQ(AvifInfoParserGetFeatures(parser, &f), kAvifInfoOk);
+  ASSERT_EQ(AvifInfoGetFeatures(input.data(), input.size(), &expected),
+            kAvifInfoOk);
+  ExpectEqual(f, expected);
+  AvifInfoParserDestroy(parser);
+}
+
 //------------------------------------------------------------------------------
 // Negative tests
 
@@ -287,6 +1800,45 @@ TEST(AvifInfoGetTest, TooManyBoxes) {
   ASSERT_EQ(AvifInfoGetFeatures(reinterpret_cast<uint8_t*>(input.data()),
                                 input.size() * 4, &f),
             kAvifInfoTooComplex);
+
+  AvifInfoParseStats stats;
+  AvifInfoOptions options = {};
+  options.stats = &stats;
+  ASSERT_EQ(AvifInfoGetFeaturesWithOptions(input.data(), input.size(),
+                                           &options, &f),
+            kAvifInfoTooComplex);
+#if defined(AVIFINFO_ENABLE_STATS)
+  EXPECT_EQ(stats.num_parsed_boxes, 4096u);
+  EXPECT_EQ(stats.max_nesting_level, 0u);
+  EXPECT_EQ(stats.features_offset, 0u);
+#endif
+}
+
+TEST(AvifInfoParserTest, Null) {
+  ASSERT_EQ(AvifInfoParserFeed(nullptr, nullptr, 0), kAvifInfoNotEnoughData);
+  AvifInfoFeatures f;
+  ASSERT_EQ(AvifInfoParserGetFeatures(nullptr, &f), kAvifInfoNotEnoughData);
+  ExpectEqual(f, {0});
+  AvifInfoParserDestroy(nullptr);
+  ASSERT_EQ(AvifInfoParserFeedAt(nullptr, 0, nullptr, 0),
+            kAvifInfoNotEnoughData);
+  uint64_t offset = 1, size = 1;
+  ASSERT_EQ(AvifInfoParserGetNextRange(nullptr, &offset, &size),
+            kAvifInfoNotEnoughData);
+  EXPECT_EQ(offset, 0u);
+  EXPECT_EQ(size, 0u);
+
+  // An empty null chunk in the middle of a box is fine.
+  const Data input = LoadFile("avifinfo_test_1x1.avif");
+  ASSERT_FALSE(input.empty());
+  AvifInfoParser* parser = AvifInfoParserCreate();
+  ASSERT_NE(parser, nullptr);
+  ASSERT_EQ(AvifInfoParserFeed(parser, input.data(), 50),
+            kAvifInfoNotEnoughData);
+  ASSERT_EQ(AvifInfoParserFeed(parser, nullptr, 0), kAvifInfoNotEnoughData);
+  ASSERT_EQ(AvifInfoParserFeed(parser, input.data() + 50, input.size() - 50),
+            kAvifInfoOk);
+  AvifInfoParserDestroy(parser);
 }
 
 TEST(AvifInfoReadTest, Null) {
@@ -298,6 +1850,25 @@ TEST(AvifInfoReadTest, Null) {
                                       /*skip=*/nullptr, &f),
             kAvifInfoNotEnoughData);
   ExpectEqual(f, {0});
+  ASSERT_EQ(AvifInfoIdentifyIov(/*segments=*/nullptr, 1),
+            kAvifInfoNotEnoughData);
+  ASSERT_EQ(AvifInfoGetFeaturesIov(/*segments=*/nullptr, 1, &f),
+            kAvifInfoNotEnoughData);
+  ExpectEqual(f, {0});
+  ASSERT_EQ(AvifInfoIdentifyStreamWindow(/*stream=*/nullptr,
+                                         /*window=*/nullptr, /*skip=*/nullptr),
+            kAvifInfoNotEnoughData);
+  ASSERT_EQ(AvifInfoGetFeaturesStreamWindow(/*stream=*/nullptr,
+                                            /*window=*/nullptr,
+                                            /*skip=*/nullptr, &f),
+            kAvifInfoNotEnoughData);
+  ExpectEqual(f, {0});
+  ASSERT_EQ(AvifInfoIdentifyStreamAt(/*stream=*/nullptr, /*read_at=*/nullptr),
+            kAvifInfoNotEnoughData);
+  ASSERT_EQ(AvifInfoGetFeaturesStreamAt(/*stream=*/nullptr,
+                                        /*read_at=*/nullptr, &f),
+            kAvifInfoNotEnoughData);
+  ExpectEqual(f, {0});
 }
 
 //------------------------------------------------------------------------------
@@ -44,3 +44,76 @@ test_avifinfo_parser('avifinfo_test_2x2_alpha.avif', 2, 2, 8, 4);
 test_avifinfo_parser('avifinfo_test_1x1_10b_nopixi_metasize64b_mdatsize0.avif',
                      1, 1, 10, 3);
 test_avifinfo_parser('avifinfo_test_199x200_alpha_grid2x1.avif', 199, 200, 8, 4);
+
+// Same as test_avifinfo_parser() but through Buffered_Stream, with blocks of
+// BLOCK_SIZE bytes and of 1 byte. The file is read from $handle if given.
+function test_avifinfo_parser_by_blocks( $file_name, $expected_width,
+                                         $expected_height, $expected_bit_depth,
+                                         $expected_num_channels,
+                                         $handle = false ) {
+  $success = true;
+  foreach ( array( Avifinfo\BLOCK_SIZE, 1 ) as $block_size ) {
+    $features = false;
+    $file     = $handle ? $handle : fopen( $file_name, 'rb' );
+    if ( $file ) {
+      rewind( $file );
+      $parser = new Avifinfo\Parser( $file, $block_size );
+      if ( $parser->parse_ftyp() && $parser->parse_file() ) {
+        $features = $parser->features->primary_item_features;
+      }
+      if ( !$handle ) {
+        fclose( $file );
+      }
+    }
+    if ( !$features ||
+         $features['width'] != $expected_width ||
+         $features['height'] != $expected_height ||
+         $features['bit_depth'] != $expected_bit_depth ||
+         $features['num_channels'] != $expected_num_channels ) {
+      $success = false;
+    }
+  }
+
+  if ( !$success ) {
+    echo 'Failure: '.$file_name.' by blocks'.PHP_EOL;
+  } else {
+    echo 'Success: '.$file_name.' by blocks'.PHP_EOL;
+  }
+}
+
+test_avifinfo_parser_by_blocks('avifinfo_test_1x1.avif', 1, 1, 8, 3);
+test_avifinfo_parser_by_blocks('avifinfo_test_2x2_alpha.avif', 2, 2, 8, 4);
+test_avifinfo_parser_by_blocks(
+    'avifinfo_test_1x1_10b_nopixi_metasize64b_mdatsize0.avif', 1, 1, 10, 3);
+test_avifinfo_parser_by_blocks('avifinfo_test_199x200_alpha_grid2x1.avif', 199,
+                               200, 8, 4);
+
+// Same as avifinfo_test_1x1.avif with a "free" box bigger than BLOCK_SIZE
+// before the "meta" box, to be skipped.
+$data      = file_get_contents( 'avifinfo_test_1x1.avif' );
+$meta      = strpos( $data, 'meta' ) - 4;
+$free_size = 3 * Avifinfo\BLOCK_SIZE;
+$data      = substr( $data, 0, $meta ).pack( 'N', $free_size ).'free'.
+             str_repeat( "\0", $free_size - 8 ).substr( $data, $meta );
+$handle    = fopen( 'php://temp', 'w+b' );
+fwrite( $handle, $data );
+test_avifinfo_parser_by_blocks('avifinfo_test_1x1.avif with free box', 1, 1, 8,
+                               3, $handle);
+fclose( $handle );
+
+// Buffered_Stream reads by blocks of 4 bytes from a handle not at position 0.
+// Skipping past the end of the block makes the next read() seek the handle.
+$handle = fopen( 'php://temp', 'w+b' );
+for ( $i = 0; $i < 100; ++$i ) {
+  fwrite( $handle, chr( $i ) );
+}
+fseek( $handle, 1, SEEK_SET );
+$stream  = new Avifinfo\Buffered_Stream( $handle, 4 );
+$success = $stream->read( 2 ) === "\x01\x02" && // Reads bytes 1 to 4.
+           $stream->skip( 10 ) &&
+           $stream->read( 3 ) === "\x0d\x0e\x0f" && // Seeks to 13.
+           $stream->read( 2 ) === "\x10\x11" && // Keeps byte 16, reads 17 to 20.
+           $stream->skip( 100 ) &&
+           $stream->read( 1 ) === false; // Past the end of the handle.
+fclose( $handle );
+echo ( $success ? 'Success' : 'Failure' ).': Buffered_Stream skip past block'.PHP_EOL;
@@ -7,8 +7,13 @@
 // Media Patent License 1.0 was not distributed with this source code in the
 // PATENTS file, you can obtain it at www.aomedia.org/license/patent.
 
-use avifinfo::{get_features, identify, AvifInfoError, Features};
-use std::{fs::File, io::Read};
+use avifinfo::{
+    get_features, get_features_batch, get_features_from_reader, identify, AvifInfoError, Features,
+};
+use std::{
+    fs::File,
+    io::{Cursor, Read, Seek, SeekFrom},
+};
 
 #[cfg(test)]
 fn load_file(path: &str) -> Vec<u8> {
@@ -17,6 +22,43 @@ fn load_file(path: &str) -> Vec<u8> {
     bytes
 }
 
+// Moves the first box of 'box_type' right after the first box of 'next_type'.
+// Both must be siblings with 32-bit sizes, in that order.
+#[cfg(test)]
+fn move_box_after(file: &mut Vec<u8>, box_type: &[u8; 4], next_type: &[u8; 4]) {
+    let find_box = |file: &[u8], tag: &[u8; 4]| {
+        let position = file.windows(4).position(|window| window == tag).unwrap() - 4;
+        let size = u32::from_be_bytes(file[position..position + 4].try_into().unwrap());
+        (position, size as usize)
+    };
+    let (position, size) = find_box(file, box_type);
+    let moved_box: Vec<u8> = file.drain(position..position + size).collect();
+    let (next_position, next_size) = find_box(file, next_type);
+    file.splice(next_position + next_size..next_position + next_size, moved_box);
+}
+
+// Inserts 'inserted_box' right before the first box of 'box_type' and grows the
+// 32-bit sizes of the first boxes of 'parent_types' by as many bytes.
+#[cfg(test)]
+fn insert_box_before(
+    file: &mut Vec<u8>,
+    box_type: &[u8; 4],
+    inserted_box: &[u8],
+    parent_types: &[&[u8; 4]],
+) {
+    let find_box =
+        |file: &[u8], tag: &[u8; 4]| file.windows(4).position(|window| window == tag).unwrap() - 4;
+    let position = find_box(file, box_type);
+    file.splice(position..position, inserted_box.iter().copied());
+    for parent_type in parent_types {
+        let parent_position = find_box(file, parent_type);
+        let size =
+            u32::from_be_bytes(file[parent_position..parent_position + 4].try_into().unwrap());
+        let size = size + inserted_box.len() as u32;
+        file[parent_position..parent_position + 4].copy_from_slice(&size.to_be_bytes());
+    }
+}
+
 //------------------------------------------------------------------------------
 // Positive tests
 
@@ -122,6 +164,35 @@ fn with_gainmap_tmap() {
     }
 }
 
+#[test]
+fn with_gainmap_tmap_in_later_dimg() {
+    let mut file = load_file("tests/avifinfo_test_12x34_gainmap_tmap_iref_after_iprp.avif");
+    // Insert a 'dimg' box unrelated to the 'tmap' item before the 'dimg' box
+    // that lists the inputs of the 'tmap' item, and grow the parent boxes.
+    let other_dimg = [0, 0, 0, 14, b'd', b'i', b'm', b'g', 0, 5, 0, 1, 0, 6]; // From 5 to 6.
+    let dimg_position = file.windows(4).position(|window| window == b"dimg").unwrap() - 4;
+    file.splice(dimg_position..dimg_position, other_dimg);
+    for parent_type in [b"meta", b"iref"] {
+        let position = file.windows(4).position(|window| window == parent_type).unwrap() - 4;
+        let size = u32::from_be_bytes(file[position..position + 4].try_into().unwrap());
+        file[position..position + 4].copy_from_slice(&(size + 14).to_be_bytes());
+    }
+
+    assert_eq!(
+        get_features(file.as_slice()),
+        Ok(Features {
+            width: 12,
+            height: 34,
+            bit_depth: 10,
+            num_channels: 4,
+            has_gainmap: true,
+            gainmap_item_id: 4,
+            primary_item_id_location: 96,
+            primary_item_id_bytes: 2,
+        })
+    );
+}
+
 #[test]
 fn no_pixi_10b() {
     // Same as above but "meta" box size is stored as 64 bits, "av1C" has
@@ -180,20 +251,9 @@ fn metabox_is_big() {
         file.insert(meta_position.unwrap() + 4, 1);
     }
 
+    // Any box bigger than 4GB stops the parsing, as in the C implementation.
     assert_eq!(identify(file.as_slice()), Ok(()));
-    assert_eq!(
-        get_features(file.as_slice()),
-        Ok(Features {
-            width: 1,
-            height: 1,
-            bit_depth: 8,
-            num_channels: 3,
-            has_gainmap: false,
-            gainmap_item_id: 0,
-            primary_item_id_location: 104,
-            primary_item_id_bytes: 2,
-        })
-    );
+    assert_eq!(get_features(file.as_slice()), Err(AvifInfoError::TooComplex));
 }
 
 #[test]
@@ -222,6 +282,204 @@ fn metabox_runs_till_end_of_file() {
     );
 }
 
+#[test]
+fn iinf_after_iprp() {
+    let file = load_file("tests/avifinfo_test_1x1.avif");
+    let mut moved_file = file.clone();
+    move_box_after(&mut moved_file, b"iinf", b"iprp");
+    assert_ne!(moved_file, file);
+
+    assert!(get_features(file.as_slice()).is_ok());
+    assert_eq!(get_features(moved_file.as_slice()), get_features(file.as_slice()));
+}
+
+#[cfg(test)]
+const TEST_FILE_PATHS: [&str; 7] = [
+    "tests/avifinfo_test_1x1.avif",
+    "tests/avifinfo_test_2x2_alpha.avif",
+    "tests/avifinfo_test_20x20_gainmap.avif",
+    "tests/avifinfo_test_12x34_gainmap_tmap.avif",
+    "tests/avifinfo_test_12x34_gainmap_tmap_iref_after_iprp.avif",
+    "tests/avifinfo_test_199x200_alpha_grid2x1.avif",
+    "tests/avifinfo_test_1x1_10b_nopixi_metasize64b_mdatsize0.avif",
+];
+
+// Counts the bytes that are read, not the ones that are skipped.
+#[cfg(test)]
+struct CountingReader<R> {
+    reader: R,
+    num_read_bytes: usize,
+}
+
+#[cfg(test)]
+impl<R: Read> Read for CountingReader<R> {
+    fn read(&mut self, buf: &mut [u8]) -> std::io::Result<usize> {
+        let num_read_bytes = self.reader.read(buf)?;
+        self.num_read_bytes += num_read_bytes;
+        Ok(num_read_bytes)
+    }
+}
+
+#[cfg(test)]
+impl<R: Seek> Seek for CountingReader<R> {
+    fn seek(&mut self, pos: SeekFrom) -> std::io::Result<u64> {
+        self.reader.seek(pos)
+    }
+}
+
+// Features output by avifinfo.c for each of TEST_FILE_PATHS, and the minimum
+// number of bytes it needs. Shorter inputs are kAvifInfoNotEnoughData.
+#[cfg(test)]
+fn c_features(file_index: usize) -> (Features, usize) {
+    let features = |width, height, bit_depth, num_channels, gainmap_item_id, location| Features {
+        width,
+        height,
+        bit_depth,
+        num_channels,
+        has_gainmap: gainmap_item_id != 0,
+        gainmap_item_id,
+        primary_item_id_location: location,
+        primary_item_id_bytes: 2,
+    };
+    match file_index {
+        0 => (features(1, 1, 8, 3, 0, 96), 274),
+        1 => (features(2, 2, 8, 4, 0, 96), 429),
+        2 => (features(20, 20, 8, 3, 2, 96), 486),
+        3 => (features(12, 34, 10, 4, 4, 96), 635),
+        4 => (features(12, 34, 10, 4, 4, 96), 616),
+        5 => (features(199, 200, 8, 4, 0, 96), 667),
+        _ => (features(1, 1, 10, 3, 0, 104), 282),
+    }
+}
+
+// Number of kAvifInfoOk, kAvifInfoNotEnoughData, kAvifInfoTooComplex and
+// kAvifInfoInvalidFile statuses returned by avifinfo.c for each of
+// TEST_FILE_PATHS, once per byte among the first 400 that is added 0x55.
+#[cfg(test)]
+const C_BROKEN_STATUS_COUNTS: [[usize; 4]; 7] = [
+    [200, 9, 2, 94],
+    [288, 9, 1, 102],
+    [294, 9, 1, 96],
+    [282, 8, 1, 109],
+    [287, 9, 1, 103],
+    [321, 9, 1, 69],
+    [201, 10, 6, 98],
+];
+
+#[test]
+fn reader_same_as_slice() {
+    for (file_index, file_path) in TEST_FILE_PATHS.iter().enumerate() {
+        let file = load_file(file_path);
+        let (expected_features, min_size) = c_features(file_index);
+        // Truncated files too.
+        for size in 0..=file.len() {
+            let expected = if size < min_size {
+                Err(&AvifInfoError::NotEnoughData)
+            } else {
+                Ok(&expected_features)
+            };
+            assert_eq!(get_features(&file[..size]).as_ref(), expected);
+            assert_eq!(
+                get_features_from_reader(&mut Cursor::new(&file[..size])).as_ref(),
+                expected
+            );
+        }
+        // Broken files.
+        let mut status_counts = [0usize; 4];
+        for position in 0..std::cmp::min(file.len(), 400) {
+            let mut broken_file = file.clone();
+            broken_file[position] = broken_file[position].wrapping_add(0x55);
+            let features = get_features(&broken_file);
+            assert_eq!(get_features_from_reader(&mut Cursor::new(&broken_file)), features);
+            status_counts[match features {
+                Ok(_) => 0,
+                Err(AvifInfoError::NotEnoughData) => 1,
+                Err(AvifInfoError::TooComplex) => 2,
+                Err(AvifInfoError::InvalidFile) => 3,
+            }] += 1;
+        }
+        assert_eq!(status_counts, C_BROKEN_STATUS_COUNTS[file_index], "{file_path}");
+    }
+}
+
+#[test]
+fn reader_skips_mdat() {
+    let mut file = load_file("tests/avifinfo_test_1x1.avif");
+    // Insert a big "mdat" box before the "meta" box.
+    let meta_position = file.windows(4).position(|window| window == b"meta").unwrap() - 4;
+    let mdat_size = 1000000u32;
+    let mut mdat = vec![0u8; mdat_size as usize];
+    mdat[..4].copy_from_slice(&mdat_size.to_be_bytes());
+    mdat[4..8].copy_from_slice(b"mdat");
+    file.splice(meta_position..meta_position, mdat);
+
+    let mut reader = CountingReader { reader: Cursor::new(&file), num_read_bytes: 0 };
+    let features = get_features_from_reader(&mut reader);
+    assert_eq!(features, get_features(&file));
+    assert_eq!(features.unwrap().primary_item_id_location, 96 + mdat_size as usize);
+    assert!(reader.num_read_bytes < 1000);
+}
+
+#[test]
+fn reader_reads_beginning_of_meta() {
+    let file = load_file("tests/avifinfo_test_1x1.avif");
+    let meta_position = file.windows(4).position(|window| window == b"meta").unwrap() - 4;
+    let meta_size = u32::from_be_bytes(file[meta_position..meta_position + 4].try_into().unwrap());
+
+    // The "meta" box runs till the end of the file, which is big.
+    let mut unsized_file = file.clone();
+    unsized_file[meta_position..meta_position + 4].copy_from_slice(&0u32.to_be_bytes());
+    unsized_file.resize(1000000, 0);
+    let mut reader = CountingReader { reader: Cursor::new(&unsized_file), num_read_bytes: 0 };
+    let features = get_features_from_reader(&mut reader);
+    assert_eq!(features, get_features(&unsized_file));
+    assert!(features.is_ok());
+    assert!(reader.num_read_bytes < 10000);
+
+    // Insert a "free" box bigger than AVIFINFO_MAX_META_SIZE before the features.
+    let free_size = (1u32 << 24) + 1;
+    let mut free = vec![0u8; free_size as usize];
+    free[..4].copy_from_slice(&free_size.to_be_bytes());
+    free[4..8].copy_from_slice(b"free");
+    let mut big_file = file.clone();
+    let first_child_position = meta_position + 12; // After the version and flags.
+    big_file.splice(first_child_position..first_child_position, free);
+    big_file[meta_position..meta_position + 4]
+        .copy_from_slice(&(meta_size + free_size).to_be_bytes());
+    assert!(get_features(&big_file).is_ok());
+    assert_eq!(
+        get_features_from_reader(&mut Cursor::new(&big_file)),
+        Err(AvifInfoError::TooComplex)
+    );
+}
+
+#[test]
+fn batch() {
+    let files: Vec<Vec<u8>> = TEST_FILE_PATHS.iter().map(|path| load_file(path)).collect();
+    let inputs: Vec<&[u8]> = files.iter().map(|file| &file[..file.len() / 2]).collect();
+    // Only the 20x20 gain map file has all its features in its first half.
+    let expected: Vec<_> = (0..inputs.len())
+        .map(|file_index| match file_index {
+            2 => Ok(c_features(file_index).0),
+            _ => Err(AvifInfoError::NotEnoughData),
+        })
+        .collect();
+    assert_eq!(get_features_batch(&inputs), expected);
+    assert_eq!(
+        get_features_batch(&files),
+        (0..files.len()).map(|file_index| Ok(c_features(file_index).0)).collect::<Vec<_>>()
+    );
+    assert!(get_features_batch::<&[u8]>(&[]).is_empty());
+
+    // Enough inputs to be parsed on several threads, if available.
+    let many_inputs: Vec<&[u8]> = inputs.iter().cycle().take(1000).cloned().collect();
+    let many_features = get_features_batch(&many_inputs);
+    assert_eq!(many_features.len(), many_inputs.len());
+    for (features, expected_features) in many_features.iter().zip(expected.iter().cycle()) {
+        assert_eq!(features, expected_features);
+    }
+}
+
 //------------------------------------------------------------------------------
 // Negative tests
 
@@ -268,6 +526,7 @@ fn metabox_is_too_big() {
 
     assert_eq!(identify(file.as_slice()), Ok(()));
     assert_eq!(get_features(file.as_slice()), Err(AvifInfoError::TooComplex));
+    assert_eq!(get_features_from_reader(&mut Cursor::new(&file)), Err(AvifInfoError::TooComplex));
 }
 
 #[test]
@@ -276,8 +535,9 @@ fn filetypebox_runs_till_end_of_file() {
     let ftyp_position = file.windows(4).position(|window| window == b"ftyp");
     file[ftyp_position.unwrap() - 1] = 0;
 
-    assert_eq!(identify(file.as_slice()), Err(AvifInfoError::InvalidFile));
-    assert_eq!(get_features(file.as_slice()), Err(AvifInfoError::InvalidFile));
+    // The brands are enough to identify the file, but no 'meta' box can follow.
+    assert_eq!(identify(file.as_slice()), Ok(()));
+    assert_eq!(get_features(file.as_slice()), Err(AvifInfoError::NotEnoughData));
 }
 
 #[test]
@@ -303,4 +563,68 @@ fn too_many_boxes() {
 
     assert_eq!(identify(input.as_slice()), Ok(()));
     assert_eq!(get_features(input.as_slice()), Err(AvifInfoError::TooComplex));
+    assert_eq!(get_features_from_reader(&mut Cursor::new(&input)), Err(AvifInfoError::TooComplex));
+}
+
+#[test]
+fn malformed_layouts_same_as_c() {
+    // The expected statuses and features are the ones output by avifinfo.c.
+    let expect = |file: &[u8], expected: Result<Features, AvifInfoError>| {
+        assert_eq!(get_features(file), expected);
+        assert_eq!(get_features_from_reader(&mut Cursor::new(file)), expected);
+    };
+    let file_1x1 = load_file("tests/avifinfo_test_1x1.avif");
+    let (features_1x1, _) = c_features(0);
+
+    // The first box is not 'ftyp'.
+    let mut file = file_1x1.clone();
+    file[4..8].copy_from_slice(b"free");
+    assert_eq!(identify(file.as_slice()), Err(AvifInfoError::InvalidFile));
+    expect(&file, Err(AvifInfoError::InvalidFile));
+
+    // A box bigger than 4GB before 'meta'.
+    let mut file = file_1x1.clone();
+    let big_box = [0, 0, 0, 1, b'f', b'r', b'e', b'e', 0, 0, 0, 1, 0, 0, 0, 16];
+    insert_box_before(&mut file, b"meta", &big_box, &[]);
+    expect(&file, Err(AvifInfoError::TooComplex));
+
+    // A box running till the end of the file before 'meta'.
+    let mut file = file_1x1.clone();
+    insert_box_before(&mut file, b"meta", &[0, 0, 0, 0, b'f', b'r', b'e', b'e'], &[]);
+    expect(&file, Err(AvifInfoError::NotEnoughData));
+
+    // Empty 'iref', 'iprp' and 'ipco' boxes.
+    let mut file = file_1x1.clone();
+    insert_box_before(
+        &mut file,
+        b"iprp",
+        &[0, 0, 0, 12, b'i', b'r', b'e', b'f', 0, 0, 0, 0],
+        &[b"meta"],
+    );
+    expect(&file, Err(AvifInfoError::InvalidFile));
+    let mut file = file_1x1.clone();
+    insert_box_before(&mut file, b"iprp", &[0, 0, 0, 8, b'i', b'p', b'r', b'p'], &[b"meta"]);
+    expect(&file, Err(AvifInfoError::InvalidFile));
+    let mut file = file_1x1.clone();
+    insert_box_before(
+        &mut file,
+        b"ipco",
+        &[0, 0, 0, 8, b'i', b'p', b'c', b'o'],
+        &[b"meta", b"iprp"],
+    );
+    expect(&file, Err(AvifInfoError::InvalidFile));
+
+    // 'ipma' before 'ipco'.
+    let mut file = file_1x1.clone();
+    move_box_after(&mut file, b"ipco", b"ipma");
+    expect(&file, Err(AvifInfoError::InvalidFile));
+
+    // Two 'pitm' boxes. The last one counts and there is no item 2.
+    let pitm = [0, 0, 0, 14, b'p', b'i', b't', b'm', 0, 0, 0, 0, 0, 2];
+    let mut file = file_1x1.clone();
+    insert_box_before(&mut file, b"iloc", &pitm, &[b"meta"]);
+    expect(&file, Err(AvifInfoError::InvalidFile));
+    let mut file = file_1x1.clone();
+    insert_box_before(&mut file, b"pitm", &pitm, &[b"meta"]);
+    expect(&file, Ok(Features { primary_item_id_location: 110, ..features_1x1 }));
 }
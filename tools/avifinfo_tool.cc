@@ -8,19 +8,46 @@
 // PATENTS file, you can obtain it at www.aomedia.org/license/patent.
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>              // NOLINT
+#include <condition_variable>  // NOLINT
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <filesystem>  // NOLINT
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <sstream>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <thread>  // NOLINT
+#include <utility>
 #include <vector>
 
 #include "avif/avif.h"
 #include "avifinfo.h"
 
+// POSIX is needed for --async and --index. io_uring is used instead of a
+// thread pool for --async on Linux.
+#if __has_include(<unistd.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define AVIFINFO_TOOL_POSIX
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define AVIFINFO_TOOL_IO_URING
+#endif
+#endif
+
 namespace {
 
 //------------------------------------------------------------------------------
@@ -33,8 +60,26 @@ std::string GetHelpStr() {
   str += "  -h, --help ...... Print this help\n";
   str += "  --fast .......... Skip libavif decoding, only use libavifinfo\n";
   str += "  --min-size ...... Find minimum size to extract features per file\n";
+  str += "  --json <file> ... Write --min-size percentiles to a JSON file\n";
+  str += "  --dims-only ..... Only extract width and height, implies --fast\n";
   str += "  --validate ...... Check libavifinfo consistency on each file\n";
   str += "  --no-bad-file ... Return an error code in case of invalid file\n";
+  str += "  --jobs <n> ...... Process the files with n threads (default: 1)\n";
+  str += "  --shard <i/n> ... Only process the i-th of n disjoint subsets of\n";
+  str += "                    the files (0 <= i < n), for example on n\n";
+  str += "                    machines given the same inputs\n";
+  str += "  --report <file> . Write the statuses, features, timings and\n";
+  str += "                    mismatches of each file as JSON lines\n";
+#if defined(AVIFINFO_TOOL_POSIX)
+  str += "  --async <n> ..... Keep n reads in flight, implies --fast\n";
+  str += "                    Incompatible with other options\n";
+  str += "  --index <file> .. Parse the new or changed files into an index\n";
+  str += "  --query <cond> .. List the files in the index matching all\n";
+  str += "                    comma-separated conditions such as\n";
+  str += "                    bit_depth=10,has_gainmap=1 (fields: status,\n";
+  str += "                    width, height, bit_depth, num_channels,\n";
+  str += "                    has_gainmap, min_size, file_size)\n";
+#endif
   return str;
 }
 
@@ -44,8 +89,23 @@ std::string GetHelpStr() {
 struct Result {
   bool success;  // True if the 'features' were correctly decoded.
   AvifInfoFeatures features;
+  const char* status = "";  // Name of the libavif or libavifinfo status.
 };
 
+const char* GetStatusName(AvifInfoStatus status) {
+  switch (status) {
+    case kAvifInfoOk:
+      return "ok";
+    case kAvifInfoNotEnoughData:
+      return "not_enough_data";
+    case kAvifInfoTooComplex:
+      return "too_complex";
+    case kAvifInfoInvalidFile:
+      return "invalid_file";
+  }
+  return "unknown";
+}
+
 // Decodes the AVIF at 'data' of 'data_size' bytes using libavif.
 Result DecodeAvif(const uint8_t data[], size_t data_size) {
   Result result;
@@ -55,51 +115,92 @@ Result DecodeAvif(const uint8_t data[], size_t data_size) {
   const avifResult status =
       avifDecoderReadMemory(decoder, image, data, data_size);
   avifDecoderDestroy(decoder);
+  result.status = avifResultToString(status);
   if (status == AVIF_RESULT_OK) {
     const uint32_t num_channels =
         ((image->yuvFormat == AVIF_PIXEL_FORMAT_NONE)     ? 0
          : (image->yuvFormat == AVIF_PIXEL_FORMAT_YUV400) ? 1
                                                           : 3) +
         ((image->alphaPlane != nullptr) ? 1 : 0);
-    result = {true, {image->width, image->height, image->depth, num_channels}};
+    result.success = true;
+    result.features = {image->width, image->height, image->depth,
+                       num_channels};
   } else {
-    result = {false};
+    result.success = false;
   }
   avifImageDestroy(image);
   return result;
 }
 
 // Parses the AVIF at 'data' of 'data_size' bytes using libavifinfo.
-Result ParseAvif(const uint8_t data[], size_t data_size) {
+Result ParseAvif(const uint8_t data[], size_t data_size,
+                 const AvifInfoOptions& options) {
   Result result;
-  result.success =
-      (AvifInfoIdentify(data, data_size) == kAvifInfoOk &&
-       AvifInfoGetFeatures(data, data_size, &result.features) == kAvifInfoOk);
+  AvifInfoStatus status = AvifInfoIdentify(data, data_size);
+  if (status == kAvifInfoOk) {
+    status = AvifInfoGetFeaturesWithOptions(data, data_size, &options,
+                                            &result.features);
+  }
+  result.success = (status == kAvifInfoOk);
+  result.status = GetStatusName(status);
   return result;
 }
 
+// Sequential access over the bytes of an AVIF file, keeping track of the
+// furthest byte that was read. Skipped bytes do not need to be available.
+struct PrefixStream {
+  const uint8_t* data;
+  size_t data_size;
+  size_t position = 0;
+  size_t num_needed_bytes = 0;
+};
+
+const uint8_t* PrefixStreamRead(void* stream, size_t num_bytes) {
+  PrefixStream* s = reinterpret_cast<PrefixStream*>(stream);
+  if (num_bytes > s->data_size - std::min(s->position, s->data_size)) {
+    return nullptr;
+  }
+  s->position += num_bytes;
+  s->num_needed_bytes = std::max(s->num_needed_bytes, s->position);
+  return s->data + s->position - num_bytes;
+}
+
+void PrefixStreamSkip(void* stream, size_t num_bytes) {
+  reinterpret_cast<PrefixStream*>(stream)->position += num_bytes;
+}
+
 // Same as above but also returns the 'min_data_size' for which 'data' can be
-// successfully parsed.
+// successfully parsed. The parsing only depends on the bytes that are read, so
+// this is the end of the furthest read, found in a single pass.
 Result ParseAvifForSize(const uint8_t data[], size_t data_size,
+                        const AvifInfoOptions& options,
                         size_t& min_data_size) {
-  const Result result = ParseAvif(data, data_size);
-  if (!result.success) {
-    min_data_size = data_size;
-    return result;
-  }
-  min_data_size = 1;
-  size_t max_data_size = data_size;
-  while (min_data_size < max_data_size) {
-    const size_t middle = (min_data_size + max_data_size) / 2;
-    if (ParseAvif(data, middle).success) {
-      max_data_size = middle;
-    } else {
-      min_data_size = middle + 1;
-    }
-  }
+  PrefixStream stream = {data, data_size};
+  Result result;
+  result.success =
+      (AvifInfoIdentifyStream(&stream, PrefixStreamRead, PrefixStreamSkip) ==
+           kAvifInfoOk &&
+       AvifInfoGetFeaturesStreamWithOptions(&stream, PrefixStreamRead,
+                                            PrefixStreamSkip, &options,
+                                            &result.features) == kAvifInfoOk);
+  min_data_size = result.success ? stream.num_needed_bytes : data_size;
   return result;
 }
 
+// Combinations of AvifInfoField values reported by --min-size, with a name.
+struct FieldMask {
+  uint32_t requested_fields;
+  const char* name;
+};
+constexpr FieldMask kFieldMasks[] = {
+    {kAvifInfoFieldAll, "all"},
+    {kAvifInfoFieldDimensions, "dimensions"},
+    {kAvifInfoFieldBitDepth | kAvifInfoFieldNumChannels,
+     "bit_depth+num_channels"},
+    {kAvifInfoFieldGainmap, "gainmap"},
+    {kAvifInfoFieldPrimaryItemIdLocation, "primary_item_id_location"},
+};
+
 // Reuses the fuzz target for easy library validation.
 extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t data_size);
 
@@ -108,20 +209,82 @@ struct Stats {
   uint32_t num_files_invalid_at_decode = 0;
   uint32_t num_files_invalid_at_parse = 0;
   uint32_t num_files_invalid_at_both = 0;
-  std::unordered_map<size_t, uint32_t> min_size_to_count;
+  // Histogram of the minimum sizes to extract each kFieldMasks element.
+  std::map<uint32_t, std::map<size_t, uint32_t>> min_size_to_count;
 };
 
+// Adds the 'stats' of a job to the 'total'.
+void MergeStats(const Stats& stats, Stats& total) {
+  total.num_files_invalid_at_decode += stats.num_files_invalid_at_decode;
+  total.num_files_invalid_at_parse += stats.num_files_invalid_at_parse;
+  total.num_files_invalid_at_both += stats.num_files_invalid_at_both;
+  for (const auto& mask : stats.min_size_to_count) {
+    for (const auto& it : mask.second) {
+      total.min_size_to_count[mask.first][it.first] += it.second;
+    }
+  }
+}
+
 //------------------------------------------------------------------------------
 
-// Recursively adds all files at 'path' to 'file_paths'.
-void FindFiles(const std::string& path, std::vector<std::string>& file_paths) {
+// Appends the bytes of the 'file' to 'bytes' until it is 'size'-byte long.
+// Returns false in case of error.
+bool ReadFileUpTo(std::ifstream& file, size_t size,
+                  std::vector<uint8_t>& bytes) {
+  const size_t offset = bytes.size();
+  bytes.resize(size);
+  file.read(reinterpret_cast<char*>(bytes.data() + offset), size - offset);
+  return static_cast<size_t>(file.gcount()) == size - offset;
+}
+
+// Reads the file at 'path' into 'bytes'. Returns false in case of error.
+bool ReadFile(const std::string& path, std::vector<uint8_t>& bytes) {
+  std::error_code error;
+  const uintmax_t file_size = std::filesystem::file_size(path, error);
+  std::ifstream file(path, std::ios::binary);
+  bytes.clear();
+  return !error && file && ReadFileUpTo(file, file_size, bytes);
+}
+
+// Reads the shortest prefix of the file at 'path' that is enough for
+// libavifinfo to extract the features with 'options', into 'bytes'. The
+// prefix grows geometrically and is the whole file if the parsing fails.
+// Returns false in case of error.
+bool ReadFilePrefix(const std::string& path, const AvifInfoOptions& options,
+                    std::vector<uint8_t>& bytes) {
+  std::error_code error;
+  const uintmax_t file_size = std::filesystem::file_size(path, error);
+  std::ifstream file(path, std::ios::binary);
+  if (error || !file) return false;
+  bytes.clear();
+  // Most headers fit in the first kilobyte.
+  size_t prefix_size = std::min<uintmax_t>(1024, file_size);
+  while (true) {
+    if (!ReadFileUpTo(file, prefix_size, bytes)) return false;
+    AvifInfoStatus status = AvifInfoIdentify(bytes.data(), bytes.size());
+    if (status == kAvifInfoOk) {
+      status = AvifInfoGetFeaturesWithOptions(bytes.data(), bytes.size(),
+                                              &options, nullptr);
+    }
+    if (status != kAvifInfoNotEnoughData || prefix_size == file_size) {
+      return true;
+    }
+    prefix_size = std::min<uintmax_t>(prefix_size * 4, file_size);
+  }
+}
+
+//------------------------------------------------------------------------------
+
+// Recursively calls 'add_file' for all files at 'path'.
+void FindFiles(const std::string& path,
+               const std::function<void(const std::string&)>& add_file) {
   if (std::filesystem::is_directory(path)) {
     for (const std::filesystem::directory_entry& entry :
          std::filesystem::directory_iterator(path)) {
-      FindFiles(entry.path(), file_paths);
+      FindFiles(entry.path(), add_file);
     }
   } else {
-    file_paths.emplace_back(path);
+    add_file(path);
   }
 }
 
@@ -136,87 +299,920 @@ std::string FindCommonLongestPrefix(const std::vector<std::string>& paths) {
   return std::filesystem::path(prefix).remove_filename().string();
 }
 
+// Returns true if the file at 'path' belongs to the 'shard_index'-th of
+// 'num_shards' subsets. The assignment only depends on the 'path', so that
+// independent runs over the same inputs process disjoint sets of files.
+bool IsInShard(const std::string& path, uint32_t shard_index,
+               uint32_t num_shards) {
+  uint64_t hash = 0xcbf29ce484222325ull;  // FNV-1a, stable across platforms.
+  for (const char c : path) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+  }
+  return hash % num_shards == shard_index;
+}
+
+//------------------------------------------------------------------------------
+// One JSON object per line and per file, for --report.
+
+// Writes 'str' to 'report' as a JSON string.
+void WriteJsonString(std::string_view str, std::ostream& report) {
+  static const char kHexDigits[] = "0123456789abcdef";
+  report << '"';
+  for (const char c : str) {
+    if (c == '"' || c == '\\') {
+      report << '\\' << c;
+    } else if (static_cast<uint8_t>(c) < 0x20) {
+      report << "\\u00" << kHexDigits[c >> 4] << kHexDigits[c & 15];
+    } else {
+      report << c;
+    }
+  }
+  report << '"';
+}
+
+// Writes the 'result' of a decoding or parsing that took 'duration' to
+// 'report' as a JSON object.
+void WriteJsonResult(const Result& result,
+                     std::chrono::steady_clock::duration duration,
+                     std::ostream& report) {
+  report << "{\"status\": ";
+  WriteJsonString(result.status, report);
+  if (result.success) {
+    report << ", \"width\": " << result.features.width
+           << ", \"height\": " << result.features.height
+           << ", \"bit_depth\": " << result.features.bit_depth
+           << ", \"num_channels\": " << result.features.num_channels;
+  }
+  report << ", \"time_us\": "
+         << std::chrono::duration_cast<std::chrono::microseconds>(duration)
+                .count()
+         << "}";
+}
+
+// What happened to a file, filled by ParseFile() or DecodeAndParseFile().
+struct FileReport {
+  bool read = false;
+  bool decoded = false;  // False if the file was only parsed.
+  Result decode, parse;
+  std::chrono::steady_clock::duration decode_duration{}, parse_duration{};
+  bool mismatch = false;  // True if libavif and libavifinfo disagree.
+};
+
+// Writes the 'file_report' of the file at 'path' of 'data_size' bytes to
+// 'report' as a line.
+void WriteJsonLine(const std::string& path, size_t data_size,
+                   const FileReport& file_report, std::ostream& report) {
+  report << "{\"path\": ";
+  WriteJsonString(path, report);
+  if (!file_report.read) {
+    report << ", \"status\": \"reading_failure\"}\n";
+    return;
+  }
+  report << ", \"size\": " << data_size;
+  if (file_report.decoded) {
+    report << ", \"decode\": ";
+    WriteJsonResult(file_report.decode, file_report.decode_duration, report);
+  }
+  report << ", \"parse\": ";
+  WriteJsonResult(file_report.parse, file_report.parse_duration, report);
+  if (file_report.decoded) {
+    report << ", \"mismatch\": " << (file_report.mismatch ? "true" : "false");
+  }
+  report << "}\n";
+}
+
 //------------------------------------------------------------------------------
 
 // Uses libavifinfo to extract the features of an AVIF file stored in 'data' at
-// 'path'. The AVIF file is 'data_size'-byte long.
+// 'path'. The AVIF file is 'data_size'-byte long. The 'report' is filled if
+// not null.
 void ParseFile(const std::string& path, const uint8_t* data, size_t data_size,
-               Stats& stats) {
-  const Result parse = ParseAvif(data, data_size);
+               const AvifInfoOptions& options, Stats& stats, std::ostream& log,
+               FileReport* report) {
+  const auto start = std::chrono::steady_clock::now();
+  const Result parse = ParseAvif(data, data_size, options);
+  const auto parse_duration = std::chrono::steady_clock::now() - start;
   if (!parse.success) {
     ++stats.num_files_invalid_at_parse;
-    std::cout << "parsing failure for " << path << std::endl;
+    log << "parsing failure for " << path << std::endl;
+  }
+  if (report != nullptr) {
+    report->parse = parse;
+    report->parse_duration = parse_duration;
   }
 }
 
 // Uses libavif then libavifinfo to extract the features of an AVIF file.
 // Returns false in case of libavifinfo parsing failure or behavior
-// inconsistency compared to libavif.
+// inconsistency compared to libavif. The 'report' is filled if not null.
 bool DecodeAndParseFile(const std::string& path, const uint8_t* data,
-                        size_t data_size, Stats& stats) {
+                        size_t data_size, Stats& stats, std::ostream& log,
+                        FileReport* report) {
+  const auto start = std::chrono::steady_clock::now();
   const Result decode = DecodeAvif(data, data_size);
-  const Result parse = ParseAvif(data, data_size);
+  const auto decode_end = std::chrono::steady_clock::now();
+  const Result parse = ParseAvif(data, data_size, AvifInfoOptions());
+  const auto parse_end = std::chrono::steady_clock::now();
   if (!decode.success) ++stats.num_files_invalid_at_decode;
   if (!parse.success) ++stats.num_files_invalid_at_parse;
   if (!decode.success && !parse.success) ++stats.num_files_invalid_at_both;
 
-  if (!parse.success ||
-      (decode.success &&
-       (decode.features.width != parse.features.width ||
-        decode.features.height != parse.features.height ||
-        decode.features.bit_depth != parse.features.bit_depth ||
-        decode.features.num_channels != parse.features.num_channels))) {
+  const bool features_differ =
+      decode.success && parse.success &&
+      (decode.features.width != parse.features.width ||
+       decode.features.height != parse.features.height ||
+       decode.features.bit_depth != parse.features.bit_depth ||
+       decode.features.num_channels != parse.features.num_channels);
+  if (report != nullptr) {
+    report->decoded = true;
+    report->decode = decode;
+    report->decode_duration = decode_end - start;
+    report->parse = parse;
+    report->parse_duration = parse_end - decode_end;
+    report->mismatch = features_differ || decode.success != parse.success;
+  }
+  if (!parse.success || features_differ) {
     if (decode.success && parse.success) {
-      std::cout << "decoded " << decode.features.width << "x"
-                << decode.features.height << "," << decode.features.bit_depth
-                << "b*" << decode.features.num_channels << " / "
-                << "parsed " << parse.features.width << "x"
-                << parse.features.height << "," << parse.features.bit_depth
-                << "b*" << parse.features.num_channels;
+      log << "decoded " << decode.features.width << "x"
+          << decode.features.height << "," << decode.features.bit_depth
+          << "b*" << decode.features.num_channels << " / "
+          << "parsed " << parse.features.width << "x" << parse.features.height
+          << "," << parse.features.bit_depth << "b*"
+          << parse.features.num_channels;
     } else {
-      std::cout << "decoding " << (decode.success ? "success" : "failure")
-                << " / parsing " << (parse.success ? "success" : "failure");
+      log << "decoding " << (decode.success ? "success" : "failure")
+          << " / parsing " << (parse.success ? "success" : "failure");
     }
-    std::cout << " for " << path << std::endl;
+    log << " for " << path << std::endl;
     return false;
   }
   return true;
 }
 
-// Returns the minimum number of bytes of AVIF 'data' for features to be
-// extracted.
+// Finds the minimum number of bytes of AVIF 'data' for features to be
+// extracted, for the requested fields of 'options' or for all kFieldMasks if
+// none.
 void FindMinSizeOfFile(const std::string& path, const uint8_t* data,
-                       size_t data_size, Stats& stats) {
-  size_t min_size;
-  const Result parse = ParseAvifForSize(data, data_size, min_size);
-  if (parse.success) {
-    ++stats.min_size_to_count[min_size];
-  } else {
-    ++stats.num_files_invalid_at_parse;
+                       size_t data_size, const AvifInfoOptions& options,
+                       Stats& stats) {
+  for (const FieldMask& mask : kFieldMasks) {
+    if (options.requested_fields != 0 &&
+        options.requested_fields != mask.requested_fields) {
+      continue;
+    }
+    AvifInfoOptions mask_options = options;
+    mask_options.requested_fields = mask.requested_fields;
+    size_t min_size;
+    const Result parse =
+        ParseAvifForSize(data, data_size, mask_options, min_size);
+    if (parse.success) {
+      ++stats.min_size_to_count[mask.requested_fields][min_size];
+    } else if (&mask == &kFieldMasks[0] || options.requested_fields != 0) {
+      ++stats.num_files_invalid_at_parse;
+    }
+  }
+}
+
+// Returns the smallest size in the 'histogram' of 'num_files' that is enough
+// for at least 'percentile' percent of them.
+size_t GetPercentile(const std::map<size_t, uint32_t>& histogram,
+                     uint32_t num_files, double percentile) {
+  const double rank = num_files * percentile / 100.;
+  uint32_t count = 0;
+  for (const auto& it : histogram) {
+    count += it.second;
+    if (count >= rank) return it.first;
+  }
+  return histogram.empty() ? 0 : histogram.rbegin()->first;
+}
+
+// Prints the minimum size percentiles of each field mask in 'stats' as text,
+// or as JSON into 'json' if not null.
+void PrintMinSizes(const Stats& stats, size_t num_files, std::ostream* json) {
+  constexpr double kPercentiles[] = {50, 90, 99, 99.9};
+  constexpr const char* kPercentileNames[] = {"p50", "p90", "p99", "p99.9"};
+  if (json != nullptr) {
+    *json << "{\n  \"num_files\": " << num_files
+          << ",\n  \"num_files_invalid_at_parse\": "
+          << stats.num_files_invalid_at_parse << ",\n  \"min_size\": {";
+  }
+  const char* mask_separator = "";
+  for (const FieldMask& mask : kFieldMasks) {
+    const auto histogram = stats.min_size_to_count.find(mask.requested_fields);
+    if (histogram == stats.min_size_to_count.end()) continue;
+    uint32_t num_parsed_files = 0;
+    for (const auto& it : histogram->second) num_parsed_files += it.second;
+
+    if (json == nullptr) {
+      std::cout << std::endl << "Bytes needed to extract " << mask.name
+                << " for " << num_parsed_files << " files:";
+      for (size_t i = 0; i < std::size(kPercentiles); ++i) {
+        std::cout << " " << kPercentileNames[i] << " "
+                  << GetPercentile(histogram->second, num_parsed_files,
+                                   kPercentiles[i]);
+      }
+      std::cout << " max " << histogram->second.rbegin()->first << std::endl;
+      continue;
+    }
+    *json << mask_separator << "\n    \"" << mask.name << "\": {"
+          << "\n      \"num_files\": " << num_parsed_files;
+    for (size_t i = 0; i < std::size(kPercentiles); ++i) {
+      *json << ",\n      \"" << kPercentileNames[i] << "\": "
+            << GetPercentile(histogram->second, num_parsed_files,
+                             kPercentiles[i]);
+    }
+    *json << ",\n      \"max\": " << histogram->second.rbegin()->first
+          << ",\n      \"histogram\": [";
+    const char* separator = "";
+    for (const auto& it : histogram->second) {
+      *json << separator << "[" << it.first << ", " << it.second << "]";
+      separator = ", ";
+    }
+    *json << "]\n    }";
+    mask_separator = ",";
   }
+  if (json != nullptr) *json << "\n  }\n}\n";
 }
 
 // Checks the consistency of libavifinfo over an AVIF file.
 // Returns false in case of error.
 bool ValidateFile(const std::string& path, const uint8_t* data,
-                  size_t data_size) {
+                  size_t data_size, std::ostream& log) {
   if (LLVMFuzzerTestOneInput(data, data_size) != 0) {
-    std::cout << "validation failed for " << path << std::endl;
+    log << "validation failed for " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Asynchronous prefix reads, fed to AvifInfoParser as they complete.
+
+#if defined(AVIFINFO_TOOL_POSIX)
+
+// Thread-safe list of file paths, filled while the directories are walked.
+class PathQueue {
+ public:
+  void Push(std::string path) {
+    {
+      const std::lock_guard<std::mutex> lock(mutex_);
+      paths_.push_back(std::move(path));
+    }
+    condition_.notify_one();
+  }
+  // No more path will be pushed.
+  void Close() {
+    {
+      const std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    condition_.notify_one();
+  }
+  // Returns false if there is no more path, or if there is none right now and
+  // 'wait' is false.
+  bool Pop(bool wait, std::string& path) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (wait) condition_.wait(lock, [&] { return closed_ || !paths_.empty(); });
+    if (paths_.empty()) return false;
+    path = std::move(paths_.front());
+    paths_.pop_front();
+    return true;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::deque<std::string> paths_;
+  bool closed_ = false;
+};
+
+// Read of a range of a file whose bytes are then fed to its 'parser'.
+struct AsyncFile {
+  std::string path;
+  int fd = -1;
+  AvifInfoParser* parser = nullptr;
+  uint64_t offset = 0;          // Position of the 'buffer' in the file.
+  std::vector<uint8_t> buffer;  // Bytes to read.
+  int64_t result = 0;           // Number of read bytes, or negative on error.
+};
+
+// Runs several reads at once.
+class AsyncReader {
+ public:
+  virtual ~AsyncReader() = default;
+  // Starts reading 'file->buffer.size()' bytes at 'file->offset'.
+  virtual void Submit(AsyncFile* file) = 0;
+  // Waits for any submitted read to complete and returns it.
+  virtual AsyncFile* WaitForCompletion() = 0;
+};
+
+// Blocking reads spread over a pool of threads.
+class ThreadPoolReader : public AsyncReader {
+ public:
+  explicit ThreadPoolReader(uint32_t num_threads) {
+    for (uint32_t i = 0; i < num_threads; ++i) {
+      threads_.emplace_back([this] { Run(); });
+    }
+  }
+  ~ThreadPoolReader() override {
+    {
+      const std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+    }
+    submitted_condition_.notify_all();
+    for (std::thread& thread : threads_) thread.join();
+  }
+  void Submit(AsyncFile* file) override {
+    {
+      const std::lock_guard<std::mutex> lock(mutex_);
+      submitted_.push_back(file);
+    }
+    submitted_condition_.notify_one();
+  }
+  AsyncFile* WaitForCompletion() override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    completed_condition_.wait(lock, [&] { return !completed_.empty(); });
+    AsyncFile* const file = completed_.front();
+    completed_.pop_front();
+    return file;
+  }
+
+ private:
+  void Run() {
+    while (true) {
+      AsyncFile* file;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        submitted_condition_.wait(lock,
+                                  [&] { return done_ || !submitted_.empty(); });
+        if (submitted_.empty()) return;
+        file = submitted_.front();
+        submitted_.pop_front();
+      }
+      file->result = pread(file->fd, file->buffer.data(), file->buffer.size(),
+                           static_cast<off_t>(file->offset));
+      {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        completed_.push_back(file);
+      }
+      completed_condition_.notify_one();
+    }
+  }
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable submitted_condition_, completed_condition_;
+  std::deque<AsyncFile*> submitted_, completed_;
+  bool done_ = false;
+};
+
+#if defined(AVIFINFO_TOOL_IO_URING)
+// Reads submitted to the kernel through an io_uring instance. There is no
+// dependency on liburing, the raw system calls are used instead.
+class IoUringReader : public AsyncReader {
+ public:
+  // Returns null if io_uring or IORING_OP_READ is not supported.
+  static std::unique_ptr<AsyncReader> Create(uint32_t num_entries) {
+    std::unique_ptr<IoUringReader> reader(new IoUringReader());
+    return reader->Init(num_entries) ? std::move(reader) : nullptr;
+  }
+  ~IoUringReader() override {
+    if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_size_);
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED) munmap(sq_ring_, sq_ring_size_);
+    if (ring_fd_ >= 0) close(ring_fd_);
+  }
+  // At most 'num_entries' reads can be pending at once.
+  void Submit(AsyncFile* file) override {
+    const uint32_t tail = *sq_tail_;  // Only written by this thread.
+    const uint32_t index = tail & sq_mask_;
+    io_uring_sqe* const sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = file->fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(file->buffer.data());
+    sqe->len = static_cast<uint32_t>(file->buffer.size());
+    sqe->off = file->offset;
+    sqe->user_data = reinterpret_cast<uintptr_t>(file);
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    if (syscall(__NR_io_uring_enter, ring_fd_, 1, 0, 0, nullptr, 0) != 1) {
+      // The read is not pending, report it as failed right away.
+      failed_.push_back(file);
+      file->result = -1;
+    }
+  }
+  AsyncFile* WaitForCompletion() override {
+    if (!failed_.empty()) {
+      AsyncFile* const file = failed_.back();
+      failed_.pop_back();
+      return file;
+    }
+    while (true) {
+      const uint32_t head = *cq_head_;  // Only written by this thread.
+      if (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+        AsyncFile* const file = reinterpret_cast<AsyncFile*>(cqe.user_data);
+        file->result = cqe.res;
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        return file;
+      }
+      syscall(__NR_io_uring_enter, ring_fd_, 0, 1, IORING_ENTER_GETEVENTS,
+              nullptr, 0);
+    }
+  }
+
+ private:
+  IoUringReader() = default;
+
+  bool Init(uint32_t num_entries) {
+    io_uring_params params = {};
+    ring_fd_ =
+        static_cast<int>(syscall(__NR_io_uring_setup, num_entries, &params));
+    // IORING_OP_READ came with IORING_FEAT_RW_CUR_POS in Linux 5.6.
+    if (ring_fd_ < 0 || !(params.features & IORING_FEAT_RW_CUR_POS)) {
+      return false;
+    }
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) return false;
+    cq_ring_ = (params.features & IORING_FEAT_SINGLE_MMAP)
+                   ? sq_ring_
+                   : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring_fd_,
+                          IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) return false;
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* const sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring_fd_,
+                            IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) return false;
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    uint8_t* const sq = static_cast<uint8_t*>(sq_ring_);
+    sq_tail_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+    uint8_t* const cq = static_cast<uint8_t*>(cq_ring_);
+    cq_head_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  int ring_fd_ = -1;
+  void* sq_ring_ = MAP_FAILED;
+  void* cq_ring_ = MAP_FAILED;
+  io_uring_sqe* sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+  size_t sq_ring_size_ = 0, cq_ring_size_ = 0, sqes_size_ = 0;
+  uint32_t* sq_tail_ = nullptr;
+  uint32_t sq_mask_ = 0;
+  uint32_t* sq_array_ = nullptr;
+  uint32_t* cq_head_ = nullptr;
+  uint32_t* cq_tail_ = nullptr;
+  uint32_t cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+  std::vector<AsyncFile*> failed_;
+};
+#endif  // AVIFINFO_TOOL_IO_URING
+
+// Same as ParseFile() for all files found at the 'input_paths', but with up to
+// 'max_num_reads' prefix reads in flight. The directories are walked while
+// the files are read and parsed. Returns false in case of reading failure.
+bool ParseFilesAsync(const std::vector<std::string>& input_paths,
+                     uint32_t max_num_reads, Stats& stats) {
+  PathQueue path_queue;
+  std::thread walker([&] {
+    for (const std::string& input_path : input_paths) {
+      FindFiles(input_path,
+                [&](const std::string& path) { path_queue.Push(path); });
+    }
+    path_queue.Close();
+  });
+
+  std::unique_ptr<AsyncReader> reader;
+#if defined(AVIFINFO_TOOL_IO_URING)
+  reader = IoUringReader::Create(max_num_reads);
+#endif
+  if (reader == nullptr) reader.reset(new ThreadPoolReader(max_num_reads));
+
+  bool success = true;
+  size_t num_files = 0;
+  uint32_t num_reads = 0;
+  std::string path;
+  while (true) {
+    // Start reading new files if possible, or wait for one if idle.
+    while (num_reads < max_num_reads &&
+           path_queue.Pop(/*wait=*/num_reads == 0, path)) {
+      ++num_files;
+      AsyncFile* const file = new AsyncFile();
+      file->path = path;
+      file->fd = open(path.c_str(), O_RDONLY);
+      file->parser = AvifInfoParserCreate();
+      if (file->fd < 0 || file->parser == nullptr) {
+        std::cout << "reading failure for " << path << std::endl;
+        success = false;
+        if (file->fd >= 0) close(file->fd);
+        AvifInfoParserDestroy(file->parser);
+        delete file;
+        continue;
+      }
+      // Most headers fit in the first kilobyte.
+      file->buffer.resize(1024);
+      reader->Submit(file);
+      ++num_reads;
+    }
+    if (num_reads == 0) break;  // All files were processed.
+
+    AsyncFile* const file = reader->WaitForCompletion();
+    --num_reads;
+    if (file->result < 0) {
+      std::cout << "reading failure for " << file->path << std::endl;
+      success = false;
+    } else {
+      AvifInfoParserFeedAt(file->parser, file->offset, file->buffer.data(),
+                           static_cast<size_t>(file->result));
+      uint64_t offset, size;
+      if (file->result > 0 &&
+          AvifInfoParserGetNextRange(file->parser, &offset, &size) ==
+              kAvifInfoNotEnoughData) {
+        // Read at least a kilobyte, at most a megabyte at once.
+        file->offset = offset;
+        file->buffer.resize(std::clamp<uint64_t>(size, 1024, 1 << 20));
+        reader->Submit(file);
+        ++num_reads;
+        continue;
+      }
+      if (AvifInfoParserGetFeatures(file->parser, nullptr) != kAvifInfoOk) {
+        ++stats.num_files_invalid_at_parse;
+        std::cout << "parsing failure for " << file->path << std::endl;
+      }
+    }
+    close(file->fd);
+    AvifInfoParserDestroy(file->parser);
+    delete file;
+  }
+  walker.join();
+  std::cout << "Found " << num_files << " files" << std::endl;
+  return success;
+}
+
+#endif  // AVIFINFO_TOOL_POSIX
+
+//------------------------------------------------------------------------------
+// Persistent index of the features of files, in a memory-mappable file.
+
+#if defined(AVIFINFO_TOOL_POSIX)
+
+constexpr char kIndexMagic[8] = {'A', 'V', 'I', 'F', 'I', 'D', 'X', '1'};
+
+struct IndexHeader {
+  char magic[8];  // kIndexMagic
+  uint64_t num_entries;
+  uint64_t paths_offset;  // Position of the concatenated paths in the file.
+};
+
+// Fixed-size record of a file, right after the IndexHeader. The records are
+// sorted by path.
+struct IndexEntry {
+  uint64_t path_offset;  // Relative to IndexHeader::paths_offset.
+  uint64_t path_size;
+  // The file is parsed again if any of these changed.
+  uint64_t file_size;
+  int64_t mtime;
+  uint64_t inode;
+  // Results of libavifinfo with the default options.
+  uint64_t min_size;  // See ParseAvifForSize(). 0 unless kAvifInfoOk.
+  uint64_t primary_item_id_location;
+  uint32_t status;  // AvifInfoStatus
+  uint32_t width, height, bit_depth, num_channels;
+  uint32_t has_gainmap, gainmap_item_id, primary_item_id_bytes;
+};
+static_assert(sizeof(IndexEntry) == 88, "IndexEntry is stored as is");
+
+// Read-only view of an index file.
+class MappedIndex {
+ public:
+  MappedIndex() = default;
+  MappedIndex(const MappedIndex&) = delete;
+  MappedIndex& operator=(const MappedIndex&) = delete;
+  ~MappedIndex() {
+    if (data_ != MAP_FAILED) munmap(data_, size_);
+  }
+
+  // Maps the index at 'path'. Returns false if it cannot be read or if it is
+  // malformed.
+  bool Open(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 &&
+        static_cast<uint64_t>(st.st_size) >= sizeof(IndexHeader)) {
+      size_ = static_cast<size_t>(st.st_size);
+      data_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (data_ == MAP_FAILED) return false;
+    const IndexHeader& header = *static_cast<const IndexHeader*>(data_);
+    const uint64_t max_num_entries =
+        (size_ - sizeof(IndexHeader)) / sizeof(IndexEntry);
+    if (std::memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) != 0 ||
+        header.num_entries > max_num_entries ||
+        header.paths_offset < sizeof(IndexHeader) +
+                                  header.num_entries * sizeof(IndexEntry) ||
+        header.paths_offset > size_) {
+      return false;
+    }
+    entries_ = reinterpret_cast<const IndexEntry*>(
+        static_cast<const uint8_t*>(data_) + sizeof(IndexHeader));
+    paths_ = static_cast<const char*>(data_) + header.paths_offset;
+    const uint64_t paths_size = size_ - header.paths_offset;
+    for (uint64_t i = 0; i < header.num_entries; ++i) {
+      if (entries_[i].path_offset > paths_size ||
+          entries_[i].path_size > paths_size - entries_[i].path_offset) {
+        return false;
+      }
+    }
+    num_entries_ = header.num_entries;
+    return true;
+  }
+
+  size_t num_entries() const { return num_entries_; }
+  const IndexEntry& entry(size_t i) const { return entries_[i]; }
+  std::string_view path(size_t i) const {
+    return {paths_ + entries_[i].path_offset, entries_[i].path_size};
+  }
+
+  // Returns the entry of the file at 'path', or null.
+  const IndexEntry* Find(std::string_view file_path) const {
+    size_t begin = 0, end = num_entries_;
+    while (begin < end) {
+      const size_t middle = begin + (end - begin) / 2;
+      const int comparison = path(middle).compare(file_path);
+      if (comparison == 0) return &entries_[middle];
+      if (comparison < 0) {
+        begin = middle + 1;
+      } else {
+        end = middle;
+      }
+    }
+    return nullptr;
+  }
+
+ private:
+  void* data_ = MAP_FAILED;
+  size_t size_ = 0;
+  const IndexEntry* entries_ = nullptr;
+  const char* paths_ = nullptr;
+  size_t num_entries_ = 0;
+};
+
+// Fills the 'entry' of the file at 'path' with its current size, modification
+// time and inode. Returns false in case of error.
+bool StatFile(const std::string& path, IndexEntry& entry) {
+  struct stat st;
+  std::error_code error;
+  const auto mtime = std::filesystem::last_write_time(path, error);
+  if (error || stat(path.c_str(), &st) != 0) return false;
+  entry.file_size = static_cast<uint64_t>(st.st_size);
+  entry.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+  entry.inode = static_cast<uint64_t>(st.st_ino);
+  return true;
+}
+
+// Parses the file at 'path' into the 'entry'. Returns false in case of error.
+bool IndexFile(const std::string& path, std::vector<uint8_t>& bytes,
+               IndexEntry& entry) {
+  const AvifInfoOptions options = {};
+  if (!ReadFilePrefix(path, options, bytes)) return false;
+  size_t min_size;
+  const Result parse =
+      ParseAvifForSize(bytes.data(), bytes.size(), options, min_size);
+  if (parse.success) {
+    entry.status = kAvifInfoOk;
+    entry.min_size = min_size;
+    entry.width = parse.features.width;
+    entry.height = parse.features.height;
+    entry.bit_depth = parse.features.bit_depth;
+    entry.num_channels = parse.features.num_channels;
+    entry.has_gainmap = parse.features.has_gainmap;
+    entry.gainmap_item_id = parse.features.gainmap_item_id;
+    entry.primary_item_id_location = parse.features.primary_item_id_location;
+    entry.primary_item_id_bytes = parse.features.primary_item_id_bytes;
+  } else {
+    entry.status = AvifInfoIdentify(bytes.data(), bytes.size());
+    if (entry.status == kAvifInfoOk) {
+      entry.status = AvifInfoGetFeatures(bytes.data(), bytes.size(), nullptr);
+    }
+  }
+  return true;
+}
+
+// Updates the index at 'index_path' with the files found at 'input_paths'.
+// Only the new or changed files are parsed, with 'num_jobs' threads. The
+// files that are not found anymore are removed from the index.
+bool UpdateIndex(const std::string& index_path,
+                 const std::vector<std::string>& input_paths,
+                 uint32_t num_jobs) {
+  MappedIndex old_index;
+  if (std::filesystem::exists(index_path) && !old_index.Open(index_path)) {
+    std::cerr << "Could not read the index " << index_path << std::endl;
     return false;
   }
+  std::vector<std::string> paths;
+  for (const std::string& input_path : input_paths) {
+    FindFiles(input_path,
+              [&](const std::string& path) { paths.emplace_back(path); });
+  }
+  std::sort(paths.begin(), paths.end());
+  paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+
+  std::vector<IndexEntry> entries(paths.size());
+  std::vector<char> is_valid(paths.size(), true);
+  std::atomic<size_t> next_file_index(0);
+  std::atomic<size_t> num_parsed_files(0);
+  auto job = [&]() {
+    std::vector<uint8_t> bytes;
+    for (size_t i = next_file_index++; i < paths.size();
+         i = next_file_index++) {
+      IndexEntry& entry = entries[i];
+      std::memset(&entry, 0, sizeof(entry));
+      if (!StatFile(paths[i], entry)) {
+        is_valid[i] = false;
+        continue;
+      }
+      const IndexEntry* const old_entry = old_index.Find(paths[i]);
+      if (old_entry != nullptr && old_entry->file_size == entry.file_size &&
+          old_entry->mtime == entry.mtime && old_entry->inode == entry.inode) {
+        entry = *old_entry;
+        continue;
+      }
+      is_valid[i] = IndexFile(paths[i], bytes, entry);
+      ++num_parsed_files;
+    }
+  };
+  std::vector<std::thread> threads;
+  for (uint32_t job_index = 1; job_index < num_jobs; ++job_index) {
+    threads.emplace_back(job);
+  }
+  job();
+  for (std::thread& thread : threads) thread.join();
+
+  // Write to a temporary file first so that the index is replaced atomically.
+  const std::string tmp_path = index_path + ".tmp";
+  std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+  IndexHeader header = {};
+  std::memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+  header.num_entries = std::count(is_valid.begin(), is_valid.end(), true);
+  header.paths_offset =
+      sizeof(IndexHeader) + header.num_entries * sizeof(IndexEntry);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  uint64_t path_offset = 0;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (!is_valid[i]) {
+      std::cout << "reading failure for " << paths[i] << std::endl;
+      continue;
+    }
+    entries[i].path_offset = path_offset;
+    entries[i].path_size = paths[i].size();
+    path_offset += paths[i].size();
+    file.write(reinterpret_cast<const char*>(&entries[i]), sizeof(entries[i]));
+  }
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (is_valid[i]) file.write(paths[i].data(), paths[i].size());
+  }
+  file.close();
+  std::error_code error;
+  if (!file || (std::filesystem::rename(tmp_path, index_path, error), error)) {
+    std::cerr << "Could not write the index " << index_path << std::endl;
+    return false;
+  }
+  std::cout << "Indexed " << header.num_entries << " files, parsed "
+            << num_parsed_files << " of them" << std::endl;
+  return true;
+}
+
+// Returns the value of the field named 'name' of the 'entry', or false if
+// there is no such field.
+bool GetIndexField(const IndexEntry& entry, std::string_view name,
+                   uint64_t& value) {
+  const std::pair<const char*, uint64_t> fields[] = {
+      {"status", entry.status},
+      {"width", entry.width},
+      {"height", entry.height},
+      {"bit_depth", entry.bit_depth},
+      {"num_channels", entry.num_channels},
+      {"has_gainmap", entry.has_gainmap},
+      {"min_size", entry.min_size},
+      {"file_size", entry.file_size}};
+  for (const auto& field : fields) {
+    if (name == field.first) {
+      value = field.second;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Condition on an IndexEntry field, such as "bit_depth=10" or "width>=1000".
+struct IndexCondition {
+  std::string field;
+  std::string op;  // "=", "!=", "<", "<=", ">" or ">="
+  uint64_t value;
+};
+
+// Parses the comma-separated 'conditions'. Returns false if malformed.
+bool ParseIndexConditions(const std::string& conditions,
+                          std::vector<IndexCondition>& parsed) {
+  std::istringstream stream(conditions);
+  std::string condition;
+  while (std::getline(stream, condition, ',')) {
+    const size_t op_begin = condition.find_first_of("=!<>");
+    if (op_begin == std::string::npos) return false;
+    const size_t op_end = condition.find_first_not_of("=!<>", op_begin);
+    if (op_end == std::string::npos) return false;
+    IndexCondition c;
+    c.field = condition.substr(0, op_begin);
+    c.op = condition.substr(op_begin, op_end - op_begin);
+    char* end;
+    c.value = std::strtoull(condition.c_str() + op_end, &end, 10);
+    uint64_t unused;
+    if (*end != '\0' || !GetIndexField(IndexEntry(), c.field, unused) ||
+        (c.op != "=" && c.op != "!=" && c.op != "<" && c.op != "<=" &&
+         c.op != ">" && c.op != ">=")) {
+      return false;
+    }
+    parsed.push_back(c);
+  }
+  return true;
+}
+
+// Prints the paths of the files in the index at 'index_path' matching all
+// 'conditions', without accessing the files themselves.
+bool QueryIndex(const std::string& index_path, const std::string& conditions) {
+  std::vector<IndexCondition> parsed;
+  if (!ParseIndexConditions(conditions, parsed)) {
+    std::cerr << "Invalid query " << conditions << std::endl;
+    return false;
+  }
+  MappedIndex index;
+  if (!index.Open(index_path)) {
+    std::cerr << "Could not read the index " << index_path << std::endl;
+    return false;
+  }
+  size_t num_matches = 0;
+  for (size_t i = 0; i < index.num_entries(); ++i) {
+    bool match = true;
+    for (const IndexCondition& c : parsed) {
+      uint64_t value;
+      GetIndexField(index.entry(i), c.field, value);
+      match = (c.op == "=")    ? value == c.value
+              : (c.op == "!=") ? value != c.value
+              : (c.op == "<")  ? value < c.value
+              : (c.op == "<=") ? value <= c.value
+              : (c.op == ">")  ? value > c.value
+                               : value >= c.value;
+      if (!match) break;
+    }
+    if (match) {
+      std::cout << index.path(i) << std::endl;
+      ++num_matches;
+    }
+  }
+  std::cout << num_matches << " of " << index.num_entries()
+            << " files match" << std::endl;
   return true;
 }
 
+#endif  // AVIFINFO_TOOL_POSIX
+
 }  // namespace
 
 //------------------------------------------------------------------------------
 
 int main(int argc, char** argv) {
-  std::vector<std::string> file_paths;
+  std::vector<std::string> input_paths;
   bool only_parse = false;
   bool find_min_size = false;
   bool validate = false;
   bool error_on_bad_file = false;
+  uint32_t num_jobs = 1;
+  uint32_t shard_index = 0, num_shards = 1;
+  uint32_t num_async_reads = 0;
+  std::string json_path;
+  std::string report_path;
+  std::string index_path;
+  std::string query;
+  AvifInfoOptions options = {};
 
   for (int arg = 1; arg < argc; ++arg) {
     if (!std::strcmp(argv[arg], "-h")) {
@@ -227,41 +1223,191 @@ int main(int argc, char** argv) {
     } else if (!std::strcmp(argv[arg], "--min-size")) {
       find_min_size = true;
       only_parse = true;
+    } else if (!std::strcmp(argv[arg], "--dims-only")) {
+      options.requested_fields = kAvifInfoFieldDimensions;
+      only_parse = true;
     } else if (!std::strcmp(argv[arg], "--validate")) {
       validate = true;
     } else if (!std::strcmp(argv[arg], "--no-bad-file")) {
       error_on_bad_file = true;
+    } else if (!std::strcmp(argv[arg], "--json") && arg + 1 < argc) {
+      json_path = argv[++arg];
+    } else if (!std::strcmp(argv[arg], "--jobs") && arg + 1 < argc) {
+      num_jobs = static_cast<uint32_t>(std::strtoul(argv[++arg], nullptr, 10));
+      if (num_jobs == 0) {
+        std::cerr << "Invalid number of jobs " << argv[arg] << std::endl;
+        return 1;
+      }
+    } else if (!std::strcmp(argv[arg], "--shard") && arg + 1 < argc) {
+      char* end;
+      shard_index = static_cast<uint32_t>(std::strtoul(argv[++arg], &end, 10));
+      num_shards = (*end == '/' && end != argv[arg])
+                       ? static_cast<uint32_t>(std::strtoul(end + 1, &end, 10))
+                       : 0;
+      if (*end != '\0' || shard_index >= num_shards) {
+        std::cerr << "Invalid shard " << argv[arg] << std::endl;
+        return 1;
+      }
+    } else if (!std::strcmp(argv[arg], "--report") && arg + 1 < argc) {
+      report_path = argv[++arg];
+#if defined(AVIFINFO_TOOL_POSIX)
+    } else if (!std::strcmp(argv[arg], "--async") && arg + 1 < argc) {
+      num_async_reads =
+          static_cast<uint32_t>(std::strtoul(argv[++arg], nullptr, 10));
+      if (num_async_reads == 0 || num_async_reads > 4096) {
+        std::cerr << "Invalid number of reads " << argv[arg] << std::endl;
+        return 1;
+      }
+      only_parse = true;
+    } else if (!std::strcmp(argv[arg], "--index") && arg + 1 < argc) {
+      index_path = argv[++arg];
+    } else if (!std::strcmp(argv[arg], "--query") && arg + 1 < argc) {
+      query = argv[++arg];
+#endif
     } else {
-      FindFiles(argv[arg], file_paths);
+      input_paths.emplace_back(argv[arg]);
+    }
+  }
+
+  if ((num_shards != 1 || !report_path.empty()) &&
+      (find_min_size || num_async_reads != 0 || !index_path.empty())) {
+    std::cerr << "--shard and --report are incompatible with --min-size, "
+                 "--async and --index"
+              << std::endl;
+    return 1;
+  }
+
+#if defined(AVIFINFO_TOOL_POSIX)
+  if (!index_path.empty()) {
+    // The inputs are only needed to update the index.
+    if (!input_paths.empty() &&
+        !UpdateIndex(index_path, input_paths, num_jobs)) {
+      return 1;
     }
+    if (!query.empty() && !QueryIndex(index_path, query)) return 1;
+    return 0;
+  }
+  if (!query.empty()) {
+    std::cerr << "--query requires --index" << std::endl;
+    return 1;
+  }
+#endif
+  if (input_paths.empty()) {
+    std::cerr << "No input specified" << std::endl;
+    return 1;
+  }
+
+#if defined(AVIFINFO_TOOL_POSIX)
+  if (num_async_reads != 0) {
+    // AvifInfoParser does not take any AvifInfoOptions.
+    if (find_min_size || validate || options.requested_fields != 0 ||
+        num_jobs != 1) {
+      std::cerr << "--async is incompatible with other options" << std::endl;
+      return 1;
+    }
+    Stats stats;
+    bool success = ParseFilesAsync(input_paths, num_async_reads, stats);
+    std::cout << stats.num_files_invalid_at_parse << " files failed to parse"
+              << std::endl;
+    if (error_on_bad_file && stats.num_files_invalid_at_parse > 0) {
+      success = false;
+    }
+    return success ? 0 : 1;
+  }
+#endif
+
+  std::vector<std::string> file_paths;
+  for (const std::string& input_path : input_paths) {
+    FindFiles(input_path, [&](const std::string& path) {
+      if (IsInShard(path, shard_index, num_shards)) {
+        file_paths.emplace_back(path);
+      }
+    });
   }
   if (file_paths.empty()) {
     std::cerr << "No input specified" << std::endl;
     return 1;
   }
+  std::ofstream report;
+  if (!report_path.empty()) {
+    report.open(report_path);
+    if (!report) {
+      std::cerr << "Could not open " << report_path << std::endl;
+      return 1;
+    }
+  }
   std::cout << "Found " << file_paths.size() << " files" << std::endl;
   const std::string prefix = FindCommonLongestPrefix(file_paths);
   for (std::string& file_path : file_paths) {
     file_path = file_path.substr(prefix.size());
   }
 
+  // Each job takes the next unprocessed file until there is none. The output
+  // of each file is printed at once.
+  std::atomic<size_t> next_file_index(0);
+  std::mutex output_mutex;
+  std::vector<Stats> job_stats(num_jobs);
+  std::vector<char> job_success(num_jobs, true);
+  auto job = [&](uint32_t job_index) {
+    Stats& stats = job_stats[job_index];
+    std::vector<uint8_t> bytes;
+    std::ostringstream log, report_lines;
+    for (size_t i = next_file_index++; i < file_paths.size();
+         i = next_file_index++) {
+      const std::string& file_path = file_paths[i];
+      FileReport file_report;
+      FileReport* const file_report_ptr =
+          report.is_open() ? &file_report : nullptr;
+      // Only libavifinfo is used without decoding or validation, so there is
+      // no need to read the whole file.
+      const bool read = (only_parse && !validate)
+                            ? ReadFilePrefix(prefix + file_path, options, bytes)
+                            : ReadFile(prefix + file_path, bytes);
+      if (!read) {
+        log << "reading failure for " << file_path << std::endl;
+        job_success[job_index] = false;
+      } else if (find_min_size) {
+        FindMinSizeOfFile(file_path, bytes.data(), bytes.size(), options,
+                          stats);
+      } else if (only_parse) {
+        ParseFile(file_path, bytes.data(), bytes.size(), options, stats, log,
+                  file_report_ptr);
+      } else if (!DecodeAndParseFile(file_path, bytes.data(), bytes.size(),
+                                     stats, log, file_report_ptr)) {
+        job_success[job_index] = false;
+      }
+      if (read && validate &&
+          !ValidateFile(file_path, bytes.data(), bytes.size(), log)) {
+        job_success[job_index] = false;
+      }
+      if (file_report_ptr != nullptr) {
+        // The paths are not relative to the 'prefix', which depends on the
+        // shard.
+        file_report.read = read;
+        WriteJsonLine(prefix + file_path, bytes.size(), file_report,
+                      report_lines);
+      }
+      if (log.tellp() > 0 || report_lines.tellp() > 0) {
+        const std::lock_guard<std::mutex> lock(output_mutex);
+        std::cout << log.str();
+        log.str("");
+        report << report_lines.str();
+        report_lines.str("");
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (uint32_t job_index = 1; job_index < num_jobs; ++job_index) {
+    threads.emplace_back(job, job_index);
+  }
+  job(0);
+  for (std::thread& thread : threads) thread.join();
+
   Stats stats;
   bool success = true;
-  for (const std::string& file_path : file_paths) {
-    std::vector<uint8_t> bytes(std::filesystem::file_size(prefix + file_path));
-    std::ifstream file(prefix + file_path, std::ios::binary);
-    file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
-    if (find_min_size) {
-      FindMinSizeOfFile(file_path, bytes.data(), bytes.size(), stats);
-    } else if (only_parse) {
-      ParseFile(file_path, bytes.data(), bytes.size(), stats);
-    } else if (!DecodeAndParseFile(file_path, bytes.data(), bytes.size(),
-                                   stats)) {
-      success = false;
-    }
-    if (validate && !ValidateFile(file_path, bytes.data(), bytes.size())) {
-      success = false;
-    }
+  for (uint32_t job_index = 0; job_index < num_jobs; ++job_index) {
+    MergeStats(job_stats[job_index], stats);
+    if (!job_success[job_index]) success = false;
   }
 
   std::cout << stats.num_files_invalid_at_parse << " files failed to parse"
@@ -273,11 +1419,23 @@ int main(int argc, char** argv) {
               << " files failed to parse and decode" << std::endl;
   }
 
+  if (report.is_open()) {
+    report.close();
+    if (!report) {
+      std::cerr << "Could not write " << report_path << std::endl;
+      success = false;
+    }
+  }
+
   if (find_min_size) {
-    std::cout << std::endl;
-    for (const auto& it : stats.min_size_to_count) {
-      std::cout << it.second << " files need " << it.first
-                << " bytes to extract features" << std::endl;
+    PrintMinSizes(stats, file_paths.size(), /*json=*/nullptr);
+    if (!json_path.empty()) {
+      std::ofstream json(json_path);
+      PrintMinSizes(stats, file_paths.size(), &json);
+      if (!json) {
+        std::cerr << "Could not write " << json_path << std::endl;
+        success = false;
+      }
     }
   }
 